@@ -401,6 +401,13 @@ public:
   /// DiagMapping on the stack.
   bool popMappings(SourceLocation Loc);
 
+  /// \brief Whether the mappings in effect at \p Loc are the ones set up from
+  /// the command line, unchanged by any diagnostic pragma.
+  bool hasCommandLineMappings(SourceLocation Loc) const {
+    return GetDiagStatePointForLoc(Loc)->State ==
+           DiagStatePoints.front().State;
+  }
+
   /// \brief Set the diagnostic client associated with this diagnostic object.
   ///
   /// \param ShouldOwnClient true if the diagnostic object should take
@@ -42,6 +42,7 @@ class MemoryBuffer;
 namespace clang {
 class FileManager;
 class FileSystemStatCache;
+class SharedStatCache;
 
 /// \brief Cached information about one directory (either on disk or in
 /// the virtual file system).
@@ -171,6 +172,11 @@ class FileManager : public RefCountedBase<FileManager> {
   // Caching.
   std::unique_ptr<FileSystemStatCache> StatCache;
 
+  /// \brief The shared stat cache installed by \c setSharedStatCacheFile,
+  /// if any.
+  IntrusiveRefCntPtr<SharedStatCache> SharedStats;
+  std::string SharedStatsFile;
+
   bool getStatValue(const char *Path, FileData &Data, bool isFile,
                     std::unique_ptr<vfs::File> *F);
 
@@ -202,6 +208,20 @@ public:
   /// \brief Removes all FileSystemStatCache objects from the manager.
   void clearStatCaches();
 
+  /// \brief Share the results of stat() calls with every other FileManager
+  /// of this process using the \c SharedStatCache persisted in \p Path.
+  ///
+  /// This is done automatically for \c FileSystemOptions::StatCacheFile.
+  void setSharedStatCacheFile(StringRef Path);
+
+  /// \brief The shared stat cache installed by \c setSharedStatCacheFile.
+  SharedStatCache *getSharedStatCache() const { return SharedStats.get(); }
+
+  /// \brief Persist the shared stat cache, if any, for later processes.
+  ///
+  /// \returns true on success, or if there is nothing to save.
+  bool saveSharedStatCache(std::string &ErrorStr);
+
   /// \brief Lookup, cache, and verify the specified directory (real or
   /// virtual).
   ///
@@ -224,6 +244,12 @@ public:
   const FileEntry *getFile(StringRef Filename, bool OpenFile = false,
                            bool CacheFailure = true);
 
+  /// \brief Whether \p Filename was looked up already, so that \c getFile
+  /// will not stat it again.
+  bool hasCachedFile(StringRef Filename) const {
+    return SeenFileEntries.count(Filename);
+  }
+
   /// \brief Returns the current file system options
   const FileSystemOptions &getFileSystemOptions() { return FileSystemOpts; }
 
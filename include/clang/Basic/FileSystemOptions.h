@@ -25,6 +25,10 @@ public:
   /// \brief If set, paths are resolved as if the working directory was
   /// set to the value of WorkingDir.
   std::string WorkingDir;
+
+  /// \brief If set, the file holding a \c SharedStatCache to use, and to
+  /// update with the results of this compilation's file system lookups.
+  std::string StatCacheFile;
 };
 
 } // end namespace clang
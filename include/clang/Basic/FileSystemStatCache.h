@@ -16,10 +16,16 @@
 #define LLVM_CLANG_FILESYSTEMSTATCACHE_H
 
 #include "clang/Basic/LLVM.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Mutex.h"
 #include <memory>
 
+namespace llvm {
+class MemoryBuffer;
+}
+
 namespace clang {
 
 namespace vfs {
@@ -124,6 +130,135 @@ public:
                        vfs::FileSystem &FS) override;
 };
 
+/// \brief The results of stat() calls, kept across many compilations.
+///
+/// Results are revalidated at most once per generation; call
+/// \c startGeneration whenever the file system may have changed since the
+/// results were last used (e.g., at the start of every compilation in a
+/// compile server). Revalidating an existing path costs one stat, but a path
+/// known to be missing stays missing as long as its parent directory has not
+/// been modified, which turns the many failed lookups of header search into
+/// a single stat of each search directory.
+///
+/// The cache is thread-safe, so the \c FileManagers of compilations running
+/// in parallel can share it. It can also be persisted with \c writeToFile and
+/// memory-mapped again by a later process with \c readFromFile (or
+/// \c getForFile); results loaded from disk start out unvalidated, so they
+/// are never trusted without checking their parent directory first.
+///
+/// Only absolute paths on the real file system are cached. Install the cache
+/// into a \c FileManager with a \c SharedStatCacheClient.
+class SharedStatCache : public ThreadSafeRefCountedBase<SharedStatCache> {
+public:
+  struct Entry {
+    Entry() : Exists(false), ParentExists(false), ParentModTime(0),
+              Known(false), Generation(0) {}
+
+    /// The stat data, if the path exists.
+    FileData Data;
+    bool Exists;
+
+    /// For missing paths, the state of the parent directory when the path
+    /// was last found missing.
+    bool ParentExists;
+    time_t ParentModTime;
+    llvm::sys::fs::UniqueID ParentID;
+
+    /// Whether this entry holds a result at all.
+    bool Known;
+
+    /// The generation this entry was last validated in.
+    unsigned Generation;
+  };
+
+private:
+  llvm::StringMap<Entry, llvm::BumpPtrAllocator> Entries;
+  unsigned Generation;
+
+  /// \brief The cache file this cache was loaded from, if any.
+  std::unique_ptr<llvm::MemoryBuffer> Buffer;
+
+  /// \brief The on-disk hash table of results in \c Buffer, which are
+  /// imported into \c Entries lazily (an \c OnDiskStatCacheTable).
+  void *OnDiskTable;
+
+  /// \brief Whether results that could be persisted changed since the cache
+  /// was last saved by \c saveIfModified.
+  bool Modified;
+
+  /// \brief Guards everything above. Never held across a system call.
+  mutable llvm::sys::Mutex Lock;
+
+  // Statistics.
+  unsigned NumLookups, NumHits, NumMissesValidatedByParent, NumImported;
+
+  Entry lookupEntry(StringRef Path, std::unique_ptr<vfs::File> *F,
+                    vfs::FileSystem &FS);
+  Entry getEntry(StringRef Path);
+  void storeEntry(StringRef Path, const Entry &E);
+
+  SharedStatCache(const SharedStatCache &) LLVM_DELETED_FUNCTION;
+  void operator=(const SharedStatCache &) LLVM_DELETED_FUNCTION;
+
+public:
+  SharedStatCache();
+  ~SharedStatCache();
+
+  /// \brief Get the process-wide cache persisted in \p Path, loading it
+  /// the first time it is requested.
+  ///
+  /// Every caller asking for the same file gets the same cache, so tools
+  /// running many compilations in one process share their results. The
+  /// cache is saved back to \p Path once, when the process exits.
+  static IntrusiveRefCntPtr<SharedStatCache> getForFile(StringRef Path);
+
+  /// \brief Map the results persisted in \p Path into this cache.
+  ///
+  /// \returns true on success. A missing or out-of-date file is not an
+  /// error worth reporting; the cache simply starts out empty.
+  bool readFromFile(StringRef Path, std::string &ErrorStr);
+
+  /// \brief Persist the results that can be revalidated by a later process
+  /// to \p Path, atomically replacing it.
+  ///
+  /// Results already persisted in \p Path for paths this cache knows
+  /// nothing about are kept.
+  ///
+  /// \returns true on success.
+  bool writeToFile(StringRef Path, std::string &ErrorStr) const;
+
+  /// \brief Like \c writeToFile, but only if results that could be persisted
+  /// changed since the last call.
+  bool saveIfModified(StringRef Path, std::string &ErrorStr);
+
+  /// \brief Begin a new generation; every result is revalidated the first
+  /// time it is used afterwards.
+  void startGeneration();
+
+  /// \brief Look up \p Path, revalidating the cached result if needed.
+  FileSystemStatCache::LookupResult
+  getStat(const char *Path, FileData &Data, bool isFile,
+          std::unique_ptr<vfs::File> *F, vfs::FileSystem &FS);
+
+  /// \brief Drop all cached results, including those loaded from disk.
+  void clear();
+
+  void PrintStats() const;
+};
+
+/// \brief A FileManager stat cache forwarding to a \c SharedStatCache.
+class SharedStatCacheClient : public FileSystemStatCache {
+  IntrusiveRefCntPtr<SharedStatCache> Cache;
+
+public:
+  explicit SharedStatCacheClient(IntrusiveRefCntPtr<SharedStatCache> Cache)
+    : Cache(Cache) {}
+
+  LookupResult getStat(const char *Path, FileData &Data, bool isFile,
+                       std::unique_ptr<vfs::File> *F,
+                       vfs::FileSystem &FS) override;
+};
+
 } // end namespace clang
 
 #endif
@@ -96,10 +96,11 @@ public:
   const char *getNameStart() const {
     if (Entry) return Entry->getKeyData();
     // FIXME: This is gross. It would be best not to embed specific details
-    // of the PTH file format here.
+    // of the PTH and AST file formats here.
     // The 'this' pointer really points to a
     // std::pair<IdentifierInfo, const char*>, where internal pointer
-    // points to the external string data.
+    // points to the external string data (see
+    // IdentifierTable::createExternal).
     typedef std::pair<IdentifierInfo, const char*> actualtype;
     return ((const actualtype*) this)->second;
   }
@@ -109,7 +110,7 @@ public:
   unsigned getLength() const {
     if (Entry) return Entry->getKeyLength();
     // FIXME: This is gross. It would be best not to embed specific details
-    // of the PTH file format here.
+    // of the PTH and AST file formats here.
     // The 'this' pointer really points to a
     // std::pair<IdentifierInfo, const char*>, where internal pointer
     // points to the external string data.
@@ -419,6 +420,11 @@ class IdentifierTable {
   typedef llvm::StringMap<IdentifierInfo*, llvm::BumpPtrAllocator> HashTableTy;
   HashTableTy HashTable;
 
+  /// \brief The slab of the identifiers whose spelling is stored outside of
+  /// the table.
+  llvm::BumpPtrAllocator ExternalAllocator;
+  unsigned NumExternalIdentifiers;
+
   IdentifierInfoLookup* ExternalLookup;
 
 public:
@@ -509,6 +515,26 @@ public:
     return *II;
   }
 
+  /// \brief Returns the identifier with the given name if the table has one,
+  /// without creating it or consulting external sources.
+  IdentifierInfo *findOwn(StringRef Name) const {
+    HashTableTy::const_iterator I = HashTable.find(Name);
+    return I == HashTable.end() ? nullptr : I->getValue();
+  }
+
+  /// \brief Creates an identifier whose spelling is stored outside of the
+  /// table, in an AST file which outlives the identifier.
+  ///
+  /// \p NameStart points to the null-terminated spelling, which is preceded
+  /// by its length plus one as a 16-bit little-endian integer, as in PTH and
+  /// AST files. The identifier is allocated in a slab of its own and is not
+  /// entered in the table, so its spelling is neither copied nor hashed: the
+  /// caller makes sure that no other identifier has this spelling, and
+  /// returns this one from IdentifierInfoLookup::get() when the spelling is
+  /// looked up, which enters it in the table. Until then, iterating over the
+  /// table does not visit it.
+  IdentifierInfo &createExternal(const char *NameStart);
+
   typedef HashTableTy::const_iterator iterator;
   typedef HashTableTy::const_iterator const_iterator;
 
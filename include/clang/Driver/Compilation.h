@@ -158,6 +158,12 @@ public:
                       const JobAction *JA,
                       bool IssueErrors = false) const;
 
+  /// PrintCommand - Print a command for -v or CC_PRINT_OPTIONS, if either is
+  /// enabled.
+  ///
+  /// \return False if the CC_PRINT_OPTIONS file could not be opened.
+  bool PrintCommand(const Command &C) const;
+
   /// ExecuteCommand - Execute an actual command.
   ///
   /// \param FailingCommand - For non-zero results, this will be set to the
@@ -172,6 +178,20 @@ public:
   void ExecuteJob(const Job &J,
      SmallVectorImpl< std::pair<int, const Command *> > &FailingCommands) const;
 
+  /// ExecuteJobsInParallel - Execute a job list, running up to \p MaxJobs
+  /// commands whose inputs are ready concurrently.
+  ///
+  /// Commands depend on the commands producing their input actions and are
+  /// skipped if one of those failed, just like with \c ExecuteJob. The
+  /// standard error of every command is buffered and replayed in job order,
+  /// and failing commands are reported in job order.
+  ///
+  /// \param FailingCommands - For non-zero results, this will be a vector of
+  /// failing commands and their associated result code.
+  void ExecuteJobsInParallel(const JobList &Jobs,
+     SmallVectorImpl< std::pair<int, const Command *> > &FailingCommands,
+     unsigned MaxJobs) const;
+
   /// initCompilationForDiagnostics - Remove stale state and suppress output
   /// so compilation can be reexecuted to generate additional diagnostic
   /// information (e.g., preprocessed source(s)).
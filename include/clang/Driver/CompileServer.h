@@ -0,0 +1,92 @@
+//===--- CompileServer.h - Compile Server Protocol --------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the protocol spoken between the driver and a compile
+// server ("clang -cc1serve <socket>"), a long-running process which runs cc1
+// jobs while keeping file system state warm between them.
+//
+// Every message is a 32-bit little-endian length followed by that many bytes.
+// A request holds the working directory followed by the cc1 arguments (not
+// including the executable and "-cc1"), each terminated by a NUL. The reply
+// holds the decimal exit status of the job, a NUL, and the diagnostics the
+// job printed. An empty reply means the server could not run the job and the
+// client should run it itself. Messages are at most MaxMessageSize bytes.
+//
+// The socket is only accessible to the user who started the server, and the
+// server drops connections from processes of other users.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CLANG_DRIVER_COMPILESERVER_H_
+#define CLANG_DRIVER_COMPILESERVER_H_
+
+#include "clang/Basic/LLVM.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace driver {
+namespace compileserver {
+
+/// \brief The largest message either side sends or accepts.
+const size_t MaxMessageSize = 64 * 1024 * 1024;
+
+/// \brief Write one message to the socket \p FD.
+///
+/// \return True on success; false if the message could not be written or is
+/// larger than MaxMessageSize.
+bool writeMessage(int FD, StringRef Message);
+
+/// \brief Read one message from the socket \p FD.
+///
+/// \return True on success; false if the message could not be read or is
+/// larger than MaxMessageSize.
+bool readMessage(int FD, std::string &Message);
+
+/// \brief Create a socket at \p SocketPath and listen on it.
+///
+/// \return The socket, or -1 (with \p Error set) on failure.
+int listenOn(StringRef SocketPath, std::string &Error);
+
+/// \brief Wait for the next client on the listening socket \p FD, dropping
+/// clients which run as a different user.
+///
+/// \return The connection, or -1 on failure.
+int acceptClient(int FD);
+
+/// \brief Close a socket returned by \c listenOn or \c acceptClient.
+void closeSocket(int FD);
+
+/// \brief Make \c acceptClient on the listening socket \p FD fail, waking up
+/// the thread waiting in it.
+void stopListening(int FD);
+
+/// \brief Split a request into its working directory and cc1 arguments.
+///
+/// \return False if the request is malformed.
+bool parseRequest(StringRef Request, std::string &WorkingDir,
+                  std::vector<std::string> &Args);
+
+/// \brief Run a cc1 job on the server listening on \p SocketPath.
+///
+/// \param Args The cc1 arguments, not including the executable and "-cc1".
+/// \param Result Set to the exit status of the job.
+/// \param Diagnostics Set to the diagnostics printed by the job.
+/// \return False if the server could not be reached or could not run the
+/// job; the caller should run the job itself.
+bool runJob(StringRef SocketPath, ArrayRef<const char *> Args, int &Result,
+            std::string &Diagnostics);
+
+} // end namespace compileserver
+} // end namespace driver
+} // end namespace clang
+
+#endif
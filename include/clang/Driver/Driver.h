@@ -153,6 +153,20 @@ public:
   /// Whether the driver is generating diagnostics for debugging purposes.
   unsigned CCGenDiagnostics : 1;
 
+  /// Run "-cc1" jobs through CC1Main instead of spawning a new process.
+  unsigned CCCIntegratedCC1 : 1;
+
+  /// CC1ToolFunc - Runs a "-cc1" job, given its full argument vector
+  /// (including the executable), and returns its exit status.
+  typedef int (*CC1ToolFunc)(ArrayRef<const char *> Argv);
+
+  /// The "-cc1" entry point of the executable hosting the driver, if it can
+  /// run the frontend itself.
+  CC1ToolFunc CC1Main;
+
+  /// The socket of the compile server to run "-cc1" jobs on, if any.
+  std::string CompileServerSocket;
+
 private:
   /// Name to use when invoking gcc/g++.
   std::string CCCGenericGCCName;
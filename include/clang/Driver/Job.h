@@ -28,6 +28,12 @@ class Tool;
 // Re-export this as clang::driver::ArgStringList.
 using llvm::opt::ArgStringList;
 
+/// \brief Whether the "-cc1" arguments \p Args set LLVM state that is global
+/// to the process, such as the command line options of the backend, which can
+/// only be set once per process. Such a job cannot share a process with other
+/// jobs, in the driver or on a compile server.
+bool cc1JobNeedsOwnProcess(ArrayRef<const char *> Args);
+
 class Job {
 public:
   enum JobClass {
@@ -144,6 +144,8 @@ public:
                                            ///< global module index if needed.
   unsigned ASTDumpLookups : 1;             ///< Whether we include lookup table
                                            ///< dumps in AST dumps.
+  unsigned ParallelASTWrite : 1;           ///< Whether to write PCH and module
+                                           ///< files on several threads.
 
   CodeCompleteOptions CodeCompleteOpts;
 
@@ -247,6 +249,7 @@ public:
     FixToTemporaries(false), ARCMTMigrateEmitARCErrors(false),
     SkipFunctionBodies(false), UseGlobalModuleIndex(true),
     GenerateGlobalModuleIndex(true), ASTDumpLookups(false),
+    ParallelASTWrite(false),
     ARCMTAction(ARCMT_None), ObjCMTAction(ObjCMT_None),
     ProgramAction(frontend::ParseSyntaxOnly)
   {}
@@ -0,0 +1,195 @@
+//===--- ModuleBuildScheduler.h - Parallel Module Builds -------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file defines the ModuleBuildScheduler interface, which builds the
+//  modules an import needs on several threads, and the lock which compilations
+//  hold on a module file in the module cache while they build it.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_FRONTEND_MODULEBUILDSCHEDULER_H
+#define LLVM_CLANG_FRONTEND_MODULEBUILDSCHEDULER_H
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/LLVM.h"
+#include "clang/Basic/SourceLocation.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace clang {
+
+class CompilerInstance;
+class CompilerInvocation;
+class FileManager;
+class HeaderSearch;
+class Module;
+class SourceManager;
+
+namespace vfs {
+class FileSystem;
+}
+
+/// \brief Creates the invocation which builds the module \p ModuleName,
+/// defined in the module map \p ModuleMapFileName, into \p ModuleFileName
+/// with the options of \p ImportingInvocation that affect modules.
+CompilerInvocation *
+createModuleBuildInvocation(const CompilerInvocation &ImportingInvocation,
+                            StringRef ModuleName, StringRef ModuleMapFileName,
+                            StringRef ModuleFileName);
+
+/// \brief An exclusive lock on a module file in the module cache, held by the
+/// compilation which builds the module.
+///
+/// The lock is an advisory lock on a file next to the module file, which the
+/// operating system releases when its owner exits or crashes. A compilation
+/// waiting for the lock blocks in the kernel on a thread of its own, and
+/// gives up after as long as LockFileManager would wait, in case the owner
+/// hangs; the thread then releases the lock once it gets it. Locks
+/// taken by two threads of the same process exclude each other as well. The
+/// lock file is never removed, as removing it would race with the
+/// compilations opening it.
+class ModuleFileLock {
+  int FD;
+  bool Waited;
+
+  ModuleFileLock(const ModuleFileLock &) LLVM_DELETED_FUNCTION;
+  void operator=(const ModuleFileLock &) LLVM_DELETED_FUNCTION;
+
+public:
+  /// \brief Locks the module file \p ModuleFileName, waiting for the
+  /// compilation holding the lock, if any, to release it.
+  explicit ModuleFileLock(StringRef ModuleFileName);
+  ~ModuleFileLock();
+
+  /// \brief Whether the lock is held. It is not if the lock file could not
+  /// be created, if the owner did not release it in time, or if the host has
+  /// no such locks.
+  bool isLocked() const { return FD >= 0; }
+
+  /// \brief Whether another compilation held the lock when it was requested,
+  /// in which case the module file may have been rebuilt meanwhile.
+  bool hadToWait() const { return Waited; }
+
+  /// \brief Returns the name of the lock file of \p ModuleFileName.
+  static std::string getLockFileName(StringRef ModuleFileName);
+};
+
+/// \brief Builds the modules which an import needs on several threads.
+///
+/// When the module an import names has to be built, the scheduler scans the
+/// headers of that module for the \#includes and \#imports of headers of
+/// other modules, and the headers of these, to discover the modules it
+/// depends on. A dependency is rebuilt when its module file is missing, when
+/// one of its input files was modified after it was written, or when one of
+/// its own dependencies is rebuilt. The modules which are rebuilt are then
+/// built as soon as their dependencies are, by a pool of threads, each with
+/// its own file manager. Each build holds the ModuleFileLock of its module
+/// file, so that concurrent compilations wait for each other rather than
+/// build the same module twice.
+///
+/// The module graph discovered this way is an approximation: \#includes in
+/// inactive conditionals add dependencies, and \@imports and headers found
+/// through macros are missed. A missed dependency is built by the module
+/// build which imports it, as it would be without the scheduler. A module
+/// which fails to build in parallel is left for the importing compilation to
+/// build again and diagnose. The warnings of the modules built in parallel
+/// are reported to the diagnostic consumer of the importing compilation once
+/// all of them are built.
+///
+/// The \#includes are resolved by a header search of the scheduler's own,
+/// configured like the importing one, so that the module maps it loads and
+/// the lookups it caches do not affect the importing compilation.
+class ModuleBuildScheduler {
+  struct ModuleNode {
+    /// \brief The module, as known to the scheduler's header search, which
+    /// only the importing thread may use.
+    Module *M;
+    std::string ModuleFileName;
+    /// \brief The modification time of the module file before the build, or
+    /// zero if it was missing.
+    uint64_t ModTime;
+    bool IsSystem;
+    /// \brief The invocation building the module, if it needs building.
+    IntrusiveRefCntPtr<CompilerInvocation> Invocation;
+    /// \brief The modules this one imports, as indices into Nodes.
+    SmallVector<unsigned, 4> Dependencies;
+    /// \brief The modules which import this one.
+    SmallVector<unsigned, 4> Dependents;
+    /// \brief The number of dependencies not built yet.
+    unsigned NumPendingDependencies;
+    bool NeedsBuild;
+    bool Failed;
+    /// \brief The diagnostics of the build, and the source manager and
+    /// engine they refer to, kept until the importing compilation reports
+    /// them.
+    std::vector<StoredDiagnostic> Diagnostics;
+    IntrusiveRefCntPtr<DiagnosticsEngine> Diags;
+    IntrusiveRefCntPtr<FileManager> FileMgr;
+    IntrusiveRefCntPtr<SourceManager> SourceMgr;
+  };
+
+  CompilerInstance &ImportingInstance;
+  IntrusiveRefCntPtr<vfs::FileSystem> FS;
+  /// \brief The header search resolving the \#includes of the headers
+  /// scanned, and what it reports to.
+  IntrusiveRefCntPtr<DiagnosticsEngine> ScanDiags;
+  std::unique_ptr<SourceManager> ScanSourceMgr;
+  std::unique_ptr<HeaderSearch> ScanHeaderInfo;
+  /// \brief The names of the modules the importing compilation is part of the
+  /// build of.
+  std::vector<std::string> BuildStack;
+  std::vector<ModuleNode> Nodes;
+  llvm::DenseMap<const Module *, unsigned> NodeIDs;
+
+  std::mutex Lock;
+  std::condition_variable ReadyChanged;
+  /// \brief The modules whose dependencies are all built.
+  std::vector<unsigned> Ready;
+  unsigned NumUnfinished;
+
+  ModuleBuildScheduler(const ModuleBuildScheduler &) LLVM_DELETED_FUNCTION;
+  void operator=(const ModuleBuildScheduler &) LLVM_DELETED_FUNCTION;
+
+  Module *createHeaderSearch(Module *M);
+  bool canSchedule(Module *M);
+  unsigned getOrCreateNode(Module *M);
+  void findDependencies(unsigned ID);
+  bool sortNodes(std::vector<unsigned> &Order);
+  bool isOutOfDate(const ModuleNode &Node);
+  void runWorker();
+  void buildModule(ModuleNode &Node);
+
+public:
+  explicit ModuleBuildScheduler(CompilerInstance &ImportingInstance);
+  ~ModuleBuildScheduler();
+
+  /// \brief Whether the modules of \p ImportingInstance can be built by a
+  /// scheduler.
+  static bool isSupported(CompilerInstance &ImportingInstance);
+
+  /// \brief Builds \p M, known to be out of date, and the modules it depends
+  /// on which are out of date, with \p NumThreads threads.
+  ///
+  /// Returns the number of modules built. Each module built other than \p M
+  /// is reported with a remark at \p ImportLoc. The caller reads the module
+  /// file of \p M afterwards, and builds it itself if that fails.
+  unsigned buildModules(Module *M, SourceLocation ImportLoc,
+                        unsigned NumThreads);
+};
+
+}  // end namespace clang
+
+#endif
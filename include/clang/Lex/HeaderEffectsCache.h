@@ -0,0 +1,253 @@
+//===--- HeaderEffectsCache.h - Replay Macro Effects of Headers -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file defines the HeaderEffectsCache interface, which records what
+//  headers do to the macros so that later inclusions can replay it.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_LEX_HEADEREFFECTSCACHE_H
+#define LLVM_CLANG_LEX_HEADEREFFECTSCACHE_H
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/LLVM.h"
+#include "clang/Basic/SourceLocation.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/ADT/StringRef.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace clang {
+class FileEntry;
+class IdentifierInfo;
+class MacroInfo;
+class Preprocessor;
+class PreprocessorLexer;
+class Token;
+
+/// \brief Records the effect of headers on the macros, and replays it.
+///
+/// Many headers consist of nothing but conditionals, \#define and \#undef:
+/// configuration headers, feature test headers and the like. All such a
+/// header does is to change some macros, and what it changes depends only on
+/// the macros its conditionals test. The cache records, for every such header
+/// and every distinct incoming definition of the macros it tested, the
+/// definitions and \#undefs it performed and its include guard. When the
+/// header is included again with the same incoming definitions, even by a
+/// later compilation, the preprocessor replays them from these snapshots
+/// instead of lexing the header.
+///
+/// The cache is a single file, normally shared by all compilations of a
+/// build. Each compilation appends a record of the entries it changed, and
+/// the file is occasionally rewritten to merge the records. Entries are
+/// validated against the size and modification time of the header, and
+/// against a hash of its contents if it was modified too recently for its
+/// modification time to tell. They are only shared between compilations with
+/// the same language, target and warning options, and only used where no
+/// diagnostic pragma changed the warnings.
+///
+/// A header is recorded only if it returns no tokens, includes no other
+/// file, uses no directive but the conditionals, \#define and \#undef,
+/// expands no builtin macro and emits no diagnostic. Otherwise it is marked
+/// as not replayable until it changes. Replaying notifies the PPCallbacks of
+/// entering and leaving the file and of each definition, but not of the
+/// conditionals in the header.
+class HeaderEffectsCache {
+public:
+  /// \brief The definition of a macro when a header first used it.
+  struct MacroState {
+    std::string Name;
+    /// \brief An encoding of the definition, empty if undefined.
+    std::string Definition;
+    /// \brief Whether the header marked the definition as used.
+    bool MarkedUsed;
+  };
+
+  struct TokenSnapshot {
+    unsigned Kind;
+    unsigned Flags;
+    unsigned Offset;
+    unsigned Length;
+    /// \brief The name of the identifier, if the token is one.
+    std::string Identifier;
+  };
+
+  /// \brief A \#define or \#undef in a header, with its macro as it was at
+  /// the end of the header.
+  struct MacroSnapshot {
+    std::string Name;
+    bool IsDefinition;
+    /// \brief The offset of the macro name in the header.
+    unsigned Offset;
+    unsigned EndOffset;
+    unsigned Flags;
+    std::vector<std::string> Params;
+    std::vector<TokenSnapshot> Tokens;
+  };
+
+  /// \brief The effects of one inclusion of a header.
+  struct Variant {
+    unsigned Characteristic;
+    std::string ControllingMacro;
+    std::vector<MacroState> Signature;
+    std::vector<MacroSnapshot> Effects;
+  };
+
+  struct HeaderEntry {
+    HeaderEntry() : Size(0), ModTime(0), RecordTime(0), Replayable(true) {}
+
+    uint64_t Size;
+    uint64_t ModTime;
+    /// \brief When the header was recorded, in seconds since the epoch.
+    uint64_t RecordTime;
+    std::string ContentHash;
+    bool Replayable;
+    std::vector<Variant> Variants;
+  };
+
+  /// \brief The entries, keyed by configuration and absolute path.
+  typedef llvm::StringMap<HeaderEntry> EntryMap;
+
+private:
+  /// \brief The inclusion of a header being recorded.
+  struct Recording {
+    explicit Recording(DiagnosticsEngine &Diags)
+      : ErrorTrap(Diags), NumWarnings(Diags.getNumWarnings()) {}
+
+    std::string Key;
+    const FileEntry *File;
+    FileID FID;
+    PreprocessorLexer *Lexer;
+    DiagnosticErrorTrap ErrorTrap;
+    unsigned NumWarnings;
+    Variant Result;
+    /// \brief The index in the signature of each macro used, and whether the
+    /// header has defined or undefined it since.
+    llvm::DenseMap<IdentifierInfo *, std::pair<unsigned, bool> > Used;
+    /// \brief The \#define and \#undef directives, in order.
+    struct MacroChange {
+      IdentifierInfo *II;
+      /// \brief The macro defined, or null for \#undef.
+      MacroInfo *MI;
+      SourceLocation UndefLoc;
+    };
+    SmallVector<MacroChange, 8> Changes;
+  };
+
+  Preprocessor &PP;
+  std::string CacheFile;
+  std::string ConfigurationHash;
+  bool Loaded;
+  /// \brief Whether the cache file should be rewritten rather than appended
+  /// to, because it is missing, damaged or has too many records.
+  bool NeedsRewrite;
+
+  EntryMap Headers;
+  /// \brief The keys of the entries this compilation changed.
+  llvm::StringSet<> Changed;
+
+  std::unique_ptr<Recording> Current;
+
+  unsigned NumReplayed, NumRecorded;
+
+  HeaderEffectsCache(const HeaderEffectsCache &) LLVM_DELETED_FUNCTION;
+  void operator=(const HeaderEffectsCache &) LLVM_DELETED_FUNCTION;
+
+  void load();
+  std::string getKey(const FileEntry *File) const;
+  bool isCurrent(const HeaderEntry &Entry, const FileEntry *File, FileID FID);
+  bool getContentHash(FileID FID, std::string &Hash);
+  void initEntry(HeaderEntry &Entry, const Recording &R);
+  bool getMacroState(IdentifierInfo *II, std::string &State);
+  bool matches(const Variant &V);
+  void replayEffects(const Variant &V, const FileEntry *File, FileID FID,
+                     SourceLocation IncluderLoc);
+  void useMacro(IdentifierInfo *II, bool MarkedUsed, bool Modifies);
+  void useExpandedMacro(IdentifierInfo *II, const MacroInfo *MI);
+  void addChange(IdentifierInfo *II, MacroInfo *MI, SourceLocation Loc);
+  void checkDirective(const Token &DirectiveTok);
+  bool snapshotMacro(FileID FID, const MacroInfo *MI,
+                     MacroSnapshot &Snapshot);
+  void markNotReplayable(const Recording &R);
+
+public:
+  HeaderEffectsCache(Preprocessor &PP, StringRef CacheFile);
+  ~HeaderEffectsCache();
+
+  /// \brief Replay a recorded inclusion of \p File, which has just been
+  /// given the FileID \p FID, if the macros it depends on are unchanged.
+  ///
+  /// \p IncluderLoc is where lexing resumes after the \#include directive.
+  /// Returns true if the header need not be entered.
+  bool replay(const FileEntry *File, FileID FID, SourceLocation IncluderLoc);
+
+  /// \brief Start recording the inclusion of \p File, which the preprocessor
+  /// has just entered with \p Lexer. Any other recording is abandoned.
+  void startRecording(const FileEntry *File, FileID FID,
+                      PreprocessorLexer *Lexer);
+
+  /// \brief The lexer of the header being recorded, if any.
+  PreprocessorLexer *getRecordedLexer() const {
+    return Current ? Current->Lexer : nullptr;
+  }
+
+  /// \brief Give up recording the current header, which has effects that
+  /// cannot be replayed.
+  void abortRecording();
+
+  /// \brief Finish recording the header lexed by \p Lexer, which reached its
+  /// end with \p ControllingMacro as include guard.
+  void finishRecording(PreprocessorLexer *Lexer,
+                       const IdentifierInfo *ControllingMacro);
+
+  /// \brief Note a directive of the recorded header.
+  void noteDirective(const Token &DirectiveTok) {
+    if (Current)
+      checkDirective(DirectiveTok);
+  }
+
+  /// \brief Note that a conditional depends on the macro definition of
+  /// \p II, which it marked as used if \p MarkedUsed.
+  void noteMacroTest(IdentifierInfo *II, bool MarkedUsed) {
+    if (Current)
+      useMacro(II, MarkedUsed, /*Modifies=*/false);
+  }
+
+  /// \brief Note the expansion of macro \p MI.
+  void noteMacroExpansion(IdentifierInfo *II, const MacroInfo *MI) {
+    if (Current)
+      useExpandedMacro(II, MI);
+  }
+
+  /// \brief Note that \p II is about to be defined as \p MI.
+  void noteMacroDefinition(IdentifierInfo *II, MacroInfo *MI) {
+    if (Current)
+      addChange(II, MI, SourceLocation());
+  }
+
+  /// \brief Note that \p II is about to be undefined at \p Loc.
+  void noteMacroUndefinition(IdentifierInfo *II, SourceLocation Loc) {
+    if (Current)
+      addChange(II, nullptr, Loc);
+  }
+
+  /// \brief Add the recordings of this compilation to the cache file.
+  void save();
+
+  unsigned getNumReplayed() const { return NumReplayed; }
+  unsigned getNumRecorded() const { return NumRecorded; }
+};
+
+}  // end namespace clang
+
+#endif
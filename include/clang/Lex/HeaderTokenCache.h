@@ -0,0 +1,94 @@
+//===--- HeaderTokenCache.h - Persistent Cache of Header Tokens -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file defines the HeaderTokenCache interface, an on-disk cache of the
+//  tokens of headers shared by all compilations using the same directory.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_LEX_HEADERTOKENCACHE_H
+#define LLVM_CLANG_LEX_HEADERTOKENCACHE_H
+
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/LLVM.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class MemoryBuffer;
+}
+
+namespace clang {
+class FileEntry;
+
+/// \brief A directory of pre-lexed header tokens, shared by compilations.
+///
+/// Each header is stored once under a hash of its contents, of the language
+/// options, of the token kinds and of the compiler version, so a cache entry
+/// never needs to be invalidated: a modified header simply hashes to a
+/// different entry. Entries are still checked before use, since a corrupted
+/// one would make the Lexer read outside of the header. The
+/// entries hold the raw token stream of the header as an array of
+/// \c PreLexedToken which is mapped into memory and handed to the Lexer as
+/// is. Since raw tokens do not depend on macros, any translation unit
+/// including the header can use them.
+///
+/// Unlike PTH, which holds the tokens of a single header chosen when the PTH
+/// file is built, the cache fills itself with every header a compilation
+/// enters and needs no explicit step to build or update it.
+class HeaderTokenCache {
+  struct CachedFile {
+    /// \brief The mapped cache entry, if the tokens came from disk.
+    std::unique_ptr<llvm::MemoryBuffer> Entry;
+    /// \brief The tokens, if they were lexed by this compilation.
+    std::vector<PreLexedToken> Lexed;
+    ArrayRef<PreLexedToken> Tokens;
+  };
+
+  std::string Directory;
+  LangOptions LangOpts;
+
+  /// \brief Hash of everything but the contents that the tokens depend on.
+  std::string ConfigurationHash;
+
+  llvm::DenseMap<const FileEntry *, CachedFile *> Files;
+
+  unsigned NumHits, NumMisses;
+
+  HeaderTokenCache(const HeaderTokenCache &) LLVM_DELETED_FUNCTION;
+  void operator=(const HeaderTokenCache &) LLVM_DELETED_FUNCTION;
+
+  std::string getEntryPath(const llvm::MemoryBuffer *Buffer) const;
+  bool readEntry(StringRef Path, const llvm::MemoryBuffer *Buffer,
+                 CachedFile &File);
+  void writeEntry(StringRef Path, const llvm::MemoryBuffer *Buffer,
+                  ArrayRef<PreLexedToken> Tokens);
+
+public:
+  HeaderTokenCache(StringRef Directory, const LangOptions &LangOpts);
+  ~HeaderTokenCache();
+
+  /// \brief Get the tokens of \p File, whose contents are \p Buffer.
+  ///
+  /// If the cache has no entry for the contents, they are lexed and added to
+  /// the cache. The tokens stay alive as long as the cache.
+  ArrayRef<PreLexedToken> getTokens(const FileEntry *File,
+                                    const llvm::MemoryBuffer *Buffer);
+
+  unsigned getNumHits() const { return NumHits; }
+  unsigned getNumMisses() const { return NumMisses; }
+};
+
+}  // end namespace clang
+
+#endif
@@ -16,6 +16,7 @@
 
 #include "clang/Basic/LangOptions.h"
 #include "clang/Lex/PreprocessorLexer.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallVector.h"
 #include <cassert>
 #include <string>
@@ -39,6 +40,22 @@ enum ConflictMarkerKind {
   CMK_Perforce
 };
 
+/// PreLexedToken - A token lexed ahead of time, by the TokenPrefetcher or in an
+/// earlier compilation, which the Lexer of the file can form without looking
+/// at its characters.  Only
+/// tokens preceded by whitespace alone are recorded, so the token is the next
+/// one whenever the lexer is positioned between GapStart and Offset.
+///
+/// The HeaderTokenCache stores arrays of these verbatim.
+struct PreLexedToken {
+  /// GapStart - Offset of the end of the previous token.
+  unsigned GapStart;
+  /// Offset - Offset of the token itself.
+  unsigned Offset;
+  unsigned Length;
+  tok::TokenKind Kind;
+};
+
 /// Lexer - This provides a simple interface that turns a text buffer into a
 /// stream of tokens.  This provides no support for file reading or buffering,
 /// or buffering/seeking of tokens, only forward lexing is supported.  It relies
@@ -67,6 +84,11 @@ class Lexer : public PreprocessorLexer {
   /// it returns comments, when it is set to 0 it returns normal tokens only.
   unsigned char ExtendedTokenMode;
 
+  /// SkipNonDirectiveLines - When set, the lines which cannot hold a directive
+  /// are jumped over instead of being lexed.  This is used when the
+  /// preprocessor only scans for the dependencies of the file.
+  bool SkipNonDirectiveLines;
+
   //===--------------------------------------------------------------------===//
   // Context that changes as the file is lexed.
   // NOTE: any state that mutates when in raw mode must have save/restore code
@@ -89,6 +111,12 @@ class Lexer : public PreprocessorLexer {
   // CurrentConflictMarkerState - The kind of conflict marker we are handling.
   ConflictMarkerKind CurrentConflictMarkerState;
 
+  // PreLexedTokens - Tokens of this file lexed ahead of time, if any, and the
+  // index of the first one which has not been passed yet.  The tokens are
+  // owned by the TokenPrefetcher or the HeaderTokenCache.
+  ArrayRef<PreLexedToken> PreLexedTokens;
+  unsigned NextPreLexedToken;
+
   Lexer(const Lexer &) LLVM_DELETED_FUNCTION;
   void operator=(const Lexer &) LLVM_DELETED_FUNCTION;
   friend class Preprocessor;
@@ -207,6 +235,24 @@ public:
   /// uninterpreted string.  This switches the lexer out of directive mode.
   void ReadToEndOfLine(SmallVectorImpl<char> *Result = nullptr);
 
+  /// SkipExcludedLines - Skip the text of an excluded conditional block up to
+  /// the next line that may start with a preprocessor directive, without
+  /// forming tokens.  Only comments, string and character literals and
+  /// escaped newlines are tracked; the skipping stops at the start of any line
+  /// holding something that needs the full lexer, such as a raw string
+  /// literal or a trigraph.  This must only be called in raw mode, outside of
+  /// a directive.
+  void SkipExcludedLines();
+
+  /// setPreLexedTokens - Provide tokens of this file which were lexed ahead of
+  /// time, which must outlive the lexer.  They are used whenever the lexer
+  /// reaches one of them outside of any special lexing mode, and ignored
+  /// otherwise.
+  void setPreLexedTokens(ArrayRef<PreLexedToken> Tokens) {
+    PreLexedTokens = Tokens;
+    NextPreLexedToken = 0;
+  }
+
 
   /// Diag - Forwarding function for diagnostics.  This translate a source
   /// position in the current buffer into a SourceLocation object for rendering.
@@ -447,6 +493,12 @@ private:
   ///
   bool LexTokenInternal(Token &Result, bool TokAtPhysicalStartOfLine);
 
+  /// LexPreLexedToken - Form the next token from the pre-lexed tokens, if the
+  /// lexer is positioned right before one of them.  Returns false if the token
+  /// must be lexed normally; otherwise \p Returned is the value to return from
+  /// LexTokenInternal.
+  bool LexPreLexedToken(Token &Result, bool &Returned);
+
   bool CheckUnicodeWhitespace(Token &Result, uint32_t C, const char *CurPtr);
 
   /// Given that a token begins with the Unicode character \p C, figure out
@@ -594,6 +646,7 @@ private:
   bool SkipBlockComment      (Token &Result, const char *CurPtr,
                               bool &TokAtPhysicalStartOfLine);
   bool SaveLineComment       (Token &Result, const char *CurPtr);
+  const char *FindPossibleDirectiveLine(bool AtStartOfLine) const;
   
   bool IsStartOfConflictMarker(const char *CurPtr);
   bool HandleEndOfConflictMarker(const char *CurPtr);
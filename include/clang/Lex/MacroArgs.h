@@ -39,18 +39,28 @@ class MacroArgs {
   /// if in strict mode and the C99 varargs macro had only a ... argument, this
   /// is false.
   bool VarargsElided;
+
+  /// ArgStarts - The index of the first unexpanded token of each argument, so
+  /// that the arguments can be found without scanning the tokens.
+  std::vector<unsigned> ArgStarts;
   
   /// PreExpArgTokens - Pre-expanded tokens for arguments that need them.  Empty
   /// if not yet computed.  This includes the EOF marker at the end of the
   /// stream.
   std::vector<std::vector<Token> > PreExpArgTokens;
 
+  /// ExpandedArgs - The tokens substituted for each argument outside of # and
+  /// ## operators: its pre-expanded tokens if it needed pre-expansion, and its
+  /// unexpanded tokens otherwise.  Null if not yet computed.
+  std::vector<const Token *> ExpandedArgs;
+
   /// StringifiedArgs - This contains arguments in 'stringified' form.  If the
   /// stringified form of an argument has not yet been computed, this is empty.
   std::vector<Token> StringifiedArgs;
 
   /// ArgCache - This is a linked list of MacroArgs objects that the
-  /// Preprocessor owns which we use to avoid thrashing malloc/free.
+  /// Preprocessor owns which we use to avoid thrashing malloc/free.  The
+  /// vectors above keep their storage while on the list.
   MacroArgs *ArgCache;
 
   MacroArgs(unsigned NumToks, bool varargsElided)
@@ -87,6 +97,14 @@ public:
   const std::vector<Token> &
     getPreExpArgument(unsigned Arg, const MacroInfo *MI, Preprocessor &PP);
 
+  /// getExpandedArgument - Return the tokens to substitute for a use of the
+  /// specified argument which is not an operand of # or ##, terminated by an
+  /// EOF: its pre-expanded form if pre-expansion could change it, its
+  /// unexpanded tokens otherwise.  The result is cached, so further uses of
+  /// the argument in the same expansion cost nothing.
+  const Token *getExpandedArgument(unsigned Arg, const MacroInfo *MI,
+                                   Preprocessor &PP);
+
   /// getStringifiedArgument - Compute, cache, and return the specified argument
   /// that has been 'stringified' as required by the # operator.
   const Token &getStringifiedArgument(unsigned ArgNo, Preprocessor &PP,
@@ -0,0 +1,141 @@
+//===--- MinimizedSourceCache.h - Sources Reduced to Directives -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file defines the MinimizedSourceCache interface and a file system
+//  serving the sources it minimized, for scanning the dependencies of many
+//  translation units at once.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_LEX_MINIMIZEDSOURCECACHE_H
+#define LLVM_CLANG_LEX_MINIMIZEDSOURCECACHE_H
+
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/LLVM.h"
+#include "clang/Basic/VirtualFileSystem.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/SmallVector.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class MemoryBuffer;
+}
+
+namespace clang {
+
+/// \brief Reduce the source file \p Input to its preprocessor directives.
+///
+/// Every character outside of a directive except the line breaks is replaced
+/// by a space, so the result has the size and the lines of the input, and
+/// the locations of the directives do not change. The directives are kept
+/// verbatim, with any comments and escaped newlines in them. Only the parts
+/// of a file the preprocessor acts on when it scans for dependencies
+/// (-fdeps-scan-only) survive.
+void minimizeSourceToDirectives(const llvm::MemoryBuffer &Input,
+                                const LangOptions &LangOpts,
+                                SmallVectorImpl<char> &Output);
+
+/// \brief The minimized contents of source files, shared by the compilations
+/// of a build.
+///
+/// The cache is safe to use from several threads. Each file is minimized
+/// once, on its first use, and its minimized contents are reused as long as
+/// its contents do not change. Modification times only have a resolution of
+/// a second, so an unchanged size and modification time are only trusted if
+/// the file was last modified before the second it was read in; otherwise
+/// the file is read again and compared by a hash of its contents. The
+/// contents handed out stay alive as long as the cache, even if the file
+/// changes meanwhile.
+///
+/// Which lines are directives depends on the language (comments, raw string
+/// literals, trigraphs), so a cache should only be shared by compilations
+/// of the same language.
+class MinimizedSourceCache
+    : public llvm::ThreadSafeRefCountedBase<MinimizedSourceCache> {
+  struct Entry {
+    uint64_t Size;
+    llvm::sys::TimeValue ModTime;
+    /// \brief When the file was read, in seconds since the epoch.
+    uint64_t ReadTime;
+    /// \brief The MD5 hash of the contents of the file, not minimized.
+    std::string ContentHash;
+    std::unique_ptr<llvm::MemoryBuffer> Contents;
+  };
+
+  LangOptions LangOpts;
+
+  std::mutex Lock;
+  std::map<llvm::sys::fs::UniqueID, Entry> Entries;
+  /// \brief The contents of entries replaced since, which may still be used.
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> StaleContents;
+
+  std::atomic<unsigned> NumMinimized, NumReused;
+
+  MinimizedSourceCache(const MinimizedSourceCache &) LLVM_DELETED_FUNCTION;
+  void operator=(const MinimizedSourceCache &) LLVM_DELETED_FUNCTION;
+
+public:
+  explicit MinimizedSourceCache(const LangOptions &LangOpts);
+  ~MinimizedSourceCache();
+
+  /// \brief Returns the minimized contents of the file with status \p Status,
+  /// or null if it was not minimized yet, has changed since, or may have
+  /// changed without changing its status.
+  const llvm::MemoryBuffer *lookup(const vfs::Status &Status);
+
+  /// \brief Minimize \p Contents, the contents of the file with status
+  /// \p Status read no earlier than \p ReadTime, and add them to the cache.
+  ///
+  /// If the cache already holds the same contents for the file, or another
+  /// thread added them meanwhile, they are returned instead, so that all
+  /// users share the same contents.
+  const llvm::MemoryBuffer *insert(const vfs::Status &Status,
+                                   const llvm::MemoryBuffer &Contents,
+                                   llvm::sys::TimeValue ReadTime);
+
+  unsigned getNumMinimized() const { return NumMinimized; }
+  unsigned getNumReused() const { return NumReused; }
+};
+
+/// \brief A file system which serves the source files of another file system
+/// minimized to their directives, through a MinimizedSourceCache.
+///
+/// Only files with the extension of a C family source or header, or with no
+/// extension at all, are minimized; everything else, such as module maps and
+/// precompiled headers, is passed through. The status of a minimized file is
+/// that of the original file, as both have the same size.
+class MinimizingFileSystem : public vfs::FileSystem {
+  IntrusiveRefCntPtr<vfs::FileSystem> UnderlyingFS;
+  IntrusiveRefCntPtr<MinimizedSourceCache> Cache;
+
+public:
+  MinimizingFileSystem(IntrusiveRefCntPtr<vfs::FileSystem> UnderlyingFS,
+                       IntrusiveRefCntPtr<MinimizedSourceCache> Cache);
+  ~MinimizingFileSystem();
+
+  /// \brief Whether the file at \p Path is minimized.
+  static bool shouldMinimize(StringRef Path);
+
+  llvm::ErrorOr<vfs::Status> status(const Twine &Path) override;
+  std::error_code openFileForRead(const Twine &Path,
+                                  std::unique_ptr<vfs::File> &Result) override;
+  vfs::directory_iterator dir_begin(const Twine &Dir,
+                                    std::error_code &EC) override;
+
+  MinimizedSourceCache &getCache() const { return *Cache; }
+};
+
+}  // end namespace clang
+
+#endif
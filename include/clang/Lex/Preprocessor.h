@@ -57,6 +57,9 @@ class DirectoryLookup;
 class PreprocessingRecord;
 class ModuleLoader;
 class PreprocessorOptions;
+class TokenPrefetcher;
+class HeaderEffectsCache;
+class HeaderTokenCache;
 
 /// \brief Stores token information for comparing actual tokens with
 /// predefined values.  Only handles simple tokens and identifiers.
@@ -104,6 +107,19 @@ class Preprocessor : public RefCountedBase<Preprocessor> {
   /// a token cache rather than lexing the original source file.
   std::unique_ptr<PTHManager> PTH;
 
+  /// \brief Lexes the headers about to be included on a background thread,
+  /// if enabled with PreprocessorOptions::PrelexHeaders.
+  std::unique_ptr<TokenPrefetcher> Prefetcher;
+
+  /// \brief The on-disk cache of header tokens, if enabled with
+  /// PreprocessorOptions::HeaderTokenCacheDir.
+  std::unique_ptr<HeaderTokenCache> HeaderTokens;
+
+  /// \brief Records and replays the effect of headers on the macros, if
+  /// enabled with PreprocessorOptions::HeaderEffectsCacheFile.
+  std::unique_ptr<HeaderEffectsCache> HeaderEffects;
+  friend class HeaderEffectsCache;
+
   /// A BumpPtrAllocator object used to quickly allocate and release
   /// objects internal to the Preprocessor.
   llvm::BumpPtrAllocator BP;
@@ -155,6 +171,10 @@ class Preprocessor : public RefCountedBase<Preprocessor> {
   /// when parsing preprocessor directives.
   bool MacroExpansionInDirectivesOverride : 1;
 
+  /// True if only the directives are preprocessed, to find the dependencies
+  /// of the main file; the text between them is skipped.
+  bool ScanningDependenciesOnly : 1;
+
   class ResetMacroExpansionHelper;
 
   /// \brief Whether we have already loaded macros from the external source.
@@ -378,7 +398,7 @@ class Preprocessor : public RefCountedBase<Preprocessor> {
   unsigned NumEnteredSourceFiles, MaxIncludeStackDepth;
   unsigned NumMacroExpanded, NumFnMacroExpanded, NumBuiltinMacroExpanded;
   unsigned NumFastMacroExpanded, NumTokenPaste, NumFastTokenPaste;
-  unsigned NumSkipped;
+  unsigned NumSkipped, NumPreLexedTokens;
 
   /// \brief The predefined macros that preprocessor should use from the
   /// command line etc.
@@ -698,6 +718,11 @@ public:
   /// preprocessing record.
   PreprocessingRecord *getPreprocessingRecord() const { return Record; }
 
+  /// \brief Retrieve the cache of header effects, if there is one.
+  HeaderEffectsCache *getHeaderEffectsCache() const {
+    return HeaderEffects.get();
+  }
+
   /// \brief Create a new preprocessing record, which will keep track of
   /// all macro expansions, macro definitions, etc.
   void createPreprocessingRecord();
@@ -837,6 +862,10 @@ public:
     MacroExpansionInDirectivesOverride = true;
   }
 
+  /// \brief Whether only the directives are preprocessed, as enabled with
+  /// PreprocessorOptions::DependencyScanOnly.
+  bool isScanningDependenciesOnly() const { return ScanningDependenciesOnly; }
+
   /// \brief Peeks ahead N tokens and returns that token without consuming any
   /// tokens.
   ///
@@ -1171,6 +1200,8 @@ public:
       ++NumTokenPaste;
   }
 
+  void IncrementPreLexedTokenCounter() { ++NumPreLexedTokens; }
+
   void PrintStats();
 
   size_t getTotalMemory() const;
@@ -1469,6 +1500,11 @@ private:
   /// start getting tokens from it using the PTH cache.
   void EnterSourceFileWithPTH(PTHLexer *PL, const DirectoryLookup *Dir);
 
+  /// \brief Queue the headers which the file just entered seems to include
+  /// for lookup and lexing on the prefetcher's thread.
+  void PrefetchIncludedFiles(const FileEntry *File,
+                             const llvm::MemoryBuffer *InputFile);
+
   /// \brief Set the FileID for the preprocessor predefines.
   void setPredefinesFileID(FileID FID) {
     assert(PredefinesFileID.isInvalid() && "PredefinesFileID already set!");
@@ -55,6 +55,19 @@ public:
   /// definitions and expansions.
   unsigned DetailedRecord : 1;
 
+  /// \brief Whether include-guarded headers should be read and lexed ahead of
+  /// time on a background thread (experimental).
+  unsigned PrelexHeaders : 1;
+
+  /// \brief Whether the preprocessor waits for the headers it queued for
+  /// pre-lexing to be done before entering one, for deterministic testing.
+  unsigned PrelexHeadersWait : 1;
+
+  /// \brief Whether only the directives should be preprocessed, skipping the
+  /// text between them, because only the dependencies of the main file are
+  /// wanted (-Eonly).
+  unsigned DependencyScanOnly : 1;
+
   /// The implicit PCH included at the start of the translation unit, or empty.
   std::string ImplicitPCHInclude;
 
@@ -89,6 +102,14 @@ public:
   /// If given, a PTH cache file to use for speeding up header parsing.
   std::string TokenCache;
 
+  /// If given, a directory in which the tokens of every header entered are
+  /// cached by content, for use by later compilations.
+  std::string HeaderTokenCacheDir;
+
+  /// If given, a file recording the effect of directive-only headers on the
+  /// macros, which later compilations replay instead of lexing the headers.
+  std::string HeaderEffectsCacheFile;
+
   /// \brief True if the SourceManager should report the original file name for
   /// contents of files that were remapped to other files. Defaults to true.
   bool RemappedFilesKeepOriginalName;
@@ -141,6 +162,8 @@ public:
 
 public:
   PreprocessorOptions() : UsePredefines(true), DetailedRecord(false),
+                          PrelexHeaders(false), PrelexHeadersWait(false),
+                          DependencyScanOnly(false),
                           DisablePCHValidation(false),
                           AllowPCHWithCompilerErrors(false),
                           DumpDeserializedPCHDecls(false),
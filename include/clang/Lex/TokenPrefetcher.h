@@ -0,0 +1,182 @@
+//===--- TokenPrefetcher.h - Background Lexing of Headers -------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file defines the TokenPrefetcher interface, which reads and lexes
+//  headers on a background thread before the preprocessor includes them.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_LEX_TOKENPREFETCHER_H
+#define LLVM_CLANG_LEX_TOKENPREFETCHER_H
+
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/LLVM.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/FileSystem.h"
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+class MemoryBuffer;
+}
+
+namespace clang {
+class FileEntry;
+
+namespace vfs {
+class FileSystem;
+}
+
+/// \brief Speculatively lexes headers on a background thread.
+///
+/// When the preprocessor enters a file, it hands the names in the
+/// \#include directives of that file to the prefetcher. The background
+/// thread looks each name up along a copy of the header search path, reads
+/// the header through the virtual file system and raw-lexes it. By the time
+/// the \#include directive is reached, the source manager can adopt the
+/// buffer the background thread read, and the Lexer of the header forms most
+/// tokens directly from the pre-lexed token array (see \c PreLexedToken)
+/// instead of scanning the characters itself.
+///
+/// Only headers whose text has the shape of an include-guarded (or
+/// \#pragma once) header are pre-lexed. Raw tokenization does not depend on
+/// the macros in effect, so the work is wasted only if the header ends up not
+/// being included.
+class TokenPrefetcher {
+  struct PrefetchRequest {
+    std::string IncluderDir;
+    std::string Name;
+    bool IsAngled;
+  };
+
+  struct PrefetchedFile {
+    PrefetchedFile() : Taken(false) {}
+
+    std::unique_ptr<llvm::MemoryBuffer> Buffer;
+    std::vector<PreLexedToken> Tokens;
+    bool Taken;
+  };
+
+  LangOptions LangOpts;
+  IntrusiveRefCntPtr<vfs::FileSystem> FS;
+
+  /// \brief Whether \c takeFile waits for the background thread to finish
+  /// the headers queued so far, which makes the results deterministic.
+  bool WaitForWorker;
+
+  /// \brief The header search path, or empty strings for the entries that
+  /// are not plain directories. Set before the first request is queued and
+  /// never changed afterwards.
+  std::vector<std::string> SearchDirs;
+  unsigned AngledDirIdx;
+  bool HasSearchPath;
+
+  std::mutex Lock;
+  std::condition_variable QueueChanged;
+  std::condition_variable Idle;
+  std::deque<PrefetchRequest> Queue;
+  bool Busy;
+  bool ShuttingDown;
+  std::thread Worker;
+
+  /// \brief Every file the background thread found, by the identity of the
+  /// file so that a header reached by different names is read once.
+  std::map<llvm::sys::fs::UniqueID, PrefetchedFile> Files;
+
+  /// \brief The requests queued so far. Only used on the main thread.
+  llvm::StringSet<> Requested;
+
+  unsigned NumLexedFiles, NumUsedFiles;
+
+  TokenPrefetcher(const TokenPrefetcher &) LLVM_DELETED_FUNCTION;
+  void operator=(const TokenPrefetcher &) LLVM_DELETED_FUNCTION;
+
+  void runWorker();
+  void lookupAndLex(const PrefetchRequest &Request);
+
+public:
+  TokenPrefetcher(const LangOptions &LangOpts,
+                  IntrusiveRefCntPtr<vfs::FileSystem> FS, bool WaitForWorker);
+  ~TokenPrefetcher();
+
+  /// \brief Whether prefetching is supported in this build, which requires
+  /// threads.
+  static bool isAvailable();
+
+  /// \brief Whether the header search path was provided yet.
+  bool hasSearchPath() const { return HasSearchPath; }
+
+  /// \brief Provide the header search path. Entries which are not plain
+  /// directories (frameworks, header maps) must be empty strings; lookups
+  /// stop there, since the header may be found through them.
+  void setSearchPath(std::vector<std::string> Dirs, unsigned AngledDirIdx);
+
+  /// \brief Queue the header that \#include \p Name in a file of
+  /// \p IncluderDir likely refers to, unless it was queued before.
+  ///
+  /// Only does string operations; the header search happens on the
+  /// background thread.
+  void prefetch(StringRef IncluderDir, StringRef Name, bool IsAngled);
+
+  /// \brief Retrieve what the background thread read and lexed for
+  /// \p File, if it is done with it.
+  ///
+  /// \p Buffer receives the contents read, if any; they are only valid if
+  /// the file did not change since its FileEntry was created, which the
+  /// caller has to check. \p Tokens receives the pre-lexed tokens if the
+  /// file is include-guarded; they stay alive as long as the prefetcher.
+  /// Everything is handed out at most once.
+  bool takeFile(const FileEntry *File,
+                std::unique_ptr<llvm::MemoryBuffer> &Buffer,
+                ArrayRef<PreLexedToken> &Tokens);
+
+  /// \brief Note that the tokens handed out for a file were used.
+  void noteTokensUsed() { ++NumUsedFiles; }
+
+  /// \brief The number of headers lexed so far. Only meaningful once the
+  /// background thread is idle.
+  unsigned getNumLexedFiles();
+  unsigned getNumUsedFiles() const { return NumUsedFiles; }
+
+  /// \brief Find the \#include and \#import directives of \p Buffer by a
+  /// quick textual scan, and append the file names and whether they are
+  /// angled to \p Includes. Other conditionals are ignored, but the
+  /// directives inside \#if 0 blocks are skipped.
+  static void findIncludes(StringRef Buffer,
+                  SmallVectorImpl<std::pair<StringRef, bool> > &Includes);
+
+  /// \brief Raw-lex \p Buffer, which must be null terminated, and keep the
+  /// tokens that the preprocessor's Lexer can take over unchanged.
+  ///
+  /// Returns whether the buffer looks like an include-guarded header: its
+  /// first directive must be \#ifndef X (or \#if !defined X) followed by
+  /// \#define X and its last one the matching \#endif, unless it contains
+  /// \#pragma once.
+  static bool lexBuffer(StringRef Buffer, const LangOptions &LangOpts,
+                        std::vector<PreLexedToken> &Tokens);
+
+  /// \brief Whether \p Tok, which must lie within \p Buffer, is of a kind
+  /// \c lexBuffer keeps and is spelled like a token of that kind. Used to
+  /// check tokens that were not lexed in this process.
+  static bool isValidPreLexedToken(StringRef Buffer, const PreLexedToken &Tok);
+};
+
+}  // end namespace clang
+
+#endif
@@ -45,7 +45,7 @@ namespace clang {
     /// for the previous version could still support reading the new
     /// version by ignoring new kinds of subblocks), this number
     /// should be increased.
-    const unsigned VERSION_MINOR = 0;
+    const unsigned VERSION_MINOR = 1;
 
     /// \brief An ID number that refers to an identifier in an AST file.
     /// 
@@ -563,7 +563,12 @@ namespace clang {
       SM_SLOC_BUFFER_BLOB = 3,
       /// \brief Describes a source location entry (SLocEntry) for a
       /// macro expansion.
-      SM_SLOC_EXPANSION_ENTRY = 4
+      SM_SLOC_EXPANSION_ENTRY = 4,
+      /// \brief Describes the offsets of the lines of a file, as the size of
+      /// its contents followed by the length of each line. This kind of
+      /// record optionally follows a SM_SLOC_FILE_ENTRY record and its
+      /// SM_SLOC_BUFFER_BLOB record, if any.
+      SM_SLOC_LINE_TABLE = 5
     };
 
     /// \brief Record types used within a preprocessor block.
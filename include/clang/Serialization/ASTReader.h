@@ -65,6 +65,7 @@ class Decl;
 class DeclContext;
 class DefMacroDirective;
 class DiagnosticOptions;
+class FileSystemStatCache;
 class NestedNameSpecifier;
 class CXXBaseSpecifier;
 class CXXConstructorDecl;
@@ -839,6 +840,29 @@ private:
   /// \brief The number of source location entries in the chain.
   unsigned TotalNumSLocEntries;
 
+  /// \brief The number of line tables of files de-serialized from the PCH
+  /// file.
+  unsigned NumLineTablesRead;
+
+  class InputFileStatPool;
+
+  /// \brief The threads that stat input files ahead of validating them,
+  /// started the first time there are enough of them and kept for every
+  /// AST file loaded afterwards.
+  std::unique_ptr<InputFileStatPool> StatPool;
+
+  /// \brief The number of input files stat'ed on several threads while
+  /// validating them.
+  unsigned NumInputFileStatsPrefetched;
+
+  /// \brief The number of input files whose validation was deferred until
+  /// they are used.
+  unsigned NumInputFilesDeferred;
+
+  /// \brief The number of input files whose validation was deferred, and
+  /// which were validated since.
+  unsigned NumDeferredInputFilesValidated;
+
   /// \brief The number of statements (and expressions) de-serialized
   /// from the chain.
   unsigned NumStatementsRead;
@@ -1080,6 +1104,13 @@ private:
   /// \brief A convenience method to read the filename from an input file.
   std::string getInputFileName(ModuleFile &F, unsigned ID);
 
+  /// \brief Stat the first \p N input files of \p F on several threads,
+  /// ahead of validating them one by one.
+  ///
+  /// \returns the stat cache holding the results, installed in the file
+  /// manager until it is removed, or null if there was too little to do.
+  FileSystemStatCache *prefetchInputFileStats(ModuleFile &F, unsigned N);
+
   /// \brief Retrieve the file entry and 'overridden' bit for an input
   /// file in the given module file.
   serialization::InputFile getInputFile(ModuleFile &F, unsigned ID,
@@ -1804,6 +1835,11 @@ public:
   /// \brief Report a diagnostic.
   DiagnosticBuilder Diag(SourceLocation Loc, unsigned DiagID);
 
+  /// \brief Whether the identifiers decoded from the AST files may reference
+  /// their spelling in the AST files rather than be entered in the
+  /// identifier table.
+  bool canReferenceIdentifierSpellings() const;
+
   IdentifierInfo *DecodeIdentifierInfo(serialization::IdentifierID ID);
 
   IdentifierInfo *GetIdentifierInfo(ModuleFile &M, const RecordData &Record,
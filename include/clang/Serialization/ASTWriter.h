@@ -29,6 +29,7 @@
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/Bitcode/BitstreamWriter.h"
 #include <map>
+#include <memory>
 #include <queue>
 #include <vector>
 
@@ -123,6 +124,16 @@ private:
   /// \brief Indicates that the AST contained compiler errors.
   bool ASTHasCompilerErrors;
 
+  /// \brief Whether to serialize the parts of the AST file which do not
+  /// depend on each other on worker threads.
+  bool WriteInParallel;
+
+  class SLocEntryWorker;
+
+  /// \brief The worker thread serializing the source manager block while the
+  /// declarations and types are written, if writing in parallel.
+  std::unique_ptr<SLocEntryWorker> SLocWorker;
+
   /// \brief Mapping from input file entries to the index into the
   /// offset table where information about that input file is stored.
   llvm::DenseMap<const FileEntry *, uint32_t> InputFileIDs;
@@ -455,6 +466,7 @@ private:
                        HeaderSearchOptions &HSOpts,
                        StringRef isysroot,
                        bool Modules);
+  void StartSourceManagerWorker(const SourceManager &SourceMgr);
   void WriteSourceManagerBlock(SourceManager &SourceMgr,
                                const Preprocessor &PP,
                                StringRef isysroot);
@@ -518,6 +530,12 @@ public:
   ASTWriter(llvm::BitstreamWriter &Stream);
   ~ASTWriter();
 
+  /// \brief Serialize the source manager block on a worker thread while the
+  /// declarations and types are written.
+  ///
+  /// The AST file written is the same, byte for byte, as without it.
+  void setWriteInParallel(bool Parallel) { WriteInParallel = Parallel; }
+
   /// \brief Write a precompiled header for the given semantic analysis.
   ///
   /// \param SemaRef a reference to the semantic analysis object that processed
@@ -800,7 +818,8 @@ public:
   PCHGenerator(const Preprocessor &PP, StringRef OutputFile,
                clang::Module *Module,
                StringRef isysroot, raw_ostream *Out,
-               bool AllowASTWithErrors = false);
+               bool AllowASTWithErrors = false,
+               bool WriteInParallel = false);
   ~PCHGenerator();
   void InitializeSema(Sema &S) override { SemaPtr = &S; }
   void HandleTranslationUnit(ASTContext &Ctx) override;
@@ -207,6 +207,10 @@ public:
   /// The time is specified in seconds since the start of the Epoch.
   uint64_t InputFilesValidationTimestamp;
 
+  /// \brief The number of input files, starting from the first, whose
+  /// validation was deferred until they are used.
+  unsigned NumDeferredInputFiles;
+
   // === Source Locations ===
 
   /// \brief Cursor used to read source location entries.
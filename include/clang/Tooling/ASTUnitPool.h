@@ -0,0 +1,120 @@
+//===--- ASTUnitPool.h - Memory-bounded pool of ASTs ------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file defines the ASTUnitPool class, which hands out the ASTs of the
+//  translation units of a ClangTool on demand while keeping only a bounded
+//  number of them in memory.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLING_AST_UNIT_POOL_H
+#define LLVM_CLANG_TOOLING_AST_UNIT_POOL_H
+
+#include "clang/Basic/LLVM.h"
+#include "clang/Frontend/ASTUnit.h"
+#include "llvm/ADT/StringRef.h"
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace tooling {
+
+class ClangTool;
+
+/// \brief A pool of the ASTs of all translation units of a \c ClangTool,
+/// built when they are first requested.
+///
+/// Unlike \c ClangTool::buildASTs, which keeps every AST of a project in
+/// memory at once, the pool keeps at most a fixed number of ASTs resident,
+/// evicting the least recently requested one to make room for another. An
+/// evicted AST is optionally saved to a temporary AST file first, and loaded
+/// from that file when it is requested again instead of being reparsed.
+///
+/// \code
+///   ASTUnitPool Pool(Tool, /*MaxResidentASTs=*/16);
+///   for (unsigned I = 0, E = Pool.size(); I != E; ++I)
+///     if (ASTUnit *AST = Pool.getAST(I))
+///       process(*AST);
+/// \endcode
+class ASTUnitPool {
+public:
+  /// \param Tool The tool whose compile commands are turned into ASTs. It
+  /// must outlive the pool.
+  /// \param MaxResidentASTs The maximum number of ASTs kept in memory; 0
+  /// means no limit.
+  /// \param SaveEvictedASTs Whether evicted ASTs are saved to temporary AST
+  /// files to be reloaded, rather than rebuilt from source.
+  ASTUnitPool(ClangTool &Tool, unsigned MaxResidentASTs,
+              bool SaveEvictedASTs = true);
+  ~ASTUnitPool();
+
+  /// \brief Returns the number of translation units in the pool.
+  unsigned size() const { return Units.size(); }
+
+  /// \brief Returns the source file of the translation unit \p Index.
+  StringRef getFile(unsigned Index) const;
+
+  /// \brief Returns the AST of the translation unit \p Index, building or
+  /// reloading it if it is not in memory.
+  ///
+  /// The AST stays valid until it is evicted, that is at least until
+  /// MaxResidentASTs - 1 other ASTs have been requested. Returns null if the
+  /// AST could not be built.
+  ASTUnit *getAST(unsigned Index);
+
+  /// \brief Returns the number of ASTs currently in memory.
+  unsigned getNumResidentASTs() const { return Resident.size(); }
+
+  /// \brief Returns the number of ASTs built from source so far.
+  unsigned getNumBuiltASTs() const { return NumBuilt; }
+
+  /// \brief Returns the number of ASTs loaded from saved AST files so far.
+  unsigned getNumReloadedASTs() const { return NumReloaded; }
+
+private:
+  ASTUnitPool(const ASTUnitPool &) LLVM_DELETED_FUNCTION;
+  void operator=(const ASTUnitPool &) LLVM_DELETED_FUNCTION;
+
+  /// \brief The state of one translation unit.
+  struct Unit {
+    Unit() : Failed(false) {}
+
+    /// \brief The AST, if it is resident.
+    std::unique_ptr<ASTUnit> AST;
+
+    /// \brief The position of the unit in \c Resident, if it is resident.
+    std::list<unsigned>::iterator Position;
+
+    /// \brief The temporary AST file the AST was saved to, if any.
+    std::string SavedFile;
+
+    /// \brief Whether building the AST failed.
+    bool Failed;
+  };
+
+  void evict(unsigned Index);
+
+  ClangTool &Tool;
+  unsigned MaxResidentASTs;
+  bool SaveEvictedASTs;
+  std::vector<Unit> Units;
+
+  /// \brief The indices of the resident units, most recently requested first.
+  std::list<unsigned> Resident;
+
+  unsigned NumBuilt;
+  unsigned NumReloaded;
+};
+
+} // end namespace tooling
+} // end namespace clang
+
+#endif // LLVM_CLANG_TOOLING_AST_UNIT_POOL_H
@@ -58,6 +58,13 @@ class ClangStripOutputAdjuster : public ArgumentsAdjuster {
   CommandLineArguments Adjust(const CommandLineArguments &Args) override;
 };
 
+/// \brief An argument adjuster which makes the frontend only preprocess the
+/// directives of the sources (-Eonly -fdeps-scan-only), as a dependency scan
+/// over sources minimized to their directives has to.
+class ClangDepsScanOnlyAdjuster : public ArgumentsAdjuster {
+  CommandLineArguments Adjust(const CommandLineArguments &Args) override;
+};
+
 } // end namespace tooling
 } // end namespace clang
 
@@ -0,0 +1,114 @@
+//===--- BinaryCompilationDatabase.h - ------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  The BinaryCompilationDatabase finds compilation databases supplied as a
+//  compile_commands.bin file in the build directory, a compact binary form of
+//  compile_commands.json which can be used without parsing it first.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLING_BINARY_COMPILATION_DATABASE_H
+#define LLVM_CLANG_TOOLING_BINARY_COMPILATION_DATABASE_H
+
+#include "clang/Basic/LLVM.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "clang/Tooling/FileMatchTrie.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Mutex.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace tooling {
+
+/// \brief A memory-mapped binary compilation database.
+///
+/// The file holds an on-disk hash table mapping the native absolute path of
+/// each source file to its compile commands. Loading it maps the file and
+/// checks that the lengths and offsets of the table stay within it; the
+/// commands of a file are decoded when they are requested, so a tool touching
+/// a few files of a huge database neither parses nor keeps in memory the rest
+/// of it.
+///
+/// Binary databases are written from any other compilation database with
+/// \c writeToFile, for example by the clang-compdb-convert tool. The
+/// compile_commands.bin of a build directory is tried before any other
+/// database in \c CompilationDatabase::loadFromDirectory, and is only loaded
+/// while it is newer than the compile_commands.json next to it.
+class BinaryCompilationDatabase : public CompilationDatabase {
+public:
+  ~BinaryCompilationDatabase();
+
+  /// \brief The name of the plugin which loads binary databases.
+  static const char *const PluginName;
+
+  /// \brief Loads a binary compilation database from the specified file.
+  ///
+  /// Returns NULL and sets ErrorMessage if the database could not be
+  /// loaded from the given file.
+  static BinaryCompilationDatabase *loadFromFile(StringRef FilePath,
+                                                 std::string &ErrorMessage);
+
+  /// \brief Loads the compile_commands.bin of \p BuildDirectory, unless it
+  /// is older than the compile_commands.json next to it.
+  ///
+  /// Returns NULL and sets ErrorMessage if there is no up-to-date binary
+  /// database in the directory.
+  static BinaryCompilationDatabase *
+  loadFromDirectory(StringRef BuildDirectory, std::string &ErrorMessage);
+
+  /// \brief Writes all compile commands of \p Database to \p FilePath as a
+  /// binary compilation database, atomically replacing the file.
+  ///
+  /// Returns false and sets ErrorMessage on failure.
+  static bool writeToFile(const CompilationDatabase &Database,
+                          StringRef FilePath, std::string &ErrorMessage);
+
+  /// \brief Returns all compile commands in which the specified file was
+  /// compiled.
+  ///
+  /// Exact matches are found with a single hash table lookup; only other
+  /// paths fall back to matching against every file in the database (see
+  /// \c FileMatchTrie).
+  std::vector<CompileCommand>
+  getCompileCommands(StringRef FilePath) const override;
+
+  /// \brief Returns the list of all files available in the compilation
+  /// database.
+  std::vector<std::string> getAllFiles() const override;
+
+  /// \brief Returns all compile commands for all the files in the compilation
+  /// database.
+  std::vector<CompileCommand> getAllCompileCommands() const override;
+
+private:
+  BinaryCompilationDatabase(std::unique_ptr<llvm::MemoryBuffer> Database,
+                            void *Table)
+    : Database(std::move(Database)), Table(Table) {}
+
+  std::unique_ptr<llvm::MemoryBuffer> Database;
+
+  /// \brief The on-disk hash table of compile commands in \c Database.
+  void *Table;
+
+  /// \brief Matches paths that are not in the database verbatim; built the
+  /// first time such a path is looked up.
+  mutable std::unique_ptr<FileMatchTrie> MatchTrie;
+
+  /// \brief Guards \c MatchTrie, so that tools may look up commands from
+  /// several threads.
+  mutable llvm::sys::Mutex MatchTrieLock;
+};
+
+} // end namespace tooling
+} // end namespace clang
+
+#endif // LLVM_CLANG_TOOLING_BINARY_COMPILATION_DATABASE_H
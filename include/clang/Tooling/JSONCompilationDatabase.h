@@ -21,8 +21,7 @@
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/MemoryBuffer.h"
-#include "llvm/Support/SourceMgr.h"
-#include "llvm/Support/YAMLParser.h"
+#include "llvm/Support/Mutex.h"
 #include <memory>
 #include <string>
 #include <vector>
@@ -47,6 +46,11 @@ namespace tooling {
 ///
 /// JSON compilation databases can for example be generated in CMake projects
 /// by setting the flag -DCMAKE_EXPORT_COMPILE_COMMANDS.
+///
+/// Loading a database makes a single pass over the file which only decodes
+/// the 'file' (and, for relative files, 'directory') entries to index the
+/// commands; command lines are decoded when the commands of a file are
+/// requested.
 class JSONCompilationDatabase : public CompilationDatabase {
 public:
   /// \brief Loads a JSON compilation database from the specified file.
@@ -82,7 +86,7 @@ public:
 private:
   /// \brief Constructs a JSON compilation database on a memory buffer.
   JSONCompilationDatabase(llvm::MemoryBuffer *Database)
-    : Database(Database), YAMLStream(Database->getBuffer(), SM) {}
+    : Database(Database) {}
 
   /// \brief Parses the database file and creates the index.
   ///
@@ -90,10 +94,9 @@ private:
   /// failed.
   bool parse(std::string &ErrorMessage);
 
-  // Tuple (directory, commandline) where 'commandline' pointing to the
-  // corresponding nodes in the YAML stream.
-  typedef std::pair<llvm::yaml::ScalarNode*,
-                    llvm::yaml::ScalarNode*> CompileCommandRef;
+  // Tuple (directory, commandline) where both are the still escaped contents
+  // of the corresponding JSON strings in the database buffer.
+  typedef std::pair<StringRef, StringRef> CompileCommandRef;
 
   /// \brief Converts the given array of CompileCommandRefs to CompileCommands.
   void getCommands(ArrayRef<CompileCommandRef> CommandsRef,
@@ -102,11 +105,15 @@ private:
   // Maps file paths to the compile command lines for that file.
   llvm::StringMap< std::vector<CompileCommandRef> > IndexByFile;
 
-  FileMatchTrie MatchTrie;
+  // Matches paths that are not in the index verbatim; built the first time
+  // such a path is looked up.
+  mutable std::unique_ptr<FileMatchTrie> MatchTrie;
+
+  /// \brief Guards \c MatchTrie, so that tools may look up commands from
+  /// several threads.
+  mutable llvm::sys::Mutex MatchTrieLock;
 
   std::unique_ptr<llvm::MemoryBuffer> Database;
-  llvm::SourceMgr SM;
-  llvm::yaml::Stream YAMLStream;
 };
 
 } // end namespace tooling
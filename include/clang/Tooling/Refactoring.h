@@ -180,6 +180,21 @@ unsigned shiftedCodePosition(const std::vector<Replacement> &Replaces,
 void deduplicate(std::vector<Replacement> &Replaces,
                  std::vector<Range> &Conflicts);
 
+/// \brief Applies all replacements in \p Replaces to the files on disk.
+///
+/// The replacements are grouped by file and deduplicated. A file whose
+/// replacements overlap is left unchanged and the conflicting replacements are
+/// reported to \p Errors. Every other file is read through \p Files (so
+/// relative paths are resolved against its working directory), rewritten
+/// independently of the others and without a \c SourceManager, and then
+/// atomically replaced. Up to \p Jobs files are processed in parallel; 0 means
+/// one per hardware thread.
+///
+/// \returns true if all replacements were applied and all files written.
+bool applyAllReplacementsToFiles(const Replacements &Replaces,
+                                 FileManager &Files, unsigned Jobs,
+                                 raw_ostream &Errors);
+
 /// \brief Collection of Replacements generated from a single translation unit.
 struct TranslationUnitReplacements {
   /// Name of the main source for the translation unit.
@@ -211,8 +226,12 @@ public:
   /// \brief Call run(), apply all generated replacements, and immediately save
   /// the results to disk.
   ///
+  /// The changed files are written by \c applyAllReplacementsToFiles, so
+  /// files with conflicting replacements are reported and left unchanged.
+  /// They are written one at a time unless \p Jobs asks for more threads.
+  ///
   /// \returns 0 upon success. Non-zero upon failure.
-  int runAndSave(FrontendActionFactory *ActionFactory);
+  int runAndSave(FrontendActionFactory *ActionFactory, unsigned Jobs = 1);
 
   /// \brief Apply all stored replacements to the given Rewriter.
   ///
@@ -222,10 +241,6 @@ public:
   /// \returns true if all replacements apply. false otherwise.
   bool applyAllReplacements(Rewriter &Rewrite);
 
-private:
-  /// \brief Write all refactored files to disk.
-  int saveRewrittenFiles(Rewriter &Rewrite);
-
 private:
   Replacements Replace;
 };
@@ -52,6 +52,7 @@ class Compilation;
 class CompilerInvocation;
 class SourceManager;
 class FrontendAction;
+class MinimizedSourceCache;
 
 namespace tooling {
 
@@ -277,31 +278,107 @@ class ClangTool {
   /// \brief Clear the command line arguments adjuster chain.
   void clearArgumentsAdjusters();
 
+  /// \brief Enables or disables sharing precompiled preambles between the
+  /// translation units processed by \c run.
+  ///
+  /// When enabled, the preamble of each main file (the leading run of
+  /// preprocessor directives, see \c Lexer::ComputePreamble) is compared
+  /// against the preambles of the translation units processed before it.
+  /// As soon as the same preamble text is seen a second time with the same
+  /// compilation flags, it is precompiled once and every later translation
+  /// unit sharing it skips parsing its headers again.
+  ///
+  /// Diagnostics in headers of a shared preamble are only reported for the
+  /// translation units that did not use the precompiled preamble.
+  /// Disabled by default.
+  void setReusePreambles(bool Reuse) { ReusePreambles = Reuse; }
+
+  /// \brief Makes the translation units processed by \c run see their source
+  /// files reduced to the preprocessor directives, through a
+  /// \c MinimizingFileSystem over \p Cache.
+  ///
+  /// This is meant for scanning dependencies with -fdeps-scan-only, which
+  /// ignores everything but the directives: each file is minimized once in
+  /// \p Cache, which may be shared by several tools, and every translation
+  /// unit including it after that only reads its directives. The command
+  /// lines are adjusted to only preprocess the directives (see
+  /// \c ClangDepsScanOnlyAdjuster), so actions which need the rest of the
+  /// sources must not use it. A null \p Cache restores the real file system
+  /// and the command lines.
+  void setMinimizedSourceCache(IntrusiveRefCntPtr<MinimizedSourceCache> Cache);
+
   /// Runs an action over all files specified in the command line.
   ///
   /// \param Action Tool action.
   int run(ToolAction *Action);
 
+  /// \brief Runs an action over all files specified in the command line,
+  /// using up to \p Jobs worker threads.
+  ///
+  /// Unlike the serial \c run, this never changes the process working
+  /// directory: every translation unit gets its own \c FileManager whose
+  /// working directory is the compile command's directory. \p Action must be
+  /// safe to call from several threads at once.
+  ///
+  /// If no diagnostic consumer was set, the diagnostics of each translation
+  /// unit are buffered and printed in the order of the compile commands, so
+  /// the output does not depend on scheduling. A consumer installed with
+  /// \c setDiagnosticConsumer is called concurrently and must be thread-safe.
+  ///
+  /// \param Action Tool action.
+  /// \param Jobs Number of worker threads; 0 means one per hardware thread.
+  int run(ToolAction *Action, unsigned Jobs);
+
   /// \brief Create an AST for each file specified in the command line and
   /// append them to ASTs.
   int buildASTs(std::vector<std::unique_ptr<ASTUnit>> &ASTs);
 
+  /// \brief Create an AST for the translation unit of the compile command
+  /// at \p Index.
+  ///
+  /// Returns null if the AST could not be built. See \c ASTUnitPool for
+  /// working through the ASTs of many files without keeping all of them in
+  /// memory.
+  std::unique_ptr<ASTUnit> buildAST(unsigned Index);
+
+  /// \brief Returns the number of compile commands, that is of translation
+  /// units, processed by \c run.
+  unsigned getNumCompileCommands() const { return CompileCommands.size(); }
+
+  /// \brief Returns the source file of the compile command at \p Index.
+  StringRef getCompileCommandFile(unsigned Index) const {
+    return CompileCommands[Index].first;
+  }
+
   /// \brief Returns the file manager used in the tool.
   ///
   /// The file manager is shared between all translation units.
   FileManager &getFiles() { return *Files; }
 
  private:
+  /// \brief Runs \p Action over the compile command at \p Index, reporting
+  /// failures on stderr.
+  bool runCompileCommand(ToolAction *Action, unsigned Index,
+                         StringRef MainExecutable);
+
   // We store compile commands as pair (file name, compile command).
   std::vector< std::pair<std::string, CompileCommand> > CompileCommands;
 
   llvm::IntrusiveRefCntPtr<FileManager> Files;
+  /// \brief The file system of the translation units, or null for the real
+  /// one.
+  llvm::IntrusiveRefCntPtr<vfs::FileSystem> SourceFS;
+  /// \brief Applied after \c ArgsAdjusters while the sources are minimized,
+  /// so that the translation units only scan their directives.
+  std::unique_ptr<ArgumentsAdjuster> MinimizedSourceAdjuster;
   // Contains a list of pairs (<file name>, <file content>).
   std::vector< std::pair<StringRef, StringRef> > MappedFileContents;
 
   SmallVector<ArgumentsAdjuster *, 2> ArgsAdjusters;
 
   DiagnosticConsumer *DiagConsumer;
+
+  bool ReusePreambles;
 };
 
 template <typename T>
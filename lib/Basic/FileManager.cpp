@@ -55,6 +55,9 @@ FileManager::FileManager(const FileSystemOptions &FSO,
   // file system.
   if (!FS)
     this->FS = vfs::getRealFileSystem();
+
+  if (!FSO.StatCacheFile.empty())
+    setSharedStatCacheFile(FSO.StatCacheFile);
 }
 
 FileManager::~FileManager() {
@@ -101,6 +104,24 @@ void FileManager::removeStatCache(FileSystemStatCache *statCache) {
 
 void FileManager::clearStatCaches() {
   StatCache.reset(nullptr);
+  SharedStats = nullptr;
+  SharedStatsFile.clear();
+}
+
+void FileManager::setSharedStatCacheFile(StringRef Path) {
+  if (SharedStats && SharedStatsFile == Path)
+    return;
+
+  IntrusiveRefCntPtr<SharedStatCache> Cache = SharedStatCache::getForFile(Path);
+  addStatCache(new SharedStatCacheClient(Cache));
+  SharedStats = Cache;
+  SharedStatsFile = Path;
+}
+
+bool FileManager::saveSharedStatCache(std::string &ErrorStr) {
+  if (!SharedStats)
+    return true;
+  return SharedStats->writeToFile(SharedStatsFile, ErrorStr);
 }
 
 /// \brief Retrieve the directory that the given file name resides in.
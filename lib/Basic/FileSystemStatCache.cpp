@@ -13,7 +13,16 @@
 
 #include "clang/Basic/FileSystemStatCache.h"
 #include "clang/Basic/VirtualFileSystem.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/OnDiskHashTable.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 
 // FIXME: This is terrible, we need this for ::close.
 #if !defined(_MSC_VER) && !defined(__MINGW32__)
@@ -136,3 +145,524 @@ MemorizeStatCalls::getStat(const char *Path, FileData &Data, bool isFile,
 
   return Result;
 }
+
+/// Stat \p Path into \p Data, opening it first if \p F is non-null.
+///
+/// \returns true if the path exists.
+static bool statPath(StringRef Path, FileData &Data,
+                     std::unique_ptr<vfs::File> *F, vfs::FileSystem &FS) {
+  if (F) {
+    std::unique_ptr<vfs::File> OwnedFile;
+    std::error_code EC = FS.openFileForRead(Path, OwnedFile);
+    if (!EC) {
+      llvm::ErrorOr<vfs::Status> Status = OwnedFile->status();
+      if (Status) {
+        copyStatusToFileData(*Status, Data);
+        *F = std::move(OwnedFile);
+        return true;
+      }
+    } else if (EC == std::errc::no_such_file_or_directory) {
+      return false;
+    }
+    // Fall back to a plain stat; the path may not be readable as a file.
+  }
+
+  llvm::ErrorOr<vfs::Status> Status = FS.status(Path);
+  if (!Status)
+    return false;
+  copyStatusToFileData(*Status, Data);
+  return true;
+}
+
+/// Marks a missing path whose parent state can't be used to revalidate it.
+static const time_t UnknownParentModTime = -1;
+
+//----------------------------------------------------------------------------//
+// On-disk stat cache format.
+//----------------------------------------------------------------------------//
+//
+// A stat cache file holds a header followed by an on-disk chained hash table
+// mapping absolute paths to the parent directory state that proves them
+// missing. Only such results are persisted: everything else costs a stat to
+// revalidate anyway.
+//
+//   uint32_t Magic;          // 'CSTC'
+//   uint32_t Version;
+//   uint32_t BucketOffset;   // of the hash table, from the start of the file
+//   <hash table payload and buckets>
+
+static const char StatCacheMagic[] = { 'C', 'S', 'T', 'C' };
+static const unsigned StatCacheVersion = 1;
+static const unsigned StatCacheHeaderSize = 12;
+
+namespace {
+
+/// \brief Persisted data for a missing path.
+struct OnDiskStatData {
+  bool ParentExists;
+  uint64_t ParentModTime;
+  uint64_t ParentFile;
+  uint64_t ParentDevice;
+};
+
+/// \brief Trait used to read the stat cache from the on-disk hash table.
+class OnDiskStatCacheReaderTrait {
+public:
+  typedef StringRef external_key_type;
+  typedef StringRef internal_key_type;
+  typedef OnDiskStatData data_type;
+  typedef unsigned hash_value_type;
+  typedef unsigned offset_type;
+
+  static bool EqualKey(const internal_key_type& a, const internal_key_type& b) {
+    return a == b;
+  }
+
+  static hash_value_type ComputeHash(const internal_key_type& a) {
+    return llvm::HashString(a);
+  }
+
+  static std::pair<unsigned, unsigned>
+  ReadKeyDataLength(const unsigned char*& d) {
+    using namespace llvm::support;
+    unsigned KeyLen = endian::readNext<uint16_t, little, unaligned>(d);
+    unsigned DataLen = endian::readNext<uint8_t, little, unaligned>(d);
+    return std::make_pair(KeyLen, DataLen);
+  }
+
+  static const internal_key_type&
+  GetInternalKey(const external_key_type& x) { return x; }
+
+  static const external_key_type&
+  GetExternalKey(const internal_key_type& x) { return x; }
+
+  static internal_key_type ReadKey(const unsigned char* d, unsigned n) {
+    return StringRef((const char *)d, n);
+  }
+
+  static data_type ReadData(const internal_key_type& k,
+                            const unsigned char* d,
+                            unsigned DataLen) {
+    using namespace llvm::support;
+    data_type Result;
+    Result.ParentExists = endian::readNext<uint8_t, little, unaligned>(d);
+    Result.ParentModTime = endian::readNext<uint64_t, little, unaligned>(d);
+    Result.ParentFile = endian::readNext<uint64_t, little, unaligned>(d);
+    Result.ParentDevice = endian::readNext<uint64_t, little, unaligned>(d);
+    return Result;
+  }
+};
+
+typedef llvm::OnDiskIterableChainedHashTable<OnDiskStatCacheReaderTrait>
+    OnDiskStatCacheTable;
+
+/// \brief Trait used to write the stat cache as an on-disk hash table.
+class OnDiskStatCacheWriterTrait {
+public:
+  typedef StringRef key_type;
+  typedef StringRef key_type_ref;
+  typedef OnDiskStatData data_type;
+  typedef const OnDiskStatData &data_type_ref;
+  typedef unsigned hash_value_type;
+  typedef unsigned offset_type;
+
+  static hash_value_type ComputeHash(key_type_ref Key) {
+    return llvm::HashString(Key);
+  }
+
+  std::pair<unsigned,unsigned>
+  EmitKeyDataLength(raw_ostream& Out, key_type_ref Key, data_type_ref Data) {
+    using namespace llvm::support;
+    endian::Writer<little> LE(Out);
+    unsigned KeyLen = Key.size();
+    unsigned DataLen = 1 + 3 * 8;
+    LE.write<uint16_t>(KeyLen);
+    LE.write<uint8_t>(DataLen);
+    return std::make_pair(KeyLen, DataLen);
+  }
+
+  void EmitKey(raw_ostream& Out, key_type_ref Key, unsigned KeyLen) {
+    Out.write(Key.data(), KeyLen);
+  }
+
+  void EmitData(raw_ostream& Out, key_type_ref Key, data_type_ref Data,
+                unsigned DataLen) {
+    using namespace llvm::support;
+    endian::Writer<little> LE(Out);
+    LE.write<uint8_t>(Data.ParentExists);
+    LE.write<uint64_t>(Data.ParentModTime);
+    LE.write<uint64_t>(Data.ParentFile);
+    LE.write<uint64_t>(Data.ParentDevice);
+  }
+};
+
+/// \brief The process-wide caches handed out by SharedStatCache::getForFile.
+///
+/// Each cache is written back to its file once, when the process exits,
+/// rather than by every compilation using it.
+struct StatCacheRegistry {
+  llvm::sys::Mutex Lock;
+  llvm::StringMap<IntrusiveRefCntPtr<SharedStatCache> > Caches;
+
+  ~StatCacheRegistry() { saveAll(); }
+
+  void saveAll() {
+    llvm::sys::ScopedLock Guard(Lock);
+    for (auto I = Caches.begin(), E = Caches.end(); I != E; ++I) {
+      std::string ErrorStr;
+      I->second->saveIfModified(I->first(), ErrorStr);
+    }
+  }
+};
+
+} // end anonymous namespace
+
+static llvm::ManagedStatic<StatCacheRegistry> StatCaches;
+
+/// \brief Save the caches of processes that exit without llvm_shutdown().
+static void saveStatCachesAtExit() {
+  if (StatCaches.isConstructed())
+    StatCaches->saveAll();
+}
+
+/// \brief Check the header of the stat cache file in \p Buf and create the
+/// on-disk hash table it holds.
+///
+/// \returns the table, or null with \p ErrorStr set if \p Buf is not a
+/// usable stat cache file.
+static OnDiskStatCacheTable *createStatCacheTable(const llvm::MemoryBuffer &Buf,
+                                                  std::string &ErrorStr) {
+  const unsigned char *Start = (const unsigned char *)Buf.getBufferStart();
+  const unsigned char *Data = Start;
+  size_t Size = Buf.getBufferSize();
+  if (Size < StatCacheHeaderSize ||
+      memcmp(Data, StatCacheMagic, sizeof(StatCacheMagic)) != 0) {
+    ErrorStr = "not a stat cache file";
+    return nullptr;
+  }
+  Data += sizeof(StatCacheMagic);
+
+  using namespace llvm::support;
+  if (endian::readNext<uint32_t, little, unaligned>(Data) !=
+      StatCacheVersion) {
+    ErrorStr = "stat cache file has a different version";
+    return nullptr;
+  }
+  uint32_t BucketOffset = endian::readNext<uint32_t, little, unaligned>(Data);
+  if (BucketOffset < StatCacheHeaderSize || BucketOffset >= Size ||
+      BucketOffset % sizeof(uint32_t) != 0) {
+    ErrorStr = "malformed stat cache file";
+    return nullptr;
+  }
+
+  return OnDiskStatCacheTable::Create(Start + BucketOffset, Data, Start,
+                                      OnDiskStatCacheReaderTrait());
+}
+
+SharedStatCache::SharedStatCache()
+  : Generation(1), OnDiskTable(nullptr), Modified(false), NumLookups(0),
+    NumHits(0), NumMissesValidatedByParent(0), NumImported(0) {}
+
+SharedStatCache::~SharedStatCache() {
+  delete static_cast<OnDiskStatCacheTable *>(OnDiskTable);
+}
+
+IntrusiveRefCntPtr<SharedStatCache>
+SharedStatCache::getForFile(StringRef Path) {
+  llvm::sys::ScopedLock Guard(StatCaches->Lock);
+  static bool RegisteredAtExit = false;
+  if (!RegisteredAtExit) {
+    std::atexit(saveStatCachesAtExit);
+    RegisteredAtExit = true;
+  }
+
+  IntrusiveRefCntPtr<SharedStatCache> &Cache = StatCaches->Caches[Path];
+  if (!Cache) {
+    Cache = new SharedStatCache();
+    std::string ErrorStr;
+    Cache->readFromFile(Path, ErrorStr);
+  }
+  return Cache;
+}
+
+bool SharedStatCache::readFromFile(StringRef Path, std::string &ErrorStr) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> BufferOrErr =
+      llvm::MemoryBuffer::getFile(Path, /*FileSize=*/-1,
+                                  /*RequiresNullTerminator=*/false);
+  if (!BufferOrErr) {
+    ErrorStr = BufferOrErr.getError().message();
+    return false;
+  }
+
+  std::unique_ptr<llvm::MemoryBuffer> NewBuffer = std::move(*BufferOrErr);
+  OnDiskStatCacheTable *Table = createStatCacheTable(*NewBuffer, ErrorStr);
+  if (!Table)
+    return false;
+
+  llvm::sys::ScopedLock Guard(Lock);
+  delete static_cast<OnDiskStatCacheTable *>(OnDiskTable);
+  OnDiskTable = Table;
+  Buffer = std::move(NewBuffer);
+  return true;
+}
+
+/// \brief Convert a persisted result into an (unvalidated) cache entry.
+static void importEntry(const OnDiskStatData &Data,
+                        SharedStatCache::Entry &E) {
+  E.Known = true;
+  E.Exists = false;
+  E.ParentExists = Data.ParentExists;
+  E.ParentModTime = Data.ParentModTime;
+  E.ParentID = llvm::sys::fs::UniqueID(Data.ParentDevice, Data.ParentFile);
+  E.Generation = 0;
+}
+
+/// \brief Whether \p E holds a result that a later process can revalidate.
+static bool isPersistable(const SharedStatCache::Entry &E) {
+  return E.Known && !E.Exists && E.ParentModTime != UnknownParentModTime;
+}
+
+/// \brief Add the results of \p Table whose paths are not in \p Written yet.
+static void
+addUnwrittenResults(OnDiskStatCacheTable &Table, llvm::StringSet<> &Written,
+    llvm::OnDiskChainedHashTableGenerator<OnDiskStatCacheWriterTrait> &Gen,
+    OnDiskStatCacheWriterTrait &Trait) {
+  for (auto I = Table.key_begin(), E = Table.key_end(); I != E; ++I) {
+    StringRef Key = *I;
+    if (Written.insert(Key))
+      Gen.insert(Key, *Table.find(Key), Trait);
+  }
+}
+
+bool SharedStatCache::writeToFile(StringRef Path, std::string &ErrorStr) const {
+  llvm::OnDiskChainedHashTableGenerator<OnDiskStatCacheWriterTrait> Generator;
+  OnDiskStatCacheWriterTrait Trait;
+  llvm::StringSet<> Written;
+
+  // Another process may have saved its own results since this cache was
+  // loaded; merge them in rather than dropping them.
+  std::unique_ptr<llvm::MemoryBuffer> Existing;
+  std::unique_ptr<OnDiskStatCacheTable> ExistingTable;
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> ExistingOrErr =
+      llvm::MemoryBuffer::getFile(Path, /*FileSize=*/-1,
+                                  /*RequiresNullTerminator=*/false);
+  if (ExistingOrErr) {
+    Existing = std::move(*ExistingOrErr);
+    std::string IgnoredError;
+    ExistingTable.reset(createStatCacheTable(*Existing, IgnoredError));
+  }
+
+  SmallString<4096> Contents;
+  {
+    llvm::sys::ScopedLock Guard(Lock);
+    for (auto I = Entries.begin(), E = Entries.end(); I != E; ++I) {
+      const Entry &Ent = I->second;
+      // Results looked up by this process supersede the persisted ones, even
+      // when they cannot be persisted themselves.
+      Written.insert(I->first());
+      if (!isPersistable(Ent))
+        continue;
+      OnDiskStatData Data;
+      Data.ParentExists = Ent.ParentExists;
+      Data.ParentModTime = Ent.ParentModTime;
+      Data.ParentFile = Ent.ParentID.getFile();
+      Data.ParentDevice = Ent.ParentID.getDevice();
+      Generator.insert(I->first(), Data, Trait);
+    }
+
+    // Keep the results loaded from disk that were never looked up.
+    if (OnDiskTable)
+      addUnwrittenResults(*static_cast<OnDiskStatCacheTable *>(OnDiskTable),
+                          Written, Generator, Trait);
+    if (ExistingTable)
+      addUnwrittenResults(*ExistingTable, Written, Generator, Trait);
+
+    using namespace llvm::support;
+    llvm::raw_svector_ostream Out(Contents);
+    Out.write(StatCacheMagic, sizeof(StatCacheMagic));
+    endian::Writer<little>(Out).write<uint32_t>(StatCacheVersion);
+    endian::Writer<little>(Out).write<uint32_t>(0);
+    uint32_t BucketOffset = Generator.Emit(Out, Trait);
+    Out.flush();
+    endian::write<uint32_t, little, unaligned>(&Contents[8], BucketOffset);
+  }
+
+  // Write the cache to a temporary file and move it into place, so that
+  // processes reading the cache never see a partial file.
+  SmallString<128> TmpPath;
+  int TmpFD;
+  if (std::error_code EC =
+          llvm::sys::fs::createUniqueFile(Path + "-%%%%%%%%", TmpFD, TmpPath)) {
+    ErrorStr = EC.message();
+    return false;
+  }
+
+  {
+    llvm::raw_fd_ostream Out(TmpFD, true);
+    Out.write(Contents.data(), Contents.size());
+    Out.close();
+    if (Out.has_error()) {
+      Out.clear_error();
+      llvm::sys::fs::remove(TmpPath.str());
+      ErrorStr = "could not write stat cache file";
+      return false;
+    }
+  }
+
+  if (std::error_code EC = llvm::sys::fs::rename(TmpPath.str(), Path)) {
+    llvm::sys::fs::remove(TmpPath.str());
+    ErrorStr = EC.message();
+    return false;
+  }
+  return true;
+}
+
+bool SharedStatCache::saveIfModified(StringRef Path, std::string &ErrorStr) {
+  {
+    llvm::sys::ScopedLock Guard(Lock);
+    if (!Modified)
+      return true;
+    Modified = false;
+  }
+  return writeToFile(Path, ErrorStr);
+}
+
+SharedStatCache::Entry SharedStatCache::getEntry(StringRef Path) {
+  Entry &E = Entries[Path];
+  if (!E.Known && OnDiskTable) {
+    OnDiskStatCacheTable *Table =
+        static_cast<OnDiskStatCacheTable *>(OnDiskTable);
+    OnDiskStatCacheTable::iterator Pos = Table->find(Path);
+    if (Pos != Table->end()) {
+      importEntry(*Pos, E);
+      ++NumImported;
+    }
+  }
+  return E;
+}
+
+void SharedStatCache::storeEntry(StringRef Path, const Entry &E) {
+  llvm::sys::ScopedLock Guard(Lock);
+  Entry &Old = Entries[Path];
+  if (isPersistable(E) &&
+      (!isPersistable(Old) || Old.ParentExists != E.ParentExists ||
+       Old.ParentModTime != E.ParentModTime || Old.ParentID != E.ParentID))
+    Modified = true;
+  Old = E;
+}
+
+SharedStatCache::Entry
+SharedStatCache::lookupEntry(StringRef Path, std::unique_ptr<vfs::File> *F,
+                             vfs::FileSystem &FS) {
+  // Only copy the entry out under the lock; the stat and open calls below
+  // must not serialize the compilations sharing this cache.
+  Entry E;
+  unsigned CurGeneration;
+  {
+    llvm::sys::ScopedLock Guard(Lock);
+    ++NumLookups;
+    E = getEntry(Path);
+    CurGeneration = Generation;
+    if (E.Generation == CurGeneration)
+      ++NumHits;
+  }
+
+  if (E.Generation == CurGeneration) {
+    // The client wants the file opened, which also refreshes its stat data.
+    if (E.Exists && F && !E.Data.IsDirectory) {
+      if (!statPath(Path, E.Data, F, FS)) {
+        E.Exists = false;
+        E.ParentModTime = UnknownParentModTime;
+      }
+      storeEntry(Path, E);
+    }
+    return E;
+  }
+
+  StringRef Parent = llvm::sys::path::parent_path(Path);
+
+  // A path that was missing is still missing as long as its parent directory
+  // has not been modified (or is still missing itself).
+  if (E.Known && !E.Exists && !Parent.empty() &&
+      E.ParentModTime != UnknownParentModTime) {
+    Entry P = lookupEntry(Parent, nullptr, FS);
+    if (P.Exists == E.ParentExists &&
+        (!P.Exists || (P.Data.IsDirectory &&
+                       P.Data.ModTime == E.ParentModTime &&
+                       P.Data.UniqueID == E.ParentID))) {
+      E.Generation = CurGeneration;
+      storeEntry(Path, E);
+      llvm::sys::ScopedLock Guard(Lock);
+      ++NumMissesValidatedByParent;
+      return E;
+    }
+  }
+
+  E.Known = true;
+  E.Generation = CurGeneration;
+  E.Exists = statPath(Path, E.Data, F, FS);
+  E.ParentModTime = UnknownParentModTime;
+  if (!E.Exists && !Parent.empty()) {
+    // Remember the parent directory's state to revalidate the missing path.
+    Entry P = lookupEntry(Parent, nullptr, FS);
+    E.ParentExists = P.Exists;
+    if (!P.Exists) {
+      E.ParentModTime = 0;
+    } else if (P.Data.IsDirectory &&
+               P.Data.ModTime + 1 < std::time(nullptr)) {
+      // Only trust modification times older than their one second
+      // granularity; the directory may change again without its
+      // modification time changing.
+      E.ParentModTime = P.Data.ModTime;
+      E.ParentID = P.Data.UniqueID;
+    }
+  }
+  storeEntry(Path, E);
+  return E;
+}
+
+void SharedStatCache::startGeneration() {
+  llvm::sys::ScopedLock Guard(Lock);
+  ++Generation;
+}
+
+FileSystemStatCache::LookupResult
+SharedStatCache::getStat(const char *Path, FileData &Data, bool isFile,
+                         std::unique_ptr<vfs::File> *F, vfs::FileSystem &FS) {
+  Entry E = lookupEntry(Path, isFile ? F : nullptr, FS);
+  if (!E.Exists)
+    return FileSystemStatCache::CacheMissing;
+  Data = E.Data;
+  return FileSystemStatCache::CacheExists;
+}
+
+void SharedStatCache::clear() {
+  llvm::sys::ScopedLock Guard(Lock);
+  Entries.clear();
+  delete static_cast<OnDiskStatCacheTable *>(OnDiskTable);
+  OnDiskTable = nullptr;
+  Buffer.reset();
+}
+
+void SharedStatCache::PrintStats() const {
+  llvm::sys::ScopedLock Guard(Lock);
+  llvm::errs() << "\n*** Shared Stat Cache Stats:\n";
+  llvm::errs() << Entries.size() << " paths cached, generation "
+               << Generation << ".\n";
+  llvm::errs() << NumLookups << " lookups, " << NumHits << " cache hits, "
+               << NumMissesValidatedByParent
+               << " missing paths revalidated by their parent, "
+               << NumImported << " results loaded from disk.\n";
+}
+
+SharedStatCacheClient::LookupResult
+SharedStatCacheClient::getStat(const char *Path, FileData &Data, bool isFile,
+                               std::unique_ptr<vfs::File> *F,
+                               vfs::FileSystem &FS) {
+  // Relative paths and virtual file systems may resolve differently in
+  // another compilation.
+  if (!llvm::sys::path::is_absolute(Path) ||
+      &FS != vfs::getRealFileSystem().get())
+    return statChained(Path, Data, isFile, F, FS);
+  return Cache->getStat(Path, Data, isFile, F, FS);
+}
@@ -22,6 +22,7 @@
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
 #include <cstdio>
+#include <cstring>
 
 using namespace clang;
 
@@ -75,7 +76,7 @@ ExternalIdentifierLookup::~ExternalIdentifierLookup() {}
 IdentifierTable::IdentifierTable(const LangOptions &LangOpts,
                                  IdentifierInfoLookup* externalLookup)
   : HashTable(8192), // Start with space for 8K identifiers.
-    ExternalLookup(externalLookup) {
+    NumExternalIdentifiers(0), ExternalLookup(externalLookup) {
 
   // Populate the identifier table with info about keywords for the current
   // language.
@@ -86,6 +87,17 @@ IdentifierTable::IdentifierTable(const LangOptions &LangOpts,
   get("import").setModulesImport(true);
 }
 
+IdentifierInfo &IdentifierTable::createExternal(const char *NameStart) {
+  // getNameStart() and getLength() find the spelling after the identifier.
+  typedef std::pair<IdentifierInfo, const char *> ExternalIdentifier;
+  ExternalIdentifier *Mem = ExternalAllocator.Allocate<ExternalIdentifier>();
+  Mem->second = NameStart;
+  IdentifierInfo *II = new ((void *) Mem) IdentifierInfo();
+  ++NumExternalIdentifiers;
+  assert(II->getLength() == strlen(NameStart) && "Spelling length mismatch");
+  return *II;
+}
+
 //===----------------------------------------------------------------------===//
 // Language Keyword Implementation
 //===----------------------------------------------------------------------===//
@@ -280,6 +292,8 @@ void IdentifierTable::PrintStats() const {
   fprintf(stderr, "Ave identifier length: %f\n",
           (AverageIdentifierSize/(double)NumIdentifiers));
   fprintf(stderr, "Max identifier length: %d\n", MaxIdentifierLength);
+  fprintf(stderr, "# Identifiers with external spellings: %d\n",
+          NumExternalIdentifiers);
 
   // Compute statistics about the memory allocated for identifiers.
   HashTable.getAllocator().PrintStats();
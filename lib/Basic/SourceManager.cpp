@@ -81,6 +81,23 @@ void ContentCache::replaceBuffer(llvm::MemoryBuffer *B, bool DoNotFree) {
   Buffer.setInt(DoNotFree? DoNotFreeFlag : 0);
 }
 
+/// \brief Returns the name of the byte order mark \p BufStr starts with, if
+/// it is one of an encoding other than UTF-8.
+static const char *getUnsupportedBOMName(StringRef BufStr) {
+  return llvm::StringSwitch<const char *>(BufStr)
+    .StartsWith("\xFE\xFF", "UTF-16 (BE)")
+    .StartsWith("\xFF\xFE", "UTF-16 (LE)")
+    .StartsWith("\x00\x00\xFE\xFF", "UTF-32 (BE)")
+    .StartsWith("\xFF\xFE\x00\x00", "UTF-32 (LE)")
+    .StartsWith("\x2B\x2F\x76", "UTF-7")
+    .StartsWith("\xF7\x64\x4C", "UTF-1")
+    .StartsWith("\xDD\x73\x66\x73", "UTF-EBCDIC")
+    .StartsWith("\x0E\xFE\xFF", "SDSU")
+    .StartsWith("\xFB\xEE\x28", "BOCU-1")
+    .StartsWith("\x84\x31\x95\x33", "GB-18030")
+    .Default(nullptr);
+}
+
 llvm::MemoryBuffer *ContentCache::getBuffer(DiagnosticsEngine &Diag,
                                             const SourceManager &SM,
                                             SourceLocation Loc,
@@ -149,19 +166,8 @@ llvm::MemoryBuffer *ContentCache::getBuffer(DiagnosticsEngine &Diag,
   // If the buffer is valid, check to see if it has a UTF Byte Order Mark
   // (BOM).  We only support UTF-8 with and without a BOM right now.  See
   // http://en.wikipedia.org/wiki/Byte_order_mark for more information.
-  StringRef BufStr = Buffer.getPointer()->getBuffer();
-  const char *InvalidBOM = llvm::StringSwitch<const char *>(BufStr)
-    .StartsWith("\xFE\xFF", "UTF-16 (BE)")
-    .StartsWith("\xFF\xFE", "UTF-16 (LE)")
-    .StartsWith("\x00\x00\xFE\xFF", "UTF-32 (BE)")
-    .StartsWith("\xFF\xFE\x00\x00", "UTF-32 (LE)")
-    .StartsWith("\x2B\x2F\x76", "UTF-7")
-    .StartsWith("\xF7\x64\x4C", "UTF-1")
-    .StartsWith("\xDD\x73\x66\x73", "UTF-EBCDIC")
-    .StartsWith("\x0E\xFE\xFF", "SDSU")
-    .StartsWith("\xFB\xEE\x28", "BOCU-1")
-    .StartsWith("\x84\x31\x95\x33", "GB-18030")
-    .Default(nullptr);
+  const char *InvalidBOM =
+      getUnsupportedBOMName(Buffer.getPointer()->getBuffer());
 
   if (InvalidBOM) {
     Diag.Report(Loc, diag::err_unsupported_bom)
@@ -373,7 +379,8 @@ SourceManager::SourceManager(DiagnosticsEngine &Diag, FileManager &FileMgr,
   : Diag(Diag), FileMgr(FileMgr), OverridenFilesKeepOriginalName(true),
     UserFilesAreVolatile(UserFilesAreVolatile),
     ExternalSLocEntries(nullptr), LineTable(nullptr), NumLinearScans(0),
-    NumBinaryProbes(0), FakeBufferForRecovery(nullptr),
+    NumBinaryProbes(0), NumRecentLookupHits(0), NumFoldedExpansionLocs(0),
+    FakeBufferForRecovery(nullptr),
     FakeContentCacheForRecovery(nullptr) {
   clearIDTables();
   Diag.setSourceManager(this);
@@ -408,11 +415,14 @@ SourceManager::~SourceManager() {
 void SourceManager::clearIDTables() {
   MainFileID = FileID();
   LocalSLocEntryTable.clear();
+  LocalSLocEntryOffsets.clear();
   LoadedSLocEntryTable.clear();
   SLocEntryLoaded.clear();
   LastLineNoFileIDQuery = FileID();
   LastLineNoContentCache = nullptr;
   LastFileIDLookup = FileID();
+  std::fill(std::begin(RecentFileIDLookups), std::end(RecentFileIDLookups),
+            FileID());
 
   if (LineTable)
     LineTable->clear();
@@ -584,6 +594,7 @@ FileID SourceManager::createFileID(const ContentCache *File,
   LocalSLocEntryTable.push_back(SLocEntry::get(NextLocalOffset,
                                                FileInfo::get(IncludePos, File,
                                                              FileCharacter)));
+  LocalSLocEntryOffsets.push_back(NextLocalOffset);
   unsigned FileSize = File->getSize();
   assert(NextLocalOffset + FileSize + 1 > NextLocalOffset &&
          NextLocalOffset + FileSize + 1 <= CurrentLoadedOffset &&
@@ -619,6 +630,31 @@ SourceManager::createExpansionLoc(SourceLocation SpellingLoc,
   return createExpansionLocImpl(Info, TokLength, LoadedID, LoadedOffset);
 }
 
+SourceLocation
+SourceManager::createLexedExpansionLoc(SourceLocation SpellingLoc,
+                                       SourceLocation ExpansionLocStart,
+                                       SourceLocation ExpansionLocEnd,
+                                       unsigned TokLength) {
+  ExpansionInfo Info = ExpansionInfo::create(SpellingLoc, ExpansionLocStart,
+                                             ExpansionLocEnd);
+
+  // Tokens lexed one at a time from the same text into the same expansion,
+  // such as the tokens of a _Pragma string, would each get an SLocEntry of
+  // their own. If the previous entry expands the text just before this token
+  // to the same range, extend it to cover the token instead, skipping the few
+  // characters in between.
+  if (unsigned Offset = getFoldedExpansionOffset(Info)) {
+    ++NumFoldedExpansionLocs;
+    assert(Offset + TokLength + 1 > Offset &&
+           Offset + TokLength + 1 <= CurrentLoadedOffset &&
+           "Ran out of source locations!");
+    NextLocalOffset = Offset + TokLength + 1;
+    return SourceLocation::getMacroLoc(Offset);
+  }
+
+  return createExpansionLocImpl(Info, TokLength);
+}
+
 SourceLocation
 SourceManager::createExpansionLocImpl(const ExpansionInfo &Info,
                                       unsigned TokLength,
@@ -633,7 +669,9 @@ SourceManager::createExpansionLocImpl(const ExpansionInfo &Info,
     SLocEntryLoaded[Index] = true;
     return SourceLocation::getMacroLoc(LoadedOffset);
   }
+
   LocalSLocEntryTable.push_back(SLocEntry::get(NextLocalOffset, Info));
+  LocalSLocEntryOffsets.push_back(NextLocalOffset);
   assert(NextLocalOffset + TokLength + 1 > NextLocalOffset &&
          NextLocalOffset + TokLength + 1 <= CurrentLoadedOffset &&
          "Ran out of source locations!");
@@ -642,6 +680,41 @@ SourceManager::createExpansionLocImpl(const ExpansionInfo &Info,
   return SourceLocation::getMacroLoc(NextLocalOffset - (TokLength + 1));
 }
 
+/// \brief The largest number of characters skipped when an expansion
+/// SLocEntry is extended to a following token.
+static const unsigned MaxFoldedExpansionGap = 8;
+
+unsigned
+SourceManager::getFoldedExpansionOffset(const ExpansionInfo &Info) const {
+  SourceLocation SpellingLoc = Info.getSpellingLoc();
+  // Macro argument expansions are already grouped by the TokenLexer, and
+  // their boundaries matter to the macro argument cache.
+  if (Info.isMacroArgExpansion() || SpellingLoc.isInvalid() ||
+      !SpellingLoc.isFileID() || LocalSLocEntryTable.size() < 2)
+    return 0;
+
+  const SLocEntry &Prev = LocalSLocEntryTable.back();
+  if (!Prev.isExpansion())
+    return 0;
+  const ExpansionInfo &PrevInfo = Prev.getExpansion();
+  if (PrevInfo.isMacroArgExpansion() ||
+      !PrevInfo.getSpellingLoc().isFileID() ||
+      PrevInfo.getExpansionLocStart() != Info.getExpansionLocStart() ||
+      PrevInfo.getExpansionLocEnd() != Info.getExpansionLocEnd())
+    return 0;
+
+  // The offsets of the entry map linearly onto the spelling, so the token
+  // must start after the end of the entry, but not far after it.
+  int RelOffs;
+  if (!isInSameSLocAddrSpace(PrevInfo.getSpellingLoc(), SpellingLoc, &RelOffs))
+    return 0;
+  unsigned PrevLength = NextLocalOffset - Prev.getOffset();
+  if (RelOffs < 0 || unsigned(RelOffs) < PrevLength ||
+      unsigned(RelOffs) - PrevLength > MaxFoldedExpansionGap)
+    return 0;
+  return Prev.getOffset() + RelOffs;
+}
+
 llvm::MemoryBuffer *SourceManager::getMemoryBufferForFile(const FileEntry *File,
                                                           bool *Invalid) {
   const SrcMgr::ContentCache *IR = getOrCreateContentCache(File);
@@ -672,6 +745,39 @@ void SourceManager::overrideFileContents(const FileEntry *SourceFile,
   getOverriddenFilesInfo().OverriddenFiles[SourceFile] = NewFile;
 }
 
+void SourceManager::setFileLineOffsets(const FileEntry *SourceFile,
+                                       unsigned FileSize,
+                                       ArrayRef<unsigned> LineOffsets) {
+  ContentCache *IR =
+      const_cast<ContentCache *>(getOrCreateContentCache(SourceFile));
+  if (IR->SourceLineCache || LineOffsets.empty() ||
+      IR->getSize() != FileSize || LineOffsets.back() > FileSize)
+    return;
+
+  IR->NumLines = LineOffsets.size();
+  IR->SourceLineCache = ContentCacheAlloc.Allocate<unsigned>(IR->NumLines);
+  std::copy(LineOffsets.begin(), LineOffsets.end(), IR->SourceLineCache);
+}
+
+bool SourceManager::provideFileContents(
+    const FileEntry *SourceFile, std::unique_ptr<llvm::MemoryBuffer> &Buffer) {
+  if (!Buffer || isFileOverridden(SourceFile))
+    return false;
+
+  // Anything getBuffer would diagnose is left for it to read and diagnose.
+  ContentCache *IR =
+      const_cast<ContentCache *>(getOrCreateContentCache(SourceFile));
+  if (IR->getRawBuffer() || IR->ContentsEntry != SourceFile ||
+      (userFilesAreVolatile() && !IR->IsSystemFile) ||
+      Buffer->getBufferSize() != (size_t)SourceFile->getSize() ||
+      Buffer->getBufferIdentifier() != SourceFile->getName() ||
+      getUnsupportedBOMName(Buffer->getBuffer()))
+    return false;
+
+  IR->replaceBuffer(Buffer.release());
+  return true;
+}
+
 void SourceManager::disableFileContentsOverride(const FileEntry *File) {
   if (!isFileOverridden(File))
     return;
@@ -718,11 +824,30 @@ FileID SourceManager::getFileIDSlow(unsigned SLocOffset) const {
   if (!SLocOffset)
     return FileID::get(0);
 
+  // Try the FileIDs found most recently, moving a hit to the front.
+  for (FileID *I = std::begin(RecentFileIDLookups),
+              *E = std::end(RecentFileIDLookups);
+       I != E && I->isValid(); ++I) {
+    if (isOffsetInFileID(*I, SLocOffset)) {
+      FileID FID = *I;
+      std::copy_backward(std::begin(RecentFileIDLookups), I, I + 1);
+      RecentFileIDLookups[0] = FID;
+      ++NumRecentLookupHits;
+      return FID;
+    }
+  }
+
   // Now it is time to search for the correct file. See where the SLocOffset
   // sits in the global view and consult local or loaded buffers for it.
-  if (SLocOffset < NextLocalOffset)
-    return getFileIDLocal(SLocOffset);
-  return getFileIDLoaded(SLocOffset);
+  FileID Res = SLocOffset < NextLocalOffset ? getFileIDLocal(SLocOffset)
+                                            : getFileIDLoaded(SLocOffset);
+  if (Res.isValid()) {
+    std::copy_backward(std::begin(RecentFileIDLookups),
+                       std::end(RecentFileIDLookups) - 1,
+                       std::end(RecentFileIDLookups));
+    RecentFileIDLookups[0] = Res;
+  }
+  return Res;
 }
 
 /// \brief Return the FileID for a SourceLocation with a low offset.
@@ -781,39 +906,26 @@ FileID SourceManager::getFileIDLocal(unsigned SLocOffset) const {
   // SLocOffset.
   unsigned LessIndex = 0;
   NumProbes = 0;
-  while (1) {
-    bool Invalid = false;
+
+  // Search the offsets rather than the entries; the entry found is the last
+  // one starting at or before SLocOffset.
+  const unsigned *Offsets = LocalSLocEntryOffsets.data();
+  while (GreaterIndex - LessIndex > 1) {
     unsigned MiddleIndex = (GreaterIndex-LessIndex)/2+LessIndex;
-    unsigned MidOffset = getLocalSLocEntry(MiddleIndex, &Invalid).getOffset();
-    if (Invalid)
-      return FileID::get(0);
-    
     ++NumProbes;
-
-    // If the offset of the midpoint is too large, chop the high side of the
-    // range to the midpoint.
-    if (MidOffset > SLocOffset) {
+    if (Offsets[MiddleIndex] > SLocOffset)
       GreaterIndex = MiddleIndex;
-      continue;
-    }
-
-    // If the middle index contains the value, succeed and return.
-    // FIXME: This could be made faster by using a function that's aware of
-    // being in the local area.
-    if (isOffsetInFileID(FileID::get(MiddleIndex), SLocOffset)) {
-      FileID Res = FileID::get(MiddleIndex);
-
-      // If this isn't a macro expansion, remember it.  We have good locality
-      // across FileID lookups.
-      if (!LocalSLocEntryTable[MiddleIndex].isExpansion())
-        LastFileIDLookup = Res;
-      NumBinaryProbes += NumProbes;
-      return Res;
-    }
-
-    // Otherwise, move the low-side up to the middle index.
-    LessIndex = MiddleIndex;
+    else
+      LessIndex = MiddleIndex;
   }
+
+  FileID Res = FileID::get(LessIndex);
+  // If this isn't a macro expansion, remember it.  We have good locality
+  // across FileID lookups.
+  if (!LocalSLocEntryTable[LessIndex].isExpansion())
+    LastFileIDLookup = Res;
+  NumBinaryProbes += NumProbes;
+  return Res;
 }
 
 /// \brief Return the FileID for a SourceLocation with a high offset.
@@ -1196,6 +1308,23 @@ static LLVM_ATTRIBUTE_NOINLINE void
 ComputeLineNumbers(DiagnosticsEngine &Diag, ContentCache *FI,
                    llvm::BumpPtrAllocator &Alloc,
                    const SourceManager &SM, bool &Invalid);
+
+/// \brief Record the start of the line following the newline character at
+/// \p P, unless \p P is the second character of a two character newline.
+static inline void AddLineAfterNewline(const unsigned char *P,
+                                       const unsigned char *Start,
+                                       const unsigned char *&LineStart,
+                                       SmallVectorImpl<unsigned> &LineOffsets) {
+  if (P < LineStart)
+    return;
+
+  // If this is \n\r or \r\n, the line starts after both characters.
+  LineStart = P + 1;
+  if ((P[1] == '\n' || P[1] == '\r') && P[0] != P[1])
+    ++LineStart;
+  LineOffsets.push_back(LineStart - Start);
+}
+
 static void ComputeLineNumbers(DiagnosticsEngine &Diag, ContentCache *FI,
                                llvm::BumpPtrAllocator &Alloc,
                                const SourceManager &SM, bool &Invalid) {
@@ -1211,65 +1340,37 @@ static void ComputeLineNumbers(DiagnosticsEngine &Diag, ContentCache *FI,
   // Line #1 starts at char 0.
   LineOffsets.push_back(0);
 
-  const unsigned char *Buf = (const unsigned char *)Buffer->getBufferStart();
+  const unsigned char *Start = (const unsigned char *)Buffer->getBufferStart();
   const unsigned char *End = (const unsigned char *)Buffer->getBufferEnd();
-  unsigned Offs = 0;
-  while (1) {
-    // Skip over the contents of the line.
-    const unsigned char *NextBuf = (const unsigned char *)Buf;
+  const unsigned char *LineStart = Start;
+  const unsigned char *I = Start;
 
 #ifdef __SSE2__
-    // Try to skip to the next newline using SSE instructions. This is very
-    // performance sensitive for programs with lots of diagnostics and in -E
-    // mode.
-    __m128i CRs = _mm_set1_epi8('\r');
-    __m128i LFs = _mm_set1_epi8('\n');
-
-    // First fix up the alignment to 16 bytes.
-    while (((uintptr_t)NextBuf & 0xF) != 0) {
-      if (*NextBuf == '\n' || *NextBuf == '\r' || *NextBuf == '\0')
-        goto FoundSpecialChar;
-      ++NextBuf;
-    }
-
-    // Scan 16 byte chunks for '\r' and '\n'. Ignore '\0'.
-    while (NextBuf+16 <= End) {
-      const __m128i Chunk = *(const __m128i*)NextBuf;
-      __m128i Cmp = _mm_or_si128(_mm_cmpeq_epi8(Chunk, CRs),
-                                 _mm_cmpeq_epi8(Chunk, LFs));
-      unsigned Mask = _mm_movemask_epi8(Cmp);
-
-      // If we found a newline, adjust the pointer and jump to the handling code.
-      if (Mask != 0) {
-        NextBuf += llvm::countTrailingZeros(Mask);
-        goto FoundSpecialChar;
-      }
-      NextBuf += 16;
-    }
+  // Find the newlines 16 bytes at a time using SSE instructions, handling all
+  // the newlines of a chunk before moving on to the next one. This is very
+  // performance sensitive for programs with lots of diagnostics and in -E
+  // mode.
+  const __m128i CRs = _mm_set1_epi8('\r');
+  const __m128i LFs = _mm_set1_epi8('\n');
+
+  // First fix up the alignment to 16 bytes.
+  for (; I != End && ((uintptr_t)I & 0xF) != 0; ++I)
+    if (*I == '\n' || *I == '\r')
+      AddLineAfterNewline(I, Start, LineStart, LineOffsets);
+
+  for (; I + 16 <= End; I += 16) {
+    const __m128i Chunk = *(const __m128i*)I;
+    __m128i Cmp = _mm_or_si128(_mm_cmpeq_epi8(Chunk, CRs),
+                               _mm_cmpeq_epi8(Chunk, LFs));
+    for (unsigned Mask = _mm_movemask_epi8(Cmp); Mask; Mask &= Mask - 1)
+      AddLineAfterNewline(I + llvm::countTrailingZeros(Mask), Start,
+                          LineStart, LineOffsets);
+  }
 #endif
 
-    while (*NextBuf != '\n' && *NextBuf != '\r' && *NextBuf != '\0')
-      ++NextBuf;
-
-#ifdef __SSE2__
-FoundSpecialChar:
-#endif
-    Offs += NextBuf-Buf;
-    Buf = NextBuf;
-
-    if (Buf[0] == '\n' || Buf[0] == '\r') {
-      // If this is \n\r or \r\n, skip both characters.
-      if ((Buf[1] == '\n' || Buf[1] == '\r') && Buf[0] != Buf[1])
-        ++Offs, ++Buf;
-      ++Offs, ++Buf;
-      LineOffsets.push_back(Offs);
-    } else {
-      // Otherwise, this is a null.  If end of file, exit.
-      if (Buf == End) break;
-      // Otherwise, skip the null.
-      ++Offs, ++Buf;
-    }
-  }
+  for (; I != End; ++I)
+    if (*I == '\n' || *I == '\r')
+      AddLineAfterNewline(I, Start, LineStart, LineOffsets);
 
   // Copy the offsets into the FileInfo structure.
   FI->NumLines = LineOffsets.size();
@@ -2128,7 +2229,26 @@ void SourceManager::PrintStats() const {
                << NumLineNumsComputed << " files with line #'s computed, "
                << NumMacroArgsComputed << " files with macro args computed.\n";
   llvm::errs() << "FileID scans: " << NumLinearScans << " linear, "
-               << NumBinaryProbes << " binary.\n";
+               << NumBinaryProbes << " binary, " << NumRecentLookupHits
+               << " recent lookup hits.\n";
+
+  unsigned NumExpansionEntries = 0, NumMacroArgEntries = 0;
+  unsigned ExpansionAddrSpace = 0;
+  for (unsigned i = 0, e = LocalSLocEntryTable.size(); i != e; ++i) {
+    const SrcMgr::SLocEntry &Entry = LocalSLocEntryTable[i];
+    if (!Entry.isExpansion())
+      continue;
+    ++NumExpansionEntries;
+    NumMacroArgEntries += Entry.getExpansion().isMacroArgExpansion();
+    unsigned End = i + 1 == e ? NextLocalOffset
+                              : LocalSLocEntryTable[i + 1].getOffset();
+    ExpansionAddrSpace += End - Entry.getOffset();
+  }
+  llvm::errs() << NumExpansionEntries << " local expansion SLocEntry's ("
+               << NumMacroArgEntries << " for macro arguments), "
+               << ExpansionAddrSpace << "B of Sloc address space used; "
+               << NumFoldedExpansionLocs
+               << " expansion locations folded into the previous entry.\n";
 }
 
 ExternalSLocEntrySource::~ExternalSLocEntrySource() { }
@@ -2156,6 +2276,7 @@ SourceManager::MemoryBufferSizes SourceManager::getMemoryBufferSizes() const {
 size_t SourceManager::getDataStructureSizes() const {
   size_t size = llvm::capacity_in_bytes(MemBufferInfos)
     + llvm::capacity_in_bytes(LocalSLocEntryTable)
+    + llvm::capacity_in_bytes(LocalSLocEntryOffsets)
     + llvm::capacity_in_bytes(LoadedSLocEntryTable)
     + llvm::capacity_in_bytes(SLocEntryLoaded)
     + llvm::capacity_in_bytes(FileInfos);
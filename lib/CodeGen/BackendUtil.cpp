@@ -39,6 +39,7 @@
 #include "llvm/Transforms/ObjCARC.h"
 #include "llvm/Transforms/Scalar.h"
 #include <memory>
+#include <mutex>
 using namespace clang;
 using namespace llvm;
 
@@ -385,8 +386,15 @@ TargetMachine *EmitAssemblyHelper::CreateTargetMachine(bool MustCreateTM) {
   if (CodeGenOpts.NoGlobalMerge)
     BackendArgs.push_back("-global-merge=false");
   BackendArgs.push_back(nullptr);
-  llvm::cl::ParseCommandLineOptions(BackendArgs.size() - 1,
-                                    BackendArgs.data());
+  // The options are global to the process, which may run several compilations
+  // at once on a compile server. Leave them alone when there is nothing to set,
+  // and never parse them on two threads at once.
+  if (BackendArgs.size() > 2) {
+    static std::mutex BackendOptionsLock;
+    std::lock_guard<std::mutex> Guard(BackendOptionsLock);
+    llvm::cl::ParseCommandLineOptions(BackendArgs.size() - 1,
+                                      BackendArgs.data());
+  }
 
   std::string FeaturesStr;
   if (TargetOpts.Features.size()) {
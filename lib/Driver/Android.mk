@@ -16,6 +16,7 @@ TBLGEN_TABLES := \
 clang_driver_SRC_FILES := \
   Action.cpp \
   Compilation.cpp \
+  CompileServer.cpp \
   Driver.cpp \
   DriverOptions.cpp \
   Job.cpp \
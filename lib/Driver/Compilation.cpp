@@ -13,10 +13,17 @@
 #include "clang/Driver/DriverDiagnostic.h"
 #include "clang/Driver/Options.h"
 #include "clang/Driver/ToolChain.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/Option/ArgList.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 using namespace clang::driver;
 using namespace clang;
@@ -122,8 +129,7 @@ bool Compilation::CleanupFileMap(const ArgStringMap &Files,
   return Success;
 }
 
-int Compilation::ExecuteCommand(const Command &C,
-                                const Command *&FailingCommand) const {
+bool Compilation::PrintCommand(const Command &C) const {
   if ((getDriver().CCPrintOptions ||
        getArgs().hasArg(options::OPT_v)) && !getDriver().CCGenDiagnostics) {
     raw_ostream *OS = &llvm::errs();
@@ -138,9 +144,8 @@ int Compilation::ExecuteCommand(const Command &C,
       if (!Error.empty()) {
         getDriver().Diag(clang::diag::err_drv_cc_print_options_failure)
           << Error;
-        FailingCommand = &C;
         delete OS;
-        return 1;
+        return false;
       }
     }
 
@@ -152,6 +157,15 @@ int Compilation::ExecuteCommand(const Command &C,
     if (OS != &llvm::errs())
       delete OS;
   }
+  return true;
+}
+
+int Compilation::ExecuteCommand(const Command &C,
+                                const Command *&FailingCommand) const {
+  if (!PrintCommand(C)) {
+    FailingCommand = &C;
+    return 1;
+  }
 
   std::string Error;
   bool ExecutionFailed;
@@ -208,6 +222,209 @@ void Compilation::ExecuteJob(const Job &J,
   }
 }
 
+static void CollectCommands(const Job &J,
+                            SmallVectorImpl<const Command *> &Commands) {
+  if (const Command *C = dyn_cast<Command>(&J)) {
+    Commands.push_back(C);
+    return;
+  }
+  const JobList *Jobs = cast<JobList>(&J);
+  for (JobList::const_iterator it = Jobs->begin(), ie = Jobs->end();
+       it != ie; ++it)
+    CollectCommands(**it, Commands);
+}
+
+/// Collect the commands producing the inputs of \p A. Commands producing
+/// inputs further up the action graph are reached through those.
+static void CollectCommandDeps(
+    const Action *A, const llvm::DenseMap<const Action *, unsigned> &Producers,
+    SmallVectorImpl<unsigned> &Deps) {
+  for (Action::const_iterator AI = A->begin(), AE = A->end(); AI != AE; ++AI) {
+    llvm::DenseMap<const Action *, unsigned>::const_iterator P =
+        Producers.find(*AI);
+    if (P != Producers.end())
+      Deps.push_back(P->second);
+    else
+      CollectCommandDeps(*AI, Producers, Deps);
+  }
+}
+
+namespace {
+/// The scheduling state of a single command in ExecuteJobsInParallel.
+struct ParallelJob {
+  ParallelJob() : State(Pending), Res(0), ExecutionFailed(false) {}
+
+  enum { Pending, Running, Finished } State;
+  SmallVector<unsigned, 4> Deps;
+  /// The file standard error is redirected to while the command runs.
+  SmallString<128> StderrPath;
+  StringRef StderrRedirect;
+  const StringRef *Redirects[3];
+  std::string Error;
+  int Res;
+  bool ExecutionFailed;
+};
+}
+
+void Compilation::ExecuteJobsInParallel(const JobList &Jobs,
+                                        FailingCommandList &FailingCommands,
+                                        unsigned MaxJobs) const {
+  // Compilations redirecting their output (for crash diagnostics) don't need
+  // the speed and would lose the redirection; run them serially.
+  if (MaxJobs <= 1 || Redirects) {
+    ExecuteJob(Jobs, FailingCommands);
+    return;
+  }
+
+  SmallVector<const Command *, 8> Commands;
+  CollectCommands(Jobs, Commands);
+
+  // The serial order runs every command after the commands producing its
+  // inputs, so only earlier commands can be dependencies.
+  llvm::DenseMap<const Action *, unsigned> Producers;
+  std::vector<ParallelJob> State(Commands.size());
+  for (unsigned I = 0, E = Commands.size(); I != E; ++I) {
+    CollectCommandDeps(&Commands[I]->getSource(), Producers, State[I].Deps);
+    Producers.insert(std::make_pair(&Commands[I]->getSource(), I));
+  }
+
+  std::mutex Mutex;
+  std::condition_variable ReadyCV, FinishedCV;
+  std::deque<unsigned> ReadyQueue;
+  std::vector<unsigned> FinishedQueue;
+  bool NoMoreJobs = false;
+  unsigned NumRunning = 0, NumFinished = 0, NextToFlush = 0;
+  unsigned FirstNewFailure = FailingCommands.size();
+
+  // At most MaxJobs commands run at once, each on one of MaxJobs threads.
+  std::vector<std::thread> Threads;
+  unsigned NumThreads = std::min<unsigned>(MaxJobs, Commands.size());
+  for (unsigned T = 0; T != NumThreads; ++T)
+    Threads.push_back(std::thread([&]() {
+      std::unique_lock<std::mutex> Lock(Mutex);
+      while (true) {
+        ReadyCV.wait(Lock,
+                     [&]() { return NoMoreJobs || !ReadyQueue.empty(); });
+        if (ReadyQueue.empty())
+          return;
+        unsigned I = ReadyQueue.front();
+        ReadyQueue.pop_front();
+        Lock.unlock();
+
+        ParallelJob &Job = State[I];
+        // Always pass the redirections, even if empty, so that the command
+        // is never run inside the driver process from several threads.
+        Job.Res = Commands[I]->Execute(Job.Redirects, &Job.Error,
+                                       &Job.ExecutionFailed);
+
+        Lock.lock();
+        FinishedQueue.push_back(I);
+        FinishedCV.notify_one();
+      }
+    }));
+
+  while (NumFinished != Commands.size()) {
+    // Start every command whose dependencies have all finished.
+    for (unsigned I = 0, E = Commands.size(); I != E && NumRunning < MaxJobs;
+         ++I) {
+      ParallelJob &Job = State[I];
+      if (Job.State != ParallelJob::Pending)
+        continue;
+      bool Ready = true;
+      for (unsigned Dep : Job.Deps)
+        Ready &= State[Dep].State == ParallelJob::Finished;
+      if (!Ready)
+        continue;
+
+      const Command &C = *Commands[I];
+      if (!InputsOk(C, FailingCommands)) {
+        Job.State = ParallelJob::Finished;
+        ++NumFinished;
+        continue;
+      }
+      if (!PrintCommand(C)) {
+        Job.State = ParallelJob::Finished;
+        Job.Res = 1;
+        FailingCommands.push_back(std::make_pair(1, &C));
+        ++NumFinished;
+        continue;
+      }
+
+      Job.Redirects[0] = Job.Redirects[1] = Job.Redirects[2] = nullptr;
+      std::error_code EC = llvm::sys::fs::createTemporaryFile(
+          "clang-job", "stderr", Job.StderrPath);
+      if (!EC) {
+        Job.StderrRedirect = Job.StderrPath;
+        Job.Redirects[2] = &Job.StderrRedirect;
+      }
+      // Without a temporary file the command writes straight to stderr;
+      // only the ordering of its output is lost.
+
+      Job.State = ParallelJob::Running;
+      ++NumRunning;
+      std::lock_guard<std::mutex> Lock(Mutex);
+      ReadyQueue.push_back(I);
+      ReadyCV.notify_one();
+    }
+
+    if (NumRunning) {
+      std::vector<unsigned> Done;
+      {
+        std::unique_lock<std::mutex> Lock(Mutex);
+        FinishedCV.wait(Lock, [&]() { return !FinishedQueue.empty(); });
+        Done.swap(FinishedQueue);
+      }
+      for (unsigned I : Done) {
+        ParallelJob &Job = State[I];
+        if (!Job.Error.empty()) {
+          assert(Job.Res && "Error string set with 0 result code!");
+          getDriver().Diag(clang::diag::err_drv_command_failure) << Job.Error;
+        }
+        if (Job.Res)
+          FailingCommands.push_back(
+              std::make_pair(Job.ExecutionFailed ? 1 : Job.Res, Commands[I]));
+        Job.State = ParallelJob::Finished;
+        --NumRunning;
+        ++NumFinished;
+      }
+    }
+
+    // Replay the buffered output of every finished command that has no
+    // unfinished predecessor.
+    for (; NextToFlush != Commands.size() &&
+           State[NextToFlush].State == ParallelJob::Finished;
+         ++NextToFlush) {
+      ParallelJob &Job = State[NextToFlush];
+      if (Job.StderrPath.empty())
+        continue;
+      llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Output =
+          llvm::MemoryBuffer::getFile(Job.StderrPath.str());
+      if (Output)
+        llvm::errs() << (*Output)->getBuffer();
+      llvm::sys::fs::remove(Job.StderrPath.str());
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    NoMoreJobs = true;
+    ReadyCV.notify_all();
+  }
+  for (std::thread &T : Threads)
+    T.join();
+
+  // Report failures in job order, as the serial execution would.
+  llvm::DenseMap<const Command *, unsigned> JobOrder;
+  for (unsigned I = 0, E = Commands.size(); I != E; ++I)
+    JobOrder[Commands[I]] = I;
+  std::stable_sort(FailingCommands.begin() + FirstNewFailure,
+                   FailingCommands.end(),
+                   [&](const std::pair<int, const Command *> &LHS,
+                       const std::pair<int, const Command *> &RHS) {
+    return JobOrder.lookup(LHS.second) < JobOrder.lookup(RHS.second);
+  });
+}
+
 void Compilation::initCompilationForDiagnostics() {
   ForDiagnostics = true;
 
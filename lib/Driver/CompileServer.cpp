@@ -0,0 +1,231 @@
+//===--- CompileServer.cpp - Compile Server Protocol ----------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Driver/CompileServer.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include <cerrno>
+#include <cstring>
+#if defined(LLVM_ON_UNIX)
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace clang::driver;
+using namespace clang;
+
+#if defined(LLVM_ON_UNIX)
+
+static bool writeAll(int FD, const char *Data, size_t Size) {
+  while (Size) {
+    ssize_t Written = ::write(FD, Data, Size);
+    if (Written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    Data += Written;
+    Size -= Written;
+  }
+  return true;
+}
+
+static bool readAll(int FD, char *Data, size_t Size) {
+  while (Size) {
+    ssize_t Read = ::read(FD, Data, Size);
+    if (Read < 0 && errno == EINTR)
+      continue;
+    if (Read <= 0)
+      return false;
+    Data += Read;
+    Size -= Read;
+  }
+  return true;
+}
+
+bool compileserver::writeMessage(int FD, StringRef Message) {
+  if (Message.size() > MaxMessageSize)
+    return false;
+  uint32_t Size = Message.size();
+  unsigned char Header[4] = {
+    (unsigned char)Size, (unsigned char)(Size >> 8),
+    (unsigned char)(Size >> 16), (unsigned char)(Size >> 24)
+  };
+  return writeAll(FD, (const char *)Header, sizeof(Header)) &&
+         writeAll(FD, Message.data(), Message.size());
+}
+
+bool compileserver::readMessage(int FD, std::string &Message) {
+  unsigned char Header[4];
+  if (!readAll(FD, (char *)Header, sizeof(Header)))
+    return false;
+  uint32_t Size = Header[0] | (Header[1] << 8) | (Header[2] << 16) |
+                  ((uint32_t)Header[3] << 24);
+  // The length comes from the peer; don't let it allocate without bound.
+  if (Size > MaxMessageSize)
+    return false;
+  Message.resize(Size);
+  return !Size || readAll(FD, &Message[0], Size);
+}
+
+static bool makeAddress(StringRef SocketPath, sockaddr_un &Addr) {
+  if (SocketPath.size() >= sizeof(Addr.sun_path))
+    return false;
+  memset(&Addr, 0, sizeof(Addr));
+  Addr.sun_family = AF_UNIX;
+  memcpy(Addr.sun_path, SocketPath.data(), SocketPath.size());
+  return true;
+}
+
+int compileserver::listenOn(StringRef SocketPath, std::string &Error) {
+  sockaddr_un Addr;
+  if (!makeAddress(SocketPath, Addr)) {
+    Error = "socket path too long";
+    return -1;
+  }
+  int FD = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (FD < 0) {
+    Error = strerror(errno);
+    return -1;
+  }
+  // Replace the socket of a previous server. Whoever can connect to the socket
+  // can run compilations as this user, so create it accessible to this user
+  // only.
+  ::unlink(Addr.sun_path);
+  mode_t OldMask = ::umask(0077);
+  bool Failed = ::bind(FD, (sockaddr *)&Addr, sizeof(Addr)) ||
+                ::chmod(Addr.sun_path, 0600) || ::listen(FD, 16);
+  int SavedErrno = errno;
+  ::umask(OldMask);
+  if (Failed) {
+    Error = strerror(SavedErrno);
+    ::close(FD);
+    return -1;
+  }
+  return FD;
+}
+
+/// Whether the process at the other end of the connection \p Conn runs as
+/// the same user as this one.
+static bool isPeerSameUser(int Conn) {
+#if defined(SO_PEERCRED)
+  ucred Cred;
+  socklen_t Size = sizeof(Cred);
+  return !::getsockopt(Conn, SOL_SOCKET, SO_PEERCRED, &Cred, &Size) &&
+         Cred.uid == ::geteuid();
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+    defined(__OpenBSD__) || defined(__DragonFly__)
+  uid_t UID;
+  gid_t GID;
+  return !::getpeereid(Conn, &UID, &GID) && UID == ::geteuid();
+#else
+  // No way to tell; don't trust anyone.
+  return false;
+#endif
+}
+
+int compileserver::acceptClient(int FD) {
+  while (true) {
+    int Conn = ::accept(FD, nullptr, nullptr);
+    if (Conn < 0) {
+      if (errno == EINTR)
+        continue;
+      return Conn;
+    }
+    if (isPeerSameUser(Conn))
+      return Conn;
+    ::close(Conn);
+  }
+}
+
+void compileserver::closeSocket(int FD) {
+  ::close(FD);
+}
+
+void compileserver::stopListening(int FD) {
+  ::shutdown(FD, SHUT_RDWR);
+}
+
+bool compileserver::runJob(StringRef SocketPath, ArrayRef<const char *> Args,
+                           int &Result, std::string &Diagnostics) {
+  SmallString<128> WorkingDir;
+  sockaddr_un Addr;
+  if (llvm::sys::fs::current_path(WorkingDir) ||
+      !makeAddress(SocketPath, Addr))
+    return false;
+
+  std::string Request(WorkingDir.begin(), WorkingDir.end());
+  Request.push_back('\0');
+  for (const char *Arg : Args) {
+    Request += Arg;
+    Request.push_back('\0');
+  }
+
+  int FD = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (FD < 0)
+    return false;
+  std::string Reply;
+  bool Success = !::connect(FD, (sockaddr *)&Addr, sizeof(Addr)) &&
+                 writeMessage(FD, Request) && readMessage(FD, Reply);
+  ::close(FD);
+  if (!Success || Reply.empty())
+    return false;
+
+  size_t StatusEnd = Reply.find('\0');
+  if (StatusEnd == std::string::npos ||
+      StringRef(Reply.data(), StatusEnd).getAsInteger(10, Result))
+    return false;
+  Diagnostics = Reply.substr(StatusEnd + 1);
+  return true;
+}
+
+#else
+
+bool compileserver::writeMessage(int FD, StringRef Message) { return false; }
+
+bool compileserver::readMessage(int FD, std::string &Message) { return false; }
+
+int compileserver::listenOn(StringRef SocketPath, std::string &Error) {
+  Error = "compile servers are not supported on this platform";
+  return -1;
+}
+
+int compileserver::acceptClient(int FD) { return -1; }
+
+void compileserver::closeSocket(int FD) {}
+
+void compileserver::stopListening(int FD) {}
+
+bool compileserver::runJob(StringRef SocketPath, ArrayRef<const char *> Args,
+                           int &Result, std::string &Diagnostics) {
+  return false;
+}
+
+#endif
+
+bool compileserver::parseRequest(StringRef Request, std::string &WorkingDir,
+                                 std::vector<std::string> &Args) {
+  WorkingDir.clear();
+  Args.clear();
+  for (size_t Start = 0; Start != Request.size();) {
+    size_t End = Request.find('\0', Start);
+    if (End == StringRef::npos)
+      return false;
+    if (Start == 0)
+      WorkingDir = Request.slice(Start, End);
+    else
+      Args.push_back(Request.slice(Start, End));
+    Start = End + 1;
+  }
+  return !WorkingDir.empty();
+}
@@ -56,7 +56,8 @@ Driver::Driver(StringRef ClangExecutable,
     CCLogDiagnosticsFilename(nullptr),
     CCCPrintBindings(false),
     CCPrintHeaders(false), CCLogDiagnostics(false),
-    CCGenDiagnostics(false), CCCGenericGCCName(""), CheckInputsExist(true),
+    CCGenDiagnostics(false), CCCIntegratedCC1(false), CC1Main(nullptr),
+    CCCGenericGCCName(""), CheckInputsExist(true),
     CCCUsePCH(true), SuppressMissingInputWarning(false) {
 
   Name = llvm::sys::path::stem(ClangExecutable);
@@ -328,6 +329,10 @@ Compilation *Driver::BuildCompilation(ArrayRef<const char *> ArgList) {
   // or -b.
   CCCPrintActions = Args->hasArg(options::OPT_ccc_print_phases);
   CCCPrintBindings = Args->hasArg(options::OPT_ccc_print_bindings);
+  CCCIntegratedCC1 = Args->hasFlag(options::OPT_fintegrated_cc1,
+                                   options::OPT_fno_integrated_cc1, false);
+  if (const Arg *A = Args->getLastArg(options::OPT_fcompile_server_EQ))
+    CompileServerSocket = A->getValue();
   if (const Arg *A = Args->getLastArg(options::OPT_ccc_gcc_name))
     CCCGenericGCCName = A->getValue();
   CCCUsePCH = Args->hasFlag(options::OPT_ccc_pch_is_pch,
@@ -579,11 +584,22 @@ int Driver::ExecuteCompilation(const Compilation &C,
     return 0;
   }
 
+  unsigned MaxJobs = 1;
+  if (Arg *A = C.getArgs().getLastArg(options::OPT_j)) {
+    StringRef Value = A->getValue();
+    if (Value.getAsInteger(10, MaxJobs) || MaxJobs == 0)
+      Diag(clang::diag::err_drv_invalid_int_value)
+        << A->getAsString(C.getArgs()) << Value;
+  }
+
   // If there were errors building the compilation, quit now.
   if (Diags.hasErrorOccurred())
     return 1;
 
-  C.ExecuteJob(C.getJobs(), FailingCommands);
+  if (MaxJobs > 1)
+    C.ExecuteJobsInParallel(C.getJobs(), FailingCommands, MaxJobs);
+  else
+    C.ExecuteJob(C.getJobs(), FailingCommands);
 
   // Remove temp files.
   C.CleanupFileList(C.getTempFiles());
@@ -1412,6 +1428,9 @@ void Driver::BuildJobs(Compilation &C) const {
   // Claim --driver-mode, it was handled earlier.
   (void) C.getArgs().hasArg(options::OPT_driver_mode);
 
+  // Claim -j, it is handled when executing the jobs.
+  (void) C.getArgs().hasArg(options::OPT_j);
+
   for (ArgList::const_iterator it = C.getArgs().begin(), ie = C.getArgs().end();
        it != ie; ++it) {
     Arg *A = *it;
@@ -7,17 +7,27 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "clang/Driver/CompileServer.h"
 #include "clang/Driver/Driver.h"
 #include "clang/Driver/DriverDiagnostic.h"
 #include "clang/Driver/Job.h"
 #include "clang/Driver/Tool.h"
 #include "clang/Driver/ToolChain.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/StringSwitch.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/CrashRecoveryContext.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Program.h"
 #include "llvm/Support/raw_ostream.h"
 #include <cassert>
+#if defined(LLVM_ON_UNIX)
+#include <unistd.h>
+#endif
 using namespace clang::driver;
 using llvm::raw_ostream;
 using llvm::StringRef;
@@ -118,14 +128,138 @@ void Command::Print(raw_ostream &OS, const char *Terminator, bool Quote,
   OS << Terminator;
 }
 
+bool clang::driver::cc1JobNeedsOwnProcess(ArrayRef<const char *> Args) {
+  // These options all end up in llvm::cl::ParseCommandLineOptions, either
+  // directly or through the options BackendUtil builds from them, and an
+  // option that is set twice in one process is an error.
+  for (size_t i = 0, e = Args.size(); i != e; ++i)
+    if (llvm::StringSwitch<bool>(Args[i])
+            .Cases("-mllvm", "-backend-option", true)
+            .Cases("-mdebug-pass", "-mlimit-float-precision", true)
+            .Cases("-mno-global-merge", "-ftime-report", true)
+            .Default(false))
+      return true;
+  return false;
+}
+
+/// Whether \p C can run without spawning a process, through Driver::CC1Main
+/// or on a compile server: a "-cc1" job of the driver's own executable whose
+/// output is not redirected and which leaves no global LLVM state behind.
+static bool isOwnCC1Job(const Command &C, const Driver &D,
+                        const StringRef **Redirects) {
+  if (Redirects)
+    return false;
+  const ArgStringList &Args = C.getArguments();
+  if (Args.empty() || StringRef(Args[0]) != "-cc1" ||
+      StringRef(C.getExecutable()) != D.getClangProgramPath())
+    return false;
+  return !cc1JobNeedsOwnProcess(Args);
+}
+
+namespace {
+/// Redirects the standard error of the process to a temporary file until
+/// finish() is called.
+class StderrCapture {
+  int SavedStderr;
+  SmallString<128> Path;
+
+public:
+  StderrCapture() : SavedStderr(-1) {
+#if defined(LLVM_ON_UNIX)
+    int FD;
+    if (llvm::sys::fs::createTemporaryFile("clang-cc1", "stderr", FD, Path))
+      return;
+    llvm::errs().flush();
+    SavedStderr = ::dup(2);
+    if (SavedStderr < 0 || ::dup2(FD, 2) < 0) {
+      if (SavedStderr >= 0)
+        ::close(SavedStderr);
+      SavedStderr = -1;
+      llvm::sys::fs::remove(Path.str());
+    }
+    ::close(FD);
+#endif
+  }
+
+  /// Restores the standard error and, if \p Replay, writes what was
+  /// captured to it.
+  void finish(bool Replay) {
+#if defined(LLVM_ON_UNIX)
+    if (SavedStderr < 0)
+      return;
+    llvm::errs().flush();
+    ::dup2(SavedStderr, 2);
+    ::close(SavedStderr);
+    SavedStderr = -1;
+    if (Replay) {
+      llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Output =
+          llvm::MemoryBuffer::getFile(Path.str());
+      if (Output)
+        llvm::errs() << (*Output)->getBuffer();
+    }
+    llvm::sys::fs::remove(Path.str());
+#endif
+  }
+
+  ~StderrCapture() { finish(/*Replay=*/true); }
+};
+}
+
 int Command::Execute(const StringRef **Redirects, std::string *ErrMsg,
                      bool *ExecutionFailed) const {
   SmallVector<const char*, 128> Argv;
   Argv.push_back(Executable);
   for (size_t i = 0, e = Arguments.size(); i != e; ++i)
     Argv.push_back(Arguments[i]);
-  Argv.push_back(nullptr);
 
+  const Driver &D = getCreator().getToolChain().getDriver();
+  if (!D.CompileServerSocket.empty() && isOwnCC1Job(*this, D, Redirects)) {
+    int Res;
+    std::string Diagnostics;
+    if (compileserver::runJob(D.CompileServerSocket,
+                              llvm::makeArrayRef(Argv).slice(2), Res,
+                              Diagnostics)) {
+      if (ExecutionFailed)
+        *ExecutionFailed = false;
+      llvm::errs() << Diagnostics;
+      return Res;
+    }
+    // The server is not running or could not run the job; run it here.
+  }
+
+  if (D.CCCIntegratedCC1 && D.CC1Main && isOwnCC1Job(*this, D, Redirects)) {
+    if (ExecutionFailed)
+      *ExecutionFailed = false;
+
+    // -disable-free would leak the whole compilation into the driver, which
+    // may run many more jobs.
+    SmallVector<const char *, 128> InProcessArgv;
+    for (size_t i = 0, e = Argv.size(); i != e; ++i)
+      if (StringRef(Argv[i]) != "-disable-free")
+        InProcessArgv.push_back(Argv[i]);
+
+    // Hold back the diagnostics of the job until it has finished, so that
+    // they are not printed twice if it crashes and is run again.
+    StderrCapture Capture;
+
+    llvm::CrashRecoveryContext::Enable();
+    llvm::CrashRecoveryContext CRC;
+    int Res = 0;
+    if (CRC.RunSafely([&]() { Res = D.CC1Main(InProcessArgv); })) {
+      Capture.finish(/*Replay=*/true);
+      return Res;
+    }
+    Capture.finish(/*Replay=*/false);
+    // cc1_main did not get to remove its fatal error handler, and installing
+    // one for the next job would assert.
+    llvm::remove_fatal_error_handler();
+
+    // The frontend crashed. Run the job again in its own process, so that
+    // the crash shows up as an abnormal exit status and the driver can
+    // generate a reproducer for it.
+  }
+
+  Argv.push_back(nullptr);
   return llvm::sys::ExecuteAndWait(Executable, Argv.data(), /*env*/ nullptr,
                                    Redirects, /*secondsToWait*/ 0,
                                    /*memoryLimit*/ 0, ErrMsg, ExecutionFailed);
@@ -22,6 +22,7 @@
 #include "clang/Frontend/FrontendActions.h"
 #include "clang/Frontend/FrontendDiagnostic.h"
 #include "clang/Frontend/LogDiagnosticPrinter.h"
+#include "clang/Frontend/ModuleBuildScheduler.h"
 #include "clang/Frontend/SerializedDiagnosticPrinter.h"
 #include "clang/Frontend/TextDiagnosticPrinter.h"
 #include "clang/Frontend/Utils.h"
@@ -839,18 +840,6 @@ bool CompilerInstance::ExecuteAction(FrontendAction &Act) {
   return !getDiagnostics().getClient()->getNumErrors();
 }
 
-/// \brief Determine the appropriate source input kind based on language
-/// options.
-static InputKind getSourceInputKindFromOptions(const LangOptions &LangOpts) {
-  if (LangOpts.OpenCL)
-    return IK_OpenCL;
-  if (LangOpts.CUDA)
-    return IK_CUDA;
-  if (LangOpts.ObjC1)
-    return LangOpts.CPlusPlus? IK_ObjCXX : IK_ObjC;
-  return LangOpts.CPlusPlus? IK_CXX : IK_C;
-}
-
 /// \brief Compile a module file for the given module, using the options 
 /// provided by the importing compiler instance.
 static void compileModuleImpl(CompilerInstance &ImportingInstance,
@@ -859,31 +848,16 @@ static void compileModuleImpl(CompilerInstance &ImportingInstance,
                           StringRef ModuleFileName) {
   ModuleMap &ModMap 
     = ImportingInstance.getPreprocessor().getHeaderSearchInfo().getModuleMap();
-    
-  // Construct a compiler invocation for creating this module.
-  IntrusiveRefCntPtr<CompilerInvocation> Invocation
-    (new CompilerInvocation(ImportingInstance.getInvocation()));
 
-  PreprocessorOptions &PPOpts = Invocation->getPreprocessorOpts();
-  
-  // For any options that aren't intended to affect how a module is built,
-  // reset them to their default values.
-  Invocation->getLangOpts()->resetNonModularOptions();
-  PPOpts.resetNonModularOptions();
-
-  // Remove any macro definitions that are explicitly ignored by the module.
-  // They aren't supposed to affect how the module is built anyway.
-  const HeaderSearchOptions &HSOpts = Invocation->getHeaderSearchOpts();
-  PPOpts.Macros.erase(
-      std::remove_if(PPOpts.Macros.begin(), PPOpts.Macros.end(),
-                     [&HSOpts](const std::pair<std::string, bool> &def) {
-        StringRef MacroDef = def.first;
-        return HSOpts.ModulesIgnoreMacros.count(MacroDef.split('=').first) > 0;
-      }),
-      PPOpts.Macros.end());
-
-  // Note the name of the module we're building.
-  Invocation->getLangOpts()->CurrentModule = Module->getTopLevelModuleName();
+  // If there is a module map file, build the module using the module map.
+  // Otherwise build it from a module map inferred from the module.
+  const FileEntry *ModuleMapFile = ModMap.getContainingModuleMapFile(Module);
+
+  // Construct a compiler invocation for creating this module.
+  IntrusiveRefCntPtr<CompilerInvocation> Invocation(createModuleBuildInvocation(
+      ImportingInstance.getInvocation(), Module->getTopLevelModuleName(),
+      ModuleMapFile ? ModuleMapFile->getName() : "__inferred_module.map",
+      ModuleFileName));
 
   // Make sure that the failed-module structure has been allocated in
   // the importing instance, and propagate the pointer to the newly-created
@@ -892,25 +866,9 @@ static void compileModuleImpl(CompilerInstance &ImportingInstance,
     = ImportingInstance.getInvocation().getPreprocessorOpts();
   if (!ImportingPPOpts.FailedModules)
     ImportingPPOpts.FailedModules = new PreprocessorOptions::FailedModulesSet;
-  PPOpts.FailedModules = ImportingPPOpts.FailedModules;
+  Invocation->getPreprocessorOpts().FailedModules =
+      ImportingPPOpts.FailedModules;
 
-  // If there is a module map file, build the module using the module map.
-  // Set up the inputs/outputs so that we build the module from its umbrella
-  // header.
-  FrontendOptions &FrontendOpts = Invocation->getFrontendOpts();
-  FrontendOpts.OutputFile = ModuleFileName.str();
-  FrontendOpts.DisableFree = false;
-  FrontendOpts.GenerateGlobalModuleIndex = false;
-  FrontendOpts.Inputs.clear();
-  InputKind IK = getSourceInputKindFromOptions(*Invocation->getLangOpts());
-
-  // Don't free the remapped file buffers; they are owned by our caller.
-  PPOpts.RetainRemappedFileBuffers = true;
-    
-  Invocation->getDiagnosticOpts().VerifyDiagnostics = 0;
-  assert(ImportingInstance.getInvocation().getModuleHash() ==
-         Invocation->getModuleHash() && "Module hash mismatch!");
-  
   // Construct a compiler instance that will be used to actually create the
   // module.
   CompilerInstance Instance(/*BuildingModule=*/true);
@@ -936,19 +894,13 @@ static void compileModuleImpl(CompilerInstance &ImportingInstance,
   // between all of the module CompilerInstances.
   Instance.setModuleDepCollector(ImportingInstance.getModuleDepCollector());
 
-  // Get or create the module map that we'll use to build this module.
+  // Create the module map that we'll use to build this module, if it has
+  // none.
   std::string InferredModuleMapContent;
-  if (const FileEntry *ModuleMapFile =
-          ModMap.getContainingModuleMapFile(Module)) {
-    // Use the module map where this module resides.
-    FrontendOpts.Inputs.push_back(
-        FrontendInputFile(ModuleMapFile->getName(), IK));
-  } else {
+  if (!ModuleMapFile) {
     llvm::raw_string_ostream OS(InferredModuleMapContent);
     Module->print(OS);
     OS.flush();
-    FrontendOpts.Inputs.push_back(
-        FrontendInputFile("__inferred_module.map", IK));
 
     llvm::MemoryBuffer *ModuleMapBuffer =
         llvm::MemoryBuffer::getMemBuffer(InferredModuleMapContent);
@@ -981,16 +933,13 @@ static void compileModuleImpl(CompilerInstance &ImportingInstance,
   }
 }
 
-static bool compileAndLoadModule(CompilerInstance &ImportingInstance,
+/// \brief Compile and load a module, coordinating with other compilations
+/// through lock files which they poll.
+static bool
+compileAndLoadModuleWithLockFile(CompilerInstance &ImportingInstance,
                                  SourceLocation ImportLoc,
-                                 SourceLocation ModuleNameLoc,
-                                 Module *Module,
+                                 SourceLocation ModuleNameLoc, Module *Module,
                                  StringRef ModuleFileName) {
-  // FIXME: have LockFileManager return an error_code so that we can
-  // avoid the mkdir when the directory already exists.
-  StringRef Dir = llvm::sys::path::parent_path(ModuleFileName);
-  llvm::sys::fs::create_directories(Dir);
-
   while (1) {
     unsigned ModuleLoadCapabilities = ASTReader::ARR_Missing;
     llvm::LockFileManager Locked(ModuleFileName);
@@ -1035,6 +984,70 @@ static bool compileAndLoadModule(CompilerInstance &ImportingInstance,
   }
 }
 
+static bool compileAndLoadModule(CompilerInstance &ImportingInstance,
+                                 SourceLocation ImportLoc,
+                                 SourceLocation ModuleNameLoc,
+                                 Module *Module,
+                                 StringRef ModuleFileName) {
+  // FIXME: have LockFileManager return an error_code so that we can
+  // avoid the mkdir when the directory already exists.
+  StringRef Dir = llvm::sys::path::parent_path(ModuleFileName);
+  llvm::sys::fs::create_directories(Dir);
+
+  ModuleFileLock Locked(ModuleFileName);
+  if (!Locked.isLocked())
+    return compileAndLoadModuleWithLockFile(ImportingInstance, ImportLoc,
+                                            ModuleNameLoc, Module,
+                                            ModuleFileName);
+
+  // If another compilation was building the module, use what it built,
+  // unless it is still out of date for us.
+  if (Locked.hadToWait()) {
+    ASTReader::ASTReadResult ReadResult =
+        ImportingInstance.getModuleManager()->ReadAST(
+            ModuleFileName, serialization::MK_Module, ImportLoc,
+            ASTReader::ARR_OutOfDate | ASTReader::ARR_Missing);
+    if (ReadResult != ASTReader::OutOfDate &&
+        ReadResult != ASTReader::Missing)
+      return ReadResult == ASTReader::Success;
+  }
+
+  // We're responsible for building the module ourselves.
+  compileModuleImpl(ImportingInstance, ModuleNameLoc, Module, ModuleFileName);
+
+  // Try to read the module file, now that we've compiled it.
+  ASTReader::ASTReadResult ReadResult =
+      ImportingInstance.getModuleManager()->ReadAST(
+          ModuleFileName, serialization::MK_Module, ImportLoc,
+          ASTReader::ARR_Missing);
+  if (ReadResult == ASTReader::Missing)
+    ImportingInstance.getDiagnostics().Report(ModuleNameLoc,
+                                              diag::err_module_not_built)
+        << Module->Name << SourceRange(ImportLoc, ModuleNameLoc);
+  return ReadResult == ASTReader::Success;
+}
+
+/// \brief Build the module and the modules it depends on which are out of
+/// date on several threads, if the importing instance allows it, and load it.
+///
+/// \returns false if the module still has to be built.
+static bool buildAndLoadModulesInParallel(CompilerInstance &ImportingInstance,
+                                          SourceLocation ImportLoc,
+                                          Module *Module,
+                                          StringRef ModuleFileName) {
+  unsigned NumJobs = ImportingInstance.getHeaderSearchOpts().ModuleBuildJobs;
+  if (NumJobs <= 1 || !ModuleBuildScheduler::isSupported(ImportingInstance))
+    return false;
+
+  ModuleBuildScheduler Scheduler(ImportingInstance);
+  if (!Scheduler.buildModules(Module, ImportLoc, NumJobs))
+    return false;
+  return ImportingInstance.getModuleManager()->ReadAST(
+             ModuleFileName, serialization::MK_Module, ImportLoc,
+             ASTReader::ARR_OutOfDate | ASTReader::ARR_Missing) ==
+         ASTReader::Success;
+}
+
 /// \brief Diagnose differences between the current definition of the given
 /// configuration macro and the definition provided on the command line.
 static void checkConfigMacro(Preprocessor &PP, StringRef ConfigMacro,
@@ -1196,6 +1209,9 @@ static void pruneModuleCache(const HeaderSearchOptions &HSOpts) {
       // Remove the timestamp file.
       std::string TimpestampFilename = File->path() + ".timestamp";
       llvm::sys::fs::remove(TimpestampFilename);
+
+      // The lock file stays: a compilation may have it open, or be about to
+      // open it, and would then lock a file no one else can see.
     }
 
     // If we removed all of the files in the directory, remove the directory
@@ -1348,8 +1364,11 @@ CompilerInstance::loadModule(SourceLocation ImportLoc,
         return ModuleLoadResult();
       }
 
-      // Try to compile and then load the module.
-      if (!compileAndLoadModule(*this, ImportLoc, ModuleNameLoc, Module,
+      // Try to build the modules it needs on several threads, then to compile
+      // what is still out of date and load the module.
+      if (!buildAndLoadModulesInParallel(*this, ImportLoc, Module,
+                                         ModuleFileName) &&
+          !compileAndLoadModule(*this, ImportLoc, ModuleNameLoc, Module,
                                 ModuleFileName)) {
         if (getPreprocessorOpts().FailedModules)
           getPreprocessorOpts().FailedModules->addFailed(ModuleName);
@@ -84,7 +84,8 @@ ASTConsumer *GeneratePCHAction::CreateASTConsumer(CompilerInstance &CI,
   if (!CI.getFrontendOpts().RelocatablePCH)
     Sysroot.clear();
   return new PCHGenerator(CI.getPreprocessor(), OutputFile, nullptr, Sysroot,
-                          OS);
+                          OS, /*AllowASTWithErrors=*/false,
+                          CI.getFrontendOpts().ParallelASTWrite);
 }
 
 bool GeneratePCHAction::ComputeASTConsumerArguments(CompilerInstance &CI,
@@ -120,7 +121,8 @@ ASTConsumer *GenerateModuleAction::CreateASTConsumer(CompilerInstance &CI,
     return nullptr;
 
   return new PCHGenerator(CI.getPreprocessor(), OutputFile, Module, 
-                          Sysroot, OS);
+                          Sysroot, OS, /*AllowASTWithErrors=*/false,
+                          CI.getFrontendOpts().ParallelASTWrite);
 }
 
 static SmallVectorImpl<char> &
@@ -0,0 +1,669 @@
+//===--- ModuleBuildScheduler.cpp - Parallel Implicit Module Builds -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file implements the ModuleBuildScheduler and ModuleFileLock
+//  interfaces.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Frontend/ModuleBuildScheduler.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Frontend/FrontendDiagnostic.h"
+#include "clang/Frontend/Utils.h"
+#include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/Preprocessor.h"
+#include "clang/Lex/TokenPrefetcher.h"
+#include "clang/Serialization/ASTReader.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/CrashRecoveryContext.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#if defined(LLVM_ON_UNIX)
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+using namespace clang;
+
+/// \brief Determine the appropriate source input kind based on language
+/// options.
+static InputKind getSourceInputKindFromOptions(const LangOptions &LangOpts) {
+  if (LangOpts.OpenCL)
+    return IK_OpenCL;
+  if (LangOpts.CUDA)
+    return IK_CUDA;
+  if (LangOpts.ObjC1)
+    return LangOpts.CPlusPlus? IK_ObjCXX : IK_ObjC;
+  return LangOpts.CPlusPlus? IK_CXX : IK_C;
+}
+
+CompilerInvocation *clang::createModuleBuildInvocation(
+    const CompilerInvocation &ImportingInvocation, StringRef ModuleName,
+    StringRef ModuleMapFileName, StringRef ModuleFileName) {
+  CompilerInvocation *Invocation = new CompilerInvocation(ImportingInvocation);
+  PreprocessorOptions &PPOpts = Invocation->getPreprocessorOpts();
+
+  // For any options that aren't intended to affect how a module is built,
+  // reset them to their default values.
+  Invocation->getLangOpts()->resetNonModularOptions();
+  PPOpts.resetNonModularOptions();
+
+  // Remove any macro definitions that are explicitly ignored by the module.
+  // They aren't supposed to affect how the module is built anyway.
+  const HeaderSearchOptions &HSOpts = Invocation->getHeaderSearchOpts();
+  PPOpts.Macros.erase(
+      std::remove_if(PPOpts.Macros.begin(), PPOpts.Macros.end(),
+                     [&HSOpts](const std::pair<std::string, bool> &def) {
+        StringRef MacroDef = def.first;
+        return HSOpts.ModulesIgnoreMacros.count(MacroDef.split('=').first) > 0;
+      }),
+      PPOpts.Macros.end());
+
+  // Note the name of the module we're building.
+  Invocation->getLangOpts()->CurrentModule = ModuleName;
+
+  // Build the module from the module map defining it.
+  FrontendOptions &FrontendOpts = Invocation->getFrontendOpts();
+  FrontendOpts.OutputFile = ModuleFileName.str();
+  FrontendOpts.DisableFree = false;
+  FrontendOpts.GenerateGlobalModuleIndex = false;
+  FrontendOpts.Inputs.clear();
+  FrontendOpts.Inputs.push_back(FrontendInputFile(
+      ModuleMapFileName, getSourceInputKindFromOptions(
+                             *Invocation->getLangOpts())));
+
+  // Don't free the remapped file buffers; they are owned by our caller.
+  PPOpts.RetainRemappedFileBuffers = true;
+
+  Invocation->getDiagnosticOpts().VerifyDiagnostics = 0;
+  assert(ImportingInvocation.getModuleHash() ==
+         Invocation->getModuleHash() && "Module hash mismatch!");
+  return Invocation;
+}
+
+//===----------------------------------------------------------------------===//
+// ModuleFileLock
+//===----------------------------------------------------------------------===//
+
+/// \brief How long a compilation waits for the owner of a module file lock
+/// before it gives up, as LockFileManager does.
+static const unsigned ModuleFileLockTimeoutSeconds = 300;
+
+#if defined(LLVM_ON_UNIX)
+namespace {
+/// \brief The state shared by a compilation waiting for a module file lock
+/// and the thread blocked in flock() on its behalf, which outlives the wait
+/// if the compilation gives up.
+struct ModuleFileLockWaiter {
+  ModuleFileLockWaiter() : Finished(false), Acquired(false), Abandoned(false) {}
+
+  std::mutex Lock;
+  std::condition_variable Done;
+  bool Finished;
+  bool Acquired;
+  /// \brief Set when the compilation stopped waiting; the thread then owns
+  /// the lock file, and closes it once flock() returns.
+  bool Abandoned;
+};
+}
+
+/// \brief Take the lock on \p FD in a thread of its own, and wait for at most
+/// ModuleFileLockTimeoutSeconds for it.
+///
+/// \returns Whether the lock was taken. If not, \p FD is no longer the
+/// caller's to close.
+static bool waitForModuleFileLock(int FD) {
+  std::shared_ptr<ModuleFileLockWaiter> Waiter =
+      std::make_shared<ModuleFileLockWaiter>();
+  std::thread Thread([Waiter, FD]() {
+    int Result;
+    do
+      Result = ::flock(FD, LOCK_EX);
+    while (Result && errno == EINTR);
+
+    std::lock_guard<std::mutex> Guard(Waiter->Lock);
+    if (Waiter->Abandoned) {
+      ::close(FD);
+      return;
+    }
+    Waiter->Finished = true;
+    Waiter->Acquired = Result == 0;
+    Waiter->Done.notify_one();
+  });
+
+  std::unique_lock<std::mutex> Guard(Waiter->Lock);
+  if (Waiter->Done.wait_for(Guard,
+                            std::chrono::seconds(ModuleFileLockTimeoutSeconds),
+                            [&]() { return Waiter->Finished; })) {
+    bool Acquired = Waiter->Acquired;
+    Guard.unlock();
+    Thread.join();
+    if (!Acquired)
+      ::close(FD);
+    return Acquired;
+  }
+
+  // The owner hangs. Leave the thread blocked in flock(); it releases the
+  // lock as soon as it gets it.
+  Waiter->Abandoned = true;
+  Guard.unlock();
+  Thread.detach();
+  return false;
+}
+#endif
+
+ModuleFileLock::ModuleFileLock(StringRef ModuleFileName)
+  : FD(-1), Waited(false) {
+#if defined(LLVM_ON_UNIX)
+  std::string LockFileName = getLockFileName(ModuleFileName);
+  int Flags = O_RDWR | O_CREAT;
+#ifdef O_CLOEXEC
+  Flags |= O_CLOEXEC;
+#endif
+  do
+    FD = ::open(LockFileName.c_str(), Flags, 0666);
+  while (FD < 0 && errno == EINTR);
+  if (FD < 0)
+    return;
+
+  if (::flock(FD, LOCK_EX | LOCK_NB) == 0)
+    return;
+  if (errno != EWOULDBLOCK) {
+    ::close(FD);
+    FD = -1;
+    return;
+  }
+
+  // Wait for the owner to release the lock, or to exit. flock() cannot wait
+  // for a limited time, and an owner which hangs must not block the other
+  // compilations forever, so the wait happens on another thread.
+  Waited = true;
+  if (!waitForModuleFileLock(FD))
+    FD = -1;
+#endif
+}
+
+ModuleFileLock::~ModuleFileLock() {
+#if defined(LLVM_ON_UNIX)
+  // Closing the lock file releases the lock.
+  if (FD >= 0)
+    ::close(FD);
+#endif
+}
+
+std::string ModuleFileLock::getLockFileName(StringRef ModuleFileName) {
+  return (ModuleFileName + ".lck").str();
+}
+
+//===----------------------------------------------------------------------===//
+// ModuleBuildScheduler
+//===----------------------------------------------------------------------===//
+
+/// \brief Returns the modification time of the file at \p Path, or zero if
+/// it does not exist.
+static uint64_t getModificationTime(vfs::FileSystem &FS, StringRef Path) {
+  llvm::ErrorOr<vfs::Status> Status = FS.status(Path);
+  if (!Status)
+    return 0;
+  return Status->getLastModificationTime().toEpochTime();
+}
+
+namespace {
+/// \brief Collects the names of the input files of an AST file.
+class InputFileCollector : public ASTReaderListener {
+  bool CollectSystemFiles;
+
+public:
+  std::vector<std::string> Files;
+
+  explicit InputFileCollector(bool CollectSystemFiles)
+    : CollectSystemFiles(CollectSystemFiles) {}
+
+  bool needsInputFileVisitation() override { return true; }
+  bool needsSystemInputFileVisitation() override {
+    return CollectSystemFiles;
+  }
+  bool visitInputFile(StringRef Filename, bool isSystem,
+                      bool isOverridden) override {
+    if (!isOverridden)
+      Files.push_back(Filename);
+    return true;
+  }
+};
+
+/// \brief Keeps the diagnostics of a module build, for the importing
+/// compilation to report.
+class StoringDiagnosticConsumer : public DiagnosticConsumer {
+  std::vector<StoredDiagnostic> &Diagnostics;
+
+public:
+  explicit StoringDiagnosticConsumer(std::vector<StoredDiagnostic> &Diagnostics)
+    : Diagnostics(Diagnostics) {}
+
+  void HandleDiagnostic(DiagnosticsEngine::Level Level,
+                        const Diagnostic &Info) override {
+    DiagnosticConsumer::HandleDiagnostic(Level, Info);
+    Diagnostics.push_back(StoredDiagnostic(Level, Info));
+  }
+};
+}
+
+ModuleBuildScheduler::ModuleBuildScheduler(CompilerInstance &ImportingInstance)
+  : ImportingInstance(ImportingInstance),
+    FS(&ImportingInstance.getVirtualFileSystem()), NumUnfinished(0) {}
+
+ModuleBuildScheduler::~ModuleBuildScheduler() {}
+
+bool ModuleBuildScheduler::isSupported(CompilerInstance &ImportingInstance) {
+#if LLVM_ENABLE_THREADS && defined(LLVM_ON_UNIX)
+  // Only the real file system is known to be safe to use from several
+  // threads, and the module dependency collector is not.
+  return &ImportingInstance.getVirtualFileSystem() ==
+             vfs::getRealFileSystem().get() &&
+         !ImportingInstance.getModuleDepCollector();
+#else
+  return false;
+#endif
+}
+
+/// \brief Sets up the header search the headers are scanned with, and returns
+/// the module \p M of the importing compilation as it knows it, if it can.
+Module *ModuleBuildScheduler::createHeaderSearch(Module *M) {
+  if (!M->ModuleMap)
+    return nullptr;
+
+  // The importing compilation reports any problem with the module maps.
+  ScanDiags = new DiagnosticsEngine(
+      ImportingInstance.getDiagnostics().getDiagnosticIDs(),
+      &ImportingInstance.getDiagnosticOpts(), new IgnoringDiagConsumer());
+  ScanSourceMgr.reset(
+      new SourceManager(*ScanDiags, ImportingInstance.getFileManager()));
+  ScanHeaderInfo.reset(new HeaderSearch(
+      &ImportingInstance.getHeaderSearchOpts(), *ScanSourceMgr, *ScanDiags,
+      ImportingInstance.getLangOpts(), &ImportingInstance.getTarget()));
+  ApplyHeaderSearchOptions(*ScanHeaderInfo,
+                           ImportingInstance.getHeaderSearchOpts(),
+                           ImportingInstance.getLangOpts(),
+                           ImportingInstance.getTarget().getTriple());
+  ScanHeaderInfo->setModuleCachePath(ImportingInstance.getPreprocessor()
+                                         .getHeaderSearchInfo()
+                                         .getModuleCachePath());
+
+  if (ScanHeaderInfo->loadModuleMapFile(M->ModuleMap, M->IsSystem))
+    return nullptr;
+  return ScanHeaderInfo->getModuleMap().findModule(M->Name);
+}
+
+bool ModuleBuildScheduler::canSchedule(Module *M) {
+  // A module which has no module map file of its own, such as an inferred
+  // framework module, or which is identified by another module map file than
+  // the one defining it, can only be built by the importing compilation.
+  ModuleMap &ModMap = ScanHeaderInfo->getModuleMap();
+  if (!M->isAvailable() || !M->ModuleMap ||
+      ModMap.getContainingModuleMapFile(M) != M->ModuleMap)
+    return false;
+
+  // Leave the modules being built, which would form a cycle, to the importing
+  // compilation to diagnose.
+  if (M->Name == ImportingInstance.getLangOpts().CurrentModule)
+    return false;
+  for (unsigned I = 0, N = BuildStack.size(); I != N; ++I)
+    if (BuildStack[I] == M->Name)
+      return false;
+  return true;
+}
+
+unsigned ModuleBuildScheduler::getOrCreateNode(Module *M) {
+  llvm::DenseMap<const Module *, unsigned>::iterator Known = NodeIDs.find(M);
+  if (Known != NodeIDs.end())
+    return Known->second;
+
+  ModuleNode Node;
+  Node.M = M;
+  Node.ModuleFileName = ScanHeaderInfo->getModuleFileName(M);
+  Node.ModTime = getModificationTime(*FS, Node.ModuleFileName);
+  Node.IsSystem = M->IsSystem;
+  Node.NumPendingDependencies = 0;
+  Node.NeedsBuild = false;
+  Node.Failed = false;
+  Nodes.push_back(Node);
+  NodeIDs[M] = Nodes.size() - 1;
+  return Nodes.size() - 1;
+}
+
+void ModuleBuildScheduler::findDependencies(unsigned ID) {
+  FileManager &FileMgr = ImportingInstance.getFileManager();
+  HeaderSearch &HS = *ScanHeaderInfo;
+  Module *Top = Nodes[ID].M;
+
+  // Start from the headers of the module and of its submodules.
+  SmallVector<const FileEntry *, 16> Worklist;
+  SmallVector<Module *, 8> Submodules(1, Top);
+  while (!Submodules.empty()) {
+    Module *M = Submodules.pop_back_val();
+    Worklist.append(M->NormalHeaders.begin(), M->NormalHeaders.end());
+    Worklist.append(M->PrivateHeaders.begin(), M->PrivateHeaders.end());
+    if (const FileEntry *UmbrellaHeader = M->getUmbrellaHeader()) {
+      Worklist.push_back(UmbrellaHeader);
+    } else if (const DirectoryEntry *UmbrellaDir = M->getUmbrellaDir()) {
+      std::error_code EC;
+      SmallString<128> DirNative;
+      llvm::sys::path::native(UmbrellaDir->getName(), DirNative);
+      for (llvm::sys::fs::recursive_directory_iterator Dir(DirNative.str(), EC),
+                                                       DirEnd;
+           Dir != DirEnd && !EC; Dir.increment(EC)) {
+        if (!llvm::StringSwitch<bool>(llvm::sys::path::extension(Dir->path()))
+                 .Cases(".h", ".H", ".hh", ".hpp", true)
+                 .Default(false))
+          continue;
+        if (const FileEntry *Header = FileMgr.getFile(Dir->path()))
+          Worklist.push_back(Header);
+      }
+    }
+    Submodules.append(M->submodule_begin(), M->submodule_end());
+  }
+
+  // Follow the headers they include into other modules, and scan the
+  // headers which are not part of any module as part of this one.
+  llvm::SmallPtrSet<const FileEntry *, 16> Scanned;
+  while (!Worklist.empty()) {
+    const FileEntry *File = Worklist.pop_back_val();
+    if (!Scanned.insert(File))
+      continue;
+
+    std::unique_ptr<llvm::MemoryBuffer> Buffer(FileMgr.getBufferForFile(File));
+    if (!Buffer)
+      continue;
+    SmallVector<std::pair<StringRef, bool>, 16> Includes;
+    TokenPrefetcher::findIncludes(Buffer->getBuffer(), Includes);
+
+    for (unsigned I = 0, E = Includes.size(); I != E; ++I) {
+      const DirectoryLookup *CurDir;
+      ModuleMap::KnownHeader Suggested;
+      const FileEntry *Included =
+          HS.LookupFile(Includes[I].first, SourceLocation(),
+                        Includes[I].second, nullptr, CurDir, File, nullptr,
+                        nullptr, &Suggested);
+      if (!Included)
+        continue;
+
+      Module *Imported = Suggested.getModule();
+      if (!Imported || Imported->getTopLevelModule() == Top) {
+        Worklist.push_back(Included);
+        continue;
+      }
+      Imported = Imported->getTopLevelModule();
+      if (!canSchedule(Imported))
+        continue;
+
+      unsigned DepID = getOrCreateNode(Imported);
+      SmallVectorImpl<unsigned> &Deps = Nodes[ID].Dependencies;
+      if (std::find(Deps.begin(), Deps.end(), DepID) != Deps.end())
+        continue;
+      Deps.push_back(DepID);
+      Nodes[DepID].Dependents.push_back(ID);
+    }
+  }
+}
+
+bool ModuleBuildScheduler::sortNodes(std::vector<unsigned> &Order) {
+  // Visit the modules depth-first, emitting each after its dependencies.
+  enum { Unvisited, Visiting, Visited };
+  std::vector<char> State(Nodes.size(), Unvisited);
+  SmallVector<std::pair<unsigned, unsigned>, 16> Stack;
+  Stack.push_back(std::make_pair(0u, 0u));
+  State[0] = Visiting;
+  while (!Stack.empty()) {
+    unsigned ID = Stack.back().first;
+    unsigned &NextDep = Stack.back().second;
+    if (NextDep == Nodes[ID].Dependencies.size()) {
+      State[ID] = Visited;
+      Order.push_back(ID);
+      Stack.pop_back();
+      continue;
+    }
+
+    unsigned DepID = Nodes[ID].Dependencies[NextDep++];
+    if (State[DepID] == Visiting)
+      return false;
+    if (State[DepID] == Unvisited) {
+      State[DepID] = Visiting;
+      Stack.push_back(std::make_pair(DepID, 0u));
+    }
+  }
+  return true;
+}
+
+bool ModuleBuildScheduler::isOutOfDate(const ModuleNode &Node) {
+  if (!Node.ModTime)
+    return true;
+
+  // A module file is known to be out of date if one of its input files was
+  // modified after it was written. Anything else is left to the ASTReader.
+  InputFileCollector Collector(
+      ImportingInstance.getHeaderSearchOpts().ModulesValidateSystemHeaders);
+  if (ASTReader::readASTFileControlBlock(Node.ModuleFileName,
+                                         ImportingInstance.getFileManager(),
+                                         Collector))
+    return true;
+  for (unsigned I = 0, N = Collector.Files.size(); I != N; ++I) {
+    uint64_t ModTime = getModificationTime(*FS, Collector.Files[I]);
+    if (!ModTime || ModTime > Node.ModTime)
+      return true;
+  }
+  return false;
+}
+
+void ModuleBuildScheduler::buildModule(ModuleNode &Node) {
+  // If another compilation was building the module, use what it built.
+  ModuleFileLock Locked(Node.ModuleFileName);
+  if (!Locked.isLocked()) {
+    Node.Failed = true;
+    return;
+  }
+  if (Locked.hadToWait() &&
+      getModificationTime(*FS, Node.ModuleFileName) != Node.ModTime)
+    return;
+
+  CompilerInstance Instance(/*BuildingModule=*/true);
+  Instance.setInvocation(&*Node.Invocation);
+
+  // The diagnostic consumer of the importing compilation cannot be used from
+  // several threads, so keep the diagnostics for it to report once all the
+  // builds are over. Leave the count of warnings and errors to it as well.
+  Node.Invocation->getDiagnosticOpts().ShowCarets = false;
+  Instance.createDiagnostics(new StoringDiagnosticConsumer(Node.Diagnostics),
+                             /*ShouldOwnClient=*/true);
+
+  // The file manager of the importing compilation cannot be shared between
+  // threads, so the module map is looked up again in a file manager of its
+  // own.
+  Instance.setVirtualFileSystem(FS);
+  Instance.createFileManager();
+  Instance.createSourceManager(Instance.getFileManager());
+  SourceManager &SourceMgr = Instance.getSourceManager();
+
+  // The diagnostics refer to the source manager of the build; keep it.
+  Node.Diags = &Instance.getDiagnostics();
+  Node.FileMgr = &Instance.getFileManager();
+  Node.SourceMgr = &SourceMgr;
+  for (unsigned I = 0, N = BuildStack.size(); I != N; ++I)
+    SourceMgr.pushModuleBuildStack(BuildStack[I],
+                                   FullSourceLoc(SourceLocation(), SourceMgr));
+  SourceMgr.pushModuleBuildStack(Node.Invocation->getLangOpts()->CurrentModule,
+                                 FullSourceLoc(SourceLocation(), SourceMgr));
+
+  GenerateModuleAction CreateModuleAction(/*ModuleMap=*/nullptr,
+                                          Node.IsSystem);
+  const unsigned ThreadStackSize = 8 << 20;
+  bool Succeeded = false;
+  llvm::CrashRecoveryContext CRC;
+  CRC.RunSafelyOnThread(
+      [&]() { Succeeded = Instance.ExecuteAction(CreateModuleAction); },
+      ThreadStackSize);
+  Instance.clearOutputFiles(/*EraseFiles=*/true);
+  Node.Failed = !Succeeded;
+
+  // The importing compilation diagnoses the modules which failed when it
+  // builds them again.
+  if (Node.Failed || Node.Diagnostics.empty()) {
+    Node.Diagnostics.clear();
+    Node.SourceMgr = nullptr;
+    Node.FileMgr = nullptr;
+    Node.Diags = nullptr;
+  }
+}
+
+void ModuleBuildScheduler::runWorker() {
+  std::unique_lock<std::mutex> Guard(Lock);
+  while (true) {
+    ReadyChanged.wait(Guard,
+                      [this] { return !Ready.empty() || !NumUnfinished; });
+    if (Ready.empty())
+      return;
+    unsigned ID = Ready.back();
+    Ready.pop_back();
+
+    Guard.unlock();
+    buildModule(Nodes[ID]);
+    Guard.lock();
+
+    // Start the modules which were waiting for this one. If it failed, they
+    // cannot be built either.
+    SmallVector<unsigned, 4> Finished(1, ID);
+    while (!Finished.empty()) {
+      const ModuleNode &Done = Nodes[Finished.pop_back_val()];
+      --NumUnfinished;
+      for (unsigned I = 0, N = Done.Dependents.size(); I != N; ++I) {
+        ModuleNode &User = Nodes[Done.Dependents[I]];
+        if (!User.NeedsBuild || User.Failed)
+          continue;
+        if (Done.Failed) {
+          User.Failed = true;
+          Finished.push_back(Done.Dependents[I]);
+        } else if (--User.NumPendingDependencies == 0) {
+          Ready.push_back(Done.Dependents[I]);
+        }
+      }
+    }
+    ReadyChanged.notify_all();
+  }
+}
+
+unsigned ModuleBuildScheduler::buildModules(Module *M, SourceLocation ImportLoc,
+                                            unsigned NumThreads) {
+  ModuleBuildStack ImportingStack =
+      ImportingInstance.getSourceManager().getModuleBuildStack();
+  for (unsigned I = 0, N = ImportingStack.size(); I != N; ++I)
+    BuildStack.push_back(ImportingStack[I].first);
+  Module *Top = createHeaderSearch(M);
+  if (!Top || !canSchedule(Top))
+    return 0;
+
+  // Discover the modules M depends on. A cycle among them is diagnosed by
+  // the importing compilation.
+  getOrCreateNode(Top);
+  for (unsigned ID = 0; ID != Nodes.size(); ++ID)
+    findDependencies(ID);
+  std::vector<unsigned> Order;
+  if (!sortNodes(Order))
+    return 0;
+
+  // Decide which modules to rebuild, and set up their builds.
+  for (unsigned I = 0, N = Order.size(); I != N; ++I) {
+    unsigned ID = Order[I];
+    ModuleNode &Node = Nodes[ID];
+    Node.NeedsBuild = ID == 0;
+    for (unsigned J = 0, NumDeps = Node.Dependencies.size(); J != NumDeps;
+         ++J) {
+      if (Nodes[Node.Dependencies[J]].NeedsBuild) {
+        Node.NeedsBuild = true;
+        ++Node.NumPendingDependencies;
+      }
+    }
+    if (!Node.NeedsBuild && !isOutOfDate(Node))
+      continue;
+    Node.NeedsBuild = true;
+    ++NumUnfinished;
+
+    // The importing compilation reported the build of the module it imports.
+    if (ID != 0)
+      ImportingInstance.getDiagnostics().Report(ImportLoc,
+                                                diag::remark_module_build)
+          << Node.M->Name << Node.ModuleFileName;
+
+    const FileEntry *ModuleMapFile = Node.M->ModuleMap;
+    Node.Invocation = createModuleBuildInvocation(
+        ImportingInstance.getInvocation(), Node.M->Name,
+        ModuleMapFile->getName(), Node.ModuleFileName);
+
+    // The builds share nothing with the importing compilation or with each
+    // other, and build the modules they find missing one at a time.
+    Node.Invocation->getPreprocessorOpts().FailedModules =
+        new PreprocessorOptions::FailedModulesSet;
+    Node.Invocation->getHeaderSearchOpts().ModuleBuildJobs = 1;
+    Node.Invocation->getDependencyOutputOpts() = DependencyOutputOptions();
+    Node.Invocation->getDiagnosticOpts().DiagnosticLogFile.clear();
+    Node.Invocation->getDiagnosticOpts().DiagnosticSerializationFile.clear();
+    Node.Invocation->getFrontendOpts().ShowStats = false;
+    Node.Invocation->getFrontendOpts().ShowTimers = false;
+    Node.Invocation->getHeaderSearchOpts().Verbose = false;
+
+    if (!Node.NumPendingDependencies)
+      Ready.push_back(ID);
+  }
+
+  // The modules are built by a pool of threads, this one included.
+  std::vector<std::thread> Workers;
+  for (unsigned I = 1, N = std::min(NumThreads, NumUnfinished); I < N; ++I)
+    Workers.push_back(std::thread(&ModuleBuildScheduler::runWorker, this));
+  runWorker();
+  for (unsigned I = 0, N = Workers.size(); I != N; ++I)
+    Workers[I].join();
+
+  // Report the warnings of the modules built to the importing compilation,
+  // as if it had built them itself.
+  unsigned NumBuilt = 0;
+  for (unsigned I = 0, N = Order.size(); I != N; ++I) {
+    ModuleNode &Node = Nodes[Order[I]];
+    if (!Node.NeedsBuild || Node.Failed)
+      continue;
+    ++NumBuilt;
+    if (Node.Diagnostics.empty())
+      continue;
+
+    DiagnosticsEngine Diags(
+        ImportingInstance.getDiagnostics().getDiagnosticIDs(),
+        &ImportingInstance.getDiagnosticOpts(),
+        new ForwardingDiagnosticConsumer(
+            ImportingInstance.getDiagnosticClient()));
+    Diags.setSourceManager(Node.SourceMgr.get());
+    for (unsigned J = 0, NumDiags = Node.Diagnostics.size(); J != NumDiags;
+         ++J)
+      Diags.Report(Node.Diagnostics[J]);
+  }
+
+  if (NumBuilt && ImportingInstance.getFrontendOpts().GenerateGlobalModuleIndex)
+    ImportingInstance.setBuildGlobalModuleIndex(true);
+  return NumBuilt;
+}
@@ -0,0 +1,871 @@
+//===--- HeaderEffectsCache.cpp - Replay Macro Effects of Headers ---------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file implements the HeaderEffectsCache interface.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Lex/HeaderEffectsCache.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Basic/TargetInfo.h"
+#include "clang/Basic/Version.h"
+#include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/MacroInfo.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "clang/Lex/Preprocessor.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/TimeValue.h"
+#include "llvm/Support/raw_ostream.h"
+using namespace clang;
+
+/// \brief The number of inclusions with different incoming macros that are
+/// remembered for each header.
+static const unsigned MaxVariants = 8;
+
+/// \brief The number of records appended to the cache file after which the
+/// next compilation to change the cache rewrites it as a single record.
+static const unsigned MaxRecords = 32;
+
+static const char CacheMagic[] = "CLANG-HEADER-EFFECTS";
+static const unsigned CacheVersion = 2;
+
+namespace {
+enum MacroFlags {
+  MF_FunctionLike = 0x01,
+  MF_C99Varargs = 0x02,
+  MF_GNUVarargs = 0x04,
+  MF_HasCommaPasting = 0x08,
+  MF_Used = 0x10,
+  MF_UsedForHeaderGuard = 0x20
+};
+
+/// \brief Reads the cache file, a sequence of decimal numbers and of strings
+/// prefixed with their length and a colon, each followed by a space.
+class CacheReader {
+  StringRef Data;
+  bool Failed;
+
+public:
+  explicit CacheReader(StringRef Data) : Data(Data), Failed(false) {}
+
+  bool hasFailed() const { return Failed; }
+  bool atEnd() const { return Data.empty(); }
+
+  uint64_t readNumber() {
+    uint64_t Value = 0;
+    size_t Space = Data.find(' ');
+    if (Failed || Space == StringRef::npos ||
+        Data.substr(0, Space).getAsInteger(10, Value)) {
+      Failed = true;
+      return 0;
+    }
+    Data = Data.substr(Space + 1);
+    return Value;
+  }
+
+  std::string readString() {
+    uint64_t Length = 0;
+    size_t Colon = Data.find(':');
+    if (Failed || Colon == StringRef::npos ||
+        Data.substr(0, Colon).getAsInteger(10, Length) ||
+        Data.size() - Colon - 1 <= Length || Data[Colon + 1 + Length] != ' ') {
+      Failed = true;
+      return std::string();
+    }
+    std::string Value = Data.substr(Colon + 1, Length).str();
+    Data = Data.substr(Colon + 2 + Length);
+    return Value;
+  }
+};
+}
+
+static void writeNumber(raw_ostream &OS, uint64_t Value) {
+  OS << Value << ' ';
+}
+
+static void writeString(raw_ostream &OS, StringRef Value) {
+  OS << Value.size() << ':' << Value << ' ';
+}
+
+/// \brief A checksum of a record, which detects records that were torn by
+/// concurrent appends or are still being written.
+static std::string getChecksum(StringRef Data) {
+  llvm::MD5 Hash;
+  Hash.update(Data);
+  llvm::MD5::MD5Result Result;
+  Hash.final(Result);
+  SmallString<32> Hex;
+  llvm::MD5::stringifyResult(Result, Hex);
+  return Hex.str();
+}
+
+static bool parseRecord(StringRef Data,
+                        HeaderEffectsCache::EntryMap &Headers) {
+  CacheReader Reader(Data);
+  for (uint64_t I = 0, E = Reader.readNumber(); I != E && !Reader.hasFailed();
+       ++I) {
+    std::string Key = Reader.readString();
+    HeaderEffectsCache::HeaderEntry &Entry = Headers[Key];
+    Entry.Size = Reader.readNumber();
+    Entry.ModTime = Reader.readNumber();
+    Entry.RecordTime = Reader.readNumber();
+    Entry.ContentHash = Reader.readString();
+    Entry.Replayable = Reader.readNumber();
+
+    for (uint64_t VI = 0, VE = Reader.readNumber();
+         VI != VE && !Reader.hasFailed(); ++VI) {
+      Entry.Variants.push_back(HeaderEffectsCache::Variant());
+      HeaderEffectsCache::Variant &V = Entry.Variants.back();
+      V.Characteristic = Reader.readNumber();
+      V.ControllingMacro = Reader.readString();
+
+      for (uint64_t SI = 0, SE = Reader.readNumber();
+           SI != SE && !Reader.hasFailed(); ++SI) {
+        HeaderEffectsCache::MacroState State;
+        State.Name = Reader.readString();
+        State.Definition = Reader.readString();
+        State.MarkedUsed = Reader.readNumber();
+        V.Signature.push_back(State);
+      }
+
+      for (uint64_t EI = 0, EE = Reader.readNumber();
+           EI != EE && !Reader.hasFailed(); ++EI) {
+        V.Effects.push_back(HeaderEffectsCache::MacroSnapshot());
+        HeaderEffectsCache::MacroSnapshot &Macro = V.Effects.back();
+        Macro.Name = Reader.readString();
+        Macro.IsDefinition = Reader.readNumber();
+        Macro.Offset = Reader.readNumber();
+        Macro.EndOffset = Reader.readNumber();
+        Macro.Flags = Reader.readNumber();
+        if (Macro.Name.empty() || Macro.Offset >= Entry.Size ||
+            Macro.EndOffset >= Entry.Size)
+          return false;
+
+        for (uint64_t PI = 0, PE = Reader.readNumber();
+             PI != PE && !Reader.hasFailed(); ++PI)
+          Macro.Params.push_back(Reader.readString());
+
+        for (uint64_t TI = 0, TE = Reader.readNumber();
+             TI != TE && !Reader.hasFailed(); ++TI) {
+          HeaderEffectsCache::TokenSnapshot Tok;
+          Tok.Kind = Reader.readNumber();
+          Tok.Flags = Reader.readNumber();
+          Tok.Offset = Reader.readNumber();
+          Tok.Length = Reader.readNumber();
+          Tok.Identifier = Reader.readString();
+
+          // Never hand the preprocessor a token it could not have lexed.
+          if (Tok.Kind >= tok::NUM_TOKENS ||
+              tok::isAnnotation(tok::TokenKind(Tok.Kind)) ||
+              Tok.Kind == tok::raw_identifier || Tok.Flags > 0xFF ||
+              Tok.Offset >= Entry.Size || Tok.Length > Entry.Size ||
+              (!Tok.Identifier.empty() &&
+               tok::isLiteral(tok::TokenKind(Tok.Kind))))
+            return false;
+          Macro.Tokens.push_back(Tok);
+        }
+      }
+    }
+  }
+
+  return !Reader.hasFailed();
+}
+
+/// \brief Whether \p A and \p B were recorded from the same contents of a
+/// header.
+static bool isSameContents(const HeaderEffectsCache::HeaderEntry &A,
+                           const HeaderEffectsCache::HeaderEntry &B) {
+  return A.Size == B.Size && A.ModTime == B.ModTime &&
+         A.ContentHash == B.ContentHash;
+}
+
+/// \brief Whether \p A and \p B are inclusions of a header with the same
+/// incoming macros, which thus have the same effects.
+static bool isSameInclusion(const HeaderEffectsCache::Variant &A,
+                            const HeaderEffectsCache::Variant &B) {
+  if (A.Characteristic != B.Characteristic ||
+      A.Signature.size() != B.Signature.size())
+    return false;
+  for (unsigned I = 0, E = A.Signature.size(); I != E; ++I)
+    if (A.Signature[I].Name != B.Signature[I].Name ||
+        A.Signature[I].Definition != B.Signature[I].Definition)
+      return false;
+  return true;
+}
+
+static void addVariant(HeaderEffectsCache::HeaderEntry &Entry,
+                       const HeaderEffectsCache::Variant &V) {
+  for (unsigned I = 0, E = Entry.Variants.size(); I != E; ++I)
+    if (isSameInclusion(Entry.Variants[I], V))
+      return;
+  if (Entry.Variants.size() == MaxVariants)
+    Entry.Variants.erase(Entry.Variants.begin());
+  Entry.Variants.push_back(V);
+}
+
+/// \brief Merge the newer entry \p From for a header into \p Into.
+static void mergeEntry(HeaderEffectsCache::HeaderEntry &Into,
+                       const HeaderEffectsCache::HeaderEntry &From) {
+  if (!From.Replayable || !Into.Replayable || !isSameContents(Into, From)) {
+    Into = From;
+    return;
+  }
+  for (unsigned I = 0, E = From.Variants.size(); I != E; ++I)
+    addVariant(Into, From.Variants[I]);
+}
+
+/// \brief Read the records of the cache file \p Data into \p Headers, each
+/// record updating the entries of the ones before it.
+///
+/// Returns false if the file was written by a different version of the
+/// format or has a corrupt record, such as one still being appended. The
+/// records before a corrupt one are kept.
+static bool readCacheFile(StringRef Data,
+                          HeaderEffectsCache::EntryMap &Headers,
+                          unsigned &NumRecords) {
+  NumRecords = 0;
+  CacheReader Reader(Data);
+  if (Reader.readString() != CacheMagic || Reader.readNumber() != CacheVersion)
+    return false;
+
+  while (!Reader.atEnd()) {
+    std::string Record = Reader.readString();
+    std::string Checksum = Reader.readString();
+    HeaderEffectsCache::EntryMap Entries;
+    if (Reader.hasFailed() || Checksum != getChecksum(Record) ||
+        !parseRecord(Record, Entries))
+      return false;
+    for (HeaderEffectsCache::EntryMap::iterator I = Entries.begin(),
+                                                E = Entries.end();
+         I != E; ++I)
+      mergeEntry(Headers[I->getKey()], I->second);
+    ++NumRecords;
+  }
+  return true;
+}
+
+static void writeRecord(raw_ostream &OS,
+                        const HeaderEffectsCache::EntryMap &Headers) {
+  writeNumber(OS, Headers.size());
+
+  for (HeaderEffectsCache::EntryMap::const_iterator I = Headers.begin(),
+                                                    E = Headers.end();
+       I != E; ++I) {
+    const HeaderEffectsCache::HeaderEntry &Entry = I->second;
+    writeString(OS, I->first());
+    writeNumber(OS, Entry.Size);
+    writeNumber(OS, Entry.ModTime);
+    writeNumber(OS, Entry.RecordTime);
+    writeString(OS, Entry.ContentHash);
+    writeNumber(OS, Entry.Replayable);
+    writeNumber(OS, Entry.Variants.size());
+
+    for (unsigned VI = 0, VE = Entry.Variants.size(); VI != VE; ++VI) {
+      const HeaderEffectsCache::Variant &V = Entry.Variants[VI];
+      writeNumber(OS, V.Characteristic);
+      writeString(OS, V.ControllingMacro);
+
+      writeNumber(OS, V.Signature.size());
+      for (unsigned SI = 0, SE = V.Signature.size(); SI != SE; ++SI) {
+        writeString(OS, V.Signature[SI].Name);
+        writeString(OS, V.Signature[SI].Definition);
+        writeNumber(OS, V.Signature[SI].MarkedUsed);
+      }
+
+      writeNumber(OS, V.Effects.size());
+      for (unsigned EI = 0, EE = V.Effects.size(); EI != EE; ++EI) {
+        const HeaderEffectsCache::MacroSnapshot &Macro = V.Effects[EI];
+        writeString(OS, Macro.Name);
+        writeNumber(OS, Macro.IsDefinition);
+        writeNumber(OS, Macro.Offset);
+        writeNumber(OS, Macro.EndOffset);
+        writeNumber(OS, Macro.Flags);
+
+        writeNumber(OS, Macro.Params.size());
+        for (unsigned PI = 0, PE = Macro.Params.size(); PI != PE; ++PI)
+          writeString(OS, Macro.Params[PI]);
+
+        writeNumber(OS, Macro.Tokens.size());
+        for (unsigned TI = 0, TE = Macro.Tokens.size(); TI != TE; ++TI) {
+          const HeaderEffectsCache::TokenSnapshot &Tok = Macro.Tokens[TI];
+          writeNumber(OS, Tok.Kind);
+          writeNumber(OS, Tok.Flags);
+          writeNumber(OS, Tok.Offset);
+          writeNumber(OS, Tok.Length);
+          writeString(OS, Tok.Identifier);
+        }
+      }
+    }
+  }
+}
+
+/// \brief Append the record of \p Headers, with its checksum, to \p OS.
+static void writeChecksummedRecord(raw_ostream &OS,
+                                   const HeaderEffectsCache::EntryMap &Headers) {
+  std::string Record;
+  llvm::raw_string_ostream RecordOS(Record);
+  writeRecord(RecordOS, Headers);
+  RecordOS.flush();
+  writeString(OS, Record);
+  writeString(OS, getChecksum(Record));
+}
+
+HeaderEffectsCache::HeaderEffectsCache(Preprocessor &PP, StringRef CacheFile)
+  : PP(PP), CacheFile(CacheFile), Loaded(false), NeedsRewrite(false),
+    NumReplayed(0), NumRecorded(0) {}
+
+HeaderEffectsCache::~HeaderEffectsCache() {}
+
+void HeaderEffectsCache::load() {
+  Loaded = true;
+
+  // What a header does depends on the language, on the target (through the
+  // width of integers in conditionals) and on which warnings it may emit.
+  // Predefined macros are part of the signatures.
+  std::string Configuration;
+  llvm::raw_string_ostream OS(Configuration);
+  OS << getClangFullRepositoryVersion() << ','
+     << PP.getTargetInfo().getTriple().str();
+  const LangOptions &LangOpts = PP.getLangOpts();
+#define LANGOPT(Name, Bits, Default, Description) \
+  OS << ',' << LangOpts.Name;
+#define ENUM_LANGOPT(Name, Type, Bits, Default, Description) \
+  OS << ',' << static_cast<unsigned>(LangOpts.get##Name());
+#include "clang/Basic/LangOptions.def"
+  const DiagnosticOptions &DiagOpts =
+      PP.getDiagnostics().getDiagnosticOptions();
+  OS << ',' << DiagOpts.IgnoreWarnings << ',' << DiagOpts.Pedantic << ','
+     << DiagOpts.PedanticErrors;
+  for (unsigned I = 0, E = DiagOpts.Warnings.size(); I != E; ++I)
+    OS << ",-W" << DiagOpts.Warnings[I];
+  OS.flush();
+
+  llvm::MD5 Hash;
+  Hash.update(Configuration);
+  llvm::MD5::MD5Result Result;
+  Hash.final(Result);
+  SmallString<32> Hex;
+  llvm::MD5::stringifyResult(Result, Hex);
+  ConfigurationHash = Hex.str();
+
+  // A missing or damaged cache file, or one with many appended records, is
+  // rewritten by save().
+  unsigned NumRecords = 0;
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> BufferOrErr =
+      llvm::MemoryBuffer::getFile(CacheFile);
+  NeedsRewrite = !BufferOrErr ||
+                 !readCacheFile(BufferOrErr.get()->getBuffer(), Headers,
+                                NumRecords) ||
+                 NumRecords > MaxRecords;
+}
+
+bool HeaderEffectsCache::isCurrent(const HeaderEntry &Entry,
+                                   const FileEntry *File, FileID FID) {
+  if (Entry.Size != uint64_t(File->getSize()) ||
+      Entry.ModTime != uint64_t(File->getModificationTime()))
+    return false;
+
+  // Modification times have a resolution of a second, so a header modified
+  // in the second it was recorded, or later, may have changed without
+  // changing its size or modification time. Compare its contents then.
+  if (Entry.ModTime < Entry.RecordTime)
+    return true;
+  std::string ContentHash;
+  return getContentHash(FID, ContentHash) && ContentHash == Entry.ContentHash;
+}
+
+bool HeaderEffectsCache::getContentHash(FileID FID, std::string &Hash) {
+  bool Invalid = false;
+  const llvm::MemoryBuffer *Buffer =
+      PP.getSourceManager().getBuffer(FID, SourceLocation(), &Invalid);
+  if (Invalid)
+    return false;
+  Hash = getChecksum(Buffer->getBuffer());
+  return true;
+}
+
+void HeaderEffectsCache::initEntry(HeaderEntry &Entry, const Recording &R) {
+  Entry = HeaderEntry();
+  Entry.Size = R.File->getSize();
+  Entry.ModTime = R.File->getModificationTime();
+  Entry.RecordTime = llvm::sys::TimeValue::now().toEpochTime();
+  getContentHash(R.FID, Entry.ContentHash);
+}
+
+std::string HeaderEffectsCache::getKey(const FileEntry *File) const {
+  // Relative names are relative to -working-directory, if any, and only then
+  // to the working directory of the process.
+  SmallString<256> Path(File->getName());
+  PP.getFileManager().FixupRelativePath(Path);
+  llvm::sys::fs::make_absolute(Path);
+  return ConfigurationHash + ':' + Path.str().str();
+}
+
+bool HeaderEffectsCache::getMacroState(IdentifierInfo *II,
+                                       std::string &State) {
+  State.clear();
+  const MacroInfo *MI = PP.getMacroInfo(II);
+  if (!MI)
+    return true;
+
+  // Uses of a macro checked by -Wunused-macros can produce diagnostics that
+  // depend on more than its definition.
+  if (MI->isWarnIfUnused())
+    return false;
+
+  llvm::raw_string_ostream OS(State);
+  if (MI->isBuiltinMacro()) {
+    OS << 'B';
+    OS.flush();
+    return true;
+  }
+
+  // Encode what MacroInfo::isIdenticalTo compares.
+  OS << 'D' << MI->isFunctionLike() << MI->isC99Varargs() << MI->isGNUVarargs();
+  for (MacroInfo::arg_iterator I = MI->arg_begin(), E = MI->arg_end(); I != E;
+       ++I)
+    OS << ' ' << (*I)->getName();
+  OS << ';';
+
+  SmallString<64> Buffer;
+  for (unsigned I = 0, E = MI->getNumTokens(); I != E; ++I) {
+    const Token &Tok = MI->getReplacementToken(I);
+    bool Invalid = false;
+    StringRef Spelling = PP.getSpelling(Tok, Buffer, &Invalid);
+    if (Invalid)
+      return false;
+    OS << Tok.getKind() << (Tok.hasLeadingSpace() ? '+' : '-')
+       << Spelling.size() << ':' << Spelling;
+  }
+  OS.flush();
+  return true;
+}
+
+bool HeaderEffectsCache::matches(const Variant &V) {
+  std::string State;
+  for (unsigned I = 0, E = V.Signature.size(); I != E; ++I) {
+    if (!getMacroState(PP.getIdentifierInfo(V.Signature[I].Name), State) ||
+        State != V.Signature[I].Definition)
+      return false;
+  }
+  return true;
+}
+
+bool HeaderEffectsCache::replay(const FileEntry *File, FileID FID,
+                                SourceLocation IncluderLoc) {
+  if (PP.isCodeCompletionEnabled())
+    return false;
+  if (!Loaded)
+    load();
+
+  // Diagnostic pragmas may enable warnings the recording did not see.
+  SourceManager &SM = PP.getSourceManager();
+  SourceLocation FileStart = SM.getLocForStartOfFile(FID);
+  if (!PP.getDiagnostics().hasCommandLineMappings(FileStart))
+    return false;
+
+  EntryMap::iterator Entry = Headers.find(getKey(File));
+  if (Entry == Headers.end() || !Entry->second.Replayable ||
+      !isCurrent(Entry->second, File, FID))
+    return false;
+
+  unsigned Characteristic = SM.getFileCharacteristic(FileStart);
+  const std::vector<Variant> &Variants = Entry->second.Variants;
+  for (unsigned I = 0, E = Variants.size(); I != E; ++I) {
+    if (Variants[I].Characteristic == Characteristic &&
+        matches(Variants[I])) {
+      replayEffects(Variants[I], File, FID, IncluderLoc);
+      ++NumReplayed;
+      return true;
+    }
+  }
+  return false;
+}
+
+void HeaderEffectsCache::replayEffects(const Variant &V, const FileEntry *File,
+                                       FileID FID,
+                                       SourceLocation IncluderLoc) {
+  SourceManager &SM = PP.getSourceManager();
+  PPCallbacks *Callbacks = PP.getPPCallbacks();
+  SourceLocation FileStart = SM.getLocForStartOfFile(FID);
+  if (Callbacks)
+    Callbacks->FileChanged(FileStart, PPCallbacks::EnterFile,
+                           SrcMgr::CharacteristicKind(V.Characteristic));
+
+  // The conditionals of the header marked the macros they tested as used.
+  for (unsigned I = 0, E = V.Signature.size(); I != E; ++I) {
+    if (!V.Signature[I].MarkedUsed)
+      continue;
+    if (MacroInfo *MI =
+            PP.getMacroInfo(PP.getIdentifierInfo(V.Signature[I].Name)))
+      PP.markMacroAsUsed(MI);
+  }
+
+  for (unsigned I = 0, E = V.Effects.size(); I != E; ++I) {
+    const MacroSnapshot &Macro = V.Effects[I];
+    IdentifierInfo *II = PP.getIdentifierInfo(Macro.Name);
+    Token MacroNameTok;
+    MacroNameTok.startToken();
+    MacroNameTok.setKind(II->getTokenID());
+    MacroNameTok.setIdentifierInfo(II);
+    MacroNameTok.setLocation(FileStart.getLocWithOffset(Macro.Offset));
+    MacroNameTok.setLength(Macro.Name.size());
+
+    if (!Macro.IsDefinition) {
+      MacroDirective *MD = PP.getMacroDirective(II);
+      if (Callbacks)
+        Callbacks->MacroUndefined(MacroNameTok, MD);
+      if (MD)
+        PP.appendMacroDirective(
+            II, PP.AllocateUndefMacroDirective(MacroNameTok.getLocation()));
+      continue;
+    }
+
+    MacroInfo *MI = PP.AllocateMacroInfo(MacroNameTok.getLocation());
+    if (Macro.Flags & MF_FunctionLike)
+      MI->setIsFunctionLike();
+    if (Macro.Flags & MF_C99Varargs)
+      MI->setIsC99Varargs();
+    if (Macro.Flags & MF_GNUVarargs)
+      MI->setIsGNUVarargs();
+    if (Macro.Flags & MF_HasCommaPasting)
+      MI->setHasCommaPasting();
+    MI->setIsUsed(Macro.Flags & MF_Used);
+    MI->setUsedForHeaderGuard(Macro.Flags & MF_UsedForHeaderGuard);
+
+    SmallVector<IdentifierInfo *, 8> Params;
+    for (unsigned PI = 0, PE = Macro.Params.size(); PI != PE; ++PI)
+      Params.push_back(PP.getIdentifierInfo(Macro.Params[PI]));
+    MI->setArgumentList(Params.data(), Params.size(),
+                        PP.getPreprocessorAllocator());
+
+    // Literals keep no data: their spelling is read from the header if it is
+    // ever needed.
+    for (unsigned TI = 0, TE = Macro.Tokens.size(); TI != TE; ++TI) {
+      const TokenSnapshot &Snapshot = Macro.Tokens[TI];
+      Token Tok;
+      Tok.startToken();
+      Tok.setKind(tok::TokenKind(Snapshot.Kind));
+      Tok.setFlag(Token::TokenFlags(Snapshot.Flags));
+      Tok.setLocation(FileStart.getLocWithOffset(Snapshot.Offset));
+      Tok.setLength(Snapshot.Length);
+      if (!Snapshot.Identifier.empty())
+        Tok.setIdentifierInfo(PP.getIdentifierInfo(Snapshot.Identifier));
+      MI->AddTokenToBody(Tok);
+    }
+    MI->setDefinitionEndLoc(FileStart.getLocWithOffset(Macro.EndOffset));
+
+    DefMacroDirective *MD = PP.appendDefMacroDirective(II, MI);
+    if (Callbacks)
+      Callbacks->MacroDefined(MacroNameTok, MD);
+  }
+
+  if (!V.ControllingMacro.empty())
+    PP.getHeaderSearchInfo().SetFileControllingMacro(
+        File, PP.getIdentifierInfo(V.ControllingMacro));
+
+  // Like the lexer of the header would, tell the SourceManager that only the
+  // header's own FileID was created while including it.
+  SM.setNumCreatedFIDsForFileID(FID, 1);
+
+  if (Callbacks)
+    Callbacks->FileChanged(IncluderLoc, PPCallbacks::ExitFile,
+                           SM.getFileCharacteristic(IncluderLoc), FID);
+}
+
+void HeaderEffectsCache::startRecording(const FileEntry *File, FileID FID,
+                                        PreprocessorLexer *Lexer) {
+  abortRecording();
+  if (PP.isCodeCompletionEnabled())
+    return;
+  if (!Loaded)
+    load();
+
+  // The effects are only shared under the diagnostic mappings of the command
+  // line, which are part of the configuration. Under other mappings, the
+  // header may well diagnose something a recording would never see, such as
+  // a warning that is ignored here.
+  SourceManager &SM = PP.getSourceManager();
+  if (!PP.getDiagnostics().hasCommandLineMappings(
+          SM.getLocForStartOfFile(FID)))
+    return;
+
+  std::string Key = getKey(File);
+  EntryMap::iterator Entry = Headers.find(Key);
+  if (Entry != Headers.end() && !Entry->second.Replayable &&
+      isCurrent(Entry->second, File, FID))
+    return;
+
+  Current.reset(new Recording(PP.getDiagnostics()));
+  Current->Key = Key;
+  Current->File = File;
+  Current->FID = FID;
+  Current->Lexer = Lexer;
+  Current->Result.Characteristic =
+      SM.getFileCharacteristic(SM.getLocForStartOfFile(FID));
+}
+
+void HeaderEffectsCache::markNotReplayable(const Recording &R) {
+  HeaderEntry &Entry = Headers[R.Key];
+  initEntry(Entry, R);
+  Entry.Replayable = false;
+  Changed.insert(R.Key);
+}
+
+void HeaderEffectsCache::abortRecording() {
+  if (!Current)
+    return;
+  markNotReplayable(*Current);
+  Current.reset();
+}
+
+void HeaderEffectsCache::checkDirective(const Token &DirectiveTok) {
+  if (DirectiveTok.is(tok::eod))
+    return;
+  if (IdentifierInfo *II = DirectiveTok.getIdentifierInfo()) {
+    switch (II->getPPKeywordID()) {
+    case tok::pp_if:
+    case tok::pp_ifdef:
+    case tok::pp_ifndef:
+    case tok::pp_elif:
+    case tok::pp_else:
+    case tok::pp_endif:
+    case tok::pp_define:
+    case tok::pp_undef:
+      return;
+    default:
+      break;
+    }
+  }
+  abortRecording();
+}
+
+void HeaderEffectsCache::useMacro(IdentifierInfo *II, bool MarkedUsed,
+                                  bool Modifies) {
+  // The first use of each macro records its incoming definition.
+  llvm::DenseMap<IdentifierInfo *, std::pair<unsigned, bool> >::iterator Use =
+      Current->Used.find(II);
+  if (Use == Current->Used.end()) {
+    MacroState State;
+    State.Name = II->getName();
+    State.MarkedUsed = false;
+    if (!getMacroState(II, State.Definition)) {
+      abortRecording();
+      return;
+    }
+    Use = Current->Used.insert(std::make_pair(
+        II, std::make_pair(Current->Result.Signature.size(), false))).first;
+    Current->Result.Signature.push_back(State);
+  }
+
+  // Marking a macro the header defined itself is part of its snapshot.
+  MacroState &State = Current->Result.Signature[Use->second.first];
+  if (MarkedUsed && !Use->second.second && !State.Definition.empty())
+    State.MarkedUsed = true;
+  if (Modifies)
+    Use->second.second = true;
+}
+
+void HeaderEffectsCache::useExpandedMacro(IdentifierInfo *II,
+                                          const MacroInfo *MI) {
+  // Builtin macros expand to things like the current line or the presence
+  // of files, which the signature does not capture.
+  if (MI->isBuiltinMacro()) {
+    abortRecording();
+    return;
+  }
+  useMacro(II, /*MarkedUsed=*/true, /*Modifies=*/false);
+}
+
+void HeaderEffectsCache::addChange(IdentifierInfo *II, MacroInfo *MI,
+                                   SourceLocation Loc) {
+  useMacro(II, /*MarkedUsed=*/false, /*Modifies=*/true);
+  if (!Current)
+    return;
+  Recording::MacroChange Change = { II, MI, Loc };
+  Current->Changes.push_back(Change);
+}
+
+bool HeaderEffectsCache::snapshotMacro(FileID FID, const MacroInfo *MI,
+                                       MacroSnapshot &Snapshot) {
+  SourceManager &SM = PP.getSourceManager();
+  std::pair<FileID, unsigned> Def =
+      SM.getDecomposedLoc(MI->getDefinitionLoc());
+  std::pair<FileID, unsigned> End =
+      SM.getDecomposedLoc(MI->getDefinitionEndLoc());
+  if (Def.first != FID || End.first != FID)
+    return false;
+  Snapshot.Offset = Def.second;
+  Snapshot.EndOffset = End.second;
+
+  Snapshot.Flags = 0;
+  if (MI->isFunctionLike())
+    Snapshot.Flags |= MF_FunctionLike;
+  if (MI->isC99Varargs())
+    Snapshot.Flags |= MF_C99Varargs;
+  if (MI->isGNUVarargs())
+    Snapshot.Flags |= MF_GNUVarargs;
+  if (MI->hasCommaPasting())
+    Snapshot.Flags |= MF_HasCommaPasting;
+  if (MI->isUsed())
+    Snapshot.Flags |= MF_Used;
+  if (MI->isUsedForHeaderGuard())
+    Snapshot.Flags |= MF_UsedForHeaderGuard;
+
+  for (MacroInfo::arg_iterator I = MI->arg_begin(), E = MI->arg_end(); I != E;
+       ++I)
+    Snapshot.Params.push_back((*I)->getName());
+
+  for (unsigned I = 0, E = MI->getNumTokens(); I != E; ++I) {
+    const Token &Tok = MI->getReplacementToken(I);
+    SourceLocation Loc = Tok.getLocation();
+    if (!Loc.isFileID())
+      return false;
+    std::pair<FileID, unsigned> Decomposed = SM.getDecomposedLoc(Loc);
+    if (Decomposed.first != FID)
+      return false;
+
+    TokenSnapshot TokSnapshot;
+    TokSnapshot.Kind = Tok.getKind();
+    TokSnapshot.Flags = Tok.getFlags();
+    TokSnapshot.Offset = Decomposed.second;
+    TokSnapshot.Length = Tok.getLength();
+    if (!Tok.isLiteral())
+      if (IdentifierInfo *II = Tok.getIdentifierInfo())
+        TokSnapshot.Identifier = II->getName();
+    Snapshot.Tokens.push_back(TokSnapshot);
+  }
+  return true;
+}
+
+void HeaderEffectsCache::finishRecording(PreprocessorLexer *Lexer,
+                                 const IdentifierInfo *ControllingMacro) {
+  if (!Current || Current->Lexer != Lexer)
+    return;
+  std::unique_ptr<Recording> R(Current.release());
+
+  // Diagnostics are not replayed.
+  if (R->ErrorTrap.hasErrorOccurred() ||
+      PP.getDiagnostics().getNumWarnings() != R->NumWarnings) {
+    markNotReplayable(*R);
+    return;
+  }
+
+  Variant &V = R->Result;
+  if (ControllingMacro)
+    V.ControllingMacro = ControllingMacro->getName();
+
+  SourceManager &SM = PP.getSourceManager();
+  for (unsigned I = 0, E = R->Changes.size(); I != E; ++I) {
+    const Recording::MacroChange &Change = R->Changes[I];
+    MacroSnapshot Snapshot;
+    Snapshot.Name = Change.II->getName();
+    Snapshot.IsDefinition = Change.MI != nullptr;
+    if (Change.MI) {
+      if (!snapshotMacro(R->FID, Change.MI, Snapshot)) {
+        markNotReplayable(*R);
+        return;
+      }
+    } else {
+      std::pair<FileID, unsigned> Undef =
+          SM.getDecomposedLoc(Change.UndefLoc);
+      if (Undef.first != R->FID) {
+        markNotReplayable(*R);
+        return;
+      }
+      Snapshot.Offset = Snapshot.EndOffset = Undef.second;
+      Snapshot.Flags = 0;
+    }
+    V.Effects.push_back(Snapshot);
+  }
+
+  HeaderEntry &Entry = Headers[R->Key];
+  if (!isCurrent(Entry, R->File, R->FID))
+    initEntry(Entry, *R);
+  addVariant(Entry, V);
+  Changed.insert(R->Key);
+  ++NumRecorded;
+}
+
+void HeaderEffectsCache::save() {
+  if (Changed.empty())
+    return;
+
+  EntryMap Ours;
+  for (llvm::StringSet<>::iterator I = Changed.begin(), E = Changed.end();
+       I != E; ++I)
+    Ours[I->getKey()] = Headers[I->getKey()];
+  Changed.clear();
+
+  // Usually, append a record of the entries this compilation changed. Each
+  // record is written with a single write, and a torn one is detected by its
+  // checksum.
+  if (!NeedsRewrite) {
+    std::string Record;
+    llvm::raw_string_ostream RecordOS(Record);
+    writeChecksummedRecord(RecordOS, Ours);
+    RecordOS.flush();
+
+    std::string ErrorInfo;
+    llvm::raw_fd_ostream Out(CacheFile.c_str(), ErrorInfo,
+                             llvm::sys::fs::F_Append);
+    if (ErrorInfo.empty()) {
+      Out.SetUnbuffered();
+      Out << Record;
+      Out.close();
+      if (!Out.has_error())
+        return;
+      Out.clear_error();
+    }
+  }
+
+  // Otherwise rewrite the cache as a single record, merged with whatever
+  // other compilations wrote since the cache was loaded. A record another
+  // compilation appends to the old file meanwhile is lost, which only means
+  // that the headers are recorded again.
+  EntryMap Merged;
+  unsigned NumRecords;
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> BufferOrErr =
+      llvm::MemoryBuffer::getFile(CacheFile);
+  if (BufferOrErr)
+    readCacheFile(BufferOrErr.get()->getBuffer(), Merged, NumRecords);
+  for (EntryMap::iterator I = Ours.begin(), E = Ours.end(); I != E; ++I)
+    mergeEntry(Merged[I->getKey()], I->second);
+
+  // Write to a temporary file and move it into place, so that concurrent
+  // compilations never see a partially written cache. Failing to write is not
+  // an error: later compilations simply record the headers again.
+  SmallString<256> TmpPath;
+  int TmpFD;
+  if (llvm::sys::fs::createUniqueFile(CacheFile + "-%%%%%%%%", TmpFD, TmpPath))
+    return;
+
+  {
+    llvm::raw_fd_ostream Out(TmpFD, /*shouldClose=*/true);
+    writeString(Out, CacheMagic);
+    writeNumber(Out, CacheVersion);
+    writeChecksummedRecord(Out, Merged);
+    Out.close();
+    if (Out.has_error()) {
+      Out.clear_error();
+      llvm::sys::fs::remove(TmpPath.str());
+      return;
+    }
+  }
+
+  if (llvm::sys::fs::rename(TmpPath.str(), CacheFile))
+    llvm::sys::fs::remove(TmpPath.str());
+  else
+    NeedsRewrite = false;
+}
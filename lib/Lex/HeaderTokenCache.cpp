@@ -0,0 +1,200 @@
+//===--- HeaderTokenCache.cpp - Persistent Cache of Header Tokens ---------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file implements the HeaderTokenCache interface.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Lex/HeaderTokenCache.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/Version.h"
+#include "clang/Lex/TokenPrefetcher.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/AlignOf.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstring>
+using namespace clang;
+
+namespace {
+/// \brief The header of a cache entry, followed by the array of tokens.
+struct EntryHeader {
+  char Magic[4];
+  uint32_t BufferSize;
+  uint32_t NumTokens;
+  uint32_t Reserved;
+};
+}
+
+static const char EntryMagic[4] = { 'C', 'T', 'O', 'K' };
+
+HeaderTokenCache::HeaderTokenCache(StringRef Directory,
+                                   const LangOptions &LangOpts)
+  : Directory(Directory), LangOpts(LangOpts), NumHits(0), NumMisses(0) {
+  llvm::sys::fs::create_directories(Directory);
+
+  // The entries store PreLexedTokens verbatim, so they depend on the exact
+  // compiler and host as well as on the language options. The version may
+  // not change with local edits, so the token kinds are part of the key too.
+  std::string Configuration;
+  llvm::raw_string_ostream OS(Configuration);
+  OS << getClangFullRepositoryVersion() << ',' << sizeof(PreLexedToken)
+     << ',' << llvm::sys::IsBigEndianHost;
+  for (unsigned Kind = 0; Kind != tok::NUM_TOKENS; ++Kind)
+    OS << ',' << tok::getTokenName(static_cast<tok::TokenKind>(Kind));
+#define LANGOPT(Name, Bits, Default, Description) \
+  OS << ',' << LangOpts.Name;
+#define ENUM_LANGOPT(Name, Type, Bits, Default, Description) \
+  OS << ',' << static_cast<unsigned>(LangOpts.get##Name());
+#include "clang/Basic/LangOptions.def"
+  OS.flush();
+
+  llvm::MD5 Hash;
+  Hash.update(Configuration);
+  llvm::MD5::MD5Result Result;
+  Hash.final(Result);
+  SmallString<32> Hex;
+  llvm::MD5::stringifyResult(Result, Hex);
+  ConfigurationHash = Hex.str();
+}
+
+HeaderTokenCache::~HeaderTokenCache() {
+  llvm::DeleteContainerSeconds(Files);
+}
+
+std::string
+HeaderTokenCache::getEntryPath(const llvm::MemoryBuffer *Buffer) const {
+  llvm::MD5 Hash;
+  Hash.update(ConfigurationHash);
+  Hash.update(Buffer->getBuffer());
+  llvm::MD5::MD5Result Result;
+  Hash.final(Result);
+  SmallString<32> Hex;
+  llvm::MD5::stringifyResult(Result, Hex);
+
+  SmallString<256> Path(Directory);
+  llvm::sys::path::append(Path, Hex.str() + ".tokens");
+  return Path.str();
+}
+
+/// \brief Check that the Lexer can use \p Tokens on \p Buffer: every token
+/// lies within the buffer, after its gap and after the previous token, and
+/// is spelled like a token of its kind that the raw lexer forms.
+///
+/// A corrupted entry would otherwise make the Lexer read out of bounds or
+/// hand the parser tokens the preprocessor never produces.
+static bool validateTokens(ArrayRef<PreLexedToken> Tokens, StringRef Buffer) {
+  unsigned BufferSize = Buffer.size();
+  unsigned PrevEnd = 0;
+  for (unsigned I = 0, E = Tokens.size(); I != E; ++I) {
+    const PreLexedToken &Tok = Tokens[I];
+    unsigned Kind = static_cast<unsigned>(Tok.Kind);
+    if (Tok.GapStart < PrevEnd || Tok.GapStart > Tok.Offset ||
+        Tok.Offset > BufferSize || Tok.Length == 0 ||
+        Tok.Length > BufferSize - Tok.Offset || Kind >= tok::NUM_TOKENS ||
+        !TokenPrefetcher::isValidPreLexedToken(Buffer, Tok))
+      return false;
+    PrevEnd = Tok.Offset + Tok.Length;
+  }
+  return true;
+}
+
+bool HeaderTokenCache::readEntry(StringRef Path,
+                                 const llvm::MemoryBuffer *Buffer,
+                                 CachedFile &File) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> EntryOrErr =
+      llvm::MemoryBuffer::getFile(Path, /*FileSize=*/-1,
+                                  /*RequiresNullTerminator=*/false);
+  if (!EntryOrErr)
+    return false;
+  std::unique_ptr<llvm::MemoryBuffer> Entry = std::move(EntryOrErr.get());
+
+  // Reject truncated or foreign files; a hash collision with the wrong size
+  // is rejected as well.
+  const char *Data = Entry->getBufferStart();
+  size_t Size = Entry->getBufferSize();
+  if (Size < sizeof(EntryHeader) ||
+      reinterpret_cast<uintptr_t>(Data) % llvm::alignOf<PreLexedToken>())
+    return false;
+  const EntryHeader *Header = reinterpret_cast<const EntryHeader *>(Data);
+  if (std::memcmp(Header->Magic, EntryMagic, sizeof(EntryMagic)) != 0 ||
+      Header->BufferSize != Buffer->getBufferSize() ||
+      Size != sizeof(EntryHeader) + Header->NumTokens * sizeof(PreLexedToken))
+    return false;
+
+  ArrayRef<PreLexedToken> Tokens = llvm::makeArrayRef(
+      reinterpret_cast<const PreLexedToken *>(Data + sizeof(EntryHeader)),
+      Header->NumTokens);
+  if (!validateTokens(Tokens, Buffer->getBuffer()))
+    return false;
+
+  File.Tokens = Tokens;
+  File.Entry = std::move(Entry);
+  return true;
+}
+
+void HeaderTokenCache::writeEntry(StringRef Path,
+                                  const llvm::MemoryBuffer *Buffer,
+                                  ArrayRef<PreLexedToken> Tokens) {
+  EntryHeader Header;
+  std::memcpy(Header.Magic, EntryMagic, sizeof(EntryMagic));
+  Header.BufferSize = Buffer->getBufferSize();
+  Header.NumTokens = Tokens.size();
+  Header.Reserved = 0;
+
+  // Write to a temporary file and move it into place, so that concurrent
+  // compilations never see a partially written entry. Failing to write is not
+  // an error: the next compilation simply lexes the header again.
+  SmallString<256> TmpPath;
+  int TmpFD;
+  if (llvm::sys::fs::createUniqueFile(Path + "-%%%%%%%%", TmpFD, TmpPath))
+    return;
+
+  {
+    llvm::raw_fd_ostream Out(TmpFD, /*shouldClose=*/true);
+    Out.write(reinterpret_cast<const char *>(&Header), sizeof(Header));
+    Out.write(reinterpret_cast<const char *>(Tokens.data()),
+              Tokens.size() * sizeof(PreLexedToken));
+    Out.close();
+    if (Out.has_error()) {
+      Out.clear_error();
+      llvm::sys::fs::remove(TmpPath.str());
+      return;
+    }
+  }
+
+  if (llvm::sys::fs::rename(TmpPath.str(), Path))
+    llvm::sys::fs::remove(TmpPath.str());
+}
+
+ArrayRef<PreLexedToken>
+HeaderTokenCache::getTokens(const FileEntry *File,
+                            const llvm::MemoryBuffer *Buffer) {
+  CachedFile *&Cached = Files[File];
+  if (Cached)
+    return Cached->Tokens;
+  Cached = new CachedFile();
+
+  std::string Path = getEntryPath(Buffer);
+  if (readEntry(Path, Buffer, *Cached)) {
+    ++NumHits;
+    return Cached->Tokens;
+  }
+
+  ++NumMisses;
+  TokenPrefetcher::lexBuffer(Buffer->getBuffer(), LangOpts, Cached->Lexed);
+  Cached->Tokens = Cached->Lexed;
+  writeEntry(Path, Buffer, Cached->Tokens);
+  return Cached->Tokens;
+}
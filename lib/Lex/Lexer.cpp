@@ -26,6 +26,15 @@
 #include "llvm/Support/ConvertUTF.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif __ALTIVEC__
+#include <altivec.h>
+#undef bool
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 using namespace clang;
 
 //===----------------------------------------------------------------------===//
@@ -78,6 +87,7 @@ void Lexer::InitLexer(const char *BufStart, const char *BufPtr,
 
   Is_PragmaLexer = false;
   CurrentConflictMarkerState = CMK_None;
+  NextPreLexedToken = 0;
 
   // Start of the file is a start of line.
   IsAtStartOfLine = true;
@@ -92,6 +102,9 @@ void Lexer::InitLexer(const char *BufStart, const char *BufPtr,
   // We are not after parsing #include.
   ParsingFilename = false;
 
+  // Directive-only scanning is enabled by the preprocessor.
+  SkipNonDirectiveLines = false;
+
   // We are not in raw mode.  Raw mode disables diagnostics and interpretation
   // of tokens (e.g. identifiers, thus disabling macro expansion).  It is used
   // to quickly lex the tokens of the buffer, e.g. when handling a "#if 0" block
@@ -115,6 +128,7 @@ Lexer::Lexer(FileID FID, const llvm::MemoryBuffer *InputFile, Preprocessor &PP)
             InputFile->getBufferEnd());
 
   resetExtendedTokenMode();
+  SkipNonDirectiveLines = PP.isScanningDependenciesOnly();
 }
 
 void Lexer::resetExtendedTokenMode() {
@@ -1041,7 +1055,7 @@ static SourceLocation GetMappedTokenLoc(Preprocessor &PP,
   std::pair<SourceLocation,SourceLocation> II =
     SM.getImmediateExpansionRange(FileLoc);
 
-  return SM.createExpansionLoc(SpellingLoc, II.first, II.second, TokLen);
+  return SM.createLexedExpansionLoc(SpellingLoc, II.first, II.second, TokLen);
 }
 
 /// getSourceLocation - Return a source location identifier for the specified
@@ -1474,14 +1488,77 @@ bool Lexer::tryConsumeIdentifierUTF8Char(const char *&CurPtr) {
   return true;
 }
 
+/// \brief Returns the first character at or after \p CurPtr which is not in
+/// [_A-Za-z0-9], or [_A-Za-z0-9.] if \p AllowDot is set.
+///
+/// Where SSE2 or AVX2 is available, 16 or 32 characters are classified at a
+/// time while they all lie before \p BufferEnd; the rest is scanned one
+/// character at a time, stopping at the null terminator at the latest.
+static LLVM_ATTRIBUTE_ALWAYS_INLINE const char *
+skipASCIIIdentifierBody(const char *CurPtr, const char *BufferEnd,
+                        bool AllowDot) {
+#ifdef __AVX2__
+  const __m256i CaseBit32 = _mm256_set1_epi8(0x20);
+  const __m256i LowerA32 = _mm256_set1_epi8('a');
+  const __m256i Zero32 = _mm256_set1_epi8('0');
+  const __m256i Underscore32 = _mm256_set1_epi8('_');
+  const __m256i Dot32 = _mm256_set1_epi8('.');
+  const __m256i Letters32 = _mm256_set1_epi8('z' - 'a');
+  const __m256i Digits32 = _mm256_set1_epi8('9' - '0');
+  while (CurPtr + 32 <= BufferEnd) {
+    __m256i Chars = _mm256_loadu_si256((const __m256i *)CurPtr);
+    // A byte is in [Lo, Lo + N] iff min(C - Lo, N) == C - Lo, unsigned.
+    __m256i Letter =
+        _mm256_sub_epi8(_mm256_or_si256(Chars, CaseBit32), LowerA32);
+    __m256i Digit = _mm256_sub_epi8(Chars, Zero32);
+    __m256i Body = _mm256_or_si256(
+        _mm256_cmpeq_epi8(_mm256_min_epu8(Letter, Letters32), Letter),
+        _mm256_or_si256(
+            _mm256_cmpeq_epi8(_mm256_min_epu8(Digit, Digits32), Digit),
+            _mm256_cmpeq_epi8(Chars, Underscore32)));
+    if (AllowDot)
+      Body = _mm256_or_si256(Body, _mm256_cmpeq_epi8(Chars, Dot32));
+    unsigned NotBody = ~(unsigned)_mm256_movemask_epi8(Body);
+    if (NotBody)
+      return CurPtr + llvm::countTrailingZeros<unsigned>(NotBody);
+    CurPtr += 32;
+  }
+#endif
+#ifdef __SSE2__
+  const __m128i CaseBit = _mm_set1_epi8(0x20);
+  const __m128i LowerA = _mm_set1_epi8('a');
+  const __m128i Zero = _mm_set1_epi8('0');
+  const __m128i Underscore = _mm_set1_epi8('_');
+  const __m128i Dot = _mm_set1_epi8('.');
+  const __m128i Letters = _mm_set1_epi8('z' - 'a');
+  const __m128i Digits = _mm_set1_epi8('9' - '0');
+  while (CurPtr + 16 <= BufferEnd) {
+    __m128i Chars = _mm_loadu_si128((const __m128i *)CurPtr);
+    // A byte is in [Lo, Lo + N] iff min(C - Lo, N) == C - Lo, unsigned.
+    __m128i Letter = _mm_sub_epi8(_mm_or_si128(Chars, CaseBit), LowerA);
+    __m128i Digit = _mm_sub_epi8(Chars, Zero);
+    __m128i Body = _mm_or_si128(
+        _mm_cmpeq_epi8(_mm_min_epu8(Letter, Letters), Letter),
+        _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(Digit, Digits), Digit),
+                     _mm_cmpeq_epi8(Chars, Underscore)));
+    if (AllowDot)
+      Body = _mm_or_si128(Body, _mm_cmpeq_epi8(Chars, Dot));
+    unsigned NotBody = ~_mm_movemask_epi8(Body) & 0xFFFF;
+    if (NotBody)
+      return CurPtr + llvm::countTrailingZeros<unsigned>(NotBody);
+    CurPtr += 16;
+  }
+#endif
+  while (isIdentifierBody(*CurPtr) || (AllowDot && *CurPtr == '.'))
+    ++CurPtr;
+  return CurPtr;
+}
+
 bool Lexer::LexIdentifier(Token &Result, const char *CurPtr) {
   // Match [_A-Za-z0-9]*, we have already matched [_A-Za-z$]
   unsigned Size;
-  unsigned char C = *CurPtr++;
-  while (isIdentifierBody(C))
-    C = *CurPtr++;
-
-  --CurPtr;   // Back up over the skipped character.
+  CurPtr = skipASCIIIdentifierBody(CurPtr, BufferEnd, /*AllowDot=*/false);
+  unsigned char C = *CurPtr;
 
   // Fast path, no $,\,? in identifier found.  '\' might be an escaped newline
   // or UCN, and ? might be a trigraph for '\', an escaped newline or UCN.
@@ -1563,9 +1640,14 @@ bool Lexer::isHexaLiteral(const char *Start, const LangOptions &LangOpts) {
 /// constant. From[-1] is the first character lexed.  Return the end of the
 /// constant.
 bool Lexer::LexNumericConstant(Token &Result, const char *CurPtr) {
+  // Skip the characters that need no cleaning quickly; escaped newlines and
+  // trigraphs are handled below.
+  const char *Start = CurPtr;
+  CurPtr = skipASCIIIdentifierBody(CurPtr, BufferEnd, /*AllowDot=*/true);
+  char PrevCh = CurPtr != Start ? CurPtr[-1] : 0;
+
   unsigned Size;
   char C = getCharAndSize(CurPtr, Size);
-  char PrevCh = 0;
   while (isPreprocessingNumberBody(C)) {
     CurPtr = ConsumeChar(CurPtr, Size, Result);
     PrevCh = C;
@@ -2236,13 +2318,6 @@ static bool isEndOfBlockCommentWithEscapedNewLine(const char *CurPtr,
   return true;
 }
 
-#ifdef __SSE2__
-#include <emmintrin.h>
-#elif __ALTIVEC__
-#include <altivec.h>
-#undef bool
-#endif
-
 /// We have just read from input the / and * characters that started a comment.
 /// Read until we find the * and / characters that terminate the comment.
 /// Note that we don't bother decoding trigraphs or escaped newlines in block
@@ -2414,6 +2489,269 @@ bool Lexer::SkipBlockComment(Token &Result, const char *CurPtr,
   return false;
 }
 
+//===----------------------------------------------------------------------===//
+// Excluded Conditional Block Skipping
+//===----------------------------------------------------------------------===//
+
+namespace {
+/// \brief A set of up to eight bytes, searched for in a buffer sixteen bytes
+/// at a time where SSE2 is available.
+class ByteSet {
+  char Bytes[8];
+#ifdef __SSE2__
+  __m128i Splats[8];
+#endif
+  unsigned NumBytes;
+
+public:
+  ByteSet() : NumBytes(0) {}
+
+  void insert(char C) {
+    assert(NumBytes < 8 && "Too many bytes in set");
+    Bytes[NumBytes] = C;
+#ifdef __SSE2__
+    Splats[NumBytes] = _mm_set1_epi8(C);
+#endif
+    ++NumBytes;
+  }
+
+  /// \brief Returns the first byte in [Ptr, End) which is in the set, or End.
+  const char *find(const char *Ptr, const char *End) const {
+#ifdef __SSE2__
+    while (Ptr + 16 <= End) {
+      __m128i Chunk = _mm_loadu_si128((const __m128i *)Ptr);
+      __m128i Matches = _mm_cmpeq_epi8(Chunk, Splats[0]);
+      for (unsigned I = 1; I != NumBytes; ++I)
+        Matches = _mm_or_si128(Matches, _mm_cmpeq_epi8(Chunk, Splats[I]));
+      if (unsigned Mask = _mm_movemask_epi8(Matches))
+        return Ptr + llvm::countTrailingZeros<unsigned>(Mask);
+      Ptr += 16;
+    }
+#endif
+    for (; Ptr != End; ++Ptr)
+      for (unsigned I = 0; I != NumBytes; ++I)
+        if (*Ptr == Bytes[I])
+          return Ptr;
+    return End;
+  }
+};
+}
+
+/// \brief If \p Ptr points to a backslash that is followed by a newline,
+/// optionally preceded by horizontal whitespace, returns a pointer past the
+/// newline.  Returns null otherwise.
+static const char *skipEscapedNewline(const char *Ptr) {
+  const char *AfterSlash = Ptr + 1;
+  while (isHorizontalWhitespace(*AfterSlash))
+    ++AfterSlash;
+  if (*AfterSlash != '\n' && *AfterSlash != '\r')
+    return nullptr;
+  // Treat \r\n and \n\r as a single newline.
+  if ((AfterSlash[1] == '\n' || AfterSlash[1] == '\r') &&
+      AfterSlash[1] != AfterSlash[0])
+    return AfterSlash + 2;
+  return AfterSlash + 1;
+}
+
+/// \brief Skips a block comment whose text starts at \p CurPtr, returning a
+/// pointer past its end, or null if it must be left to the lexer.
+static const char *skipBlockComment(const char *CurPtr, const char *End,
+                                    const ByteSet &Interesting) {
+  const char *CommentStart = CurPtr;
+  while (true) {
+    CurPtr = Interesting.find(CurPtr, End);
+    if (*CurPtr == '\0')
+      return nullptr;
+    if (CurPtr != CommentStart) {
+      if (CurPtr[-1] == '*')
+        return CurPtr + 1;
+      // The '*' and '/' may be separated by an escaped newline.
+      if (CurPtr[-1] == '\n' || CurPtr[-1] == '\r')
+        return nullptr;
+    }
+    ++CurPtr;
+  }
+}
+
+/// \brief Skips a line comment (if \p Quote is 0), or the rest of a string or
+/// character literal ending with \p Quote, starting at \p CurPtr. Returns a pointer past the
+/// closing quote or to the newline ending the line, or null if it must be
+/// left to the lexer.
+static const char *skipToEndOfLine(const char *CurPtr, const char *End,
+                                   const ByteSet &Interesting, char Quote) {
+  while (true) {
+    CurPtr = Interesting.find(CurPtr, End);
+    char C = *CurPtr;
+    if (C == '\0' || (C == '?' && CurPtr[1] == '?'))
+      return nullptr;
+    if (C == Quote)
+      return CurPtr + 1;
+    if (C == '\n' || C == '\r')
+      return CurPtr;
+    if (C == '\\') {
+      if (const char *AfterNewline = skipEscapedNewline(CurPtr)) {
+        CurPtr = AfterNewline;
+        continue;
+      }
+      // Skip the escaped character of a literal.
+      if (Quote && CurPtr[1] != '\0')
+        ++CurPtr;
+    }
+    ++CurPtr;
+  }
+}
+
+void Lexer::SkipExcludedLines() {
+  assert(LexingRawMode && !ParsingPreprocessorDirective &&
+         "Not skipping an excluded conditional block");
+  const char *NextLine = FindPossibleDirectiveLine(IsAtStartOfLine);
+  if (NextLine != BufferPtr) {
+    BufferPtr = NextLine;
+    IsAtStartOfLine = IsAtPhysicalStartOfLine = true;
+  }
+}
+
+/// \brief Returns the start of the first line at or after BufferPtr which may
+/// hold a directive or needs the full lexer, or BufferPtr itself if lexing
+/// must resume there.  \p AtStartOfLine tells whether BufferPtr is at the
+/// start of a line; any other pointer returned is.
+const char *Lexer::FindPossibleDirectiveLine(bool AtStartOfLine) const {
+  const bool Trigraphs = LangOpts.Trigraphs;
+
+  // Mirror how LexTokenInternal treats '//': always a comment with line
+  // comments, never one when they are disabled and we are just preprocessing,
+  // and otherwise a comment unless a '*' follows (see the comment there).
+  const bool LineComments =
+      LangOpts.LineComment && (LangOpts.CPlusPlus || !LangOpts.TraditionalCPP);
+  const bool LineCommentsUnlessStar =
+      !LineComments && !(PP && PP->isPreprocessedOutput());
+
+  // The bytes that may change the lexing state of ordinary text, of line and
+  // block comments, and of string and character literals. The '\0' found at
+  // the end of the buffer, at a code completion point or embedded in the file
+  // always stops the skipping.
+  ByteSet Text, LineComment, BlockComment, StringLiteral, CharLiteral;
+  Text.insert('/');
+  Text.insert('"');
+  Text.insert('\'');
+  BlockComment.insert('/');
+  BlockComment.insert('\0');
+  StringLiteral.insert('"');
+  CharLiteral.insert('\'');
+  ByteSet *EndOfLineSets[] = { &Text, &LineComment, &StringLiteral,
+                               &CharLiteral };
+  for (ByteSet *Set : EndOfLineSets) {
+    Set->insert('\n');
+    Set->insert('\r');
+    Set->insert('\\');
+    Set->insert('\0');
+    if (Trigraphs)
+      Set->insert('?');
+  }
+
+  // Where to resume lexing: the start of the last line we entered outside of
+  // any comment or literal, which is always the start of a token.
+  const char *SafePtr = BufferPtr;
+
+  const char *CurPtr = BufferPtr;
+  while (true) {
+    if (AtStartOfLine) {
+      while (isHorizontalWhitespace(*CurPtr))
+        ++CurPtr;
+      char C = *CurPtr;
+      if (C == '\n' || C == '\r') {
+        SafePtr = ++CurPtr;
+        continue;
+      }
+      // A block comment does not end the leading whitespace of a line, so a
+      // '#' after it still starts a directive.
+      if (C == '/' && CurPtr[1] == '*') {
+        CurPtr = skipBlockComment(CurPtr + 2, BufferEnd, BlockComment);
+        if (!CurPtr)
+          break;
+        continue;
+      }
+      // Leave anything that is or may be spelled as a '#' to the lexer.
+      if (C == '#' || C == '%' || C == '\\' || C == '\0' ||
+          (C == '?' && Trigraphs))
+        break;
+      AtStartOfLine = false;
+    }
+
+    CurPtr = Text.find(CurPtr, BufferEnd);
+    switch (*CurPtr) {
+    case '\n':
+    case '\r':
+      SafePtr = ++CurPtr;
+      AtStartOfLine = true;
+      break;
+
+    case '/':
+      if (CurPtr[1] == '/' && !LineComments && !LineCommentsUnlessStar)
+        // Just a '/'; the second one is looked at next.
+        ++CurPtr;
+      else if (CurPtr[1] == '/' && !LineComments &&
+               (CurPtr[2] == '\\' || (CurPtr[2] == '?' && Trigraphs)))
+        // Possibly a '*' after an escaped newline.
+        CurPtr = nullptr;
+      else if (CurPtr[1] == '/' && !LineComments && CurPtr[2] == '*')
+        // A '/' followed by a block comment.
+        ++CurPtr;
+      else if (CurPtr[1] == '/')
+        CurPtr = skipToEndOfLine(CurPtr + 2, BufferEnd, LineComment, '\0');
+      else if (CurPtr[1] == '*')
+        CurPtr = skipBlockComment(CurPtr + 2, BufferEnd, BlockComment);
+      else if (CurPtr[1] == '\\' || (CurPtr[1] == '?' && Trigraphs))
+        // Possibly a comment start split by an escaped newline.
+        CurPtr = nullptr;
+      else
+        ++CurPtr;
+      break;
+
+    case '"':
+    case '\'': {
+      char Quote = *CurPtr;
+      // Raw string literals span lines without escaped newlines, and a quote
+      // after a digit may be a digit separator; leave both to the lexer.
+      if (CurPtr != BufferStart &&
+          ((Quote == '"' && CurPtr[-1] == 'R' && LangOpts.CPlusPlus11) ||
+           (Quote == '\'' && isIdentifierBody(CurPtr[-1]) &&
+            LangOpts.CPlusPlus1y)))
+        CurPtr = nullptr;
+      else
+        CurPtr = skipToEndOfLine(CurPtr + 1, BufferEnd,
+                                 Quote == '"' ? StringLiteral : CharLiteral,
+                                 Quote);
+      break;
+    }
+
+    case '\\':
+      // An escaped newline continues the current line.
+      if (const char *AfterNewline = skipEscapedNewline(CurPtr))
+        CurPtr = AfterNewline;
+      else
+        ++CurPtr;
+      break;
+
+    case '?':
+      if (CurPtr[1] == '?')
+        CurPtr = nullptr;
+      else
+        ++CurPtr;
+      break;
+
+    default:
+      assert(*CurPtr == '\0' && "Unexpected byte found");
+      CurPtr = nullptr;
+      break;
+    }
+    if (!CurPtr)
+      break;
+  }
+
+  return SafePtr;
+}
+
 //===----------------------------------------------------------------------===//
 // Primary Lexing Entry Points
 //===----------------------------------------------------------------------===//
@@ -2894,6 +3232,55 @@ bool Lexer::Lex(Token &Result) {
   return returnedToken;
 }
 
+/// LexPreLexedToken - Form the next token from the tokens the TokenPrefetcher
+/// lexed ahead of time, which saves scanning its characters.  This is only
+/// possible if the text between BufferPtr and the token is whitespace, which
+/// the prefetcher has checked for all the tokens it kept.
+bool Lexer::LexPreLexedToken(Token &Result, bool &Returned) {
+  unsigned CurOffset = BufferPtr - BufferStart;
+  while (NextPreLexedToken != PreLexedTokens.size() &&
+         PreLexedTokens[NextPreLexedToken].Offset < CurOffset)
+    ++NextPreLexedToken;
+  if (NextPreLexedToken == PreLexedTokens.size())
+    return false;
+
+  const PreLexedToken &PreLexed = PreLexedTokens[NextPreLexedToken];
+  if (PreLexed.GapStart > CurOffset)
+    return false;
+  ++NextPreLexedToken;
+
+  // Set the whitespace flags like SkipWhitespace would.
+  const char *TokStart = BufferStart + PreLexed.Offset;
+  if (TokStart != BufferPtr) {
+    for (const char *CurPtr = BufferPtr; CurPtr != TokStart; ++CurPtr)
+      if (isVerticalWhitespace(*CurPtr)) {
+        Result.setFlag(Token::StartOfLine);
+        break;
+      }
+    Result.setFlagValue(Token::LeadingSpace,
+                        !isVerticalWhitespace(TokStart[-1]));
+    BufferPtr = TokStart;
+  }
+
+  // Notify MIOpt that we read a non-whitespace/non-comment token.
+  MIOpt.ReadToken();
+  FormTokenWithChars(Result, TokStart + PreLexed.Length, PreLexed.Kind);
+  PP->IncrementPreLexedTokenCounter();
+
+  if (PreLexed.Kind == tok::raw_identifier) {
+    Result.setRawIdentifierData(TokStart);
+    IdentifierInfo *II = PP->LookUpIdentifierInfo(Result);
+    Returned = II->isHandleIdentifierCase() ? PP->HandleIdentifier(Result)
+                                            : true;
+    return true;
+  }
+
+  if (tok::isLiteral(PreLexed.Kind))
+    Result.setLiteralData(TokStart);
+  Returned = true;
+  return true;
+}
+
 /// LexTokenInternal - This implements a simple C family lexer.  It is an
 /// extremely performance critical piece of code.  This assumes that the buffer
 /// has a null character at the end of the file.  This returns a preprocessing
@@ -2905,6 +3292,28 @@ LexNextToken:
   Result.clearFlag(Token::NeedsCleaning);
   Result.setIdentifierInfo(nullptr);
 
+  // Use the token lexed ahead of time if the preprocessor does not need any
+  // special lexing mode.
+  if (NextPreLexedToken != PreLexedTokens.size() && !LexingRawMode &&
+      !ParsingPreprocessorDirective && !ParsingFilename &&
+      !isKeepWhitespaceMode()) {
+    bool Returned;
+    if (LexPreLexedToken(Result, Returned))
+      return Returned;
+  }
+
+  // When the preprocessor only scans for dependencies, nothing outside of the
+  // directives matters: jump from the start of a line to the next line that
+  // may hold one without forming the tokens in between.
+  if (SkipNonDirectiveLines && Result.isAtStartOfLine() && !LexingRawMode &&
+      !ParsingPreprocessorDirective && !isKeepWhitespaceMode()) {
+    const char *NextLine = FindPossibleDirectiveLine(/*AtStartOfLine=*/true);
+    if (NextLine != BufferPtr) {
+      BufferPtr = NextLine;
+      TokAtPhysicalStartOfLine = true;
+    }
+  }
+
   // CurPtr - Cache BufferPtr in an automatic variable.
   const char *CurPtr = BufferPtr;
 
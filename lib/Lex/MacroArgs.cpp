@@ -63,7 +63,13 @@ MacroArgs *MacroArgs::create(const MacroInfo *MI,
   // Copy the actual unexpanded tokens to immediately after the result ptr.
   if (!UnexpArgTokens.empty())
     std::copy(UnexpArgTokens.begin(), UnexpArgTokens.end(), 
-              const_cast<Token*>(Result->getUnexpArgument(0)));
+              (Token*)(Result+1));
+
+  // Record where each argument starts; every argument ends with an EOF.
+  Result->ArgStarts.clear();
+  for (unsigned i = 0, e = UnexpArgTokens.size(); i != e; ++i)
+    if (i == 0 || UnexpArgTokens[i-1].is(tok::eof))
+      Result->ArgStarts.push_back(i);
 
   return Result;
 }
@@ -77,6 +83,7 @@ void MacroArgs::destroy(Preprocessor &PP) {
   // would deallocate the element vectors.
   for (unsigned i = 0, e = PreExpArgTokens.size(); i != e; ++i)
     PreExpArgTokens[i].clear();
+  ExpandedArgs.clear();
   
   // Add this to the preprocessor's free list.
   ArgCache = PP.MacroArgCache;
@@ -111,18 +118,10 @@ unsigned MacroArgs::getArgLength(const Token *ArgPtr) {
 /// getUnexpArgument - Return the unexpanded tokens for the specified formal.
 ///
 const Token *MacroArgs::getUnexpArgument(unsigned Arg) const {
+  assert(Arg < ArgStarts.size() && "Invalid arg #");
   // The unexpanded argument tokens start immediately after the MacroArgs object
   // in memory.
-  const Token *Start = (const Token *)(this+1);
-  const Token *Result = Start;
-  // Scan to find Arg.
-  for (; Arg; ++Result) {
-    assert(Result < Start+NumUnexpArgTokens && "Invalid arg #");
-    if (Result->is(tok::eof))
-      --Arg;
-  }
-  assert(Result < Start+NumUnexpArgTokens && "Invalid arg #");
-  return Result;
+  return (const Token *)(this+1) + ArgStarts[Arg];
 }
 
 
@@ -187,6 +186,25 @@ MacroArgs::getPreExpArgument(unsigned Arg, const MacroInfo *MI,
 }
 
 
+/// getExpandedArgument - Return the tokens to substitute for a use of the
+/// specified argument which is not an operand of # or ##.
+const Token *MacroArgs::getExpandedArgument(unsigned Arg, const MacroInfo *MI,
+                                            Preprocessor &PP) {
+  assert(Arg < MI->getNumArgs() && "Invalid argument number!");
+  if (ExpandedArgs.size() < MI->getNumArgs())
+    ExpandedArgs.resize(MI->getNumArgs());
+  if (const Token *Result = ExpandedArgs[Arg])
+    return Result;
+
+  // Only preexpand the argument if it could possibly need it.  This avoids
+  // some work in common cases.
+  const Token *Result = getUnexpArgument(Arg);
+  if (ArgNeedsPreexpansion(Result, PP))
+    Result = &getPreExpArgument(Arg, MI, PP)[0];
+  ExpandedArgs[Arg] = Result;
+  return Result;
+}
+
 /// StringifyArgument - Implement C99 6.10.3.2p2, converting a sequence of
 /// tokens into the literal string token that should be produced by the C #
 /// preprocessor operator.  If Charify is true, then it should be turned into
@@ -0,0 +1,217 @@
+//===--- MinimizedSourceCache.cpp - Sources Reduced to Directives ---------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file implements the MinimizedSourceCache interface.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Lex/MinimizedSourceCache.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include <algorithm>
+using namespace clang;
+
+void clang::minimizeSourceToDirectives(const llvm::MemoryBuffer &Input,
+                                       const LangOptions &LangOpts,
+                                       SmallVectorImpl<char> &Output) {
+  const char *Start = Input.getBufferStart();
+  Output.resize(Input.getBufferSize());
+  for (size_t I = 0, E = Input.getBufferSize(); I != E; ++I)
+    Output[I] = (Start[I] == '\n' || Start[I] == '\r') ? Start[I] : ' ';
+
+  // Use a "fake" file location at offset 1 so that the offsets of the tokens
+  // can be recovered from their locations, as Lexer::ComputePreamble does.
+  const unsigned StartOffset = 1;
+  Lexer L(SourceLocation::getFromRawEncoding(StartOffset), LangOpts, Start,
+          Start, Input.getBufferEnd());
+  Token Tok;
+  L.LexFromRawLexer(Tok);
+  while (Tok.isNot(tok::eof)) {
+    if (Tok.isNot(tok::hash) || !Tok.isAtStartOfLine()) {
+      L.LexFromRawLexer(Tok);
+      continue;
+    }
+
+    // A directive extends to the last token before the next line; the text
+    // after its last token can only be whitespace or comments.
+    unsigned DirectiveStart = Tok.getLocation().getRawEncoding() - StartOffset;
+    unsigned DirectiveEnd;
+    do {
+      DirectiveEnd =
+          Tok.getLocation().getRawEncoding() - StartOffset + Tok.getLength();
+      L.LexFromRawLexer(Tok);
+    } while (Tok.isNot(tok::eof) && !Tok.isAtStartOfLine());
+    std::copy(Start + DirectiveStart, Start + DirectiveEnd,
+              Output.begin() + DirectiveStart);
+  }
+}
+
+MinimizedSourceCache::MinimizedSourceCache(const LangOptions &LangOpts)
+  : LangOpts(LangOpts), NumMinimized(0), NumReused(0) {}
+
+MinimizedSourceCache::~MinimizedSourceCache() {}
+
+static std::string getContentHash(StringRef Data) {
+  llvm::MD5 Hash;
+  Hash.update(Data);
+  llvm::MD5::MD5Result Result;
+  Hash.final(Result);
+  SmallString<32> Hex;
+  llvm::MD5::stringifyResult(Result, Hex);
+  return Hex.str();
+}
+
+const llvm::MemoryBuffer *
+MinimizedSourceCache::lookup(const vfs::Status &Status) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  auto Known = Entries.find(Status.getUniqueID());
+  if (Known == Entries.end() || Known->second.Size != Status.getSize() ||
+      Known->second.ModTime != Status.getLastModificationTime())
+    return nullptr;
+  // A file modified in the second it was read, or later, may have changed
+  // again without changing its modification time; let insert() compare its
+  // contents.
+  if (Known->second.ModTime.toEpochTime() >= Known->second.ReadTime)
+    return nullptr;
+  ++NumReused;
+  return Known->second.Contents.get();
+}
+
+const llvm::MemoryBuffer *
+MinimizedSourceCache::insert(const vfs::Status &Status,
+                             const llvm::MemoryBuffer &Contents,
+                             llvm::sys::TimeValue ReadTime) {
+  std::string ContentHash = getContentHash(Contents.getBuffer());
+
+  // Reuses the entry of the file if it has the same contents.
+  auto ReuseEntry = [&](Entry &E) -> const llvm::MemoryBuffer * {
+    if (!E.Contents || E.Size != Status.getSize() ||
+        E.ContentHash != ContentHash)
+      return nullptr;
+    E.ModTime = Status.getLastModificationTime();
+    E.ReadTime = std::max(E.ReadTime, ReadTime.toEpochTime());
+    ++NumReused;
+    return E.Contents.get();
+  };
+
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    auto Known = Entries.find(Status.getUniqueID());
+    if (Known != Entries.end())
+      if (const llvm::MemoryBuffer *Reused = ReuseEntry(Known->second))
+        return Reused;
+  }
+
+  // Minimize without holding the lock, so that the threads only wait for
+  // each other to update the map.
+  SmallVector<char, 0> Minimized;
+  minimizeSourceToDirectives(Contents, LangOpts, Minimized);
+  std::unique_ptr<llvm::MemoryBuffer> Buffer(
+      llvm::MemoryBuffer::getMemBufferCopy(
+          StringRef(Minimized.data(), Minimized.size()),
+          Contents.getBufferIdentifier()));
+
+  std::lock_guard<std::mutex> Guard(Lock);
+  Entry &E = Entries[Status.getUniqueID()];
+  if (const llvm::MemoryBuffer *Reused = ReuseEntry(E))
+    return Reused;
+  if (E.Contents)
+    StaleContents.push_back(std::move(E.Contents));
+  E.Size = Status.getSize();
+  E.ModTime = Status.getLastModificationTime();
+  E.ReadTime = ReadTime.toEpochTime();
+  E.ContentHash = std::move(ContentHash);
+  E.Contents = std::move(Buffer);
+  ++NumMinimized;
+  return E.Contents.get();
+}
+
+namespace {
+/// \brief A file whose contents are owned by a MinimizedSourceCache.
+class MinimizedFile : public vfs::File {
+  vfs::Status S;
+  const llvm::MemoryBuffer *Contents;
+
+public:
+  MinimizedFile(const vfs::Status &S, const llvm::MemoryBuffer *Contents)
+    : S(S), Contents(Contents) {}
+  ~MinimizedFile() {}
+
+  llvm::ErrorOr<vfs::Status> status() override { return S; }
+  std::error_code getBuffer(const Twine &Name,
+                            std::unique_ptr<llvm::MemoryBuffer> &Result,
+                            int64_t FileSize = -1,
+                            bool RequiresNullTerminator = true,
+                            bool IsVolatile = false) override {
+    Result.reset(llvm::MemoryBuffer::getMemBuffer(
+        Contents->getBuffer(), Name.str(), RequiresNullTerminator));
+    return std::error_code();
+  }
+  std::error_code close() override { return std::error_code(); }
+  void setName(StringRef Name) override { S.setName(Name); }
+};
+}
+
+MinimizingFileSystem::MinimizingFileSystem(
+    IntrusiveRefCntPtr<vfs::FileSystem> UnderlyingFS,
+    IntrusiveRefCntPtr<MinimizedSourceCache> Cache)
+  : UnderlyingFS(UnderlyingFS), Cache(Cache) {}
+
+MinimizingFileSystem::~MinimizingFileSystem() {}
+
+bool MinimizingFileSystem::shouldMinimize(StringRef Path) {
+  // Standard library headers have no extension.
+  return llvm::StringSwitch<bool>(llvm::sys::path::extension(Path))
+      .Cases("", ".h", ".H", ".hh", ".hpp", true)
+      .Cases(".hxx", ".h++", ".inc", ".def", ".ipp", true)
+      .Cases(".tcc", ".inl", ".c", ".C", ".cc", true)
+      .Cases(".cpp", ".cxx", ".c++", ".m", ".mm", true)
+      .Cases(".cu", ".cl", true)
+      .Default(false);
+}
+
+llvm::ErrorOr<vfs::Status> MinimizingFileSystem::status(const Twine &Path) {
+  return UnderlyingFS->status(Path);
+}
+
+std::error_code
+MinimizingFileSystem::openFileForRead(const Twine &Path,
+                                      std::unique_ptr<vfs::File> &Result) {
+  std::unique_ptr<vfs::File> F;
+  if (std::error_code EC = UnderlyingFS->openFileForRead(Path, F))
+    return EC;
+
+  SmallString<256> PathStorage;
+  llvm::ErrorOr<vfs::Status> Status = F->status();
+  if (!shouldMinimize(Path.toStringRef(PathStorage)) || !Status ||
+      !Status->isRegularFile()) {
+    Result = std::move(F);
+    return std::error_code();
+  }
+
+  const llvm::MemoryBuffer *Minimized = Cache->lookup(*Status);
+  if (!Minimized) {
+    llvm::sys::TimeValue ReadTime = llvm::sys::TimeValue::now();
+    std::unique_ptr<llvm::MemoryBuffer> Contents;
+    if (std::error_code EC = F->getBuffer(Path, Contents))
+      return EC;
+    Minimized = Cache->insert(*Status, *Contents, ReadTime);
+  }
+  Result.reset(new MinimizedFile(*Status, Minimized));
+  return std::error_code();
+}
+
+vfs::directory_iterator
+MinimizingFileSystem::dir_begin(const Twine &Dir, std::error_code &EC) {
+  return UnderlyingFS->dir_begin(Dir, EC);
+}
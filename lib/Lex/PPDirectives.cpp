@@ -16,6 +16,7 @@
 #include "clang/Basic/FileManager.h"
 #include "clang/Basic/SourceManager.h"
 #include "clang/Lex/CodeCompletionHandler.h"
+#include "clang/Lex/HeaderEffectsCache.h"
 #include "clang/Lex/HeaderSearch.h"
 #include "clang/Lex/HeaderSearchOptions.h"
 #include "clang/Lex/LexDiagnostic.h"
@@ -264,6 +265,9 @@ void Preprocessor::SkipExcludedConditionalBlock(SourceLocation IfTokenLoc,
   CurPPLexer->LexingRawMode = true;
   Token Tok;
   while (1) {
+    // Jump over the lines that cannot start a directive without forming their
+    // tokens; this is where skipping spends most of its time.
+    CurLexer->SkipExcludedLines();
     CurLexer->Lex(Tok);
 
     if (Tok.is(tok::code_completion)) {
@@ -730,6 +734,9 @@ void Preprocessor::HandleDirective(Token &Result) {
   // and reset to previous state when returning from this function.
   ResetMacroExpansionHelper helper(this);
 
+  if (HeaderEffects)
+    HeaderEffects->noteDirective(Result);
+
   switch (Result.getKind()) {
   case tok::eod:
     return;   // null directive.
@@ -1688,10 +1695,19 @@ void Preprocessor::HandleIncludeDirective(SourceLocation HashLoc,
         HeaderInfo.getModuleMap().findModuleForHeader(File, RequestingModule);
   }
 
+  // If an earlier inclusion of this header with the same incoming macros was
+  // recorded, replay its effects instead of lexing it.
+  if (HeaderEffects &&
+      HeaderEffects->replay(File, FID, CurPPLexer->getSourceLocation()))
+    return;
+
   // If all is good, enter the new file!
   if (EnterSourceFile(FID, CurDir, FilenameTok.getLocation()))
     return;
 
+  if (HeaderEffects)
+    HeaderEffects->startRecording(File, FID, CurPPLexer);
+
   // If we're walking into another part of the same module, let the parser
   // know that any future declarations are within that other submodule.
   if (BuildingModule) {
@@ -2087,6 +2103,9 @@ void Preprocessor::HandleDefineDirective(Token &DefineTok,
 
   MI->setDefinitionEndLoc(LastTok.getLocation());
 
+  if (HeaderEffects)
+    HeaderEffects->noteMacroDefinition(MacroNameTok.getIdentifierInfo(), MI);
+
   // Finally, if this identifier already had a macro defined for it, verify that
   // the macro bodies are identical, and issue diagnostics if they are not.
   if (const MacroInfo *OtherMI=getMacroInfo(MacroNameTok.getIdentifierInfo())) {
@@ -2151,6 +2170,10 @@ void Preprocessor::HandleUndefDirective(Token &UndefTok) {
   MacroDirective *MD = getMacroDirective(MacroNameTok.getIdentifierInfo());
   const MacroInfo *MI = MD ? MD->getMacroInfo() : nullptr;
 
+  if (HeaderEffects)
+    HeaderEffects->noteMacroUndefinition(MacroNameTok.getIdentifierInfo(),
+                                         MacroNameTok.getLocation());
+
   // If the callbacks want to know, tell them about the macro #undef.
   // Note: no matter if the macro was defined or not.
   if (Callbacks)
@@ -2204,6 +2227,9 @@ void Preprocessor::HandleIfdefDirective(Token &Result, bool isIfndef,
   MacroDirective *MD = getMacroDirective(MII);
   MacroInfo *MI = MD ? MD->getMacroInfo() : nullptr;
 
+  if (HeaderEffects)
+    HeaderEffects->noteMacroTest(MII, /*MarkedUsed=*/MI != nullptr);
+
   if (CurPPLexer->getConditionalStackDepth() == 0) {
     // If the start of a top-level #ifdef and if the macro is not defined,
     // inform MIOpt that this might be the start of a proper include guard.
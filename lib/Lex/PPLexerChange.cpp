@@ -15,9 +15,12 @@
 #include "clang/Lex/Preprocessor.h"
 #include "clang/Basic/FileManager.h"
 #include "clang/Basic/SourceManager.h"
+#include "clang/Lex/HeaderEffectsCache.h"
 #include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/HeaderTokenCache.h"
 #include "clang/Lex/LexDiagnostic.h"
 #include "clang/Lex/MacroInfo.h"
+#include "clang/Lex/TokenPrefetcher.h"
 #include "llvm/ADT/StringSwitch.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
@@ -83,6 +86,20 @@ bool Preprocessor::EnterSourceFile(FileID FID, const DirectoryLookup *CurDir,
     }
   }
   
+  const FileEntry *File = nullptr;
+  if ((HeaderTokens || Prefetcher) && !isCodeCompletionEnabled())
+    File = SourceMgr.getFileEntryForID(FID);
+
+  // If the background thread read the file already, let the source manager
+  // use its buffer. The pre-lexed tokens are only good for that very text.
+  ArrayRef<PreLexedToken> PrefetchedTokens;
+  if (File && Prefetcher) {
+    std::unique_ptr<llvm::MemoryBuffer> Prefetched;
+    if (Prefetcher->takeFile(File, Prefetched, PrefetchedTokens) &&
+        !SourceMgr.provideFileContents(File, Prefetched))
+      PrefetchedTokens = ArrayRef<PreLexedToken>();
+  }
+
   // Get the MemoryBuffer for this FID, if it fails, we fail.
   bool Invalid = false;
   const llvm::MemoryBuffer *InputFile = 
@@ -101,10 +118,49 @@ bool Preprocessor::EnterSourceFile(FileID FID, const DirectoryLookup *CurDir,
         CodeCompletionFileLoc.getLocWithOffset(CodeCompletionOffset);
   }
 
-  EnterSourceFileWithLexer(new Lexer(FID, InputFile, *this), CurDir);
+  Lexer *TheLexer = new Lexer(FID, InputFile, *this);
+  if (File) {
+    ArrayRef<PreLexedToken> Tokens;
+    if (HeaderTokens && FID != SourceMgr.getMainFileID())
+      Tokens = HeaderTokens->getTokens(File, InputFile);
+    if (Tokens.empty() && !PrefetchedTokens.empty()) {
+      Tokens = PrefetchedTokens;
+      Prefetcher->noteTokensUsed();
+    }
+    TheLexer->setPreLexedTokens(Tokens);
+  }
+
+  EnterSourceFileWithLexer(TheLexer, CurDir);
+
+  // Let the background thread look for the headers this file includes.
+  if (File && Prefetcher)
+    PrefetchIncludedFiles(File, InputFile);
   return false;
 }
 
+void Preprocessor::PrefetchIncludedFiles(const FileEntry *File,
+                                         const llvm::MemoryBuffer *InputFile) {
+  // The background thread searches a copy of the search path, which is
+  // complete by the time the first file is entered.
+  if (!Prefetcher->hasSearchPath()) {
+    std::vector<std::string> Dirs;
+    for (HeaderSearch::search_dir_iterator I = HeaderInfo.search_dir_begin(),
+                                           E = HeaderInfo.search_dir_end();
+         I != E; ++I)
+      Dirs.push_back(I->isNormalDir() ? I->getDir()->getName() : "");
+    Prefetcher->setSearchPath(std::move(Dirs),
+                              HeaderInfo.angled_dir_begin() -
+                                  HeaderInfo.search_dir_begin());
+  }
+
+  SmallVector<std::pair<StringRef, bool>, 16> Includes;
+  TokenPrefetcher::findIncludes(InputFile->getBuffer(), Includes);
+
+  StringRef IncluderDir = File->getDir()->getName();
+  for (unsigned I = 0, E = Includes.size(); I != E; ++I)
+    Prefetcher->prefetch(IncluderDir, Includes[I].first, Includes[I].second);
+}
+
 /// EnterSourceFileWithLexer - Add a source file to the top of the include stack
 ///  and start lexing tokens from it instead of the current buffer.
 void Preprocessor::EnterSourceFileWithLexer(Lexer *TheLexer,
@@ -336,6 +392,11 @@ bool Preprocessor::HandleEndOfFile(Token &Result, bool isEndOfMacro) {
     PragmaARCCFCodeAuditedLoc = SourceLocation();
   }
 
+  // Remember what a recorded header did to the macros.
+  if (HeaderEffects && CurPPLexer && !isEndOfMacro)
+    HeaderEffects->finishRecording(
+        CurPPLexer, CurPPLexer->MIOpt.GetControllingMacroAtEndOfFile());
+
   // If this is a #include'd file, pop it off the include stack and continue
   // lexing the #includer file.
   if (!IncludeMacroStack.empty()) {
@@ -19,6 +19,7 @@
 #include "clang/Basic/TargetInfo.h"
 #include "clang/Lex/CodeCompletionHandler.h"
 #include "clang/Lex/ExternalPreprocessorSource.h"
+#include "clang/Lex/HeaderEffectsCache.h"
 #include "clang/Lex/LexDiagnostic.h"
 #include "clang/Lex/MacroArgs.h"
 #include "clang/Lex/MacroInfo.h"
@@ -220,6 +221,9 @@ bool Preprocessor::HandleMacroExpandedIdentifier(Token &Identifier,
   assert(Def.isValid());
   MacroInfo *MI = Def.getMacroInfo();
 
+  if (HeaderEffects)
+    HeaderEffects->noteMacroExpansion(Identifier.getIdentifierInfo(), MI);
+
   // If this is a macro expansion in the "#if !defined(x)" line for the file,
   // then the macro could expand to different things in other contexts, we need
   // to disable the optimization in this case.
@@ -31,7 +31,9 @@
 #include "clang/Basic/TargetInfo.h"
 #include "clang/Lex/CodeCompletionHandler.h"
 #include "clang/Lex/ExternalPreprocessorSource.h"
+#include "clang/Lex/HeaderEffectsCache.h"
 #include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/HeaderTokenCache.h"
 #include "clang/Lex/LexDiagnostic.h"
 #include "clang/Lex/LiteralSupport.h"
 #include "clang/Lex/MacroArgs.h"
@@ -41,6 +43,7 @@
 #include "clang/Lex/PreprocessingRecord.h"
 #include "clang/Lex/PreprocessorOptions.h"
 #include "clang/Lex/ScratchBuffer.h"
+#include "clang/Lex/TokenPrefetcher.h"
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallString.h"
@@ -84,6 +87,7 @@ Preprocessor::Preprocessor(IntrusiveRefCntPtr<PreprocessorOptions> PPOpts,
   NumFastMacroExpanded = NumTokenPaste = NumFastTokenPaste = 0;
   MaxIncludeStackDepth = 0;
   NumSkipped = 0;
+  NumPreLexedTokens = 0;
   
   // Default to discarding comments.
   KeepComments = false;
@@ -116,6 +120,31 @@ Preprocessor::Preprocessor(IntrusiveRefCntPtr<PreprocessorOptions> PPOpts,
   
   // Initialize builtin macros like __LINE__ and friends.
   RegisterBuiltinMacros();
+
+  // When scanning for dependencies, the lexers skip everything outside of the
+  // directives, and nothing there is macro expanded. Tokens lexed ahead of
+  // time would only be thrown away.
+  ScanningDependenciesOnly = this->PPOpts->DependencyScanOnly;
+  if (ScanningDependenciesOnly)
+    SetMacroExpansionOnlyInDirectives();
+
+  // Headers are only pre-lexed for textual inclusion; MSVC header search
+  // depends on the whole include stack.
+  if (this->PPOpts->PrelexHeaders && TokenPrefetcher::isAvailable() &&
+      !LangOpts.Modules && !LangOpts.MSVCCompat && !ScanningDependenciesOnly)
+    Prefetcher.reset(new TokenPrefetcher(
+        LangOpts, SourceMgr.getFileManager().getVirtualFileSystem(),
+        this->PPOpts->PrelexHeadersWait));
+  if (!this->PPOpts->HeaderTokenCacheDir.empty() && !ScanningDependenciesOnly)
+    HeaderTokens.reset(
+        new HeaderTokenCache(this->PPOpts->HeaderTokenCacheDir, LangOpts));
+  // Replayed headers do not tell a preprocessing record about their
+  // conditionals, nor do they enter submodules. A dependency scan does not see
+  // the tokens that make a header unfit for recording.
+  if (!this->PPOpts->HeaderEffectsCacheFile.empty() && !LangOpts.Modules &&
+      !this->PPOpts->DetailedRecord && !ScanningDependenciesOnly)
+    HeaderEffects.reset(
+        new HeaderEffectsCache(*this, this->PPOpts->HeaderEffectsCacheFile));
   
   if(LangOpts.Borland) {
     Ident__exception_info        = getIdentifierInfo("_exception_info");
@@ -237,6 +266,19 @@ void Preprocessor::PrintStats() {
   llvm::errs() << "  " << NumEndif << " #endif.\n";
   llvm::errs() << "  " << NumPragma << " #pragma.\n";
   llvm::errs() << NumSkipped << " #if/#ifndef#ifdef regions skipped\n";
+  if (Prefetcher)
+    llvm::errs() << Prefetcher->getNumLexedFiles() << " headers pre-lexed, "
+                 << Prefetcher->getNumUsedFiles() << " used.\n";
+  if (Prefetcher || HeaderTokens)
+    llvm::errs() << NumPreLexedTokens << " tokens formed from pre-lexed "
+                 << "tokens.\n";
+  if (HeaderTokens)
+    llvm::errs() << HeaderTokens->getNumHits() << " header token cache hits, "
+                 << HeaderTokens->getNumMisses() << " misses.\n";
+  if (HeaderEffects)
+    llvm::errs() << HeaderEffects->getNumReplayed()
+                 << " header effects replayed, "
+                 << HeaderEffects->getNumRecorded() << " recorded.\n";
 
   llvm::errs() << NumMacroExpanded << "/" << NumFnMacroExpanded << "/"
              << NumBuiltinMacroExpanded << " obj/fn/builtin macros expanded, "
@@ -494,6 +536,9 @@ void Preprocessor::EndSourceFile() {
   // Notify the client that we reached the end of the source file.
   if (Callbacks)
     Callbacks->EndOfMainFile();
+
+  if (HeaderEffects)
+    HeaderEffects->save();
 }
 
 //===----------------------------------------------------------------------===//
@@ -684,6 +729,12 @@ void Preprocessor::Lex(Token &Result) {
     }
   } while (!ReturnedToken);
 
+  // The effects of a header that returns tokens cannot be replayed.
+  if (HeaderEffects)
+    if (PreprocessorLexer *Recorded = HeaderEffects->getRecordedLexer())
+      if (!Recorded->ParsingPreprocessorDirective && Result.isNot(tok::eod))
+        HeaderEffects->abortRecording();
+
   LastTokenWasAt = Result.is(tok::at);
 }
 
@@ -261,15 +261,8 @@ void TokenLexer::ExpandFunctionArguments() {
     // argument and substitute the expanded tokens into the result.  This is
     // C99 6.10.3.1p1.
     if (!PasteBefore && !PasteAfter) {
-      const Token *ResultArgToks;
-
-      // Only preexpand the argument if it could possibly need it.  This
-      // avoids some work in common cases.
-      const Token *ArgTok = ActualArgs->getUnexpArgument(ArgNo);
-      if (ActualArgs->ArgNeedsPreexpansion(ArgTok, PP))
-        ResultArgToks = &ActualArgs->getPreExpArgument(ArgNo, Macro, PP)[0];
-      else
-        ResultArgToks = ArgTok;  // Use non-preexpanded tokens.
+      const Token *ResultArgToks =
+          ActualArgs->getExpandedArgument(ArgNo, Macro, PP);
 
       // If the arg token expanded into anything, append it.
       if (ResultArgToks->isNot(tok::eof)) {
@@ -0,0 +1,518 @@
+//===--- TokenPrefetcher.cpp - Background Lexing of Headers ---------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file implements the TokenPrefetcher interface.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Lex/TokenPrefetcher.h"
+#include "clang/Basic/CharInfo.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/VirtualFileSystem.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include <algorithm>
+using namespace clang;
+
+TokenPrefetcher::TokenPrefetcher(const LangOptions &LangOpts,
+                                 IntrusiveRefCntPtr<vfs::FileSystem> FS,
+                                 bool WaitForWorker)
+  : LangOpts(LangOpts), FS(FS), WaitForWorker(WaitForWorker),
+    AngledDirIdx(0), HasSearchPath(false), Busy(false), ShuttingDown(false),
+    NumLexedFiles(0), NumUsedFiles(0) {
+#if LLVM_ENABLE_THREADS
+  Worker = std::thread(&TokenPrefetcher::runWorker, this);
+#endif
+}
+
+TokenPrefetcher::~TokenPrefetcher() {
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    ShuttingDown = true;
+  }
+  QueueChanged.notify_one();
+  if (Worker.joinable())
+    Worker.join();
+}
+
+bool TokenPrefetcher::isAvailable() {
+#if LLVM_ENABLE_THREADS
+  return true;
+#else
+  return false;
+#endif
+}
+
+void TokenPrefetcher::setSearchPath(std::vector<std::string> Dirs,
+                                    unsigned AngledDirIdx) {
+  assert(!HasSearchPath && "Search path can only be set once");
+  assert(AngledDirIdx <= Dirs.size() && "Invalid angled directory index");
+  std::lock_guard<std::mutex> Guard(Lock);
+  SearchDirs.swap(Dirs);
+  this->AngledDirIdx = AngledDirIdx;
+  HasSearchPath = true;
+}
+
+void TokenPrefetcher::prefetch(StringRef IncluderDir, StringRef Name,
+                               bool IsAngled) {
+  if (!isAvailable() || !HasSearchPath)
+    return;
+
+  // Angled includes do not depend on the includer.
+  SmallString<256> Key;
+  if (IsAngled) {
+    Key += '<';
+  } else {
+    Key += IncluderDir;
+    Key += '"';
+  }
+  Key += Name;
+  if (!Requested.insert(Key))
+    return;
+
+  PrefetchRequest Request;
+  Request.IncluderDir = IncluderDir;
+  Request.Name = Name;
+  Request.IsAngled = IsAngled;
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    Queue.push_back(std::move(Request));
+  }
+  QueueChanged.notify_one();
+}
+
+bool TokenPrefetcher::takeFile(const FileEntry *File,
+                               std::unique_ptr<llvm::MemoryBuffer> &Buffer,
+                               ArrayRef<PreLexedToken> &Tokens) {
+  std::unique_lock<std::mutex> Guard(Lock);
+  if (WaitForWorker)
+    while (Busy || !Queue.empty())
+      Idle.wait(Guard);
+
+  std::map<llvm::sys::fs::UniqueID, PrefetchedFile>::iterator Known =
+      Files.find(File->getUniqueID());
+  if (Known == Files.end() || Known->second.Taken)
+    return false;
+  PrefetchedFile &Entry = Known->second;
+  Entry.Taken = true;
+  Buffer = std::move(Entry.Buffer);
+  Tokens = Entry.Tokens;
+  return true;
+}
+
+unsigned TokenPrefetcher::getNumLexedFiles() {
+  std::lock_guard<std::mutex> Guard(Lock);
+  return NumLexedFiles;
+}
+
+void TokenPrefetcher::runWorker() {
+  std::unique_lock<std::mutex> Guard(Lock);
+  while (true) {
+    while (Queue.empty() && !ShuttingDown)
+      QueueChanged.wait(Guard);
+    if (ShuttingDown)
+      return;
+
+    PrefetchRequest Request = std::move(Queue.front());
+    Queue.pop_front();
+    Busy = true;
+    Guard.unlock();
+
+    lookupAndLex(Request);
+
+    Guard.lock();
+    Busy = false;
+    if (Queue.empty())
+      Idle.notify_all();
+  }
+}
+
+void TokenPrefetcher::lookupAndLex(const PrefetchRequest &Request) {
+  // Probe the candidates in the order HeaderSearch::LookupFile tries them,
+  // composing the paths the same way so that the buffer gets the name the
+  // FileManager will know the header by.
+  SmallVector<std::string, 8> Candidates;
+  if (llvm::sys::path::is_absolute(Request.Name)) {
+    Candidates.push_back(Request.Name);
+  } else {
+    if (!Request.IsAngled)
+      Candidates.push_back(Request.IncluderDir + '/' + Request.Name);
+    for (unsigned I = Request.IsAngled ? AngledDirIdx : 0,
+                  E = SearchDirs.size(); I != E; ++I) {
+      // The header may well be found through a framework or header map,
+      // which only the preprocessor can search.
+      if (SearchDirs[I].empty())
+        break;
+      SmallString<256> Path(SearchDirs[I]);
+      llvm::sys::path::append(Path, Request.Name);
+      Candidates.push_back(Path.str());
+    }
+  }
+
+  for (unsigned I = 0, E = Candidates.size(); I != E; ++I) {
+    llvm::ErrorOr<vfs::Status> Status = FS->status(Candidates[I]);
+    if (!Status)
+      continue;
+    if (!Status->isRegularFile())
+      return;
+
+    {
+      std::lock_guard<std::mutex> Guard(Lock);
+      if (Files.count(Status->getUniqueID()))
+        return;
+    }
+
+    // The buffer is kept even if the header is not guarded; the source
+    // manager adopts it instead of reading the file again.
+    PrefetchedFile Entry;
+    if (FS->getBufferForFile(Candidates[I], Entry.Buffer, Status->getSize()))
+      return;
+    if (!lexBuffer(Entry.Buffer->getBuffer(), LangOpts, Entry.Tokens))
+      std::vector<PreLexedToken>().swap(Entry.Tokens);
+
+    std::lock_guard<std::mutex> Guard(Lock);
+    if (!Entry.Tokens.empty())
+      ++NumLexedFiles;
+    PrefetchedFile &Slot = Files[Status->getUniqueID()];
+    Slot.Buffer = std::move(Entry.Buffer);
+    Slot.Tokens.swap(Entry.Tokens);
+    return;
+  }
+}
+
+void TokenPrefetcher::findIncludes(StringRef Buffer,
+                      SmallVectorImpl<std::pair<StringRef, bool> > &Includes) {
+  const char *CurPtr = Buffer.begin(), *End = Buffer.end();
+  // The nesting depth of conditionals in the #if 0 block being skipped.
+  unsigned SkipDepth = 0;
+  while (CurPtr != End) {
+    while (CurPtr != End && isHorizontalWhitespace(*CurPtr))
+      ++CurPtr;
+
+    if (CurPtr != End && *CurPtr == '#') {
+      ++CurPtr;
+      while (CurPtr != End && isHorizontalWhitespace(*CurPtr))
+        ++CurPtr;
+
+      const char *NameStart = CurPtr;
+      while (CurPtr != End && isIdentifierBody(*CurPtr))
+        ++CurPtr;
+      StringRef Directive(NameStart, CurPtr - NameStart);
+      while (CurPtr != End && isHorizontalWhitespace(*CurPtr))
+        ++CurPtr;
+
+      if (SkipDepth) {
+        if (Directive == "if" || Directive == "ifdef" || Directive == "ifndef")
+          ++SkipDepth;
+        else if (Directive == "endif" ||
+                 ((Directive == "else" || Directive == "elif") &&
+                  SkipDepth == 1))
+          --SkipDepth;
+      } else if (Directive == "if") {
+        if (CurPtr != End && *CurPtr == '0' &&
+            (CurPtr + 1 == End || !isPreprocessingNumberBody(CurPtr[1])))
+          SkipDepth = 1;
+      } else if ((Directive == "include" || Directive == "import") &&
+                 CurPtr != End && (*CurPtr == '"' || *CurPtr == '<')) {
+        char Terminator = *CurPtr == '"' ? '"' : '>';
+        const char *FileNameStart = ++CurPtr;
+        while (CurPtr != End && *CurPtr != Terminator &&
+               !isVerticalWhitespace(*CurPtr))
+          ++CurPtr;
+        if (CurPtr != End && *CurPtr == Terminator && CurPtr != FileNameStart)
+          Includes.push_back(std::make_pair(
+              StringRef(FileNameStart, CurPtr - FileNameStart),
+              Terminator == '>'));
+      }
+    }
+
+    CurPtr = std::find(CurPtr, End, '\n');
+    if (CurPtr != End)
+      ++CurPtr;
+  }
+}
+
+namespace {
+/// \brief Recognizes the directives of an include-guarded header from the
+/// words of each directive line.
+class GuardDetector {
+  enum {
+    /// Nothing but comments seen so far.
+    GS_Start,
+    /// \#ifndef X was the first thing in the file, expecting \#define X.
+    GS_ExpectDefine,
+    /// Inside the guard.
+    GS_Guarded,
+    /// The guard was closed and nothing but comments followed.
+    GS_Closed,
+    /// The file is not guarded.
+    GS_None
+  } State;
+  StringRef GuardMacro;
+  unsigned Depth;
+  bool PragmaOnce;
+
+public:
+  GuardDetector() : State(GS_Start), Depth(0), PragmaOnce(false) {}
+
+  bool isGuarded() const { return PragmaOnce || State == GS_Closed; }
+
+  /// \brief A token outside of any directive.
+  void token() {
+    if (State != GS_Guarded)
+      State = GS_None;
+  }
+
+  void directive(ArrayRef<StringRef> Words) {
+    StringRef Name = Words.empty() ? StringRef() : Words[0];
+    if (Name == "pragma" && Words.size() > 1 && Words[1] == "once")
+      PragmaOnce = true;
+
+    if (State == GS_ExpectDefine) {
+      if (Name == "define" && Words.size() > 1 && Words[1] == GuardMacro)
+        State = GS_Guarded;
+      else
+        State = GS_None;
+      return;
+    }
+
+    if (Name == "if" || Name == "ifdef" || Name == "ifndef") {
+      if (State == GS_Start) {
+        State = GS_None;
+        if (Name == "ifndef" && Words.size() == 2) {
+          GuardMacro = Words[1];
+          State = GS_ExpectDefine;
+        } else if (Name == "if" && Words.size() >= 4 && Words[1] == "!" &&
+                   Words[2] == "defined") {
+          // #if !defined X or #if !defined(X)
+          if (Words.size() == 4) {
+            GuardMacro = Words[3];
+            State = GS_ExpectDefine;
+          } else if (Words.size() == 6 && Words[3] == "(" && Words[5] == ")") {
+            GuardMacro = Words[4];
+            State = GS_ExpectDefine;
+          }
+        }
+      }
+      ++Depth;
+      return;
+    }
+
+    if (State == GS_Start || State == GS_Closed) {
+      State = GS_None;
+      return;
+    }
+    if (State != GS_Guarded)
+      return;
+
+    if (Name == "endif") {
+      if (--Depth == 0)
+        State = GS_Closed;
+    } else if ((Name == "else" || Name == "elif") && Depth == 1) {
+      State = GS_None;
+    }
+  }
+};
+}
+
+/// \brief Whether the preprocessor's Lexer, starting anywhere in the
+/// whitespace before this raw token, lexes exactly the same token without
+/// emitting any diagnostic.
+static bool isTrustedToken(const Token &Tok, const char *TokStart,
+                           const char *TokEnd, bool AtPhysicalStartOfLine) {
+  if (Tok.needsCleaning())
+    return false;
+
+  // Conflict markers are only recognized at the start of a line.
+  if (AtPhysicalStartOfLine &&
+      (*TokStart == '<' || *TokStart == '>' || *TokStart == '=' ||
+       *TokStart == '|'))
+    return false;
+
+  switch (Tok.getKind()) {
+  case tok::raw_identifier:
+    // '$', UCNs and UTF-8 characters may be diagnosed.
+    for (const char *CurPtr = TokStart; CurPtr != TokEnd; ++CurPtr)
+      if (!isIdentifierBody(*CurPtr))
+        return false;
+    return true;
+
+  case tok::numeric_constant:
+    // Digit separators may be diagnosed.
+    for (const char *CurPtr = TokStart; CurPtr != TokEnd; ++CurPtr)
+      if (!isPreprocessingNumberBody(*CurPtr) && *CurPtr != '+' &&
+          *CurPtr != '-')
+        return false;
+    return true;
+
+  case tok::string_literal:
+  case tok::char_constant: {
+    // Only plain, terminated literals without a user-defined suffix; embedded
+    // nulls and ignored trigraphs would be diagnosed.
+    char Quote = Tok.is(tok::string_literal) ? '"' : '\'';
+    unsigned MinLength = Tok.is(tok::string_literal) ? 2 : 3;
+    if (*TokStart != Quote || TokEnd[-1] != Quote ||
+        unsigned(TokEnd - TokStart) < MinLength)
+      return false;
+    for (const char *CurPtr = TokStart; CurPtr != TokEnd; ++CurPtr)
+      if (*CurPtr == 0 || (CurPtr[0] == '?' && CurPtr[1] == '?'))
+        return false;
+    return isASCII(*TokEnd) && !isIdentifierBody(*TokEnd, true) &&
+           *TokEnd != '\\';
+  }
+
+  case tok::hash:
+  case tok::hashhash:
+  case tok::hashat:
+    return false;
+
+  case tok::question:
+    // '??' may start a trigraph.
+    return *TokEnd != '?';
+
+  case tok::less:
+    // '<::' may be diagnosed.
+    if (*TokEnd == ':')
+      return false;
+    return true;
+
+  default:
+    return tok::getPunctuatorSpelling(Tok.getKind()) != nullptr;
+  }
+}
+
+bool TokenPrefetcher::isValidPreLexedToken(StringRef Buffer,
+                                           const PreLexedToken &Tok) {
+  StringRef Spelling = Buffer.substr(Tok.Offset, Tok.Length);
+  if (Spelling.empty())
+    return false;
+
+  switch (Tok.Kind) {
+  case tok::raw_identifier:
+    if (isDigit(Spelling[0]))
+      return false;
+    for (unsigned I = 0, E = Spelling.size(); I != E; ++I)
+      if (!isIdentifierBody(Spelling[I]))
+        return false;
+    return true;
+
+  case tok::numeric_constant:
+    if (!isDigit(Spelling[0]) &&
+        !(Spelling[0] == '.' && Spelling.size() > 1 && isDigit(Spelling[1])))
+      return false;
+    for (unsigned I = 0, E = Spelling.size(); I != E; ++I)
+      if (!isPreprocessingNumberBody(Spelling[I]) && Spelling[I] != '+' &&
+          Spelling[I] != '-')
+        return false;
+    return true;
+
+  case tok::string_literal:
+  case tok::char_constant: {
+    char Quote = Tok.Kind == tok::string_literal ? '"' : '\'';
+    unsigned MinLength = Tok.Kind == tok::string_literal ? 2 : 3;
+    if (Spelling.size() < MinLength || Spelling.front() != Quote ||
+        Spelling.back() != Quote)
+      return false;
+    for (unsigned I = 0, E = Spelling.size(); I != E; ++I)
+      if (Spelling[I] == 0 || isVerticalWhitespace(Spelling[I]))
+        return false;
+    return true;
+  }
+
+  // Digraphs.
+  case tok::l_square:
+    return Spelling == "[" || Spelling == "<:";
+  case tok::r_square:
+    return Spelling == "]" || Spelling == ":>";
+  case tok::l_brace:
+    return Spelling == "{" || Spelling == "<%";
+  case tok::r_brace:
+    return Spelling == "}" || Spelling == "%>";
+
+  case tok::hash:
+  case tok::hashhash:
+  case tok::hashat:
+    return false;
+
+  default:
+    // Everything else that is not a punctuator, such as eof, eod, comments
+    // and annotations, is never kept.
+    if (const char *Punctuator = tok::getPunctuatorSpelling(Tok.Kind))
+      return Spelling == Punctuator;
+    return false;
+  }
+}
+
+bool TokenPrefetcher::lexBuffer(StringRef Buffer, const LangOptions &LangOpts,
+                                std::vector<PreLexedToken> &Tokens) {
+  const char *BufStart = Buffer.begin(), *BufEnd = Buffer.end();
+  assert(*BufEnd == 0 && "Buffer is not null terminated");
+  Lexer TheLexer(SourceLocation(), LangOpts, BufStart, BufStart, BufEnd);
+
+  GuardDetector Guard;
+  SmallVector<StringRef, 8> DirectiveWords;
+  bool InDirective = false;
+  unsigned PrevEnd = 0;
+  Token Tok;
+  while (true) {
+    TheLexer.LexFromRawLexer(Tok);
+    if (InDirective && (Tok.isAtStartOfLine() || Tok.is(tok::eof))) {
+      Guard.directive(DirectiveWords);
+      InDirective = false;
+    }
+    if (Tok.is(tok::eof))
+      break;
+
+    const char *TokEnd = TheLexer.getBufferLocation();
+    const char *TokStart = TokEnd - Tok.getLength();
+    unsigned Offset = TokStart - BufStart;
+
+    if (InDirective) {
+      // Directive lines are lexed by the preprocessor itself.
+      if (DirectiveWords.size() != DirectiveWords.capacity())
+        DirectiveWords.push_back(StringRef(TokStart, Tok.getLength()));
+    } else if (Tok.is(tok::hash) && Tok.isAtStartOfLine()) {
+      InDirective = true;
+      DirectiveWords.clear();
+    } else {
+      Guard.token();
+
+      // The preprocessor's Lexer skips whitespace exactly like the raw lexer,
+      // but diagnoses stray nulls and may retain comments.
+      bool OnlyWhitespace = true;
+      bool SawNewline = PrevEnd == 0;
+      for (const char *CurPtr = BufStart + PrevEnd; CurPtr != TokStart;
+           ++CurPtr) {
+        if (!isWhitespace(*CurPtr)) {
+          OnlyWhitespace = false;
+          break;
+        }
+        if (isVerticalWhitespace(*CurPtr))
+          SawNewline = true;
+      }
+
+      if (OnlyWhitespace &&
+          isTrustedToken(Tok, TokStart, TokEnd, SawNewline)) {
+        PreLexedToken PreLexed = PreLexedToken();
+        PreLexed.GapStart = PrevEnd;
+        PreLexed.Offset = Offset;
+        PreLexed.Length = Tok.getLength();
+        PreLexed.Kind = Tok.getKind();
+        Tokens.push_back(PreLexed);
+      }
+    }
+
+    PrevEnd = Offset + Tok.getLength();
+  }
+
+  return Guard.isGuarded();
+}
@@ -24,6 +24,7 @@
 #include "clang/AST/TypeLocVisitor.h"
 #include "clang/Basic/DiagnosticOptions.h"
 #include "clang/Basic/FileManager.h"
+#include "clang/Basic/FileSystemStatCache.h"
 #include "clang/Basic/SourceManager.h"
 #include "clang/Basic/SourceManagerInternals.h"
 #include "clang/Basic/TargetInfo.h"
@@ -53,9 +54,14 @@
 #include "llvm/Support/SaveAndRestore.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstdio>
+#include <functional>
 #include <iterator>
+#include <mutex>
 #include <system_error>
+#include <thread>
 
 using namespace clang;
 using namespace clang::serialization;
@@ -689,6 +695,16 @@ static bool isInterestingIdentifier(IdentifierInfo &II) {
          II.getFETokenInfo<void>();
 }
 
+IdentifierInfo *
+ASTIdentifierLookupTrait::getOrCreateIdentifier(const internal_key_type &k,
+                                                IdentID ID) {
+  // The identifier may have been decoded without being entered in the
+  // identifier table; see ASTReader::DecodeIdentifierInfo.
+  if (IdentifierInfo *II = Reader.IdentifiersLoaded[ID - 1])
+    return II;
+  return &Reader.getIdentifierTable().getOwn(k);
+}
+
 IdentifierInfo *ASTIdentifierLookupTrait::ReadData(const internal_key_type& k,
                                                    const unsigned char* d,
                                                    unsigned DataLen) {
@@ -705,7 +721,7 @@ IdentifierInfo *ASTIdentifierLookupTrait::ReadData(const internal_key_type& k,
     // and associate it with the persistent ID.
     IdentifierInfo *II = KnownII;
     if (!II) {
-      II = &Reader.getIdentifierTable().getOwn(k);
+      II = getOrCreateIdentifier(k, ID);
       KnownII = II;
     }
     Reader.SetIdentifierInfo(ID, II);
@@ -741,7 +757,7 @@ IdentifierInfo *ASTIdentifierLookupTrait::ReadData(const internal_key_type& k,
   // the new IdentifierInfo.
   IdentifierInfo *II = KnownII;
   if (!II) {
-    II = &Reader.getIdentifierTable().getOwn(StringRef(k));
+    II = getOrCreateIdentifier(k, ID);
     KnownII = II;
   }
   Reader.markIdentifierUpToDate(II);
@@ -1230,6 +1246,32 @@ bool ASTReader::ReadSLocEntry(int ID) {
       SourceMgr.overrideFileContents(File, Buffer);
     }
 
+    // Pick up the line table of the file, if the AST file has one, so that
+    // we need not compute it by scanning the file.
+    if (!ContentCache->SourceLineCache && !IF.isOutOfDate()) {
+      for (unsigned I = 0; I != 2; ++I) {
+        // The last entry of the block may have no line table; don't leave
+        // the block in search of one.
+        llvm::BitstreamEntry Next =
+            SLocEntryCursor.advance(BitstreamCursor::AF_DontPopBlockAtEnd);
+        if (Next.Kind != llvm::BitstreamEntry::Record)
+          break;
+        Record.clear();
+        unsigned RecCode = SLocEntryCursor.readRecord(Next.ID, Record, &Blob);
+        if (RecCode == SM_SLOC_BUFFER_BLOB)
+          continue;
+        if (RecCode == SM_SLOC_LINE_TABLE && !Record.empty()) {
+          SmallVector<unsigned, 256> LineOffsets;
+          LineOffsets.push_back(0);
+          for (unsigned Line = 1, N = Record.size(); Line != N; ++Line)
+            LineOffsets.push_back(LineOffsets.back() + Record[Line]);
+          SourceMgr.setFileLineOffsets(File, Record[0], LineOffsets);
+          ++NumLineTablesRead;
+        }
+        break;
+      }
+    }
+
     break;
   }
 
@@ -2051,6 +2093,148 @@ std::string ASTReader::getInputFileName(ModuleFile &F, unsigned int ID) {
   return readInputFileInfo(F, ID).Filename;
 }
 
+/// \brief The number of input files each thread stats at a time when
+/// validating the input files of an AST file.
+static const unsigned InputFileStatBatchSize = 64;
+
+namespace {
+/// \brief The status of the input files of an AST file, looked up ahead of
+/// validating them.
+class PrefetchedStatCache : public FileSystemStatCache {
+public:
+  llvm::StringMap<FileData> Files;
+
+  LookupResult getStat(const char *Path, FileData &Data, bool isFile,
+                       std::unique_ptr<vfs::File> *F,
+                       vfs::FileSystem &FS) override {
+    // Opening the file, or looking for a directory, needs the file system.
+    llvm::StringMap<FileData>::iterator Known = Files.find(Path);
+    if (F || !isFile || Known == Files.end())
+      return statChained(Path, Data, isFile, F, FS);
+    Data = Known->second;
+    return CacheExists;
+  }
+};
+}
+
+/// \brief A set of threads which all run the same job when asked to, and wait
+/// for the next one in between.
+class ASTReader::InputFileStatPool {
+  std::mutex Lock;
+  std::condition_variable JobReady, JobDone;
+  const std::function<void()> *Job;
+  unsigned JobNumber;
+  unsigned NumRunning;
+  bool ShuttingDown;
+  std::vector<std::thread> Threads;
+
+  void work() {
+    unsigned LastJob = 0;
+    std::unique_lock<std::mutex> Guard(Lock);
+    while (true) {
+      JobReady.wait(Guard,
+                    [&] { return ShuttingDown || JobNumber != LastJob; });
+      if (ShuttingDown)
+        return;
+      LastJob = JobNumber;
+      const std::function<void()> &Current = *Job;
+      Guard.unlock();
+      Current();
+      Guard.lock();
+      if (--NumRunning == 0)
+        JobDone.notify_one();
+    }
+  }
+
+public:
+  explicit InputFileStatPool(unsigned NumThreads)
+    : Job(nullptr), JobNumber(0), NumRunning(0), ShuttingDown(false) {
+    for (unsigned I = 0; I != NumThreads; ++I)
+      Threads.push_back(std::thread(&InputFileStatPool::work, this));
+  }
+  ~InputFileStatPool() {
+    {
+      std::lock_guard<std::mutex> Guard(Lock);
+      ShuttingDown = true;
+    }
+    JobReady.notify_all();
+    for (std::thread &T : Threads)
+      T.join();
+  }
+
+  /// \brief Run \p NewJob on each thread of the pool and on the calling
+  /// thread, and wait until all of them return.
+  void run(const std::function<void()> &NewJob) {
+    {
+      std::lock_guard<std::mutex> Guard(Lock);
+      Job = &NewJob;
+      ++JobNumber;
+      NumRunning = Threads.size();
+    }
+    JobReady.notify_all();
+    NewJob();
+    std::unique_lock<std::mutex> Guard(Lock);
+    JobDone.wait(Guard, [&] { return NumRunning == 0; });
+    Job = nullptr;
+  }
+};
+
+FileSystemStatCache *ASTReader::prefetchInputFileStats(ModuleFile &F,
+                                                       unsigned N) {
+  // Only the real file system is known to be safe to use from several
+  // threads.
+  IntrusiveRefCntPtr<vfs::FileSystem> FS = FileMgr.getVirtualFileSystem();
+  if (FS != vfs::getRealFileSystem())
+    return nullptr;
+
+  // The file manager would not stat the files it has seen, nor relative
+  // paths under the name they are looked up with, so leave those alone.
+  std::vector<std::string> Paths;
+  for (unsigned I = 0; I != N; ++I) {
+    if (F.InputFilesLoaded[I].getFile() || F.InputFilesLoaded[I].isNotFound())
+      continue;
+    InputFileInfo FI = readInputFileInfo(F, I + 1);
+    if (!FI.Overridden && llvm::sys::path::is_absolute(FI.Filename) &&
+        !FileMgr.hasCachedFile(FI.Filename))
+      Paths.push_back(std::move(FI.Filename));
+  }
+
+  unsigned NumBatches =
+      (Paths.size() + InputFileStatBatchSize - 1) / InputFileStatBatchSize;
+  if (NumBatches < 2)
+    return nullptr;
+
+  std::vector<FileData> Results(Paths.size());
+  std::vector<char> Exists(Paths.size());
+  std::atomic<unsigned> NextBatch(0);
+  std::function<void()> StatBatches = [&] {
+    for (unsigned B = NextBatch++; B < NumBatches; B = NextBatch++) {
+      unsigned Begin = B * InputFileStatBatchSize;
+      unsigned End = std::min<unsigned>(Begin + InputFileStatBatchSize,
+                                        Paths.size());
+      for (unsigned I = Begin; I != End; ++I)
+        Exists[I] = !FileSystemStatCache::get(Paths[I].c_str(), Results[I],
+                                              /*isFile=*/true, nullptr,
+                                              nullptr, *FS);
+    }
+  };
+
+  // The calling thread takes batches too. Threads of the pool which find no
+  // batch left return at once.
+  if (!StatPool)
+    StatPool.reset(new InputFileStatPool(
+        std::max(1u, std::thread::hardware_concurrency()) - 1));
+  StatPool->run(StatBatches);
+  NumInputFileStatsPrefetched += Paths.size();
+
+  PrefetchedStatCache *Cache = new PrefetchedStatCache();
+  for (unsigned I = 0, E = Paths.size(); I != E; ++I)
+    if (Exists[I])
+      Cache->Files[Paths[I]] = Results[I];
+  FileMgr.addStatCache(Cache, /*AtBeginning=*/true);
+  return Cache;
+}
+
 InputFile ASTReader::getInputFile(ModuleFile &F, unsigned ID, bool Complain) {
   // If this ID is bogus, just return an empty input file.
   if (ID == 0 || ID > F.InputFilesLoaded.size())
@@ -2063,6 +2247,9 @@ InputFile ASTReader::getInputFile(ModuleFile &F, unsigned ID, bool Complain) {
   if (F.InputFilesLoaded[ID-1].isNotFound())
     return InputFile();
 
+  if (ID <= F.NumDeferredInputFiles)
+    ++NumDeferredInputFilesValidated;
+
   // Go find this input file.
   BitstreamCursor &Cursor = F.InputFilesCursor;
   SavedStreamPosition SavedPosition(Cursor);
@@ -2257,9 +2444,20 @@ ASTReader::ReadControlBlock(ModuleFile &F,
             (HSOpts.ModulesValidateOncePerBuildSession && F.Kind == MK_Module))
           N = NumInputs;
 
-        for (unsigned I = 0; I < N; ++I) {
-          InputFile IF = getInputFile(F, I+1, Complain);
-          if (!IF.getFile() || IF.isOutOfDate())
+        if (HSOpts.ModulesValidateInputFilesLazily && F.Kind == MK_Module) {
+          // Validate each input file when its source location entry is
+          // loaded instead; most of them never are.
+          F.NumDeferredInputFiles = N;
+          NumInputFilesDeferred += N;
+        } else {
+          FileSystemStatCache *Prefetched = prefetchInputFileStats(F, N);
+          bool IsOutOfDate = false;
+          for (unsigned I = 0; I < N && !IsOutOfDate; ++I) {
+            InputFile IF = getInputFile(F, I+1, Complain);
+            IsOutOfDate = !IF.getFile() || IF.isOutOfDate();
+          }
+          FileMgr.removeStatCache(Prefetched);
+          if (IsOutOfDate)
             return OutOfDate;
         }
       }
@@ -3611,9 +3809,11 @@ ASTReader::ASTReadResult ASTReader::ReadAST(const std::string &FileName,
     // up to date.  Create or update timestamp files for modules that are
     // located in the module cache (not for PCH files that could be anywhere
     // in the filesystem).
+    // Modules whose input files are validated lazily are not known to be
+    // up to date yet.
     for (unsigned I = 0, N = Loaded.size(); I != N; ++I) {
       ImportedModule &M = Loaded[I];
-      if (M.Mod->Kind == MK_Module) {
+      if (M.Mod->Kind == MK_Module && !M.Mod->NumDeferredInputFiles) {
         updateModuleTimestamp(*M.Mod);
       }
     }
@@ -6645,6 +6845,16 @@ void ASTReader::PrintStats() {
     std::fprintf(stderr, "  %u/%u source location entries read (%f%%)\n",
                  NumSLocEntriesRead, TotalNumSLocEntries,
                  ((float)NumSLocEntriesRead/TotalNumSLocEntries * 100));
+  if (NumLineTablesRead)
+    std::fprintf(stderr, "  %u file line tables read\n", NumLineTablesRead);
+  if (NumInputFileStatsPrefetched)
+    std::fprintf(stderr, "  %u input files stat'ed in parallel\n",
+                 NumInputFileStatsPrefetched);
+  if (NumInputFilesDeferred)
+    std::fprintf(stderr, "  %u/%u deferred input files validated "
+                 "(%u stats avoided)\n",
+                 NumDeferredInputFilesValidated, NumInputFilesDeferred,
+                 NumInputFilesDeferred - NumDeferredInputFilesValidated);
   if (!TypesLoaded.empty())
     std::fprintf(stderr, "  %u/%u types read (%f%%)\n",
                  NumTypesLoaded, (unsigned)TypesLoaded.size(),
@@ -7270,8 +7480,25 @@ IdentifierInfo *ASTReader::DecodeIdentifierInfo(IdentifierID ID) {
     const unsigned char *StrLenPtr = (const unsigned char*) Str - 2;
     unsigned StrLen = (((unsigned) StrLenPtr[0])
                        | (((unsigned) StrLenPtr[1]) << 8)) - 1;
-    IdentifiersLoaded[ID]
-      = &PP.getIdentifierTable().get(StringRef(Str, StrLen));
+    StringRef Name(Str, StrLen);
+    IdentifierTable &Idents = PP.getIdentifierTable();
+    IdentifierInfo *II;
+    if (!canReferenceIdentifierSpellings()) {
+      II = &Idents.get(Name);
+    } else if (IdentifierInfo *Existing = Idents.findOwn(Name)) {
+      II = Existing;
+    } else {
+      // Nothing has looked this name up yet. Rather than copying it into the
+      // identifier table and looking it up in the AST files, reference its
+      // spelling in the AST file and read what the AST file says about it
+      // once it is used, as the identifier is out of date. Looking the name
+      // up later finds this identifier in IdentifiersLoaded, as each name
+      // has a single ID.
+      II = &Idents.createExternal(Str);
+      II->setIsFromAST();
+      II->setOutOfDate(true);
+    }
+    IdentifiersLoaded[ID] = II;
     if (DeserializationListener)
       DeserializationListener->IdentifierRead(ID + 1, IdentifiersLoaded[ID]);
   }
@@ -7279,6 +7506,14 @@ IdentifierInfo *ASTReader::DecodeIdentifierInfo(IdentifierID ID) {
   return IdentifiersLoaded[ID];
 }
 
+bool ASTReader::canReferenceIdentifierSpellings() const {
+  // Each module file numbers the identifiers it uses on its own, so a name
+  // may have several IDs. The files of a PCH chain reuse the IDs of the files
+  // they are built on instead.
+  return !Context.getLangOpts().Modules &&
+         PP.getIdentifierTable().getExternalIdentifierLookup() == this;
+}
+
 IdentifierInfo *ASTReader::getLocalIdentifier(ModuleFile &M, unsigned LocalID) {
   return DecodeIdentifierInfo(getGlobalIdentifierID(M, LocalID));
 }
@@ -8326,10 +8561,12 @@ ASTReader::ASTReader(Preprocessor &PP, ASTContext &Context, StringRef isysroot,
       ValidateSystemInputs(ValidateSystemInputs),
       UseGlobalIndex(UseGlobalIndex), TriedLoadingGlobalIndex(false),
       CurrSwitchCaseStmts(&SwitchCaseStmts),
-      NumSLocEntriesRead(0), TotalNumSLocEntries(0), NumStatementsRead(0),
-      TotalNumStatements(0), NumMacrosRead(0), TotalNumMacros(0),
-      NumIdentifierLookups(0), NumIdentifierLookupHits(0), NumSelectorsRead(0),
-      NumMethodPoolEntriesRead(0), NumMethodPoolLookups(0),
+      NumSLocEntriesRead(0), TotalNumSLocEntries(0), NumLineTablesRead(0),
+      NumInputFileStatsPrefetched(0), NumInputFilesDeferred(0),
+      NumDeferredInputFilesValidated(0),
+      NumStatementsRead(0), TotalNumStatements(0), NumMacrosRead(0),
+      TotalNumMacros(0), NumIdentifierLookups(0), NumIdentifierLookupHits(0),
+      NumSelectorsRead(0), NumMethodPoolEntriesRead(0), NumMethodPoolLookups(0),
       NumMethodPoolHits(0), NumMethodPoolTableLookups(0),
       NumMethodPoolTableHits(0), TotalNumMethodPoolEntries(0),
       NumLexicalDeclContextsRead(0), TotalLexicalDeclContexts(0),
@@ -125,6 +125,9 @@ class ASTIdentifierLookupTrait : public ASTIdentifierLookupTraitBase {
   // not build a new one. Used when deserializing information about an
   // identifier that was constructed before the AST file was read.
   IdentifierInfo *KnownII;
+
+  IdentifierInfo *getOrCreateIdentifier(const internal_key_type &k,
+                                        IdentID ID);
   
 public:
   typedef IdentifierInfo * data_type;
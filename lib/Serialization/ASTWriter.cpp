@@ -46,6 +46,7 @@
 #include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Bitcode/BitstreamWriter.h"
+#include "llvm/Support/Endian.h"
 #include "llvm/Support/EndianStream.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
@@ -54,6 +55,7 @@
 #include <algorithm>
 #include <cstdio>
 #include <string.h>
+#include <thread>
 #include <utility>
 using namespace clang;
 using namespace clang::serialization;
@@ -874,6 +876,7 @@ void ASTWriter::WriteBlockInfoBlock() {
   RECORD(SM_SLOC_BUFFER_ENTRY);
   RECORD(SM_SLOC_BUFFER_BLOB);
   RECORD(SM_SLOC_EXPANSION_ENTRY);
+  RECORD(SM_SLOC_LINE_TABLE);
 
   // Preprocessor Block.
   BLOCK(PREPROCESSOR_BLOCK);
@@ -1448,6 +1451,17 @@ static unsigned CreateSLocBufferBlobAbbrev(llvm::BitstreamWriter &Stream) {
   return Stream.EmitAbbrev(Abbrev);
 }
 
+/// \brief Create an abbreviation for the line table of a file.
+static unsigned CreateSLocLineTableAbbrev(llvm::BitstreamWriter &Stream) {
+  using namespace llvm;
+  BitCodeAbbrev *Abbrev = new BitCodeAbbrev();
+  Abbrev->Add(BitCodeAbbrevOp(SM_SLOC_LINE_TABLE));
+  Abbrev->Add(BitCodeAbbrevOp(BitCodeAbbrevOp::VBR, 16)); // File size
+  Abbrev->Add(BitCodeAbbrevOp(BitCodeAbbrevOp::Array));
+  Abbrev->Add(BitCodeAbbrevOp(BitCodeAbbrevOp::VBR, 6)); // Line lengths
+  return Stream.EmitAbbrev(Abbrev);
+}
+
 /// \brief Create an abbreviation for the SLocEntry that refers to a macro
 /// expansion.
 static unsigned CreateSLocExpansionAbbrev(llvm::BitstreamWriter &Stream) {
@@ -1646,6 +1660,197 @@ void ASTWriter::WriteHeaderSearch(const HeaderSearch &HS, StringRef isysroot) {
     free(const_cast<char *>(SavedStrings[I]));
 }
 
+namespace {
+/// \brief The abbreviations of the records of the source manager block.
+struct SLocAbbrevs {
+  unsigned File, Buffer, BufferBlob, Expansion, LineTable;
+
+  explicit SLocAbbrevs(llvm::BitstreamWriter &Stream) {
+    File = CreateSLocFileAbbrev(Stream);
+    Buffer = CreateSLocBufferAbbrev(Stream);
+    BufferBlob = CreateSLocBufferBlobAbbrev(Stream);
+    Expansion = CreateSLocExpansionAbbrev(Stream);
+    LineTable = CreateSLocLineTableAbbrev(Stream);
+  }
+};
+}
+
+/// \brief Whether \p SLoc is the entry of a file, rather than of a memory
+/// buffer or a macro expansion.
+static bool isFileEntrySLoc(const SrcMgr::SLocEntry &SLoc) {
+  return SLoc.isFile() && SLoc.getFile().getContentCache()->OrigEntry;
+}
+
+/// \brief Add the fields common to the records of files and buffers.
+static void AddSLocFileInfo(unsigned Code, const SrcMgr::SLocEntry &SLoc,
+                            ASTWriter::RecordDataImpl &Record) {
+  const SrcMgr::FileInfo &File = SLoc.getFile();
+  Record.push_back(Code);
+  // Starting offset of this entry within this module, so skip the dummy.
+  Record.push_back(SLoc.getOffset() - 2);
+  Record.push_back(File.getIncludeLoc().getRawEncoding());
+  Record.push_back(File.getFileCharacteristic()); // FIXME: stable encoding
+  Record.push_back(File.hasLineDirectives());
+}
+
+/// \brief Write the entry \p SLoc of a memory buffer with contents
+/// \p Buffer.
+static void WriteSLocBuffer(llvm::BitstreamWriter &Stream,
+                            const SLocAbbrevs &Abbrevs,
+                            const SrcMgr::SLocEntry &SLoc,
+                            const llvm::MemoryBuffer *Buffer) {
+  // The source location entry is a buffer. The blob associated
+  // with this entry contains the contents of the buffer.
+  ASTWriter::RecordData Record;
+  AddSLocFileInfo(SM_SLOC_BUFFER_ENTRY, SLoc, Record);
+
+  // We add one to the size so that we capture the trailing NULL
+  // that is required by llvm::MemoryBuffer::getMemBuffer (on
+  // the reader side).
+  const char *Name = Buffer->getBufferIdentifier();
+  Stream.EmitRecordWithBlob(Abbrevs.Buffer, Record,
+                            StringRef(Name, strlen(Name) + 1));
+  Record.clear();
+  Record.push_back(SM_SLOC_BUFFER_BLOB);
+  Stream.EmitRecordWithBlob(Abbrevs.BufferBlob, Record,
+                            StringRef(Buffer->getBufferStart(),
+                                      Buffer->getBufferSize() + 1));
+}
+
+/// \brief Write the entry \p SLoc of a macro expansion, given the offset
+/// \p NextOffset where the next entry starts.
+///
+/// Unlike the entries of files and buffers, these only depend on the entries
+/// themselves and have no blob, so they can be written on another thread and
+/// copied into the AST file at any bit position.
+static void WriteSLocExpansion(llvm::BitstreamWriter &Stream,
+                               const SLocAbbrevs &Abbrevs,
+                               const SrcMgr::SLocEntry &SLoc,
+                               unsigned NextOffset) {
+  // The source location entry is a macro expansion.
+  const SrcMgr::ExpansionInfo &Expansion = SLoc.getExpansion();
+  ASTWriter::RecordData Record;
+  Record.push_back(SM_SLOC_EXPANSION_ENTRY);
+  Record.push_back(SLoc.getOffset() - 2);
+  Record.push_back(Expansion.getSpellingLoc().getRawEncoding());
+  Record.push_back(Expansion.getExpansionLocStart().getRawEncoding());
+  Record.push_back(Expansion.isMacroArgExpansion() ? 0
+                         : Expansion.getExpansionLocEnd().getRawEncoding());
+
+  // Compute the token length for this macro expansion.
+  Record.push_back(NextOffset - SLoc.getOffset() - 1);
+  Stream.EmitRecordWithAbbrev(Abbrevs.Expansion, Record);
+}
+
+/// \brief Whether \p Buffer holds the predefines, whose entry the AST reader
+/// loads eagerly.
+static bool isPredefinesBuffer(const llvm::MemoryBuffer *Buffer) {
+  return Buffer && strcmp(Buffer->getBufferIdentifier(), "<built-in>") == 0;
+}
+
+/// \brief Append the bits [\p Begin, \p End) of the flushed bitstream \p Bits
+/// to \p Stream.
+///
+/// The bits land at a different position within a 32-bit word, so they must
+/// not hold a blob, whose start the writer aligns to a word.
+static void SpliceBits(llvm::BitstreamWriter &Stream, ArrayRef<char> Bits,
+                       uint64_t Begin, uint64_t End) {
+  using namespace llvm::support;
+  while (Begin != End) {
+    unsigned Shift = Begin % 32;
+    unsigned NumBits = std::min<uint64_t>(32 - Shift, End - Begin);
+    uint32_t Word =
+        endian::read<uint32_t, little, unaligned>(&Bits[Begin / 32 * 4]);
+    Word >>= Shift;
+    if (NumBits != 32)
+      Word &= (1U << NumBits) - 1;
+    Stream.Emit(Word, NumBits);
+    Begin += NumBits;
+  }
+}
+
+/// \brief Writes the macro expansion entries of the source manager block on a
+/// thread of its own, into a bitstream of its own.
+///
+/// The record of a file names the declarations in the file, which are only
+/// known once all of them are written, and the blob of a memory buffer must
+/// start on a word boundary, so the worker leaves both out. The runs of
+/// expansions in between them are segments of the worker's bitstream, which
+/// WriteSourceManagerBlock copies into the AST file in between the records it
+/// writes itself, moving the offsets of the entries along.
+///
+/// The worker reads a copy of the entries taken when it starts, since the
+/// source manager's table may grow, and move, while it runs.
+class ASTWriter::SLocEntryWorker {
+public:
+  /// \brief A run of consecutive local macro expansion entries.
+  struct Segment {
+    unsigned FirstEntry, EndEntry;
+    uint64_t StartBit, EndBit;
+  };
+
+  /// \brief The local entries, including the dummy entry 0.
+  std::vector<SrcMgr::SLocEntry> Entries;
+  unsigned NextLocalOffset;
+
+  SmallVector<char, 0> Bits;
+  llvm::BitstreamWriter Stream;
+  std::vector<Segment> Segments;
+
+  /// \brief The bit offset of each entry within Bits, by entry index.
+  std::vector<uint64_t> EntryOffsets;
+
+  std::thread Thread;
+
+  explicit SLocEntryWorker(const SourceManager &SourceMgr)
+    : NextLocalOffset(SourceMgr.getNextLocalOffset()), Stream(Bits) {
+    Entries.reserve(SourceMgr.local_sloc_entry_size());
+    for (unsigned I = 0, N = SourceMgr.local_sloc_entry_size(); I != N; ++I)
+      Entries.push_back(SourceMgr.getLocalSLocEntry(I));
+  }
+  ~SLocEntryWorker() {
+    if (Thread.joinable())
+      Thread.join();
+  }
+
+  void run() {
+    // Enter the block and create the abbreviations as WriteSourceManagerBlock
+    // does, so that the records use the same abbreviation IDs.
+    Stream.EnterSubblock(SOURCE_MANAGER_BLOCK_ID, 3);
+    SLocAbbrevs Abbrevs(Stream);
+
+    unsigned NumEntries = Entries.size();
+    EntryOffsets.resize(NumEntries);
+    for (unsigned I = 1; I != NumEntries; ++I) {
+      const SrcMgr::SLocEntry &SLoc = Entries[I];
+      if (!SLoc.isExpansion())
+        continue;
+
+      uint64_t Offset = Stream.GetCurrentBitNo();
+      if (Segments.empty() || Segments.back().EndEntry != I) {
+        Segment S = { I, I, Offset, Offset };
+        Segments.push_back(S);
+      }
+      EntryOffsets[I] = Offset;
+      unsigned NextOffset = NextLocalOffset;
+      if (I + 1 != NumEntries)
+        NextOffset = Entries[I + 1].getOffset();
+      WriteSLocExpansion(Stream, Abbrevs, SLoc, NextOffset);
+      Segments.back().EndEntry = I + 1;
+      Segments.back().EndBit = Stream.GetCurrentBitNo();
+    }
+
+    Stream.ExitBlock();
+  }
+};
+
+/// \brief Start writing the parts of the source manager block which do not
+/// depend on the declarations on a worker thread.
+void ASTWriter::StartSourceManagerWorker(const SourceManager &SourceMgr) {
+  SLocWorker.reset(new SLocEntryWorker(SourceMgr));
+  SLocWorker->Thread = std::thread(&SLocEntryWorker::run, SLocWorker.get());
+}
+
 /// \brief Writes the block containing the serialized form of the
 /// source manager.
 ///
@@ -1659,14 +1864,22 @@ void ASTWriter::WriteSourceManagerBlock(SourceManager &SourceMgr,
                                         StringRef isysroot) {
   RecordData Record;
 
+  // Collect the entries the worker thread wrote, if any. Writing the
+  // declarations is not expected to create source locations; should it
+  // have, write everything here.
+  if (SLocWorker) {
+    SLocWorker->Thread.join();
+    if (SLocWorker->Entries.size() != SourceMgr.local_sloc_entry_size() ||
+        SLocWorker->NextLocalOffset != SourceMgr.getNextLocalOffset())
+      SLocWorker.reset();
+  }
+  unsigned NextSegment = 0;
+
   // Enter the source manager block.
   Stream.EnterSubblock(SOURCE_MANAGER_BLOCK_ID, 3);
 
   // Abbreviations for the various kinds of source-location entries.
-  unsigned SLocFileAbbrv = CreateSLocFileAbbrev(Stream);
-  unsigned SLocBufferAbbrv = CreateSLocBufferAbbrev(Stream);
-  unsigned SLocBufferBlobAbbrv = CreateSLocBufferBlobAbbrev(Stream);
-  unsigned SLocExpansionAbbrv = CreateSLocExpansionAbbrev(Stream);
+  SLocAbbrevs Abbrevs(Stream);
 
   // Write out the source location entry table. We skip the first
   // entry, which is always the same dummy entry.
@@ -1680,99 +1893,91 @@ void ASTWriter::WriteSourceManagerBlock(SourceManager &SourceMgr,
     FileID FID = FileID::get(I);
     assert(&SourceMgr.getSLocEntry(FID) == SLoc);
 
+    if (SLocWorker && SLoc->isExpansion()) {
+      // Copy the run of entries starting here from the worker's bitstream,
+      // and move their offsets to where the run lands.
+      const SLocEntryWorker::Segment &S = SLocWorker->Segments[NextSegment++];
+      assert(S.FirstEntry == I && "Missed source-location entry");
+      uint64_t Delta = Stream.GetCurrentBitNo() - S.StartBit;
+      SpliceBits(Stream, SLocWorker->Bits, S.StartBit, S.EndBit);
+      for (; I != S.EndEntry; ++I)
+        SLocEntryOffsets.push_back(SLocWorker->EntryOffsets[I] + Delta);
+      --I;
+      continue;
+    }
+
     // Record the offset of this source-location entry.
     SLocEntryOffsets.push_back(Stream.GetCurrentBitNo());
 
-    // Figure out which record code to use.
-    unsigned Code;
-    if (SLoc->isFile()) {
-      const SrcMgr::ContentCache *Cache = SLoc->getFile().getContentCache();
-      if (Cache->OrigEntry) {
-        Code = SM_SLOC_FILE_ENTRY;
-      } else
-        Code = SM_SLOC_BUFFER_ENTRY;
-    } else
-      Code = SM_SLOC_EXPANSION_ENTRY;
-    Record.clear();
-    Record.push_back(Code);
-
-    // Starting offset of this entry within this module, so skip the dummy.
-    Record.push_back(SLoc->getOffset() - 2);
-    if (SLoc->isFile()) {
-      const SrcMgr::FileInfo &File = SLoc->getFile();
-      Record.push_back(File.getIncludeLoc().getRawEncoding());
-      Record.push_back(File.getFileCharacteristic()); // FIXME: stable encoding
-      Record.push_back(File.hasLineDirectives());
-
-      const SrcMgr::ContentCache *Content = File.getContentCache();
-      if (Content->OrigEntry) {
-        assert(Content->OrigEntry == Content->ContentsEntry &&
-               "Writing to AST an overridden file is not supported");
-
-        // The source location entry is a file. Emit input file ID.
-        assert(InputFileIDs[Content->OrigEntry] != 0 && "Missed file entry");
-        Record.push_back(InputFileIDs[Content->OrigEntry]);
-
-        Record.push_back(File.NumCreatedFIDs);
-        
-        FileDeclIDsTy::iterator FDI = FileDeclIDs.find(FID);
-        if (FDI != FileDeclIDs.end()) {
-          Record.push_back(FDI->second->FirstDeclIndex);
-          Record.push_back(FDI->second->DeclIDs.size());
-        } else {
-          Record.push_back(0);
-          Record.push_back(0);
-        }
-        
-        Stream.EmitRecordWithAbbrev(SLocFileAbbrv, Record);
-        
-        if (Content->BufferOverridden) {
-          Record.clear();
-          Record.push_back(SM_SLOC_BUFFER_BLOB);
-          const llvm::MemoryBuffer *Buffer
-            = Content->getBuffer(PP.getDiagnostics(), PP.getSourceManager());
-          Stream.EmitRecordWithBlob(SLocBufferBlobAbbrv, Record,
-                                    StringRef(Buffer->getBufferStart(),
-                                              Buffer->getBufferSize() + 1));          
-        }
-      } else {
-        // The source location entry is a buffer. The blob associated
-        // with this entry contains the contents of the buffer.
-
-        // We add one to the size so that we capture the trailing NULL
-        // that is required by llvm::MemoryBuffer::getMemBuffer (on
-        // the reader side).
-        const llvm::MemoryBuffer *Buffer
-          = Content->getBuffer(PP.getDiagnostics(), PP.getSourceManager());
-        const char *Name = Buffer->getBufferIdentifier();
-        Stream.EmitRecordWithBlob(SLocBufferAbbrv, Record,
-                                  StringRef(Name, strlen(Name) + 1));
-        Record.clear();
-        Record.push_back(SM_SLOC_BUFFER_BLOB);
-        Stream.EmitRecordWithBlob(SLocBufferBlobAbbrv, Record,
-                                  StringRef(Buffer->getBufferStart(),
-                                                  Buffer->getBufferSize() + 1));
-
-        if (strcmp(Name, "<built-in>") == 0) {
-          PreloadSLocs.push_back(SLocEntryOffsets.size());
-        }
-      }
-    } else {
-      // The source location entry is a macro expansion.
-      const SrcMgr::ExpansionInfo &Expansion = SLoc->getExpansion();
-      Record.push_back(Expansion.getSpellingLoc().getRawEncoding());
-      Record.push_back(Expansion.getExpansionLocStart().getRawEncoding());
-      Record.push_back(Expansion.isMacroArgExpansion() ? 0
-                             : Expansion.getExpansionLocEnd().getRawEncoding());
-
-      // Compute the token length for this macro expansion.
+    if (SLoc->isExpansion()) {
       unsigned NextOffset = SourceMgr.getNextLocalOffset();
       if (I + 1 != N)
         NextOffset = SourceMgr.getLocalSLocEntry(I + 1).getOffset();
-      Record.push_back(NextOffset - SLoc->getOffset() - 1);
-      Stream.EmitRecordWithAbbrev(SLocExpansionAbbrv, Record);
+      WriteSLocExpansion(Stream, Abbrevs, *SLoc, NextOffset);
+      continue;
+    }
+
+    if (!isFileEntrySLoc(*SLoc)) {
+      const llvm::MemoryBuffer *Buffer =
+          SLoc->getFile().getContentCache()->getBuffer(PP.getDiagnostics(),
+                                                       PP.getSourceManager());
+      WriteSLocBuffer(Stream, Abbrevs, *SLoc, Buffer);
+      if (isPredefinesBuffer(Buffer))
+        PreloadSLocs.push_back(SLocEntryOffsets.size());
+      continue;
+    }
+
+    // The source location entry is a file.
+    const SrcMgr::FileInfo &File = SLoc->getFile();
+    Record.clear();
+    AddSLocFileInfo(SM_SLOC_FILE_ENTRY, *SLoc, Record);
+
+    const SrcMgr::ContentCache *Content = File.getContentCache();
+    assert(Content->OrigEntry == Content->ContentsEntry &&
+           "Writing to AST an overridden file is not supported");
+
+    // Emit input file ID.
+    assert(InputFileIDs[Content->OrigEntry] != 0 && "Missed file entry");
+    Record.push_back(InputFileIDs[Content->OrigEntry]);
+
+    Record.push_back(File.NumCreatedFIDs);
+
+    FileDeclIDsTy::iterator FDI = FileDeclIDs.find(FID);
+    if (FDI != FileDeclIDs.end()) {
+      Record.push_back(FDI->second->FirstDeclIndex);
+      Record.push_back(FDI->second->DeclIDs.size());
+    } else {
+      Record.push_back(0);
+      Record.push_back(0);
+    }
+
+    Stream.EmitRecordWithAbbrev(Abbrevs.File, Record);
+
+    if (Content->BufferOverridden) {
+      Record.clear();
+      Record.push_back(SM_SLOC_BUFFER_BLOB);
+      const llvm::MemoryBuffer *Buffer
+        = Content->getBuffer(PP.getDiagnostics(), PP.getSourceManager());
+      Stream.EmitRecordWithBlob(Abbrevs.BufferBlob, Record,
+                                StringRef(Buffer->getBufferStart(),
+                                          Buffer->getBufferSize() + 1));
+    }
+
+    // If this compilation computed the line numbers of the file, save
+    // them so that users of the AST file need not scan it again.
+    if (Content->SourceLineCache) {
+      Record.clear();
+      Record.push_back(SM_SLOC_LINE_TABLE);
+      Record.push_back(Content->getSize());
+      for (unsigned Line = 1; Line != Content->NumLines; ++Line)
+        Record.push_back(Content->SourceLineCache[Line] -
+                         Content->SourceLineCache[Line - 1]);
+      Stream.EmitRecordWithAbbrev(Abbrevs.LineTable, Record);
     }
   }
+  assert((!SLocWorker || NextSegment == SLocWorker->Segments.size()) &&
+         "Source-location entries left unwritten");
+  SLocWorker.reset();
 
   Stream.ExitBlock();
 
@@ -3934,7 +4139,7 @@ void ASTWriter::SetSelectorOffset(Selector Sel, uint32_t Offset) {
 ASTWriter::ASTWriter(llvm::BitstreamWriter &Stream)
   : Stream(Stream), Context(nullptr), PP(nullptr), Chain(nullptr),
     WritingModule(nullptr), WritingAST(false), DoneWritingDeclsAndTypes(false),
-    ASTHasCompilerErrors(false),
+    ASTHasCompilerErrors(false), WriteInParallel(false),
     FirstDeclID(NUM_PREDEF_DECL_IDS), NextDeclID(FirstDeclID),
     FirstTypeID(NUM_PREDEF_TYPE_IDS), NextTypeID(FirstTypeID),
     FirstIdentID(NUM_PREDEF_IDENT_IDS), NextIdentID(FirstIdentID),
@@ -4324,6 +4529,11 @@ void ASTWriter::WriteASTCore(Sema &SemaRef,
 
   RecordData DeclUpdatesOffsetsRecord;
 
+  // The macro expansion entries of the source manager block don't depend on
+  // the declarations, so they can be written while the declarations are.
+  if (WriteInParallel)
+    StartSourceManagerWorker(Context.getSourceManager());
+
   // Keep writing types, declarations, and declaration update records
   // until we've emitted all of them.
   Stream.EnterSubblock(DECLTYPES_BLOCK_ID, NUM_ALLOWED_ABBREVS_SIZE);
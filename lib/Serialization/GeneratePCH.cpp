@@ -28,12 +28,14 @@ PCHGenerator::PCHGenerator(const Preprocessor &PP,
                            StringRef OutputFile,
                            clang::Module *Module,
                            StringRef isysroot,
-                           raw_ostream *OS, bool AllowASTWithErrors)
+                           raw_ostream *OS, bool AllowASTWithErrors,
+                           bool WriteInParallel)
   : PP(PP), OutputFile(OutputFile), Module(Module), 
     isysroot(isysroot.str()), Out(OS), 
     SemaPtr(nullptr), Stream(Buffer), Writer(Stream),
     AllowASTWithErrors(AllowASTWithErrors),
     HasEmittedPCH(false) {
+  Writer.setWriteInParallel(WriteInParallel);
 }
 
 PCHGenerator::~PCHGenerator() {
@@ -22,7 +22,7 @@ using namespace reader;
 
 ModuleFile::ModuleFile(ModuleKind Kind, unsigned Generation)
   : Kind(Kind), File(nullptr), DirectlyImported(false),
-    Generation(Generation), SizeInBits(0),
+    Generation(Generation), SizeInBits(0), NumDeferredInputFiles(0),
     LocalNumSLocEntries(0), SLocEntryBaseID(0),
     SLocEntryBaseOffset(0), SLocEntryOffsets(nullptr),
     LocalNumIdentifiers(0),
@@ -0,0 +1,108 @@
+//===--- ASTUnitPool.cpp - Memory-bounded pool of ASTs --------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file implements the ASTUnitPool class.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Tooling/ASTUnitPool.h"
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Basic/FileSystemOptions.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+
+namespace clang {
+namespace tooling {
+
+ASTUnitPool::ASTUnitPool(ClangTool &Tool, unsigned MaxResidentASTs,
+                         bool SaveEvictedASTs)
+    : Tool(Tool), MaxResidentASTs(MaxResidentASTs),
+      SaveEvictedASTs(SaveEvictedASTs), Units(Tool.getNumCompileCommands()),
+      NumBuilt(0), NumReloaded(0) {}
+
+ASTUnitPool::~ASTUnitPool() {
+  for (Unit &U : Units) {
+    // Release the AST before removing the file it may have been loaded from.
+    U.AST.reset();
+    if (!U.SavedFile.empty())
+      llvm::sys::fs::remove(U.SavedFile);
+  }
+}
+
+StringRef ASTUnitPool::getFile(unsigned Index) const {
+  return Tool.getCompileCommandFile(Index);
+}
+
+ASTUnit *ASTUnitPool::getAST(unsigned Index) {
+  assert(Index < Units.size() && "Invalid translation unit index");
+  Unit &U = Units[Index];
+  if (U.AST) {
+    Resident.splice(Resident.begin(), Resident, U.Position);
+    return U.AST.get();
+  }
+  if (U.Failed)
+    return nullptr;
+
+  // Make room before building, so the peak stays within the limit.
+  while (MaxResidentASTs && Resident.size() >= MaxResidentASTs)
+    evict(Resident.back());
+
+  if (!U.SavedFile.empty()) {
+    // The diagnostics were reported when the AST was built.
+    IntrusiveRefCntPtr<DiagnosticsEngine> Diags =
+        CompilerInstance::createDiagnostics(new DiagnosticOptions(),
+                                            new IgnoringDiagConsumer());
+    U.AST.reset(ASTUnit::LoadFromASTFile(U.SavedFile, Diags,
+                                         FileSystemOptions(),
+                                         /*OnlyLocalDecls=*/false, None,
+                                         /*CaptureDiagnostics=*/false,
+                                         /*AllowPCHWithCompilerErrors=*/true));
+    if (U.AST) {
+      ++NumReloaded;
+    } else {
+      llvm::sys::fs::remove(U.SavedFile);
+      U.SavedFile.clear();
+    }
+  }
+  if (!U.AST) {
+    U.AST = Tool.buildAST(Index);
+    if (!U.AST) {
+      U.Failed = true;
+      return nullptr;
+    }
+    ++NumBuilt;
+  }
+
+  Resident.push_front(Index);
+  U.Position = Resident.begin();
+  return U.AST.get();
+}
+
+void ASTUnitPool::evict(unsigned Index) {
+  Unit &U = Units[Index];
+  assert(U.AST && "Evicting an AST that is not resident");
+  // An AST loaded from its saved file does not need to be saved again.
+  if (SaveEvictedASTs && U.SavedFile.empty()) {
+    SmallString<128> Path;
+    if (!llvm::sys::fs::createTemporaryFile("tool", "ast", Path)) {
+      if (U.AST->Save(Path))
+        llvm::sys::fs::remove(Path.str());
+      else
+        U.SavedFile = Path.str();
+    }
+  }
+  Resident.erase(U.Position);
+  U.AST.reset();
+}
+
+} // end namespace tooling
+} // end namespace clang
@@ -54,6 +54,18 @@ ClangStripOutputAdjuster::Adjust(const CommandLineArguments &Args) {
   return AdjustedArgs;
 }
 
+/// Add "-Xclang -Eonly -Xclang -fdeps-scan-only"; the driver only forwards
+/// -fdeps-scan-only with -M, and the cc1 action given last wins.
+CommandLineArguments
+ClangDepsScanOnlyAdjuster::Adjust(const CommandLineArguments &Args) {
+  CommandLineArguments AdjustedArgs = Args;
+  AdjustedArgs.push_back("-Xclang");
+  AdjustedArgs.push_back("-Eonly");
+  AdjustedArgs.push_back("-Xclang");
+  AdjustedArgs.push_back("-fdeps-scan-only");
+  return AdjustedArgs;
+}
+
 } // end namespace tooling
 } // end namespace clang
 
@@ -0,0 +1,465 @@
+//===--- BinaryCompilationDatabase.cpp - ----------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file contains the implementation of the BinaryCompilationDatabase.
+//
+//  A binary compilation database consists of a header followed by an on-disk
+//  chained hash table:
+//
+//    uint32_t Magic;          // 'CCDB'
+//    uint32_t Version;
+//    uint32_t BucketOffset;   // of the hash table, from the start of the file
+//    <hash table payload and buckets>
+//
+//  The table maps native absolute file paths to the list of their compile
+//  commands, each encoded as its directory followed by its arguments. All
+//  integers are little endian; strings are prefixed by their 32-bit length.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Tooling/BinaryCompilationDatabase.h"
+#include "clang/Tooling/CompilationDatabasePluginRegistry.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/OnDiskHashTable.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <system_error>
+
+namespace clang {
+namespace tooling {
+
+static const char BinaryDatabaseMagic[] = { 'C', 'C', 'D', 'B' };
+static const unsigned BinaryDatabaseVersion = 1;
+static const unsigned BinaryDatabaseHeaderSize = 12;
+
+const char *const BinaryCompilationDatabase::PluginName =
+    "binary-compilation-database";
+
+namespace {
+
+/// \brief Trait used to read the compile commands from the on-disk hash
+/// table.
+class CompileCommandReaderTrait {
+public:
+  typedef StringRef external_key_type;
+  typedef StringRef internal_key_type;
+  typedef std::vector<CompileCommand> data_type;
+  typedef unsigned hash_value_type;
+  typedef unsigned offset_type;
+
+  static bool EqualKey(const internal_key_type& a, const internal_key_type& b) {
+    return a == b;
+  }
+
+  static hash_value_type ComputeHash(const internal_key_type& a) {
+    return llvm::HashString(a);
+  }
+
+  static std::pair<unsigned, unsigned>
+  ReadKeyDataLength(const unsigned char*& d) {
+    using namespace llvm::support;
+    unsigned KeyLen = endian::readNext<uint32_t, little, unaligned>(d);
+    unsigned DataLen = endian::readNext<uint32_t, little, unaligned>(d);
+    return std::make_pair(KeyLen, DataLen);
+  }
+
+  static const internal_key_type&
+  GetInternalKey(const external_key_type& x) { return x; }
+
+  static const external_key_type&
+  GetExternalKey(const internal_key_type& x) { return x; }
+
+  static internal_key_type ReadKey(const unsigned char* d, unsigned n) {
+    return StringRef((const char *)d, n);
+  }
+
+  /// \brief Reads a 32-bit integer, unless it would extend past \p End.
+  static bool readInt(const unsigned char*& d, const unsigned char* End,
+                      unsigned &Result) {
+    using namespace llvm::support;
+    if (End - d < 4)
+      return false;
+    Result = endian::readNext<uint32_t, little, unaligned>(d);
+    return true;
+  }
+
+  /// \brief Reads a string, unless it would extend past \p End.
+  static bool readString(const unsigned char*& d, const unsigned char* End,
+                         StringRef &Result) {
+    unsigned Len;
+    if (!readInt(d, End, Len) || (size_t)(End - d) < Len)
+      return false;
+    Result = StringRef((const char *)d, Len);
+    d += Len;
+    return true;
+  }
+
+  /// \brief Decodes the commands of a file; a malformed entry has none.
+  static data_type ReadData(const internal_key_type& k,
+                            const unsigned char* d,
+                            unsigned DataLen) {
+    const unsigned char *End = d + DataLen;
+    data_type Result;
+    unsigned NumCommands;
+    if (!readInt(d, End, NumCommands))
+      return data_type();
+    for (unsigned I = 0; I != NumCommands; ++I) {
+      StringRef Directory;
+      unsigned NumArgs;
+      if (!readString(d, End, Directory) || !readInt(d, End, NumArgs))
+        return data_type();
+      std::vector<std::string> CommandLine;
+      for (unsigned J = 0; J != NumArgs; ++J) {
+        StringRef Arg;
+        if (!readString(d, End, Arg))
+          return data_type();
+        CommandLine.push_back(Arg);
+      }
+      Result.push_back(CompileCommand(Directory, std::move(CommandLine)));
+    }
+    return Result;
+  }
+};
+
+typedef llvm::OnDiskIterableChainedHashTable<CompileCommandReaderTrait>
+    CompileCommandTable;
+
+/// \brief Trait used to write the compile commands as an on-disk hash table.
+class CompileCommandWriterTrait {
+public:
+  typedef StringRef key_type;
+  typedef StringRef key_type_ref;
+  typedef std::vector<CompileCommand> data_type;
+  typedef const std::vector<CompileCommand> &data_type_ref;
+  typedef unsigned hash_value_type;
+  typedef unsigned offset_type;
+
+  static hash_value_type ComputeHash(key_type_ref Key) {
+    return llvm::HashString(Key);
+  }
+
+  std::pair<unsigned,unsigned>
+  EmitKeyDataLength(raw_ostream& Out, key_type_ref Key, data_type_ref Data) {
+    using namespace llvm::support;
+    endian::Writer<little> LE(Out);
+    unsigned KeyLen = Key.size();
+    unsigned DataLen = 4;
+    for (const CompileCommand &Command : Data) {
+      DataLen += 4 + Command.Directory.size() + 4;
+      for (const std::string &Arg : Command.CommandLine)
+        DataLen += 4 + Arg.size();
+    }
+    LE.write<uint32_t>(KeyLen);
+    LE.write<uint32_t>(DataLen);
+    return std::make_pair(KeyLen, DataLen);
+  }
+
+  void EmitKey(raw_ostream& Out, key_type_ref Key, unsigned KeyLen) {
+    Out.write(Key.data(), KeyLen);
+  }
+
+  static void writeString(raw_ostream& Out, StringRef String) {
+    using namespace llvm::support;
+    endian::Writer<little>(Out).write<uint32_t>(String.size());
+    Out.write(String.data(), String.size());
+  }
+
+  void EmitData(raw_ostream& Out, key_type_ref Key, data_type_ref Data,
+                unsigned DataLen) {
+    using namespace llvm::support;
+    endian::Writer<little> LE(Out);
+    LE.write<uint32_t>(Data.size());
+    for (const CompileCommand &Command : Data) {
+      writeString(Out, Command.Directory);
+      LE.write<uint32_t>(Command.CommandLine.size());
+      for (const std::string &Arg : Command.CommandLine)
+        writeString(Out, Arg);
+    }
+  }
+};
+
+class BinaryCompilationDatabasePlugin : public CompilationDatabasePlugin {
+  CompilationDatabase *loadFromDirectory(StringRef Directory,
+                                         std::string &ErrorMessage) override {
+    return BinaryCompilationDatabase::loadFromDirectory(Directory,
+                                                        ErrorMessage);
+  }
+};
+
+} // end namespace
+
+// Register the BinaryCompilationDatabasePlugin with the
+// CompilationDatabasePluginRegistry using this statically initialized variable.
+static CompilationDatabasePluginRegistry::Add<BinaryCompilationDatabasePlugin>
+X(BinaryCompilationDatabase::PluginName,
+  "Reads memory-mapped binary compilation databases");
+
+// This anchor is used to force the linker to link in the generated object file
+// and thus register the BinaryCompilationDatabasePlugin.
+volatile int BinaryAnchorSource = 0;
+
+/// \brief Skips the items of the bucket at \p Ptr, which must all end before
+/// \p End, and sets \p NumItems to their number.
+static bool skipBucket(const unsigned char *&Ptr, const unsigned char *End,
+                       unsigned &NumItems) {
+  using namespace llvm::support;
+  if (End - Ptr < 2)
+    return false;
+  NumItems = endian::readNext<uint16_t, little, unaligned>(Ptr);
+  for (unsigned I = 0; I != NumItems; ++I) {
+    // The hash, then the lengths of the key and of the data.
+    if (End - Ptr < 12)
+      return false;
+    Ptr += 4;
+    uint64_t KeyLen = endian::readNext<uint32_t, little, unaligned>(Ptr);
+    uint64_t DataLen = endian::readNext<uint32_t, little, unaligned>(Ptr);
+    if (KeyLen + DataLen > uint64_t(End - Ptr))
+      return false;
+    Ptr += KeyLen + DataLen;
+  }
+  return true;
+}
+
+/// \brief Checks that the hash table, whose items lie between the header and
+/// \p BucketOffset, can be read without leaving the buffer: through the
+/// \p NumBuckets bucket offsets by lookups, and from the start of the items
+/// for the \p NumEntries entries by iteration.
+static bool validateTable(const unsigned char *Start, uint32_t BucketOffset,
+                          uint32_t NumBuckets, uint32_t NumEntries) {
+  using namespace llvm::support;
+  const unsigned char *ItemsEnd = Start + BucketOffset;
+  const unsigned char *Buckets = ItemsEnd + 2 * sizeof(uint32_t);
+  for (uint32_t I = 0; I != NumBuckets; ++I) {
+    uint32_t Offset = endian::readNext<uint32_t, little, unaligned>(Buckets);
+    if (Offset == 0)
+      continue;
+    const unsigned char *Items = Start + Offset;
+    unsigned NumItems;
+    if (Offset < BinaryDatabaseHeaderSize || Offset >= BucketOffset ||
+        !skipBucket(Items, ItemsEnd, NumItems))
+      return false;
+  }
+
+  const unsigned char *Items = Start + BinaryDatabaseHeaderSize;
+  for (uint32_t Left = NumEntries; Left != 0;) {
+    unsigned NumItems;
+    if (!skipBucket(Items, ItemsEnd, NumItems) || NumItems == 0)
+      return false;
+    Left -= std::min(Left, uint32_t(NumItems));
+  }
+  return true;
+}
+
+BinaryCompilationDatabase::~BinaryCompilationDatabase() {
+  delete static_cast<CompileCommandTable *>(Table);
+}
+
+BinaryCompilationDatabase *
+BinaryCompilationDatabase::loadFromFile(StringRef FilePath,
+                                        std::string &ErrorMessage) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> DatabaseBuffer =
+      llvm::MemoryBuffer::getFile(FilePath, /*FileSize=*/-1,
+                                  /*RequiresNullTerminator=*/false);
+  if (std::error_code Result = DatabaseBuffer.getError()) {
+    ErrorMessage = "Error while opening binary database: " + Result.message();
+    return nullptr;
+  }
+
+  std::unique_ptr<llvm::MemoryBuffer> Buffer = std::move(*DatabaseBuffer);
+  const unsigned char *Start = (const unsigned char *)Buffer->getBufferStart();
+  const unsigned char *Data = Start;
+  size_t Size = Buffer->getBufferSize();
+  if (Size < BinaryDatabaseHeaderSize ||
+      memcmp(Data, BinaryDatabaseMagic, sizeof(BinaryDatabaseMagic)) != 0) {
+    ErrorMessage = "Not a binary compilation database.";
+    return nullptr;
+  }
+  Data += sizeof(BinaryDatabaseMagic);
+
+  using namespace llvm::support;
+  if (endian::readNext<uint32_t, little, unaligned>(Data) !=
+      BinaryDatabaseVersion) {
+    ErrorMessage = "Unsupported binary compilation database version.";
+    return nullptr;
+  }
+  uint32_t BucketOffset = endian::readNext<uint32_t, little, unaligned>(Data);
+  if (BucketOffset < BinaryDatabaseHeaderSize ||
+      BucketOffset % sizeof(uint32_t) != 0 ||
+      Size - BucketOffset < 2 * sizeof(uint32_t)) {
+    ErrorMessage = "Malformed binary compilation database.";
+    return nullptr;
+  }
+
+  // The bucket array follows the number of buckets and entries.
+  const unsigned char *Buckets = Start + BucketOffset;
+  uint32_t NumBuckets = endian::readNext<uint32_t, little, unaligned>(Buckets);
+  uint32_t NumEntries = endian::readNext<uint32_t, little, unaligned>(Buckets);
+  if (NumBuckets == 0 || (NumBuckets & (NumBuckets - 1)) != 0 ||
+      (Size - BucketOffset - 2 * sizeof(uint32_t)) / sizeof(uint32_t) <
+          NumBuckets ||
+      !validateTable(Start, BucketOffset, NumBuckets, NumEntries)) {
+    ErrorMessage = "Malformed binary compilation database.";
+    return nullptr;
+  }
+
+  CompileCommandTable *Table = CompileCommandTable::Create(
+      Start + BucketOffset, Data, Start, CompileCommandReaderTrait());
+  return new BinaryCompilationDatabase(std::move(Buffer), Table);
+}
+
+BinaryCompilationDatabase *
+BinaryCompilationDatabase::loadFromDirectory(StringRef BuildDirectory,
+                                             std::string &ErrorMessage) {
+  SmallString<1024> BinaryDatabasePath(BuildDirectory);
+  llvm::sys::path::append(BinaryDatabasePath, "compile_commands.bin");
+  SmallString<1024> JSONDatabasePath(BuildDirectory);
+  llvm::sys::path::append(JSONDatabasePath, "compile_commands.json");
+
+  // Don't hide changes made to the JSON database since it was converted.
+  llvm::sys::fs::file_status BinaryStatus, JSONStatus;
+  if (llvm::sys::fs::status(BinaryDatabasePath.str(), BinaryStatus) ||
+      !llvm::sys::fs::exists(BinaryStatus)) {
+    ErrorMessage = "No binary compilation database found.";
+    return nullptr;
+  }
+  // Modification times only have a granularity of one second, so a JSON
+  // database modified in the same second may be newer as well.
+  if (!llvm::sys::fs::status(JSONDatabasePath.str(), JSONStatus) &&
+      llvm::sys::fs::exists(JSONStatus) &&
+      JSONStatus.getLastModificationTime() >=
+          BinaryStatus.getLastModificationTime()) {
+    ErrorMessage = "Binary compilation database is older than "
+                   "compile_commands.json.";
+    return nullptr;
+  }
+  return loadFromFile(BinaryDatabasePath, ErrorMessage);
+}
+
+bool BinaryCompilationDatabase::writeToFile(const CompilationDatabase &Database,
+                                            StringRef FilePath,
+                                            std::string &ErrorMessage) {
+  llvm::OnDiskChainedHashTableGenerator<CompileCommandWriterTrait> Generator;
+  CompileCommandWriterTrait Trait;
+
+  // Key the commands by the native path of their file, as the JSON database
+  // does.
+  std::vector<std::string> Files = Database.getAllFiles();
+  for (std::string &File : Files) {
+    SmallString<128> NativeFilePath;
+    llvm::sys::path::native(File, NativeFilePath);
+    File = NativeFilePath.str();
+    Generator.insert(File, Database.getCompileCommands(File), Trait);
+  }
+
+  SmallString<4096> Contents;
+  {
+    using namespace llvm::support;
+    llvm::raw_svector_ostream Out(Contents);
+    Out.write(BinaryDatabaseMagic, sizeof(BinaryDatabaseMagic));
+    endian::Writer<little>(Out).write<uint32_t>(BinaryDatabaseVersion);
+    endian::Writer<little>(Out).write<uint32_t>(0);
+    uint32_t BucketOffset = Generator.Emit(Out, Trait);
+    Out.flush();
+    endian::write<uint32_t, little, unaligned>(&Contents[8], BucketOffset);
+  }
+
+  // Write the database to a temporary file and move it into place, so that
+  // tools never see a partially written database.
+  SmallString<128> TmpPath;
+  int TmpFD;
+  if (std::error_code EC = llvm::sys::fs::createUniqueFile(
+          FilePath + "-%%%%%%%%", TmpFD, TmpPath)) {
+    ErrorMessage = "Error while creating binary database: " + EC.message();
+    return false;
+  }
+
+  {
+    llvm::raw_fd_ostream Out(TmpFD, true);
+    Out.write(Contents.data(), Contents.size());
+    Out.close();
+    if (Out.has_error()) {
+      Out.clear_error();
+      llvm::sys::fs::remove(TmpPath.str());
+      ErrorMessage = "Error while writing binary database.";
+      return false;
+    }
+  }
+
+  if (std::error_code EC = llvm::sys::fs::rename(TmpPath.str(), FilePath)) {
+    llvm::sys::fs::remove(TmpPath.str());
+    ErrorMessage = "Error while writing binary database: " + EC.message();
+    return false;
+  }
+  return true;
+}
+
+std::vector<CompileCommand>
+BinaryCompilationDatabase::getCompileCommands(StringRef FilePath) const {
+  CompileCommandTable *Commands = static_cast<CompileCommandTable *>(Table);
+
+  SmallString<128> NativeFilePath;
+  llvm::sys::path::native(FilePath, NativeFilePath);
+  CompileCommandTable::iterator Pos = Commands->find(NativeFilePath.str());
+  if (Pos != Commands->end())
+    return *Pos;
+
+  // The file may still be in the database under another name (e.g., through
+  // a symlink).
+  llvm::sys::ScopedLock Guard(MatchTrieLock);
+  if (!MatchTrie) {
+    MatchTrie.reset(new FileMatchTrie());
+    for (CompileCommandTable::key_iterator I = Commands->key_begin(),
+                                           E = Commands->key_end();
+         I != E; ++I)
+      MatchTrie->insert(*I);
+  }
+
+  std::string Error;
+  llvm::raw_string_ostream ES(Error);
+  StringRef Match = MatchTrie->findEquivalent(NativeFilePath.str(), ES);
+  if (Match.empty())
+    return std::vector<CompileCommand>();
+  Pos = Commands->find(Match);
+  if (Pos == Commands->end())
+    return std::vector<CompileCommand>();
+  return *Pos;
+}
+
+std::vector<std::string>
+BinaryCompilationDatabase::getAllFiles() const {
+  CompileCommandTable *Commands = static_cast<CompileCommandTable *>(Table);
+  std::vector<std::string> Result;
+  for (CompileCommandTable::key_iterator I = Commands->key_begin(),
+                                         E = Commands->key_end();
+       I != E; ++I)
+    Result.push_back(*I);
+  return Result;
+}
+
+std::vector<CompileCommand>
+BinaryCompilationDatabase::getAllCompileCommands() const {
+  CompileCommandTable *Commands = static_cast<CompileCommandTable *>(Table);
+  std::vector<CompileCommand> Result;
+  for (CompileCommandTable::data_iterator I = Commands->data_begin(),
+                                          E = Commands->data_end();
+       I != E; ++I) {
+    std::vector<CompileCommand> FileCommands = *I;
+    std::move(FileCommands.begin(), FileCommands.end(),
+              std::back_inserter(Result));
+  }
+  return Result;
+}
+
+} // end namespace tooling
+} // end namespace clang
@@ -21,6 +21,7 @@
 #include "clang/Driver/DriverDiagnostic.h"
 #include "clang/Driver/Job.h"
 #include "clang/Frontend/TextDiagnosticPrinter.h"
+#include "clang/Tooling/BinaryCompilationDatabase.h"
 #include "clang/Tooling/CompilationDatabasePluginRegistry.h"
 #include "clang/Tooling/Tooling.h"
 #include "llvm/ADT/SmallString.h"
@@ -39,10 +40,22 @@ CompilationDatabase *
 CompilationDatabase::loadFromDirectory(StringRef BuildDirectory,
                                        std::string &ErrorMessage) {
   std::stringstream ErrorStream;
+
+  // A binary database stands in for the JSON database it was converted from,
+  // so it has to be tried first, whatever the order of the registry.
+  std::string BinaryErrorMessage;
+  if (CompilationDatabase *DB = BinaryCompilationDatabase::loadFromDirectory(
+          BuildDirectory, BinaryErrorMessage))
+    return DB;
+  ErrorStream << BinaryCompilationDatabase::PluginName << ": "
+              << BinaryErrorMessage << "\n";
+
   for (CompilationDatabasePluginRegistry::iterator
        It = CompilationDatabasePluginRegistry::begin(),
        Ie = CompilationDatabasePluginRegistry::end();
        It != Ie; ++It) {
+    if (StringRef(It->getName()) == BinaryCompilationDatabase::PluginName)
+      continue;
     std::string DatabaseErrorMessage;
     std::unique_ptr<CompilationDatabasePlugin> Plugin(It->instantiate());
     if (CompilationDatabase *DB =
@@ -331,5 +344,10 @@ FixedCompilationDatabase::getAllCompileCommands() const {
 extern volatile int JSONAnchorSource;
 static int JSONAnchorDest = JSONAnchorSource;
 
+// This anchor is used to force the linker to link in the generated object file
+// and thus register the BinaryCompilationDatabasePlugin.
+extern volatile int BinaryAnchorSource;
+static int BinaryAnchorDest = BinaryAnchorSource;
+
 } // end namespace tooling
 } // end namespace clang
@@ -16,7 +16,9 @@
 #include "clang/Tooling/CompilationDatabasePluginRegistry.h"
 #include "clang/Tooling/Tooling.h"
 #include "llvm/ADT/SmallString.h"
+#include "llvm/Support/ConvertUTF.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
 #include <system_error>
 
 namespace clang {
@@ -117,6 +119,116 @@ std::vector<std::string> unescapeCommandLine(
   return parser.parse();
 }
 
+/// \brief A single-pass scanner over the JSON text of a compilation database.
+///
+/// Strings are returned still escaped, pointing into the scanned buffer, so
+/// that only the strings actually used need to be decoded.
+class JSONScanner {
+ public:
+  JSONScanner(StringRef Input) : Position(Input.begin()), End(Input.end()) {}
+
+  /// \brief Consumes \p C after optional whitespace, if it is next.
+  bool consume(char C) {
+    skipWhitespace();
+    if (Position == End || *Position != C)
+      return false;
+    ++Position;
+    return true;
+  }
+
+  /// \brief Consumes a string, setting \p Raw to its escaped contents.
+  bool consumeString(StringRef &Raw) {
+    if (!consume('"'))
+      return false;
+    const char *Start = Position;
+    while (Position != End && *Position != '"') {
+      if (*Position == '\\' && ++Position == End)
+        return false;
+      ++Position;
+    }
+    if (Position == End)
+      return false;
+    Raw = StringRef(Start, Position - Start);
+    ++Position;
+    return true;
+  }
+
+  bool atEnd() {
+    skipWhitespace();
+    return Position == End;
+  }
+
+ private:
+  void skipWhitespace() {
+    while (Position != End && (*Position == ' ' || *Position == '\t' ||
+                               *Position == '\n' || *Position == '\r'))
+      ++Position;
+  }
+
+  const char *Position;
+  const char *End;
+};
+
+/// \brief Reads the four hex digits of a \\u escape starting at \p Pos.
+bool readHexQuad(StringRef Raw, size_t Pos, unsigned &Result) {
+  return Pos + 4 <= Raw.size() &&
+         !Raw.substr(Pos, 4).getAsInteger(16, Result);
+}
+
+/// \brief Decodes the escape sequences of the JSON string contents \p Raw,
+/// using \p Storage if needed.
+StringRef unescapeJSONString(StringRef Raw, SmallVectorImpl<char> &Storage) {
+  if (Raw.find('\\') == StringRef::npos)
+    return Raw;
+  Storage.clear();
+  for (size_t I = 0, E = Raw.size(); I != E; ++I) {
+    if (Raw[I] != '\\' || I + 1 == E) {
+      Storage.push_back(Raw[I]);
+      continue;
+    }
+    char C = Raw[++I];
+    switch (C) {
+    case 'b': Storage.push_back('\b'); break;
+    case 'f': Storage.push_back('\f'); break;
+    case 'n': Storage.push_back('\n'); break;
+    case 'r': Storage.push_back('\r'); break;
+    case 't': Storage.push_back('\t'); break;
+    case 'u': {
+      unsigned CodePoint;
+      if (!readHexQuad(Raw, I + 1, CodePoint)) {
+        Storage.push_back(C);
+        break;
+      }
+      I += 4;
+
+      // Characters outside the BMP are escaped as a UTF-16 surrogate pair.
+      unsigned Low;
+      if (CodePoint >= 0xD800 && CodePoint <= 0xDBFF && I + 2 < E &&
+          Raw[I + 1] == '\\' && Raw[I + 2] == 'u' &&
+          readHexQuad(Raw, I + 3, Low) && Low >= 0xDC00 && Low <= 0xDFFF) {
+        CodePoint = 0x10000 + ((CodePoint - 0xD800) << 10) + (Low - 0xDC00);
+        I += 6;
+      }
+
+      char UTF8[UNI_MAX_UTF8_BYTES_PER_CODE_POINT];
+      char *UTF8End = UTF8;
+      if (!llvm::ConvertCodePointToUTF8(CodePoint, UTF8End)) {
+        // An unpaired surrogate.
+        UTF8End = UTF8;
+        llvm::ConvertCodePointToUTF8(UNI_REPLACEMENT_CHAR, UTF8End);
+      }
+      Storage.append(UTF8, UTF8End);
+      break;
+    }
+    default:
+      // '"', '\\' and '/' stand for themselves.
+      Storage.push_back(C);
+      break;
+    }
+  }
+  return StringRef(Storage.begin(), Storage.size());
+}
+
 class JSONCompilationDatabasePlugin : public CompilationDatabasePlugin {
   CompilationDatabase *loadFromDirectory(StringRef Directory,
                                          std::string &ErrorMessage) override {
@@ -174,15 +286,29 @@ JSONCompilationDatabase::getCompileCommands(StringRef FilePath) const {
   SmallString<128> NativeFilePath;
   llvm::sys::path::native(FilePath, NativeFilePath);
 
-  std::string Error;
-  llvm::raw_string_ostream ES(Error);
-  StringRef Match = MatchTrie.findEquivalent(NativeFilePath.str(), ES);
-  if (Match.empty())
-    return std::vector<CompileCommand>();
   llvm::StringMap< std::vector<CompileCommandRef> >::const_iterator
+    CommandsRefI = IndexByFile.find(NativeFilePath);
+  if (CommandsRefI == IndexByFile.end()) {
+    // The file may still be in the database under another name (e.g., through
+    // a symlink).
+    llvm::sys::ScopedLock Guard(MatchTrieLock);
+    if (!MatchTrie) {
+      MatchTrie.reset(new FileMatchTrie());
+      for (llvm::StringMap< std::vector<CompileCommandRef> >::const_iterator
+             I = IndexByFile.begin(), E = IndexByFile.end();
+           I != E; ++I)
+        MatchTrie->insert(I->first());
+    }
+
+    std::string Error;
+    llvm::raw_string_ostream ES(Error);
+    StringRef Match = MatchTrie->findEquivalent(NativeFilePath.str(), ES);
+    if (Match.empty())
+      return std::vector<CompileCommand>();
     CommandsRefI = IndexByFile.find(Match);
-  if (CommandsRefI == IndexByFile.end())
-    return std::vector<CompileCommand>();
+    if (CommandsRefI == IndexByFile.end())
+      return std::vector<CompileCommand>();
+  }
   std::vector<CompileCommand> Commands;
   getCommands(CommandsRefI->getValue(), Commands);
   return Commands;
@@ -222,90 +348,80 @@ void JSONCompilationDatabase::getCommands(
     SmallString<1024> CommandStorage;
     Commands.push_back(CompileCommand(
       // FIXME: Escape correctly:
-      CommandsRef[I].first->getValue(DirectoryStorage),
-      unescapeCommandLine(CommandsRef[I].second->getValue(CommandStorage))));
+      unescapeJSONString(CommandsRef[I].first, DirectoryStorage),
+      unescapeCommandLine(
+          unescapeJSONString(CommandsRef[I].second, CommandStorage))));
   }
 }
 
 bool JSONCompilationDatabase::parse(std::string &ErrorMessage) {
-  llvm::yaml::document_iterator I = YAMLStream.begin();
-  if (I == YAMLStream.end()) {
-    ErrorMessage = "Error while parsing YAML.";
-    return false;
-  }
-  llvm::yaml::Node *Root = I->getRoot();
-  if (!Root) {
-    ErrorMessage = "Error while parsing YAML.";
-    return false;
-  }
-  llvm::yaml::SequenceNode *Array = dyn_cast<llvm::yaml::SequenceNode>(Root);
-  if (!Array) {
+  JSONScanner Scanner(Database->getBuffer());
+  if (!Scanner.consume('[')) {
     ErrorMessage = "Expected array.";
     return false;
   }
-  for (llvm::yaml::SequenceNode::iterator AI = Array->begin(),
-                                          AE = Array->end();
-       AI != AE; ++AI) {
-    llvm::yaml::MappingNode *Object = dyn_cast<llvm::yaml::MappingNode>(&*AI);
-    if (!Object) {
+  for (bool FirstObject = true; !Scanner.consume(']'); FirstObject = false) {
+    if (!FirstObject && !Scanner.consume(',')) {
+      ErrorMessage = "Expected ',' or ']'.";
+      return false;
+    }
+    if (!Scanner.consume('{')) {
       ErrorMessage = "Expected object.";
       return false;
     }
-    llvm::yaml::ScalarNode *Directory = nullptr;
-    llvm::yaml::ScalarNode *Command = nullptr;
-    llvm::yaml::ScalarNode *File = nullptr;
-    for (llvm::yaml::MappingNode::iterator KVI = Object->begin(),
-                                           KVE = Object->end();
-         KVI != KVE; ++KVI) {
-      llvm::yaml::Node *Value = (*KVI).getValue();
-      if (!Value) {
-        ErrorMessage = "Expected value.";
+    StringRef Directory, Command, File;
+    bool HasDirectory = false, HasCommand = false, HasFile = false;
+    for (bool FirstKey = true; !Scanner.consume('}'); FirstKey = false) {
+      if (!FirstKey && !Scanner.consume(',')) {
+        ErrorMessage = "Expected ',' or '}'.";
         return false;
       }
-      llvm::yaml::ScalarNode *ValueString =
-          dyn_cast<llvm::yaml::ScalarNode>(Value);
-      if (!ValueString) {
-        ErrorMessage = "Expected string as value.";
+      StringRef Key, Value;
+      if (!Scanner.consumeString(Key)) {
+        ErrorMessage = "Expected strings as key.";
         return false;
       }
-      llvm::yaml::ScalarNode *KeyString =
-          dyn_cast<llvm::yaml::ScalarNode>((*KVI).getKey());
-      if (!KeyString) {
-        ErrorMessage = "Expected strings as key.";
+      if (!Scanner.consume(':')) {
+        ErrorMessage = "Expected ':'.";
+        return false;
+      }
+      if (!Scanner.consumeString(Value)) {
+        ErrorMessage = "Expected string as value.";
         return false;
       }
-      SmallString<8> KeyStorage;
-      if (KeyString->getValue(KeyStorage) == "directory") {
-        Directory = ValueString;
-      } else if (KeyString->getValue(KeyStorage) == "command") {
-        Command = ValueString;
-      } else if (KeyString->getValue(KeyStorage) == "file") {
-        File = ValueString;
+      if (Key == "directory") {
+        Directory = Value;
+        HasDirectory = true;
+      } else if (Key == "command") {
+        Command = Value;
+        HasCommand = true;
+      } else if (Key == "file") {
+        File = Value;
+        HasFile = true;
       } else {
-        ErrorMessage = ("Unknown key: \"" +
-                        KeyString->getRawValue() + "\"").str();
+        ErrorMessage = ("Unknown key: \"" + Key + "\"").str();
         return false;
       }
     }
-    if (!File) {
+    if (!HasFile) {
       ErrorMessage = "Missing key: \"file\".";
       return false;
     }
-    if (!Command) {
+    if (!HasCommand) {
       ErrorMessage = "Missing key: \"command\".";
       return false;
     }
-    if (!Directory) {
+    if (!HasDirectory) {
       ErrorMessage = "Missing key: \"directory\".";
       return false;
     }
     SmallString<8> FileStorage;
-    StringRef FileName = File->getValue(FileStorage);
+    StringRef FileName = unescapeJSONString(File, FileStorage);
     SmallString<128> NativeFilePath;
     if (llvm::sys::path::is_relative(FileName)) {
       SmallString<8> DirectoryStorage;
       SmallString<128> AbsolutePath(
-          Directory->getValue(DirectoryStorage));
+          unescapeJSONString(Directory, DirectoryStorage));
       llvm::sys::path::append(AbsolutePath, FileName);
       llvm::sys::path::native(AbsolutePath.str(), NativeFilePath);
     } else {
@@ -313,7 +429,10 @@ bool JSONCompilationDatabase::parse(std::string &ErrorMessage) {
     }
     IndexByFile[NativeFilePath].push_back(
         CompileCommandRef(Directory, Command));
-    MatchTrie.insert(NativeFilePath.str());
+  }
+  if (!Scanner.atEnd()) {
+    ErrorMessage = "Unexpected data after array.";
+    return false;
   }
   return true;
 }
@@ -0,0 +1,56 @@
+//===--- ParallelTasks.cpp - Worker threads for tooling tasks -------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file implements the worker thread pool shared by the parallel parts
+//  of the tooling library.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ParallelTasks.h"
+#include "llvm/Config/llvm-config.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace clang {
+namespace tooling {
+
+unsigned getNumWorkerThreads(unsigned Jobs, unsigned NumTasks) {
+#if LLVM_ENABLE_THREADS
+  if (Jobs == 0)
+    Jobs = std::max(1u, std::thread::hardware_concurrency());
+#else
+  Jobs = 1;
+#endif
+  return std::min(Jobs, NumTasks);
+}
+
+void runTasksInParallel(unsigned NumTasks, unsigned NumThreads,
+                        const std::function<void(unsigned)> &Task) {
+  if (NumThreads <= 1) {
+    for (unsigned I = 0; I != NumTasks; ++I)
+      Task(I);
+    return;
+  }
+
+  std::atomic<unsigned> NextTask(0);
+  auto Worker = [&]() {
+    for (unsigned I = NextTask++; I < NumTasks; I = NextTask++)
+      Task(I);
+  };
+  std::vector<std::thread> Workers;
+  for (unsigned I = 0; I != NumThreads; ++I)
+    Workers.push_back(std::thread(Worker));
+  for (std::thread &T : Workers)
+    T.join();
+}
+
+} // end namespace tooling
+} // end namespace clang
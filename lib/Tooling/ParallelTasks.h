@@ -0,0 +1,40 @@
+//===--- ParallelTasks.h - Worker threads for tooling tasks -----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file declares the worker thread pool shared by the parallel parts of
+//  the tooling library.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_LIB_TOOLING_PARALLELTASKS_H
+#define LLVM_CLANG_LIB_TOOLING_PARALLELTASKS_H
+
+#include <functional>
+
+namespace clang {
+namespace tooling {
+
+/// \brief Returns the number of worker threads to use for \p NumTasks
+/// independent tasks when up to \p Jobs threads were requested.
+///
+/// A \p Jobs of 0 means one per hardware thread. The result is at most
+/// \p NumTasks, and 1 if threads are disabled.
+unsigned getNumWorkerThreads(unsigned Jobs, unsigned NumTasks);
+
+/// \brief Calls \p Task with each index in [0, \p NumTasks) from
+/// \p NumThreads worker threads, and waits for all of them.
+///
+/// With fewer than two threads, the tasks run in order on the calling thread.
+void runTasksInParallel(unsigned NumTasks, unsigned NumThreads,
+                        const std::function<void(unsigned)> &Task);
+
+} // end namespace tooling
+} // end namespace clang
+
+#endif
@@ -11,6 +11,7 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "ParallelTasks.h"
 #include "clang/Basic/DiagnosticOptions.h"
 #include "clang/Basic/FileManager.h"
 #include "clang/Basic/SourceManager.h"
@@ -18,9 +19,12 @@
 #include "clang/Lex/Lexer.h"
 #include "clang/Rewrite/Core/Rewriter.h"
 #include "clang/Tooling/Refactoring.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/raw_os_ostream.h"
+#include <map>
 
 namespace clang {
 namespace tooling {
@@ -270,6 +274,170 @@ void deduplicate(std::vector<Replacement> &Replaces,
     Conflicts.push_back(Range(ConflictStart, ConflictLength));
 }
 
+namespace {
+
+/// \brief The replacements of a single file, and the result of applying them.
+struct FileReplacements {
+  FileReplacements() : Succeeded(false) {}
+
+  std::string FilePath;
+  /// \brief \c FilePath resolved against the working directory of the
+  /// \c FileManager.
+  std::string ResolvedPath;
+  std::vector<Replacement> Replaces;
+  std::string Errors;
+  bool Succeeded;
+};
+
+}
+
+/// \brief Applies the sorted, non-overlapping \p Replaces to the contents of
+/// \p FilePath, and atomically replaces the file with the result.
+static bool rewriteFile(FileManager &Files, StringRef FilePath,
+                        ArrayRef<Replacement> Replaces, raw_ostream &Errors) {
+  std::string ErrorStr;
+  std::unique_ptr<llvm::MemoryBuffer> Buffer(
+      Files.getBufferForFile(FilePath, &ErrorStr));
+  if (!Buffer) {
+    Errors << "error: unable to read '" << FilePath << "': " << ErrorStr
+           << "\n";
+    return false;
+  }
+  StringRef Code = Buffer->getBuffer();
+
+  std::string Result;
+  Result.reserve(Code.size());
+  unsigned Position = 0;
+  for (const Replacement &Replace : Replaces) {
+    if (Replace.getOffset() + Replace.getLength() > Code.size()) {
+      Errors << "error: replacement out of range: " << Replace.toString()
+             << "\n";
+      return false;
+    }
+    Result.append(Code.begin() + Position, Code.begin() + Replace.getOffset());
+    Result.append(Replace.getReplacementText());
+    Position = Replace.getOffset() + Replace.getLength();
+  }
+  Result.append(Code.begin() + Position, Code.end());
+  Buffer.reset();
+
+  SmallString<128> TempPath(FilePath);
+  TempPath += "-%%%%%%%%";
+  int FD;
+  if (std::error_code EC =
+          llvm::sys::fs::createUniqueFile(TempPath.str(), FD, TempPath)) {
+    Errors << "error: unable to make temporary file '" << TempPath << "': "
+           << EC.message() << "\n";
+    return false;
+  }
+  {
+    llvm::raw_fd_ostream Out(FD, /*shouldClose=*/true);
+    Out << Result;
+    Out.close();
+    if (Out.has_error()) {
+      Out.clear_error();
+      llvm::sys::fs::remove(TempPath.str());
+      Errors << "error: unable to write '" << TempPath << "'\n";
+      return false;
+    }
+  }
+  if (std::error_code EC = llvm::sys::fs::rename(TempPath.str(), FilePath)) {
+    llvm::sys::fs::remove(TempPath.str());
+    Errors << "error: unable to rename temporary '" << TempPath << "' to '"
+           << FilePath << "': " << EC.message() << "\n";
+    return false;
+  }
+  return true;
+}
+
+/// \brief Deduplicates the replacements of \p File and, unless they conflict,
+/// applies them.
+static void applyFileReplacements(FileManager &Files, FileReplacements &File) {
+  llvm::raw_string_ostream Errors(File.Errors);
+  std::vector<Range> Conflicts;
+  deduplicate(File.Replaces, Conflicts);
+  if (!Conflicts.empty()) {
+    for (const Range &Conflict : Conflicts) {
+      Errors << "error: conflicting replacements in '" << File.FilePath
+             << "':\n";
+      for (unsigned I = Conflict.getOffset(),
+                    E = Conflict.getOffset() + Conflict.getLength();
+           I != E; ++I)
+        Errors << "  " << File.Replaces[I].toString() << "\n";
+    }
+    return;
+  }
+  File.Succeeded = rewriteFile(Files, File.ResolvedPath, File.Replaces, Errors);
+}
+
+bool applyAllReplacementsToFiles(const Replacements &Replaces,
+                                 FileManager &Files, unsigned Jobs,
+                                 raw_ostream &Errors) {
+  bool Result = true;
+
+  // Group the replacements by file. The same file may be spelled differently
+  // (relative to another directory, through a symlink, ...), so the groups
+  // are keyed by the identity of the file; replacements which cannot be
+  // resolved to a file are grouped by their resolved path, and fail later.
+  llvm::StringMap<unsigned> PathIndex;
+  std::map<llvm::sys::fs::UniqueID, unsigned> FileIndex;
+  llvm::StringMap<unsigned> MissingFileIndex;
+  std::vector<FileReplacements> Groups;
+  for (const Replacement &Replace : Replaces) {
+    if (!Replace.isApplicable()) {
+      Result = false;
+      continue;
+    }
+    llvm::StringMap<unsigned>::iterator Known =
+        PathIndex.find(Replace.getFilePath());
+    unsigned Index;
+    if (Known == PathIndex.end()) {
+      SmallString<128> ResolvedPath(Replace.getFilePath());
+      Files.FixupRelativePath(ResolvedPath);
+      unsigned NewIndex = Groups.size();
+      if (const FileEntry *Entry = Files.getFile(ResolvedPath))
+        Index = FileIndex.insert(std::make_pair(Entry->getUniqueID(), NewIndex))
+                    .first->second;
+      else
+        Index = MissingFileIndex.GetOrCreateValue(ResolvedPath, NewIndex)
+                    .getValue();
+      if (Index == NewIndex) {
+        Groups.push_back(FileReplacements());
+        Groups.back().FilePath = Replace.getFilePath();
+        Groups.back().ResolvedPath = ResolvedPath.str();
+      }
+      PathIndex[Replace.getFilePath()] = Index;
+    } else {
+      Index = Known->second;
+    }
+    // Spell all the replacements of a file alike, so that deduplicate() sees
+    // through the different paths.
+    FileReplacements &Group = Groups[Index];
+    Group.Replaces.push_back(Replacement(Group.FilePath, Replace.getOffset(),
+                                         Replace.getLength(),
+                                         Replace.getReplacementText()));
+  }
+  if (!Result)
+    Errors << "Skipped some replacements.\n";
+
+  // Reading a file by name only uses the file system of the FileManager,
+  // never its caches, so the workers can share it.
+  runTasksInParallel(Groups.size(), getNumWorkerThreads(Jobs, Groups.size()),
+                     [&](unsigned I) {
+    applyFileReplacements(Files, Groups[I]);
+  });
+
+  // Report in a deterministic order, however the files were scheduled.
+  std::sort(Groups.begin(), Groups.end(),
+            [](const FileReplacements &LHS, const FileReplacements &RHS) {
+    return LHS.FilePath < RHS.FilePath;
+  });
+  for (const FileReplacements &Group : Groups) {
+    Errors << Group.Errors;
+    Result = Group.Succeeded && Result;
+  }
+  return Result;
+}
 
 RefactoringTool::RefactoringTool(const CompilationDatabase &Compilations,
                                  ArrayRef<std::string> SourcePaths)
@@ -277,34 +445,20 @@ RefactoringTool::RefactoringTool(const CompilationDatabase &Compilations,
 
 Replacements &RefactoringTool::getReplacements() { return Replace; }
 
-int RefactoringTool::runAndSave(FrontendActionFactory *ActionFactory) {
+int RefactoringTool::runAndSave(FrontendActionFactory *ActionFactory,
+                                unsigned Jobs) {
   if (int Result = run(ActionFactory)) {
     return Result;
   }
 
-  LangOptions DefaultLangOptions;
-  IntrusiveRefCntPtr<DiagnosticOptions> DiagOpts = new DiagnosticOptions();
-  TextDiagnosticPrinter DiagnosticPrinter(llvm::errs(), &*DiagOpts);
-  DiagnosticsEngine Diagnostics(
-      IntrusiveRefCntPtr<DiagnosticIDs>(new DiagnosticIDs()),
-      &*DiagOpts, &DiagnosticPrinter, false);
-  SourceManager Sources(Diagnostics, getFiles());
-  Rewriter Rewrite(Sources, DefaultLangOptions);
-
-  if (!applyAllReplacements(Rewrite)) {
-    llvm::errs() << "Skipped some replacements.\n";
-  }
-
-  return saveRewrittenFiles(Rewrite);
+  return applyAllReplacementsToFiles(Replace, getFiles(), Jobs, llvm::errs())
+             ? 0
+             : 1;
 }
 
 bool RefactoringTool::applyAllReplacements(Rewriter &Rewrite) {
   return tooling::applyAllReplacements(Replace, Rewrite);
 }
 
-int RefactoringTool::saveRewrittenFiles(Rewriter &Rewrite) {
-  return Rewrite.overwriteChangedFiles() ? 1 : 0;
-}
-
 } // end namespace tooling
 } // end namespace clang
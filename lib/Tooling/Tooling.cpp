@@ -13,23 +13,33 @@
 //===----------------------------------------------------------------------===//
 
 #include "clang/Tooling/Tooling.h"
+#include "ParallelTasks.h"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/Driver/Compilation.h"
 #include "clang/Driver/Driver.h"
 #include "clang/Driver/Tool.h"
 #include "clang/Frontend/ASTUnit.h"
 #include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
 #include "clang/Frontend/FrontendDiagnostic.h"
 #include "clang/Frontend/TextDiagnosticPrinter.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Lex/MinimizedSourceCache.h"
+#include "clang/Lex/PreprocessorOptions.h"
 #include "clang/Tooling/ArgumentsAdjusters.h"
 #include "clang/Tooling/CompilationDatabase.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Config/llvm-config.h"
 #include "llvm/Option/Option.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Host.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <map>
+#include <mutex>
 
 // For chdir, see the comment in ClangTool::run for more information.
 #ifdef LLVM_ON_WIN32
@@ -263,6 +273,10 @@ bool FrontendActionFactory::runInvocation(CompilerInvocation *Invocation,
 
   Compiler.createSourceManager(*Files);
 
+  // Share stat() results with the other compilations using the same cache.
+  if (!Compiler.getFileSystemOpts().StatCacheFile.empty())
+    Files->setSharedStatCacheFile(Compiler.getFileSystemOpts().StatCacheFile);
+
   const bool Success = Compiler.ExecuteAction(*ScopedToolAction);
 
   Files->clearStatCaches();
@@ -271,7 +285,8 @@ bool FrontendActionFactory::runInvocation(CompilerInvocation *Invocation,
 
 ClangTool::ClangTool(const CompilationDatabase &Compilations,
                      ArrayRef<std::string> SourcePaths)
-    : Files(new FileManager(FileSystemOptions())), DiagConsumer(nullptr) {
+    : Files(new FileManager(FileSystemOptions())), DiagConsumer(nullptr),
+      ReusePreambles(false) {
   ArgsAdjusters.push_back(new ClangStripOutputAdjuster());
   ArgsAdjusters.push_back(new ClangSyntaxOnlyAdjuster());
   for (const auto &SourcePath : SourcePaths) {
@@ -303,6 +318,18 @@ void ClangTool::mapVirtualFile(StringRef FilePath, StringRef Content) {
   MappedFileContents.push_back(std::make_pair(FilePath, Content));
 }
 
+void ClangTool::setMinimizedSourceCache(
+    IntrusiveRefCntPtr<MinimizedSourceCache> Cache) {
+  SourceFS = nullptr;
+  MinimizedSourceAdjuster.reset();
+  if (Cache) {
+    SourceFS = new MinimizingFileSystem(vfs::getRealFileSystem(), Cache);
+    MinimizedSourceAdjuster.reset(new ClangDepsScanOnlyAdjuster());
+  }
+  // The serial run shares one file manager between all translation units.
+  Files = new FileManager(FileSystemOptions(), SourceFS);
+}
+
 void ClangTool::setArgumentsAdjuster(ArgumentsAdjuster *Adjuster) {
   clearArgumentsAdjusters();
   appendArgumentsAdjuster(Adjuster);
@@ -318,7 +345,212 @@ void ClangTool::clearArgumentsAdjusters() {
   ArgsAdjusters.clear();
 }
 
-int ClangTool::run(ToolAction *Action) {
+namespace {
+
+/// \brief A \c ToolAction precompiling the preambles shared by several
+/// translation units, and running the wrapped action on top of them.
+class PreambleReusingAction : public ToolAction {
+public:
+  explicit PreambleReusingAction(ToolAction *Action) : Action(Action) {}
+  ~PreambleReusingAction();
+
+  bool runInvocation(CompilerInvocation *Invocation, FileManager *Files,
+                     DiagnosticConsumer *DiagConsumer) override;
+
+private:
+  /// \brief A preamble seen in one or more translation units.
+  struct SharedPreamble {
+    SharedPreamble() : NumUses(0), Failed(false) {}
+
+    /// \brief Held while the preamble is being precompiled.
+    std::mutex BuildLock;
+    unsigned NumUses;
+    std::string PCHFile;
+    bool Failed;
+  };
+
+  static std::string getPreambleKey(const CompilerInvocation &Invocation,
+                                    StringRef MainFileDir, StringRef Preamble,
+                                    bool EndsAtStartOfLine);
+  static bool buildPreamble(const CompilerInvocation &Invocation,
+                            FileManager *Files, StringRef Preamble,
+                            std::string &PCHFile);
+
+  ToolAction *Action;
+
+  /// \brief Guards \c Preambles, but not the preambles themselves.
+  std::mutex Lock;
+  std::map<std::string, std::unique_ptr<SharedPreamble>> Preambles;
+};
+
+}
+
+PreambleReusingAction::~PreambleReusingAction() {
+  for (const auto &Entry : Preambles)
+    if (!Entry.second->PCHFile.empty())
+      llvm::sys::fs::remove(Entry.second->PCHFile);
+}
+
+/// \brief Returns a key identifying the preamble of a translation unit along
+/// with everything that affects how it is parsed.
+std::string PreambleReusingAction::getPreambleKey(
+    const CompilerInvocation &Invocation, StringRef MainFileDir,
+    StringRef Preamble, bool EndsAtStartOfLine) {
+  std::string Key;
+  llvm::raw_string_ostream OS(Key);
+  // The module hash covers the language, target and system header options,
+  // but ignores some macros and all user header search paths.
+  OS << Invocation.getModuleHash() << '\0' << MainFileDir << '\0';
+  for (const auto &Macro : Invocation.getPreprocessorOpts().Macros)
+    OS << (Macro.second ? "-U" : "-D") << Macro.first << '\0';
+  for (const auto &Include : Invocation.getPreprocessorOpts().Includes)
+    OS << "-include" << Include << '\0';
+  for (const auto &Include : Invocation.getPreprocessorOpts().MacroIncludes)
+    OS << "-imacros" << Include << '\0';
+  for (const auto &Remapped : Invocation.getPreprocessorOpts().RemappedFiles)
+    OS << "-remap" << Remapped.first << '\0' << Remapped.second << '\0';
+  for (const auto &Entry : Invocation.getHeaderSearchOpts().UserEntries)
+    OS << "-I" << unsigned(Entry.Group) << unsigned(Entry.IsFramework)
+       << unsigned(Entry.IgnoreSysRoot) << Entry.Path << '\0';
+  for (const auto &Warning : Invocation.getDiagnosticOpts().Warnings)
+    OS << "-W" << Warning << '\0';
+  OS << EndsAtStartOfLine << Preamble;
+  return OS.str();
+}
+
+/// \brief Precompiles \p Preamble, the preamble of the main file of
+/// \p Invocation, into a temporary PCH file.
+bool PreambleReusingAction::buildPreamble(const CompilerInvocation &Invocation,
+                                          FileManager *Files,
+                                          StringRef Preamble,
+                                          std::string &PCHFile) {
+  SmallString<128> PCHPath;
+  if (llvm::sys::fs::createTemporaryFile("preamble", "pch", PCHPath))
+    return false;
+
+  IntrusiveRefCntPtr<CompilerInvocation> PreambleInvocation(
+      new CompilerInvocation(Invocation));
+  FrontendOptions &FrontendOpts = PreambleInvocation->getFrontendOpts();
+  PreprocessorOptions &PPOpts = PreambleInvocation->getPreprocessorOpts();
+
+  // The remapped buffers still belong to the original invocation; remap the
+  // main file to its preamble instead.
+  PPOpts.RetainRemappedFileBuffers = true;
+  StringRef MainFile = FrontendOpts.Inputs[0].getFile();
+  std::unique_ptr<llvm::MemoryBuffer> PreambleBuffer(
+      llvm::MemoryBuffer::getMemBufferCopy(Preamble, MainFile));
+  auto &Buffers = PPOpts.RemappedFileBuffers;
+  Buffers.erase(std::remove_if(Buffers.begin(), Buffers.end(),
+                               [&](const std::pair<std::string,
+                                                   llvm::MemoryBuffer *> &B) {
+                                 return B.first == MainFile;
+                               }),
+                Buffers.end());
+  PPOpts.addRemappedFile(MainFile, PreambleBuffer.get());
+
+  FrontendOpts.ProgramAction = frontend::GeneratePCH;
+  FrontendOpts.OutputFile = PCHPath.str();
+  PPOpts.PrecompiledPreambleBytes.first = 0;
+  PPOpts.PrecompiledPreambleBytes.second = false;
+
+  // As in ASTUnit, the preamble gets a FileManager of its own: the remapping
+  // above would otherwise leave the translation unit's FileManager with a
+  // virtual main file of the size of the preamble.
+  IntrusiveRefCntPtr<FileManager> PreambleFiles(new FileManager(
+      Files->getFileSystemOptions(), Files->getVirtualFileSystem()));
+
+  bool Success;
+  {
+    CompilerInstance Compiler;
+    Compiler.setInvocation(PreambleInvocation.get());
+    Compiler.setFileManager(PreambleFiles.get());
+    // The diagnostics of the preamble are reported by the translation unit
+    // it was first seen in.
+    IgnoringDiagConsumer IgnoreDiagnostics;
+    Compiler.createDiagnostics(&IgnoreDiagnostics, /*ShouldOwnClient=*/false);
+    Compiler.createSourceManager(*PreambleFiles);
+    GeneratePCHAction Action;
+    Success = Compiler.ExecuteAction(Action);
+  }
+  if (!Success) {
+    llvm::sys::fs::remove(PCHPath.str());
+    return false;
+  }
+  PCHFile = PCHPath.str();
+  return true;
+}
+
+bool PreambleReusingAction::runInvocation(CompilerInvocation *Invocation,
+                                          FileManager *Files,
+                                          DiagnosticConsumer *DiagConsumer) {
+  FrontendOptions &FrontendOpts = Invocation->getFrontendOpts();
+  PreprocessorOptions &PPOpts = Invocation->getPreprocessorOpts();
+  if (FrontendOpts.Inputs.size() != 1 || !FrontendOpts.Inputs[0].isFile() ||
+      FrontendOpts.Inputs[0].getKind() == IK_AST ||
+      FrontendOpts.Inputs[0].getKind() == IK_LLVM_IR ||
+      !PPOpts.ImplicitPCHInclude.empty() || !PPOpts.ImplicitPTHInclude.empty())
+    return Action->runInvocation(Invocation, Files, DiagConsumer);
+
+  // Find the contents of the main file, which may have been remapped.
+  StringRef MainFile = FrontendOpts.Inputs[0].getFile();
+  const llvm::MemoryBuffer *MainBuffer = nullptr;
+  for (const auto &RB : PPOpts.RemappedFileBuffers)
+    if (RB.first == MainFile)
+      MainBuffer = RB.second;
+  std::unique_ptr<llvm::MemoryBuffer> OwnedBuffer;
+  if (!MainBuffer) {
+    OwnedBuffer.reset(Files->getBufferForFile(MainFile));
+    MainBuffer = OwnedBuffer.get();
+  }
+  if (!MainBuffer)
+    return Action->runInvocation(Invocation, Files, DiagConsumer);
+
+  std::pair<unsigned, bool> Bounds =
+      Lexer::ComputePreamble(MainBuffer, *Invocation->getLangOpts());
+  if (Bounds.first == 0)
+    return Action->runInvocation(Invocation, Files, DiagConsumer);
+  StringRef Preamble = MainBuffer->getBuffer().substr(0, Bounds.first);
+
+  // Quoted includes are looked up relative to the main file, so identical
+  // preambles in different directories are not interchangeable.
+  SmallString<256> MainFileDir(MainFile);
+  Files->FixupRelativePath(MainFileDir);
+  llvm::sys::fs::make_absolute(MainFileDir);
+  llvm::sys::path::remove_filename(MainFileDir);
+
+  SharedPreamble *Shared;
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    std::unique_ptr<SharedPreamble> &Entry = Preambles[getPreambleKey(
+        *Invocation, MainFileDir, Preamble, Bounds.second)];
+    if (!Entry)
+      Entry.reset(new SharedPreamble());
+    Shared = Entry.get();
+  }
+
+  std::string PCHFile;
+  {
+    std::lock_guard<std::mutex> Guard(Shared->BuildLock);
+    // Only precompile preambles used by more than one translation unit.
+    if (!Shared->Failed && ++Shared->NumUses > 1) {
+      if (Shared->PCHFile.empty() &&
+          !buildPreamble(*Invocation, Files, Preamble, Shared->PCHFile))
+        Shared->Failed = true;
+      PCHFile = Shared->PCHFile;
+    }
+  }
+
+  if (!PCHFile.empty()) {
+    PPOpts.ImplicitPCHInclude = PCHFile;
+    PPOpts.PrecompiledPreambleBytes = Bounds;
+    // The preamble was just built from the same files.
+    PPOpts.DisablePCHValidation = true;
+  }
+  return Action->runInvocation(Invocation, Files, DiagConsumer);
+}
+
+/// \brief Returns the path the driver should be run as.
+static std::string getToolExecutable() {
   // Exists solely for the purpose of lookup of the resource path.
   // This just needs to be some symbol in the binary.
   static int StaticSymbol;
@@ -327,42 +559,156 @@ int ClangTool::run(ToolAction *Action) {
   // FIXME: On linux, GetMainExecutable is independent of the value of the
   // first argument, thus allowing ClangTool and runToolOnCode to just
   // pass in made-up names here. Make sure this works on other platforms.
-  std::string MainExecutable =
-      llvm::sys::fs::getMainExecutable("clang_tool", &StaticSymbol);
+  return llvm::sys::fs::getMainExecutable("clang_tool", &StaticSymbol);
+}
+
+bool ClangTool::runCompileCommand(ToolAction *Action, unsigned Index,
+                                  StringRef MainExecutable) {
+  const auto &Command = CompileCommands[Index];
+  // FIXME: chdir is thread hostile; on the other hand, creating the same
+  // behavior as chdir is complex: chdir resolves the path once, thus
+  // guaranteeing that all subsequent relative path operations work
+  // on the same path the original chdir resulted in. This makes a difference
+  // for example on network filesystems, where symlinks might be switched
+  // during runtime of the tool. Fixing this depends on having a file system
+  // abstraction that allows openat() style interactions.
+  if (chdir(Command.second.Directory.c_str()))
+    llvm::report_fatal_error("Cannot chdir into \"" +
+                             Twine(Command.second.Directory) + "\n!");
+  std::vector<std::string> CommandLine = Command.second.CommandLine;
+  for (ArgumentsAdjuster *Adjuster : ArgsAdjusters)
+    CommandLine = Adjuster->Adjust(CommandLine);
+  if (MinimizedSourceAdjuster)
+    CommandLine = MinimizedSourceAdjuster->Adjust(CommandLine);
+  assert(!CommandLine.empty());
+  CommandLine[0] = MainExecutable;
+  // FIXME: We need a callback mechanism for the tool writer to output a
+  // customized message for each file.
+  DEBUG({
+    llvm::dbgs() << "Processing: " << Command.first << ".\n";
+  });
+  ToolInvocation Invocation(std::move(CommandLine), Action, Files.get());
+  Invocation.setDiagnosticConsumer(DiagConsumer);
+  for (const auto &MappedFile : MappedFileContents) {
+    Invocation.mapVirtualFile(MappedFile.first, MappedFile.second);
+  }
+  if (!Invocation.run()) {
+    // FIXME: Diagnostics should be used instead.
+    llvm::errs() << "Error while processing " << Command.first << ".\n";
+    return false;
+  }
+  return true;
+}
+
+int ClangTool::run(ToolAction *Action) {
+  std::string MainExecutable = getToolExecutable();
+
+  std::unique_ptr<PreambleReusingAction> PreambleReuse;
+  if (ReusePreambles) {
+    PreambleReuse.reset(new PreambleReusingAction(Action));
+    Action = PreambleReuse.get();
+  }
 
   bool ProcessingFailed = false;
+  for (unsigned I = 0, E = CompileCommands.size(); I != E; ++I)
+    if (!runCompileCommand(Action, I, MainExecutable))
+      ProcessingFailed = true;
+  return ProcessingFailed ? 1 : 0;
+}
+
+namespace {
+
+/// \brief The state of one translation unit processed by the parallel
+/// \c ClangTool::run.
+struct ParallelToolJob {
+  ParallelToolJob() : Done(false), Failed(false) {}
+
+  /// \brief Buffered diagnostics, printed once all earlier jobs are printed.
+  std::string Output;
+  bool Done;
+  bool Failed;
+};
+
+}
+
+int ClangTool::run(ToolAction *Action, unsigned Jobs) {
+  Jobs = getNumWorkerThreads(Jobs, CompileCommands.size());
+  if (Jobs <= 1)
+    return run(Action);
+
+  std::unique_ptr<PreambleReusingAction> PreambleReuse;
+  if (ReusePreambles) {
+    PreambleReuse.reset(new PreambleReusingAction(Action));
+    Action = PreambleReuse.get();
+  }
+
+  std::string MainExecutable = getToolExecutable();
+
+  // Adjust all command lines up front; the adjusters are not required to be
+  // thread-safe.
+  std::vector<std::vector<std::string>> CommandLines;
+  CommandLines.reserve(CompileCommands.size());
   for (const auto &Command : CompileCommands) {
-    // FIXME: chdir is thread hostile; on the other hand, creating the same
-    // behavior as chdir is complex: chdir resolves the path once, thus
-    // guaranteeing that all subsequent relative path operations work
-    // on the same path the original chdir resulted in. This makes a difference
-    // for example on network filesystems, where symlinks might be switched
-    // during runtime of the tool. Fixing this depends on having a file system
-    // abstraction that allows openat() style interactions.
-    if (chdir(Command.second.Directory.c_str()))
-      llvm::report_fatal_error("Cannot chdir into \"" +
-                               Twine(Command.second.Directory) + "\n!");
     std::vector<std::string> CommandLine = Command.second.CommandLine;
     for (ArgumentsAdjuster *Adjuster : ArgsAdjusters)
       CommandLine = Adjuster->Adjust(CommandLine);
+    if (MinimizedSourceAdjuster)
+      CommandLine = MinimizedSourceAdjuster->Adjust(CommandLine);
     assert(!CommandLine.empty());
     CommandLine[0] = MainExecutable;
-    // FIXME: We need a callback mechanism for the tool writer to output a
-    // customized message for each file.
+    // Resolve relative paths in the driver and in the frontend against the
+    // compile command's directory instead of chdir'ing into it.
+    CommandLine.push_back("-working-directory=" + Command.second.Directory);
+    CommandLines.push_back(std::move(CommandLine));
+  }
+
+  std::vector<ParallelToolJob> Results(CompileCommands.size());
+  std::mutex OutputMutex;
+  unsigned NextToPrint = 0;
+  bool ProcessingFailed = false;
+
+  runTasksInParallel(CompileCommands.size(), Jobs, [&](unsigned I) {
+    const auto &Command = CompileCommands[I];
     DEBUG({
       llvm::dbgs() << "Processing: " << Command.first << ".\n";
     });
-    ToolInvocation Invocation(std::move(CommandLine), Action, Files.get());
-    Invocation.setDiagnosticConsumer(DiagConsumer);
-    for (const auto &MappedFile : MappedFileContents) {
+    FileSystemOptions FileSystemOpts;
+    FileSystemOpts.WorkingDir = Command.second.Directory;
+    IntrusiveRefCntPtr<FileManager> JobFiles(
+        new FileManager(FileSystemOpts, SourceFS));
+
+    std::string Output;
+    llvm::raw_string_ostream OS(Output);
+    IntrusiveRefCntPtr<DiagnosticOptions> DiagOpts = new DiagnosticOptions();
+    TextDiagnosticPrinter BufferingPrinter(OS, &*DiagOpts);
+
+    ToolInvocation Invocation(std::move(CommandLines[I]), Action,
+                              JobFiles.get());
+    Invocation.setDiagnosticConsumer(DiagConsumer ? DiagConsumer
+                                                  : &BufferingPrinter);
+    for (const auto &MappedFile : MappedFileContents)
       Invocation.mapVirtualFile(MappedFile.first, MappedFile.second);
+    bool Failed = !Invocation.run();
+    if (Failed)
+      OS << "Error while processing " << Command.first << ".\n";
+    OS.flush();
+
+    // Print every finished job that has no unfinished predecessor, so the
+    // output is in compile command order regardless of scheduling.
+    std::lock_guard<std::mutex> Lock(OutputMutex);
+    Results[I].Output = std::move(Output);
+    Results[I].Failed = Failed;
+    Results[I].Done = true;
+    for (; NextToPrint < Results.size() && Results[NextToPrint].Done;
+         ++NextToPrint) {
+      ParallelToolJob &Result = Results[NextToPrint];
+      llvm::errs() << Result.Output;
+      ProcessingFailed |= Result.Failed;
+      Result.Output.clear();
     }
-    if (!Invocation.run()) {
-      // FIXME: Diagnostics should be used instead.
-      llvm::errs() << "Error while processing " << Command.first << ".\n";
-      ProcessingFailed = true;
-    }
-  }
+  });
+
+  assert(NextToPrint == Results.size() && "Unprinted tool results");
   return ProcessingFailed ? 1 : 0;
 }
 
@@ -396,6 +742,14 @@ int ClangTool::buildASTs(std::vector<std::unique_ptr<ASTUnit>> &ASTs) {
   return run(&Action);
 }
 
+std::unique_ptr<ASTUnit> ClangTool::buildAST(unsigned Index) {
+  std::vector<std::unique_ptr<ASTUnit>> ASTs;
+  ASTBuilderAction Action(ASTs);
+  if (!runCompileCommand(&Action, Index, getToolExecutable()) || ASTs.empty())
+    return nullptr;
+  return std::move(ASTs.back());
+}
+
 std::unique_ptr<ASTUnit> buildASTFromCode(const Twine &Code,
                                           const Twine &FileName) {
   return buildASTFromCodeWithArgs(Code, std::vector<std::string>(), FileName);
@@ -0,0 +1,38 @@
+// RUN: %clang -fcompile-server=%t.sock -### -c %s 2>&1 | FileCheck %s
+// CHECK-NOT: argument unused during compilation
+// CHECK: "-cc1"
+
+// Without a server listening on the socket, the driver runs the job itself.
+// RUN: rm -f %t.sock
+// RUN: %clang -fcompile-server=%t.sock -fsyntax-only %s
+
+// RUN: not %clang -cc1serve 2>&1 | FileCheck -check-prefix=CHECK-USAGE %s
+// CHECK-USAGE: usage: clang -cc1serve [-v] <socket>
+
+// Two builds in different directories, with relative paths, run on the server
+// at the same time.
+// REQUIRES: shell
+// RUN: rm -rf %t && mkdir -p %t/a %t/b
+// RUN: echo 'int a;' > %t/a/x.c
+// RUN: echo 'int b = undeclared;' > %t/b/x.c
+// RUN: %clang -cc1serve -v %t/sock 2> %t/server.log & SERVER=$!; \
+// RUN:   i=0; while [ ! -S %t/sock ] && [ $i -lt 100 ]; do \
+// RUN:     sleep 0.1; i=$((i+1)); done; ls -l %t/sock > %t/mode.txt; \
+// RUN:   (cd %t/a && %clang -fcompile-server=%t/sock -c x.c -o x.o) & A=$!; \
+// RUN:   (cd %t/b && not %clang -fcompile-server=%t/sock -c x.c -o x.o \
+// RUN:      2> err.txt) & B=$!; \
+// RUN:   wait $A && wait $B; STATUS=$?; kill $SERVER; wait $SERVER; \
+// RUN:   exit $STATUS
+// RUN: ls %t/a/x.o
+// RUN: not ls %t/b/x.o
+// RUN: FileCheck -check-prefix=CHECK-ERR %s < %t/b/err.txt
+// CHECK-ERR: x.c:1:9: error: use of undeclared identifier 'undeclared'
+// RUN: FileCheck -check-prefix=CHECK-LOG %s < %t/server.log
+// CHECK-LOG-DAG: running job in {{.*}}a
+// CHECK-LOG-DAG: running job in {{.*}}b
+
+// Only the user who started the server can connect to it.
+// RUN: FileCheck -check-prefix=CHECK-MODE %s < %t/mode.txt
+// CHECK-MODE: srw-------
+
+int x;
@@ -0,0 +1,8 @@
+// RUN: %clang -### -M -fdeps-scan-only %s 2>&1 | FileCheck %s
+// RUN: %clang -### -MM -fdeps-scan-only %s 2>&1 | FileCheck %s
+// CHECK: "-Eonly" "-fdeps-scan-only"
+
+// The directives are only scanned when nothing but the dependencies is wanted.
+// RUN: %clang -### -MD -c -fdeps-scan-only %s 2>&1 | FileCheck -check-prefix=UNUSED %s
+// UNUSED: argument unused during compilation: '-fdeps-scan-only'
+// UNUSED-NOT: "-fdeps-scan-only"
@@ -0,0 +1,14 @@
+// A job which crashes in the driver is run again in its own process, and its
+// diagnostics are printed once.
+// REQUIRES: crash-recovery
+
+// RUN: rm -rf %t
+// RUN: mkdir %t
+// RUN: not env TMPDIR=%t TEMP=%t TMP=%t %clang -fintegrated-cc1 -fsyntax-only %s 2>&1 | FileCheck %s
+// CHECK: warning: unused variable 'unused'
+// CHECK-NOT: warning: unused variable 'unused'
+// CHECK: Preprocessed source(s) and associated run script(s) are located at:
+
+#pragma clang diagnostic warning "-Wunused-variable"
+void f(void) { int unused; }
+#pragma clang __debug parser_crash
@@ -0,0 +1,24 @@
+// RUN: %clang -fintegrated-cc1 -### -c %s 2>&1 | FileCheck %s
+// CHECK-NOT: argument unused during compilation
+// CHECK: "-cc1"
+
+// RUN: %clang -fintegrated-cc1 -fsyntax-only %s
+// RUN: not %clang -fintegrated-cc1 -fsyntax-only -DBAD %s 2>&1 | FileCheck -check-prefix=CHECK-ERR %s
+// CHECK-ERR: error: use of undeclared identifier 'undeclared'
+// CHECK-ERR-NOT: error: use of undeclared identifier 'undeclared'
+
+// Jobs which set backend options run in processes of their own, so that two
+// of them in one driver do not set the options twice.
+// RUN: rm -rf %t
+// RUN: mkdir %t
+// RUN: cp %s %t/a.c
+// RUN: cp %s %t/b.c
+// RUN: cd %t
+// RUN: %clang -fintegrated-cc1 -ftime-report -c a.c b.c 2>&1 | FileCheck -check-prefix=CHECK-OPT %s
+// RUN: %clang -fintegrated-cc1 -Xclang -backend-option -Xclang -unroll-threshold=100 -c a.c b.c 2>&1 | FileCheck -check-prefix=CHECK-OPT %s
+// CHECK-OPT-NOT: may only occur zero or one times
+
+#ifdef BAD
+int x = undeclared;
+#endif
+int y;
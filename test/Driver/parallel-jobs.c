@@ -0,0 +1,13 @@
+// RUN: %clang -j 4 -### -c %s 2>&1 | FileCheck -check-prefix=CHECK-CLAIM %s
+// CHECK-CLAIM-NOT: argument unused during compilation
+
+// RUN: not %clang -j 0 -fsyntax-only %s 2>&1 | FileCheck -check-prefix=CHECK-ZERO %s
+// CHECK-ZERO: invalid integral value '0' in '-j 0'
+
+// RUN: rm -rf %t && mkdir %t
+// RUN: echo 'int a(void) { return 1; }' > %t/a.c
+// RUN: echo 'int b(void) { return undeclared; }' > %t/b.c
+// RUN: echo 'int c(void) { return 3; }' > %t/c.c
+// RUN: not %clang -j 3 -fsyntax-only %t/a.c %t/b.c %t/c.c 2>&1 | FileCheck -check-prefix=CHECK-FAIL %s
+// CHECK-FAIL: b.c:1:28: error: use of undeclared identifier 'undeclared'
+// CHECK-FAIL-NOT: error:
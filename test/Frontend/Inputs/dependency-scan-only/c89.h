@@ -0,0 +1 @@
+int c89(void);
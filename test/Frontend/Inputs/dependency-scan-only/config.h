@@ -0,0 +1,3 @@
+#define NEXT_HEADER "next.h"
+#define HAVE_FEATURE 1
+extern int config_version;
@@ -0,0 +1 @@
+int feature(void);
@@ -0,0 +1 @@
+int has(void);
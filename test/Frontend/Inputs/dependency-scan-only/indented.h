@@ -0,0 +1 @@
+int indented(void);
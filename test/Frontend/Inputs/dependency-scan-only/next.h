@@ -0,0 +1,4 @@
+struct next {
+  int x; // #include "never.h"
+};
+  #  include "indented.h"
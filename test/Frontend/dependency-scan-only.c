@@ -0,0 +1,63 @@
+// RUN: %clang_cc1 -Eonly -I %S/Inputs/dependency-scan-only -dependency-file %t.full -MT out %s
+// RUN: %clang_cc1 -Eonly -fdeps-scan-only -I %S/Inputs/dependency-scan-only -dependency-file %t.scan -MT out %s
+// RUN: diff %t.full %t.scan
+// RUN: FileCheck %s < %t.scan
+// RUN: %clang_cc1 -Eonly -std=c89 -DC89 -I %S/Inputs/dependency-scan-only -dependency-file %t.c89.full -MT out %s
+// RUN: %clang_cc1 -Eonly -std=c89 -DC89 -fdeps-scan-only -I %S/Inputs/dependency-scan-only -dependency-file %t.c89.scan -MT out %s
+// RUN: diff %t.c89.full %t.c89.scan
+// RUN: FileCheck -check-prefix=C89 %s < %t.c89.scan
+// RUN: not %clang_cc1 -fsyntax-only -fdeps-scan-only %s 2>&1 | FileCheck -check-prefix=ERROR %s
+
+// The text between the directives is skipped, but directives hidden in it
+// must not be seen, and the directives must still see the macros defined by
+// earlier headers.
+
+// CHECK: out:
+// CHECK: dependency-scan-only.c
+// CHECK: config.h
+// CHECK: next.h
+// CHECK: indented.h
+// CHECK: feature.h
+// CHECK: has.h
+// CHECK-NOT: never.h
+
+// C89: c89.h
+// C89-NOT: never.h
+
+// ERROR: invalid argument '-fdeps-scan-only' only allowed with '-Eonly'
+
+#include "config.h"
+#define STR(x) #x
+const char *s = STR(#include "never.h");
+#include NEXT_HEADER
+
+/*
+#include "never.h"
+*/ int after_comment;
+
+// a line comment \
+#include "never.h"
+
+const char *t = "a string \
+#include \"never.h\"";
+
+#if HAVE_FEATURE
+#include "feature.h"
+#else
+#include "never.h"
+#endif
+
+#if __has_include("has.h") && !__has_include("never.h")
+#include "has.h"
+#endif
+
+#ifdef C89
+//* Without line comments, this is a '/' followed by a block comment.
+#include "never.h"
+*/
+#include "c89.h"
+#endif
+
+int main(void) {
+  return config_version;
+}
@@ -0,0 +1,43 @@
+// REQUIRES: shell
+// RUN: rm -rf %t
+// RUN: mkdir -p %t/Inputs
+// RUN: echo 'int left(void);' > %t/Inputs/left.h
+// RUN: echo 'int right(void);' > %t/Inputs/right.h
+// RUN: echo '#include "left.h"' > %t/Inputs/top.h
+// RUN: echo '#include "right.h"' >> %t/Inputs/top.h
+// RUN: echo 'int top(void);' >> %t/Inputs/top.h
+// RUN: echo 'module Left { header "left.h" }' > %t/Inputs/module.map
+// RUN: echo 'module Right { header "right.h" }' >> %t/Inputs/module.map
+// RUN: echo 'module Top { header "top.h" export * }' >> %t/Inputs/module.map
+
+// The modules Top depends on are built along with it.
+// RUN: %clang_cc1 -fmodules -fdisable-module-hash -fmodules-cache-path=%t/cache -fsyntax-only -I %t/Inputs -fmodules-build-jobs=4 -Wmodule-build %s 2>&1 | FileCheck %s
+// CHECK: building module 'Top'
+// CHECK: building module 'Left'
+// CHECK: building module 'Right'
+// RUN: ls %t/cache/Left.pcm %t/cache/Right.pcm %t/cache/Top.pcm %t/cache/Top.pcm.lck
+
+// Only the modules which are out of date are rebuilt.
+// RUN: echo 'int right2(void);' >> %t/Inputs/right.h
+// RUN: %clang_cc1 -fmodules -fdisable-module-hash -fmodules-cache-path=%t/cache -fsyntax-only -I %t/Inputs -fmodules-build-jobs=4 -Wmodule-build %s 2>&1 | FileCheck %s --check-prefix=CHANGED
+// CHANGED-NOT: building module 'Left'
+// CHANGED: building module 'Top'
+// CHANGED-NOT: building module 'Left'
+// CHANGED: building module 'Right'
+// CHANGED-NOT: building module 'Left'
+
+// Nothing is rebuilt when everything is up to date.
+// RUN: %clang_cc1 -fmodules -fdisable-module-hash -fmodules-cache-path=%t/cache -fsyntax-only -I %t/Inputs -fmodules-build-jobs=4 -Wmodule-build %s 2>&1 | not grep 'building module'
+
+// The warnings of the modules built in parallel are reported, and counted,
+// by the importing compilation.
+// RUN: echo '#warning right is built' >> %t/Inputs/right.h
+// RUN: %clang_cc1 -fmodules -fdisable-module-hash -fmodules-cache-path=%t/cache -fsyntax-only -I %t/Inputs -fmodules-build-jobs=4 %s 2>&1 | FileCheck %s --check-prefix=WARNING
+// WARNING: right.h:3:2: warning: right is built
+// WARNING: 1 warning generated.
+
+@import Top;
+
+int f(void) {
+  return left() + right() + top();
+}
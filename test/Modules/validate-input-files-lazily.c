@@ -0,0 +1,50 @@
+#include "foo.h"
+#ifdef MANY
+#include "many/many_1.h"
+#endif
+
+// REQUIRES: shell
+
+// RUN: rm -rf %t
+// RUN: mkdir -p %t/Inputs %t/modules-to-compare
+// RUN: echo 'void meow(void);' > %t/Inputs/foo.h
+// RUN: echo 'void purr(void);' > %t/Inputs/unused.h
+// RUN: echo 'module Foo { header "foo.h" header "unused.h" }' > %t/Inputs/module.map
+// RUN: echo 'module Many { umbrella "many" }' >> %t/Inputs/module.map
+// RUN: mkdir -p %t/Inputs/many
+// RUN: for i in $(seq 1 130); do echo "int many_$i;" > %t/Inputs/many/many_$i.h; done
+
+// Build the module, then use it with its input files validated lazily.
+// RUN: %clang_cc1 -fmodules -fdisable-module-hash -fmodules-cache-path=%t/modules-cache -fsyntax-only -I %t/Inputs %s
+// RUN: cp %t/modules-cache/Foo.pcm %t/modules-to-compare/Foo-before.pcm
+// RUN: %clang_cc1 -fmodules -fdisable-module-hash -fmodules-cache-path=%t/modules-cache -fsyntax-only -I %t/Inputs -fmodules-validate-input-files-lazily -print-stats %s 2>&1 | FileCheck %s
+// CHECK: {{[0-9]+}}/{{[0-9]+}} deferred input files validated ({{[1-9][0-9]*}} stats avoided)
+
+// A header which is never needed is never checked, so the module is not
+// rebuilt when it changes.
+// RUN: echo 'void purr(int);' > %t/Inputs/unused.h
+// RUN: %clang_cc1 -fmodules -fdisable-module-hash -fmodules-cache-path=%t/modules-cache -fsyntax-only -I %t/Inputs -fmodules-validate-input-files-lazily %s
+// RUN: diff %t/modules-cache/Foo.pcm %t/modules-to-compare/Foo-before.pcm
+
+// A header which is needed is found out of date when it is used.
+// RUN: echo 'void meow(int);' > %t/Inputs/foo.h
+// RUN: not %clang_cc1 -fmodules -fdisable-module-hash -fmodules-cache-path=%t/modules-cache -fsyntax-only -I %t/Inputs -fmodules-validate-input-files-lazily -DARG=1 %s 2>&1 | FileCheck %s --check-prefix=MODIFIED
+// MODIFIED: error: file '{{.*}}foo.h' has been modified since the precompiled header '{{.*}}Foo.pcm' was built
+
+// Validating eagerly rebuilds the module.
+// RUN: %clang_cc1 -fmodules -fdisable-module-hash -fmodules-cache-path=%t/modules-cache -fsyntax-only -I %t/Inputs -DARG=1 %s
+// RUN: not diff %t/modules-cache/Foo.pcm %t/modules-to-compare/Foo-before.pcm
+
+// The input files of a module with enough of them are stat'ed on several
+// threads before they are validated eagerly.
+// RUN: %clang_cc1 -fmodules -fdisable-module-hash -fmodules-cache-path=%t/modules-cache -fsyntax-only -I %t/Inputs -DARG=1 -DMANY %s
+// RUN: %clang_cc1 -fmodules -fdisable-module-hash -fmodules-cache-path=%t/modules-cache -fsyntax-only -I %t/Inputs -DARG=1 -DMANY -print-stats %s 2>&1 | FileCheck %s --check-prefix=PARALLEL
+// PARALLEL: {{1[2-9][0-9]}} input files stat'ed in parallel
+
+void f(void) {
+#ifdef ARG
+  meow(ARG);
+#else
+  meow();
+#endif
+}
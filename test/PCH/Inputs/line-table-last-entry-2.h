@@ -0,0 +1,4 @@
+// Header for PCH test line-table-last-entry.c, included last and never
+// diagnosed, so that the PCH has no line table for it.
+
+void last_function(void) __attribute__((deprecated));
@@ -0,0 +1,7 @@
+// Header for PCH test line-table-last-entry.c
+
+#warning building the PCH computes the line numbers of this header
+
+void old_function(void) __attribute__((deprecated));
+
+#include "line-table-last-entry-2.h"
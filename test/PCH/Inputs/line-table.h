@@ -0,0 +1,5 @@
+// Header for PCH test line-table.c
+
+#warning building the PCH computes the line numbers of this header
+
+void old_function(void) __attribute__((deprecated));
@@ -0,0 +1,4 @@
+#define DECLARE(type, name) extern type name##_value;
+
+DECLARE(int, header)
+DECLARE(PAIR_TYPE, pair)
@@ -0,0 +1,44 @@
+// Identifiers only reached through declarations read from a PCH file keep
+// their spelling in the PCH file until their name is looked up.
+
+// Without PCH
+// RUN: %clang_cc1 -fsyntax-only -verify -include %s %s
+
+// With PCH
+// RUN: %clang_cc1 -x c++-header -emit-pch -o %t %s
+// RUN: %clang_cc1 -include-pch %t -fsyntax-only -verify %s
+// RUN: %clang_cc1 -include-pch %t -fsyntax-only -print-stats %s 2>&1 | FileCheck %s
+
+#ifndef HEADER
+#define HEADER
+
+#define TWICE(x) (2 * (x))
+
+int helper(int);
+
+template<typename T> struct Box {
+  T value;
+  int twice() const { return TWICE(value); }
+  int help() const { return helper(value); }
+};
+
+inline int unbox(const Box<int> &B) { return B.value + B.twice(); }
+
+#else
+
+// expected-no-diagnostics
+
+int use() {
+  Box<int> B = { 1 };
+  return unbox(B) + B.help();
+}
+
+// The declaration of helper read along with Box is found by the lookup of
+// its name, as is the macro TWICE.
+int helper(int x) { return TWICE(x); }
+
+int use_value(const Box<int> &B) { return B.value; }
+
+// CHECK: # Identifiers with external spellings: {{[1-9][0-9]*}}
+
+#endif
@@ -0,0 +1,18 @@
+// The last source location entry of a PCH file can be a file without a line
+// table. Loading it must not leave the source manager block.
+
+// RUN: %clang_cc1 -x c-header -emit-pch -o %t.pch %S/Inputs/line-table-last-entry.h 2>&1 | FileCheck %s --check-prefix=BUILD
+// RUN: %clang_cc1 -include-pch %t.pch -fsyntax-only -print-stats %s 2>&1 | FileCheck %s
+
+// BUILD: line-table-last-entry.h:3:2: warning: building the PCH
+
+void f(void) {
+  last_function();
+  old_function();
+}
+
+// CHECK: line-table-last-entry.c:10:3: warning: 'last_function' is deprecated
+// CHECK: line-table-last-entry-2.h:4:6: note: {{.*}} here
+// CHECK: line-table-last-entry.c:11:3: warning: 'old_function' is deprecated
+// CHECK: line-table-last-entry.h:5:6: note: {{.*}} here
+// CHECK: 1 file line tables read
@@ -0,0 +1,15 @@
+// The line numbers a PCH build computes for its headers are saved in the PCH,
+// and used for the diagnostics of its users.
+
+// RUN: %clang_cc1 -x c-header -emit-pch -o %t.pch %S/Inputs/line-table.h 2>&1 | FileCheck %s --check-prefix=BUILD
+// RUN: %clang_cc1 -include-pch %t.pch -fsyntax-only -print-stats %s 2>&1 | FileCheck %s
+
+// BUILD: line-table.h:3:2: warning: building the PCH
+
+void f(void) {
+  old_function();
+}
+
+// CHECK: line-table.c:10:3: warning: 'old_function' is deprecated
+// CHECK: line-table.h:5:6: note: {{.*}} here
+// CHECK: 1 file line tables read
@@ -0,0 +1,34 @@
+// A PCH written on several threads is the same, byte for byte, as one
+// written on a single thread. The token paste puts a memory buffer, whose
+// blob is word-aligned, in between macro expansions.
+
+// RUN: %clang_cc1 -x c-header -emit-pch -o %t.serial.pch %s
+// RUN: %clang_cc1 -x c-header -emit-pch -parallel-ast-write -o %t.parallel.pch %s
+// RUN: cmp %t.serial.pch %t.parallel.pch
+// RUN: %clang_cc1 -include-pch %t.parallel.pch -fsyntax-only -verify %s
+
+#ifndef HEADER
+#define HEADER
+
+#define PAIR(a, b) struct { a first; b second; }
+#define PAIR_TYPE PAIR(int, long)
+
+PAIR_TYPE before;
+#define CAT(a, b) a##b
+int CAT(pasted_, value);
+#include "Inputs/parallel-write.h"
+PAIR_TYPE after;
+
+# 100 "renamed.h"
+int renamed(void) { return __LINE__; }
+
+#else
+
+int *p = &header_value;
+long *q = &pair_value.second;
+int *r = &after.first;
+int (*s)(void) = renamed;
+int *u = &pasted_value;
+char *t = &before.second; // expected-warning{{incompatible pointer types}}
+
+#endif
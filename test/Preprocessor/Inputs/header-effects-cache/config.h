@@ -0,0 +1,15 @@
+// Only changes macros, depending on FEATURE.
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#ifdef FEATURE
+#define OPT_LEVEL 2
+#else
+#define OPT_LEVEL 1
+#endif
+
+#define MAKE_NAME(x) name_##x
+#define GREETING "hello"
+#undef UNWANTED
+
+#endif
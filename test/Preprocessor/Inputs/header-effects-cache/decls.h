@@ -0,0 +1,5 @@
+// Returns tokens, so its effects cannot be replayed.
+#ifndef DECLS_H
+#define DECLS_H
+int declared;
+#endif
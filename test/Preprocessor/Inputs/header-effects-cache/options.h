@@ -0,0 +1,7 @@
+// Not guarded, so each inclusion depends on the previous one.
+#undef HAVE_OPTIONS
+#if OPT_LEVEL > 1 && defined(CONFIG_H)
+#define HAVE_OPTIONS "fast"
+#else
+#define HAVE_OPTIONS "small"
+#endif
@@ -0,0 +1,3 @@
+#if HEADER_EFFECTS_UNDEFINED
+#define UNDEF_H_VALUE 1
+#endif
@@ -0,0 +1,20 @@
+// Tokens the prelexer keeps, and some it must leave to the preprocessor.
+#ifndef GUARDED_H
+#define GUARDED_H
+
+#include "pragma-once.h"
+
+int guarded_int = 0x1p+3 + 1e-5 + 42;
+const char *guarded_str = "a \"quoted\" string" /* comment */ "b";
+char guarded_chars[] = { 'a', '\n', 'bc' };
+#define EXPAND(x) expanded_##x
+int EXPAND(name) = sizeof(EXPAND(other));
+int split\
+_identifier = GUARDED_H_VALUE;
+  <:guarded_digraph:> <% %> ?:
+#if 0
+unmatched ' quote
+#endif
+int after_the_block;
+
+#endif // GUARDED_H
@@ -0,0 +1,2 @@
+#pragma once
+struct pragma_once { int member; };
@@ -0,0 +1 @@
+int unguarded_ UNGUARDED_SUFFIX;
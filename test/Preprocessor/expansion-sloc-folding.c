@@ -0,0 +1,18 @@
+// RUN: %clang_cc1 -E -CC %s | FileCheck %s
+// RUN: %clang_cc1 -E -CC -print-stats %s -o /dev/null 2>&1 | FileCheck %s --check-prefix=STATS
+// RUN: %clang_cc1 -fsyntax-only -verify %s
+
+// The tokens of a _Pragma string share the SLocEntry of the first one, but
+// keep their own spelling. Macro bodies, including their comments with -CC,
+// are unaffected.
+
+_Pragma("omp parallel for schedule(static) num_threads(4)")
+// CHECK: #pragma omp parallel for schedule(static) num_threads(4)
+
+#define COMMENTED /* first */ 1 /* second */ + /* third */ 2
+int x = COMMENTED;
+// CHECK: int x = /* first */ 1 /* second */ + /* third */ 2;
+
+_Pragma("clang diagnostic warning \"-Wnot-a-real-warning\"") // expected-warning {{unknown warning group '-Wnot-a-real-warning'}}
+
+// STATS: {{[0-9]+}} local expansion SLocEntry's ({{[0-9]+}} for macro arguments), {{[0-9]+}}B of Sloc address space used; {{[1-9][0-9]*}} expansion locations folded into the previous entry.
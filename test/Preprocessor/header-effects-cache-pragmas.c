@@ -0,0 +1,16 @@
+// RUN: rm -f %t.cache
+// RUN: %clang_cc1 -E -Wundef -DIGNORE -header-effects-cache %t.cache -print-stats -I %S/Inputs/header-effects-cache %s -o /dev/null 2>&1 | FileCheck %s --check-prefix=IGNORED
+// RUN: %clang_cc1 -E -Wundef -header-effects-cache %t.cache -print-stats -I %S/Inputs/header-effects-cache %s -o /dev/null 2>&1 | FileCheck %s --check-prefix=WARNED
+
+// A header included where a diagnostic pragma ignores one of its warnings is
+// not recorded, so that it is not replayed without the warning elsewhere.
+
+#ifdef IGNORE
+#pragma clang diagnostic ignored "-Wundef"
+#endif
+#include "undef.h"
+
+// IGNORED-NOT: warning:
+// IGNORED: 0 header effects replayed, 0 recorded.
+// WARNED: undef.h:1:5: warning: 'HEADER_EFFECTS_UNDEFINED' is not defined
+// WARNED: 0 header effects replayed, 0 recorded.
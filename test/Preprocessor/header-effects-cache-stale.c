@@ -0,0 +1,28 @@
+// The header is dated next year, so that it looks modified at or after the
+// time its effects are recorded.
+// REQUIRES: shell
+// RUN: rm -rf %t && mkdir -p %t
+// RUN: touch -t $(($(date +%Y) + 1))01010000 %t/timestamp
+// RUN: echo '#define STALE_VALUE 1' > %t/stale.h
+// RUN: touch -r %t/timestamp %t/stale.h
+// RUN: %clang_cc1 -E -header-effects-cache %t/cache -print-stats -I %t %s -o %t/first 2>&1 | FileCheck %s --check-prefix=RECORDED
+// RUN: FileCheck %s --check-prefix=FIRST --input-file=%t/first
+
+// The header changes without changing its size or modification time, as it
+// may within the second it was recorded in.
+// RUN: echo '#define STALE_VALUE 2' > %t/stale.h
+// RUN: touch -r %t/timestamp %t/stale.h
+// RUN: %clang_cc1 -E -header-effects-cache %t/cache -print-stats -I %t %s -o %t/second 2>&1 | FileCheck %s --check-prefix=RECORDED
+// RUN: FileCheck %s --check-prefix=SECOND --input-file=%t/second
+
+// Unchanged contents are still replayed.
+// RUN: %clang_cc1 -E -header-effects-cache %t/cache -print-stats -I %t %s -o %t/third 2>&1 | FileCheck %s --check-prefix=REPLAYED
+// RUN: FileCheck %s --check-prefix=SECOND --input-file=%t/third
+
+#include "stale.h"
+int value = STALE_VALUE;
+
+// RECORDED: 0 header effects replayed, 1 recorded.
+// REPLAYED: 1 header effects replayed, 0 recorded.
+// FIRST: int value = 1;
+// SECOND: int value = 2;
@@ -0,0 +1,37 @@
+// RUN: rm -f %t.cache
+// RUN: %clang_cc1 -E -dD -I %S/Inputs/header-effects-cache %s > %t.expected
+// RUN: %clang_cc1 -E -dD -header-effects-cache %t.cache -print-stats -I %S/Inputs/header-effects-cache %s -o %t.first 2>&1 | FileCheck %s --check-prefix=FIRST
+// RUN: %clang_cc1 -E -dD -header-effects-cache %t.cache -print-stats -I %S/Inputs/header-effects-cache %s -o %t.second 2>&1 | FileCheck %s --check-prefix=SECOND
+// RUN: diff %t.expected %t.first
+// RUN: diff %t.expected %t.second
+// RUN: FileCheck %s --input-file=%t.second
+
+// Different incoming macros are recorded separately, and coexist.
+// RUN: %clang_cc1 -E -DFEATURE -I %S/Inputs/header-effects-cache %s > %t.feature.expected
+// RUN: %clang_cc1 -E -DFEATURE -header-effects-cache %t.cache -print-stats -I %S/Inputs/header-effects-cache %s -o %t.feature 2>&1 | FileCheck %s --check-prefix=FIRST
+// RUN: %clang_cc1 -E -DFEATURE -header-effects-cache %t.cache -print-stats -I %S/Inputs/header-effects-cache %s -o %t.feature 2>&1 | FileCheck %s --check-prefix=SECOND
+// RUN: diff %t.feature.expected %t.feature
+// RUN: %clang_cc1 -E -header-effects-cache %t.cache -print-stats -I %S/Inputs/header-effects-cache %s -o /dev/null 2>&1 | FileCheck %s --check-prefix=SECOND
+
+// config.h is recorded once, options.h twice since the second inclusion sees
+// the first one's HAVE_OPTIONS; decls.h returns tokens and is never recorded.
+// FIRST: 0 header effects replayed, 3 recorded.
+// SECOND: 3 header effects replayed, 0 recorded.
+
+#define UNWANTED 1
+#include "config.h"
+#include "options.h"
+#include "decls.h"
+#include "options.h"
+#include "config.h"
+
+int value = OPT_LEVEL;
+const char *options = HAVE_OPTIONS GREETING;
+int MAKE_NAME(id);
+#ifdef UNWANTED
+#error UNWANTED should be undefined
+#endif
+
+// CHECK: int value = 1;
+// CHECK: const char *options = "small" "hello";
+// CHECK: int name_id;
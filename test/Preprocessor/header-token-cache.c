@@ -0,0 +1,23 @@
+// RUN: rm -rf %t.cache
+// RUN: %clang_cc1 -E -I %S/Inputs/prelex-headers %s > %t.expected
+// RUN: %clang_cc1 -E -header-token-cache %t.cache -print-stats -I %S/Inputs/prelex-headers %s -o %t.first 2>&1 | FileCheck %s --check-prefix=FIRST
+// RUN: %clang_cc1 -E -header-token-cache %t.cache -print-stats -I %S/Inputs/prelex-headers %s -o %t.second 2>&1 | FileCheck %s --check-prefix=SECOND
+// RUN: diff %t.expected %t.first
+// RUN: diff %t.expected %t.second
+
+// Different language options must not share cache entries.
+// RUN: %clang_cc1 -E -x c++ -header-token-cache %t.cache -print-stats -I %S/Inputs/prelex-headers %s -o /dev/null 2>&1 | FileCheck %s --check-prefix=FIRST
+
+// The main file is not cached; each header is cached once, however often it
+// is included.
+// FIRST: 0 header token cache hits, 3 misses.
+// SECOND: 3 header token cache hits, 0 misses.
+
+#define GUARDED_H_VALUE 7
+#define UNGUARDED_SUFFIX first
+#include "guarded.h"
+#include <unguarded.h>
+#undef UNGUARDED_SUFFIX
+#define UNGUARDED_SUFFIX second
+#include "unguarded.h"
+#include "guarded.h"
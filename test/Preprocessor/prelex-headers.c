@@ -0,0 +1,37 @@
+// RUN: %clang_cc1 -E -I %S/Inputs/prelex-headers %s > %t.expected
+// RUN: %clang_cc1 -E -prelex-headers -I %S/Inputs/prelex-headers %s > %t.prelexed
+// RUN: diff %t.expected %t.prelexed
+// RUN: FileCheck %s < %t.prelexed
+
+// Waiting for the background thread makes sure the pre-lexed tokens are used.
+// RUN: %clang_cc1 -E -prelex-headers -prelex-headers-wait -print-stats -I %S/Inputs/prelex-headers %s -o %t.waited 2>&1 | FileCheck %s --check-prefix=STATS
+// RUN: diff %t.expected %t.waited
+// STATS: 2 headers pre-lexed, 2 used.
+// STATS: {{[1-9][0-9]*}} tokens formed from pre-lexed tokens.
+
+// Headers lexed ahead of time must preprocess exactly like the others,
+// whether or not the background thread was done with them in time.
+
+#define GUARDED_H_VALUE 7
+#define UNGUARDED_SUFFIX first
+#include "guarded.h"
+#include <unguarded.h>
+#undef UNGUARDED_SUFFIX
+#define UNGUARDED_SUFFIX second
+#include "unguarded.h"
+#include "guarded.h"
+#include "pragma-once.h"
+
+// CHECK: struct pragma_once { int member; };
+// CHECK: int guarded_int = 0x1p+3 + 1e-5 + 42;
+// CHECK: const char *guarded_str = "a \"quoted\" string" "b";
+// CHECK: char guarded_chars[] = { 'a', '\n', 'bc' };
+// CHECK: int expanded_name = sizeof(expanded_other);
+// CHECK: int split_identifier = 7;
+// CHECK: <:guarded_digraph:> <% %> ?:
+// CHECK-NOT: unmatched
+// CHECK: int after_the_block;
+// CHECK: int unguarded_ first;
+// CHECK: int unguarded_ second;
+// CHECK-NOT: pragma_once
+// CHECK-NOT: guarded_int
@@ -0,0 +1,52 @@
+// RUN: %clang_cc1 -E %s | FileCheck %s
+// RUN: %clang_cc1 -E -trigraphs -DTRIGRAPHS %s | FileCheck %s --check-prefix=CHECK --check-prefix=TRIGRAPHS
+
+// Excluded blocks are skipped line by line, but directives hidden in
+// comments, literals and escaped newlines must not be seen.
+
+#if 0
+char *s = "#endif";
+char c = '#'; /* a block comment
+#endif
+*/ int x;
+// a line comment \
+#endif
+char *t = "a string \
+#endif";
+int y = 1 \
+#endif
+don't
+#endif
+// CHECK: ok1
+ok1
+
+#if 0
+  /* comment
+  */ #else
+// CHECK: ok2
+ok2
+#endif
+
+#if 0
+    %:else
+// CHECK: ok3
+ok3
+#endif
+
+#if 0
+\
+#else
+// CHECK: ok4
+ok4
+#endif
+
+#ifdef TRIGRAPHS
+#if 0
+int a ??/
+#endif
+??=else
+// TRIGRAPHS: ok5
+ok5
+??=endif
+#endif
+
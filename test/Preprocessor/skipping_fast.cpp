@@ -0,0 +1,15 @@
+// RUN: %clang_cc1 -E -std=c++1y %s | FileCheck %s
+
+// Raw string literals and digit separators in excluded blocks.
+
+#if 0
+const char *r = R"(
+#endif
+)";
+int i = 1'000; /*
+#endif
+*/
+#else
+// CHECK: ok
+ok
+#endif
@@ -0,0 +1,21 @@
+// RUN: %clang_cc1 -E -std=c89 %s | FileCheck %s
+
+/* Without line comments, a '//' followed by a '*' is a '/' and a block
+   comment, and when just preprocessing, '//' never starts a comment.
+   Skipping excluded blocks must agree with the lexer. */
+
+#if 0
+//* a block comment
+#endif
+*/
+#else
+/* CHECK: ok1 */
+ok1
+#endif
+
+#if 0
+// don't
+#else
+/* CHECK: ok2 */
+ok2
+#endif
@@ -0,0 +1,70 @@
+//===--- tools/clang-compdb-convert/ClangCompDBConvert.cpp ----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file implements a tool converting a compile_commands.json compilation
+//  database into the binary compile_commands.bin format, which clang tools
+//  load without parsing it.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Tooling/BinaryCompilationDatabase.h"
+#include "clang/Tooling/JSONCompilationDatabase.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+
+using namespace clang::tooling;
+using namespace llvm;
+
+static cl::opt<std::string>
+Input(cl::Positional,
+      cl::desc("<compile_commands.json or build directory>"),
+      cl::Required);
+
+static cl::opt<std::string>
+Output("o", cl::desc("Output file (defaults to compile_commands.bin next to "
+                     "the input)"),
+       cl::value_desc("filename"));
+
+int main(int argc, const char **argv) {
+  llvm::sys::PrintStackTraceOnErrorSignal();
+  cl::ParseCommandLineOptions(
+      argc, argv, "Convert a JSON compilation database to the binary format.\n");
+
+  SmallString<1024> JSONDatabasePath(Input);
+  if (llvm::sys::fs::is_directory(JSONDatabasePath.str()))
+    llvm::sys::path::append(JSONDatabasePath, "compile_commands.json");
+
+  std::string ErrorMessage;
+  std::unique_ptr<JSONCompilationDatabase> Database(
+      JSONCompilationDatabase::loadFromFile(JSONDatabasePath, ErrorMessage));
+  if (!Database) {
+    llvm::errs() << "error: " << JSONDatabasePath << ": " << ErrorMessage
+                 << "\n";
+    return 1;
+  }
+
+  SmallString<1024> BinaryDatabasePath(Output);
+  if (BinaryDatabasePath.empty()) {
+    BinaryDatabasePath = llvm::sys::path::parent_path(JSONDatabasePath);
+    llvm::sys::path::append(BinaryDatabasePath, "compile_commands.bin");
+  }
+
+  if (!BinaryCompilationDatabase::writeToFile(*Database, BinaryDatabasePath,
+                                              ErrorMessage)) {
+    llvm::errs() << "error: " << BinaryDatabasePath << ": " << ErrorMessage
+                 << "\n";
+    return 1;
+  }
+  return 0;
+}
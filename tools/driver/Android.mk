@@ -19,6 +19,7 @@ TBLGEN_TABLES := \
 clang_SRC_FILES := \
   cc1_main.cpp \
   cc1as_main.cpp \
+  cc1serve_main.cpp \
   driver.cpp
 
 LOCAL_SRC_FILES := $(clang_SRC_FILES)
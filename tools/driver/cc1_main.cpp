@@ -27,6 +27,7 @@
 #include "llvm/LinkAllPasses.h"
 #include "llvm/Option/ArgList.h"
 #include "llvm/Option/OptTable.h"
+#include "llvm/Support/CrashRecoveryContext.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/Signals.h"
@@ -51,6 +52,12 @@ static void LLVMErrorHandler(void *UserData, const std::string &Message,
   // particular that we remove files registered with RemoveFileOnSignal.
   llvm::sys::RunInterruptHandlers();
 
+  // When running inside the driver process, exiting would take the driver
+  // down with us. Crash instead; the driver recovers and reruns the job in
+  // its own process, which then exits with the status below.
+  if (llvm::CrashRecoveryContext::GetCurrent())
+    abort();
+
   // We cannot recover from llvm errors.  When reporting a fatal error, exit
   // with status 70 to generate crash diagnostics.  For BSD systems this is
   // defined as an internal software error.  Otherwise, exit with status 1.
@@ -129,8 +136,10 @@ int cc1_main(const char **ArgBegin, const char **ArgEnd,
   }
 
   // Managed static deconstruction. Useful for making things like
-  // -time-passes usable.
-  llvm::llvm_shutdown();
+  // -time-passes usable. The driver shuts down itself when it runs us
+  // in-process, and may still run more jobs.
+  if (!llvm::CrashRecoveryContext::GetCurrent())
+    llvm::llvm_shutdown();
 
   return !Success;
 }
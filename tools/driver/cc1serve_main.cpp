@@ -0,0 +1,265 @@
+//===-- cc1serve_main.cpp - Clang Compile Server --------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This is the entry point to the clang -cc1serve functionality, a long-running
+// compile server which runs the cc1 jobs of drivers invoked with
+// -fcompile-server=<socket>. The results of stat() calls are kept across jobs
+// and revalidated cheaply, so that warm builds skip most of the file system
+// traffic of header search. Jobs run concurrently, one per thread, up to the
+// number of hardware threads.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/FileSystemStatCache.h"
+#include "clang/Driver/CompileServer.h"
+#include "clang/Driver/Job.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/TextDiagnosticBuffer.h"
+#include "clang/Frontend/TextDiagnosticPrinter.h"
+#include "clang/FrontendTool/Utils.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CrashRecoveryContext.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#ifdef LLVM_ON_WIN32
+#include <direct.h>
+#else
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sched.h>
+#endif
+using namespace clang;
+using namespace clang::driver;
+
+static void ServerErrorHandler(void *UserData, const std::string &Message,
+                               bool GenCrashDiag) {
+  // Exiting would take the server down. Crash instead; the job's crash
+  // recovery context catches it and the client reruns the job itself, which
+  // reports the error.
+  abort();
+}
+
+/// Run one cc1 job, printing its diagnostics to \p Diagnostics.
+static int runJob(ArrayRef<const char *> Args, const char *Argv0,
+                  void *MainAddr, SharedStatCache &StatCache,
+                  std::string &Diagnostics) {
+  llvm::raw_string_ostream DiagOS(Diagnostics);
+  std::unique_ptr<CompilerInstance> Clang(new CompilerInstance());
+
+  IntrusiveRefCntPtr<DiagnosticIDs> DiagID(new DiagnosticIDs());
+  IntrusiveRefCntPtr<DiagnosticOptions> DiagOpts = new DiagnosticOptions();
+  TextDiagnosticBuffer *DiagsBuffer = new TextDiagnosticBuffer;
+  DiagnosticsEngine Diags(DiagID, &*DiagOpts, DiagsBuffer);
+  bool Success = CompilerInvocation::CreateFromArgs(
+      Clang->getInvocation(), Args.begin(), Args.end(), Diags);
+
+  if (Clang->getHeaderSearchOpts().UseBuiltinIncludes &&
+      Clang->getHeaderSearchOpts().ResourceDir.empty())
+    Clang->getHeaderSearchOpts().ResourceDir =
+      CompilerInvocation::GetResourcesPath(Argv0, MainAddr);
+
+  // The server outlives the job, so everything it allocates must be freed.
+  Clang->getFrontendOpts().DisableFree = false;
+  Clang->getCodeGenOpts().DisableFree = false;
+
+  Clang->createDiagnostics(
+      new TextDiagnosticPrinter(DiagOS, &Clang->getDiagnosticOpts()));
+  if (!Clang->hasDiagnostics())
+    return 1;
+
+  DiagsBuffer->FlushDiagnostics(Clang->getDiagnostics());
+  if (!Success)
+    return 1;
+
+  Clang->createFileManager();
+  Clang->getFileManager().addStatCache(new SharedStatCacheClient(&StatCache));
+
+  Success = ExecuteCompilerInvocation(Clang.get());
+  Clang.reset();
+  DiagOS.flush();
+  return !Success;
+}
+
+/// Give the calling thread a working directory of its own, so that it can
+/// change it without affecting the jobs running on other threads.
+static bool unshareWorkingDirectory() {
+#if defined(__linux__) && defined(CLONE_FS)
+  return ::unshare(CLONE_FS) == 0;
+#else
+  return false;
+#endif
+}
+
+namespace {
+/// The state shared by the threads of the server.
+struct CompileServer {
+  CompileServer(const char *Argv0, void *MainAddr, bool Verbose)
+    : Argv0(Argv0), MainAddr(MainAddr), Verbose(Verbose),
+      StatCache(new SharedStatCache()), Listener(-1), NumActiveJobs(0),
+      Stopping(false) {}
+
+  const char *Argv0;
+  void *MainAddr;
+  bool Verbose;
+  IntrusiveRefCntPtr<SharedStatCache> StatCache;
+  int Listener;
+
+  std::mutex Lock;
+  std::condition_variable JobFinished;
+  unsigned NumActiveJobs;
+  bool Stopping;
+
+  /// \brief Held while a job runs in the working directory of the process,
+  /// on hosts where threads cannot have their own.
+  std::mutex ProcessWorkingDirLock;
+
+  void serveClient(int Client);
+};
+}
+
+void CompileServer::serveClient(int Client) {
+  std::string Request, WorkingDir, Reply;
+  std::vector<std::string> Args;
+  std::unique_lock<std::mutex> ProcessWorkingDir(ProcessWorkingDirLock,
+                                                 std::defer_lock);
+  if (!unshareWorkingDirectory())
+    ProcessWorkingDir.lock();
+  if (!compileserver::readMessage(Client, Request) ||
+      !compileserver::parseRequest(Request, WorkingDir, Args) ||
+      chdir(WorkingDir.c_str())) {
+    compileserver::writeMessage(Client, Reply);
+    compileserver::closeSocket(Client);
+    return;
+  }
+
+  SmallVector<const char *, 128> ArgPtrs;
+  for (const std::string &Arg : Args)
+    ArgPtrs.push_back(Arg.c_str());
+
+  // Options which set global LLVM state would leak into the jobs that follow,
+  // and could not be set again by them.
+  if (cc1JobNeedsOwnProcess(ArgPtrs)) {
+    compileserver::writeMessage(Client, Reply);
+    compileserver::closeSocket(Client);
+    return;
+  }
+
+  if (Verbose) {
+    std::string Log = "clang -cc1serve: running job in " + WorkingDir + "\n";
+    std::lock_guard<std::mutex> Guard(Lock);
+    llvm::errs() << Log;
+  }
+
+  // The file system may have changed since the last job.
+  StatCache->startGeneration();
+
+  std::string Diagnostics;
+  int Res = 0;
+  llvm::CrashRecoveryContext CRC;
+  bool Crashed = !CRC.RunSafely([&]() {
+    Res = runJob(ArgPtrs, Argv0, MainAddr, *StatCache, Diagnostics);
+  });
+  if (!Crashed)
+    Reply = llvm::itostr(Res) + '\0' + Diagnostics;
+  compileserver::writeMessage(Client, Reply);
+  compileserver::closeSocket(Client);
+
+  // A crash may have left the server in an inconsistent state; let the next
+  // build start a fresh one.
+  if (Crashed) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    if (!Stopping) {
+      Stopping = true;
+      compileserver::stopListening(Listener);
+    }
+  }
+}
+
+int cc1serve_main(const char **ArgBegin, const char **ArgEnd,
+                  const char *Argv0, void *MainAddr) {
+  bool Verbose = ArgBegin != ArgEnd && StringRef(ArgBegin[0]) == "-v";
+  if (Verbose)
+    ++ArgBegin;
+  if (ArgEnd - ArgBegin != 1) {
+    llvm::errs() << "usage: clang -cc1serve [-v] <socket>\n";
+    return 1;
+  }
+  // The jobs change the working directory, so remember where the socket is.
+  SmallString<128> SocketPath(ArgBegin[0]);
+  llvm::sys::fs::make_absolute(SocketPath);
+
+  llvm::InitializeAllTargets();
+  llvm::InitializeAllTargetMCs();
+  llvm::InitializeAllAsmPrinters();
+  llvm::InitializeAllAsmParsers();
+
+  std::string Error;
+  CompileServer Server(Argv0, MainAddr, Verbose);
+  Server.Listener = compileserver::listenOn(SocketPath, Error);
+  if (Server.Listener < 0) {
+    llvm::errs() << "error: cannot listen on '" << SocketPath.str() << "': "
+                 << Error << '\n';
+    return 1;
+  }
+  llvm::sys::RemoveFileOnSignal(SocketPath);
+  llvm::CrashRecoveryContext::Enable();
+  // The handler is process-wide, so it is installed once for all the jobs.
+  llvm::install_fatal_error_handler(ServerErrorHandler);
+
+  unsigned MaxActiveJobs = std::max(1u, std::thread::hardware_concurrency());
+  while (true) {
+    {
+      std::unique_lock<std::mutex> Guard(Server.Lock);
+      Server.JobFinished.wait(Guard, [&]() {
+        return Server.NumActiveJobs < MaxActiveJobs || Server.Stopping;
+      });
+      if (Server.Stopping)
+        break;
+    }
+
+    int Client = compileserver::acceptClient(Server.Listener);
+    if (Client < 0)
+      break;
+
+    std::lock_guard<std::mutex> Guard(Server.Lock);
+    ++Server.NumActiveJobs;
+    std::thread([&Server, Client]() {
+      Server.serveClient(Client);
+      std::lock_guard<std::mutex> Guard(Server.Lock);
+      --Server.NumActiveJobs;
+      Server.JobFinished.notify_all();
+    }).detach();
+  }
+
+  // Wait for the jobs still running.
+  {
+    std::unique_lock<std::mutex> Guard(Server.Lock);
+    Server.Stopping = true;
+    Server.JobFinished.wait(Guard,
+                            [&]() { return Server.NumActiveJobs == 0; });
+  }
+
+  compileserver::closeSocket(Server.Listener);
+  llvm::sys::fs::remove(SocketPath.str());
+  llvm::remove_fatal_error_handler();
+  llvm::llvm_shutdown();
+  return 0;
+}
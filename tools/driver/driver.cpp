@@ -191,6 +191,15 @@ extern int cc1_main(const char **ArgBegin, const char **ArgEnd,
                     const char *Argv0, void *MainAddr);
 extern int cc1as_main(const char **ArgBegin, const char **ArgEnd,
                       const char *Argv0, void *MainAddr);
+extern int cc1serve_main(const char **ArgBegin, const char **ArgEnd,
+                         const char *Argv0, void *MainAddr);
+
+/// Runs a "-cc1" job inside the driver process, see Driver::CC1Main.
+static int ExecuteCC1Tool(ArrayRef<const char *> Argv) {
+  assert(Argv.size() > 1 && StringRef(Argv[1]) == "-cc1");
+  return cc1_main(Argv.data()+2, Argv.data()+Argv.size(), Argv[0],
+                  (void*) (intptr_t) GetExecutablePath);
+}
 
 static void ParseProgName(SmallVectorImpl<const char *> &ArgVector,
                           std::set<std::string> &SavedStrings,
@@ -320,6 +329,9 @@ int main(int argc_, const char **argv_) {
     if (Tool == "as")
       return cc1as_main(argv.data()+2, argv.data()+argv.size(), argv[0],
                       (void*) (intptr_t) GetExecutablePath);
+    if (Tool == "serve")
+      return cc1serve_main(argv.data()+2, argv.data()+argv.size(), argv[0],
+                           (void*) (intptr_t) GetExecutablePath);
 
     // Reject unknown tools.
     llvm::errs() << "error: unknown integrated tool '" << Tool << "'\n";
@@ -372,6 +384,7 @@ int main(int argc_, const char **argv_) {
   ProcessWarningOptions(Diags, *DiagOpts, /*ReportDiags=*/false);
 
   Driver TheDriver(Path, llvm::sys::getDefaultTargetTriple(), Diags);
+  TheDriver.CC1Main = &ExecuteCC1Tool;
 
   // Attempt to find the original path used to invoke the driver, to determine
   // the installed path. We do this manually, because we want to support that
@@ -0,0 +1,109 @@
+//===- unittests/Basic/FileIDLookupTest.cpp - FileID lookups --------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Checks that getFileID finds the right SLocEntry among many files and macro
+// expansions, in any order. Its throughput over a translation unit importing
+// many modules is measured in unittests/Frontend.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../BenchmarkUtils.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Basic/FileManager.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace clang;
+
+namespace {
+
+class FileIDLookupTest : public ::testing::Test {
+protected:
+  FileIDLookupTest()
+    : FileMgr(FileMgrOpts),
+      DiagID(new DiagnosticIDs()),
+      Diags(DiagID, new DiagnosticOptions, new IgnoringDiagConsumer()),
+      SourceMgr(Diags, FileMgr) {}
+
+  /// \brief A location created in the SourceManager, and what it should be
+  /// found to be.
+  struct CreatedLoc {
+    SourceLocation Loc;
+    /// \brief The file of a file location, invalid for a macro location.
+    FileID File;
+    /// \brief The spelling of a macro location.
+    SourceLocation SpellingLoc;
+  };
+
+  /// \brief Creates \p NumFiles files, each followed by \p NumExpansions
+  /// expansions of its contents, returning a location in each entry.
+  std::vector<CreatedLoc> populate(unsigned NumFiles, unsigned NumExpansions) {
+    std::vector<CreatedLoc> Locs;
+    for (unsigned F = 0; F != NumFiles; ++F) {
+      std::string Contents(NumExpansions * 8 + 1, 'x');
+      FileID FID = SourceMgr.createFileID(
+          MemoryBuffer::getMemBufferCopy(Contents, "file" + utostr(F)));
+      SourceLocation Start = SourceMgr.getLocForStartOfFile(FID);
+      CreatedLoc File = { Start.getLocWithOffset(F % Contents.size()), FID,
+                          SourceLocation() };
+      Locs.push_back(File);
+
+      for (unsigned E = 0; E != NumExpansions; ++E) {
+        SourceLocation Spelling = Start.getLocWithOffset(E * 8);
+        SourceLocation Loc = SourceMgr.createExpansionLoc(
+            Spelling, Start.getLocWithOffset(E * 8 + 1),
+            Start.getLocWithOffset(E * 8 + 3), 5);
+        CreatedLoc Expansion = { Loc, FileID(), Spelling };
+        Locs.push_back(Expansion);
+      }
+    }
+    return Locs;
+  }
+
+  /// \brief Checks that \p L is found in the entry it was created in.
+  void check(const CreatedLoc &L) {
+    std::pair<FileID, unsigned> Decomposed = SourceMgr.getDecomposedLoc(L.Loc);
+    if (L.File.isValid()) {
+      EXPECT_EQ(L.File, Decomposed.first);
+      return;
+    }
+    const SrcMgr::SLocEntry &Entry = SourceMgr.getSLocEntry(Decomposed.first);
+    ASSERT_TRUE(Entry.isExpansion());
+    EXPECT_EQ(0U, Decomposed.second);
+    EXPECT_EQ(L.SpellingLoc, Entry.getExpansion().getSpellingLoc());
+  }
+
+  FileSystemOptions FileMgrOpts;
+  FileManager FileMgr;
+  IntrusiveRefCntPtr<DiagnosticIDs> DiagID;
+  DiagnosticsEngine Diags;
+  SourceManager SourceMgr;
+};
+
+TEST_F(FileIDLookupTest, FindsEntriesInAnyOrder) {
+  std::vector<CreatedLoc> Locs = populate(50, 40);
+
+  // In order, in reverse, and at random, so that the lookups go through the
+  // caches, the linear scans and the binary searches.
+  for (unsigned I = 0, E = Locs.size(); I != E; ++I)
+    check(Locs[I]);
+  for (unsigned I = Locs.size(); I != 0; --I)
+    check(Locs[I - 1]);
+  benchmark::IndexSequence Random(Locs.size());
+  for (unsigned I = 0; I != 10000; ++I)
+    check(Locs[Random.next()]);
+}
+
+} // anonymous namespace
@@ -10,8 +10,12 @@
 #include "clang/Basic/FileManager.h"
 #include "clang/Basic/FileSystemOptions.h"
 #include "clang/Basic/FileSystemStatCache.h"
+#include "clang/Basic/VirtualFileSystem.h"
 #include "gtest/gtest.h"
 #include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
 
 using namespace llvm;
 using namespace clang;
@@ -238,4 +242,46 @@ TEST_F(FileManagerTest, getFileReturnsSameFileEntryForAliasedVirtualFiles) {
 
 #endif  // !LLVM_ON_WIN32
 
+// A persisted SharedStatCache must not hide files created after it was saved.
+TEST(SharedStatCacheTest, PersistedResultsAreRevalidated) {
+  SmallString<128> Dir;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("stat-cache-test", Dir));
+  SmallString<128> Header(Dir), CacheFile(Dir);
+  llvm::sys::path::append(Header, "a.h");
+  llvm::sys::path::append(CacheFile, "stats");
+
+  IntrusiveRefCntPtr<vfs::FileSystem> FS = vfs::getRealFileSystem();
+  FileData Data;
+  std::string ErrorStr;
+  {
+    IntrusiveRefCntPtr<SharedStatCache> Cache(new SharedStatCache());
+    EXPECT_EQ(FileSystemStatCache::CacheMissing,
+              Cache->getStat(Header.c_str(), Data, true, nullptr, *FS));
+    EXPECT_EQ(FileSystemStatCache::CacheExists,
+              Cache->getStat(Dir.c_str(), Data, false, nullptr, *FS));
+    EXPECT_TRUE(Data.IsDirectory);
+    EXPECT_TRUE(Cache->writeToFile(CacheFile, ErrorStr)) << ErrorStr;
+  }
+
+  {
+    IntrusiveRefCntPtr<SharedStatCache> Cache(new SharedStatCache());
+    EXPECT_TRUE(Cache->readFromFile(CacheFile, ErrorStr)) << ErrorStr;
+    EXPECT_EQ(FileSystemStatCache::CacheMissing,
+              Cache->getStat(Header.c_str(), Data, true, nullptr, *FS));
+
+    {
+      std::string OutErr;
+      llvm::raw_fd_ostream Out(Header.c_str(), OutErr, llvm::sys::fs::F_None);
+      ASSERT_TRUE(OutErr.empty());
+    }
+    Cache->startGeneration();
+    EXPECT_EQ(FileSystemStatCache::CacheExists,
+              Cache->getStat(Header.c_str(), Data, true, nullptr, *FS));
+  }
+
+  llvm::sys::fs::remove(Header.str());
+  llvm::sys::fs::remove(CacheFile.str());
+  llvm::sys::fs::remove(Dir.str());
+}
+
 } // anonymous namespace
@@ -171,6 +171,82 @@ TEST_F(SourceManagerTest, getColumnNumber) {
   EXPECT_EQ(1U, SourceMgr.getColumnNumber(MainFileID, 0, nullptr));
 }
 
+TEST_F(SourceManagerTest, getLineNumberWithMixedNewlines) {
+  // Lines of many lengths, so that newlines fall at every position of the
+  // 16 byte chunks the line table is computed from, ending with every kind
+  // of newline, and a few embedded nulls. No line is empty, as "\n" followed
+  // by an empty line ending with "\r\n" would read as "\n\r" and "\n".
+  static const char *const Newlines[] = { "\n", "\r\n", "\r", "\n\r" };
+  std::string Source;
+  std::vector<unsigned> LineStarts(1, 0);
+  for (unsigned Line = 0; Line != 200; ++Line) {
+    Source.append(1 + Line % 37, Line % 11 ? 'x' : '\0');
+    Source += Newlines[Line % 4];
+    LineStarts.push_back(Source.size());
+  }
+  Source += "last";
+
+  MemoryBuffer *Buf = MemoryBuffer::getMemBufferCopy(Source);
+  FileID MainFileID = SourceMgr.createFileID(Buf);
+  SourceMgr.setMainFileID(MainFileID);
+
+  for (unsigned Line = 0, E = LineStarts.size(); Line != E; ++Line) {
+    bool Invalid = false;
+    EXPECT_EQ(Line + 1, SourceMgr.getLineNumber(MainFileID, LineStarts[Line],
+                                                &Invalid));
+    EXPECT_FALSE(Invalid);
+    EXPECT_EQ(1U, SourceMgr.getColumnNumber(MainFileID, LineStarts[Line]));
+  }
+  EXPECT_EQ(LineStarts.size(),
+            SourceMgr.getLineNumber(MainFileID, Source.size()));
+  EXPECT_EQ(5U, SourceMgr.getColumnNumber(MainFileID, Source.size()));
+}
+
+TEST_F(SourceManagerTest, foldedExpansionLocations) {
+  const char *Source = "int x; a bc d";
+  MemoryBuffer *Buf = MemoryBuffer::getMemBuffer(Source);
+  FileID MainFileID = SourceMgr.createFileID(Buf);
+  SourceMgr.setMainFileID(MainFileID);
+
+  SourceLocation Start = SourceMgr.getLocForStartOfFile(MainFileID);
+  SourceLocation ExpBegin = Start;
+  SourceLocation ExpEnd = Start.getLocWithOffset(5);
+
+  // "a" and "bc" are lexed into the same expansion and share its entry.
+  SourceLocation First = SourceMgr.createLexedExpansionLoc(
+      Start.getLocWithOffset(7), ExpBegin, ExpEnd, 1);
+  SourceLocation Second = SourceMgr.createLexedExpansionLoc(
+      Start.getLocWithOffset(9), ExpBegin, ExpEnd, 2);
+  ASSERT_TRUE(First.isMacroID());
+  ASSERT_TRUE(Second.isMacroID());
+  EXPECT_EQ(SourceMgr.getFileID(First), SourceMgr.getFileID(Second));
+
+  EXPECT_EQ(Start.getLocWithOffset(7), SourceMgr.getSpellingLoc(First));
+  EXPECT_EQ(Start.getLocWithOffset(9), SourceMgr.getSpellingLoc(Second));
+  std::pair<SourceLocation, SourceLocation> Range =
+      SourceMgr.getImmediateExpansionRange(Second);
+  EXPECT_EQ(ExpBegin, Range.first);
+  EXPECT_EQ(ExpEnd, Range.second);
+
+  // Only the first of the folded tokens starts the entry, and only the last
+  // one ends it.
+  SourceLocation MacroBegin, MacroEnd;
+  EXPECT_TRUE(SourceMgr.isAtStartOfImmediateMacroExpansion(First, &MacroBegin));
+  EXPECT_EQ(ExpBegin, MacroBegin);
+  EXPECT_FALSE(SourceMgr.isAtStartOfImmediateMacroExpansion(Second));
+  EXPECT_FALSE(
+      SourceMgr.isAtEndOfImmediateMacroExpansion(First.getLocWithOffset(1)));
+  EXPECT_TRUE(SourceMgr.isAtEndOfImmediateMacroExpansion(
+      Second.getLocWithOffset(2), &MacroEnd));
+  EXPECT_EQ(ExpEnd, MacroEnd);
+
+  // Other expansions always get an entry of their own.
+  SourceLocation Third = SourceMgr.createExpansionLoc(
+      Start.getLocWithOffset(12), ExpBegin, ExpEnd, 1);
+  EXPECT_NE(SourceMgr.getFileID(Second), SourceMgr.getFileID(Third));
+  EXPECT_TRUE(SourceMgr.isAtStartOfImmediateMacroExpansion(Third));
+}
+
 #if defined(LLVM_ON_UNIX)
 
 TEST_F(SourceManagerTest, getMacroArgExpandedLocation) {
@@ -0,0 +1,70 @@
+//===- unittests/BenchmarkUtils.h - Throughput benchmark helpers ----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file defines helpers shared by the throughput benchmarks of the unit
+//  tests. A benchmark is a test named DISABLED_<Name>Throughput so that it
+//  does not slow down check-clang; run it with
+//    <Tests> --gtest_also_run_disabled_tests --gtest_filter='*Throughput*'
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_UNITTESTS_BENCHMARK_UTILS_H
+#define LLVM_CLANG_UNITTESTS_BENCHMARK_UTILS_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/DataTypes.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace clang {
+namespace benchmark {
+
+/// \brief Runs \p Body once, returning the wall time it took in seconds.
+template <typename Callable> double measureWallTime(Callable Body) {
+  llvm::TimeRecord Start = llvm::TimeRecord::getCurrentTime(true);
+  Body();
+  return llvm::TimeRecord::getCurrentTime(false).getWallTime() -
+         Start.getWallTime();
+}
+
+/// \brief Prints "<Action> <Count> <Units> in <Seconds>s: <Rate> M <Units>/s".
+inline void reportThroughput(llvm::StringRef Action, uint64_t Count,
+                             llvm::StringRef Units, double Seconds) {
+  llvm::outs() << Action << " " << Count << " " << Units << " in "
+               << llvm::format("%.3f", Seconds) << "s: "
+               << llvm::format("%.1f", Count / Seconds / 1e6) << " M "
+               << Units << "/s\n";
+}
+
+/// \brief Prints "<Count> <Operations> in <Seconds>s: <Latency> ns each".
+inline void reportLatency(uint64_t Count, llvm::StringRef Operations,
+                          double Seconds) {
+  llvm::outs() << Count << " " << Operations << " in "
+               << llvm::format("%.3f", Seconds) << "s: "
+               << llvm::format("%.1f", Seconds * 1e9 / Count) << " ns each\n";
+}
+
+/// \brief A deterministic sequence of pseudo-random indices below \p N.
+class IndexSequence {
+  unsigned Seed;
+  unsigned N;
+
+public:
+  explicit IndexSequence(unsigned N) : Seed(12345), N(N) {}
+  unsigned next() {
+    Seed = Seed * 1103515245 + 12345;
+    return (Seed >> 8) % N;
+  }
+};
+
+} // end namespace benchmark
+} // end namespace clang
+
+#endif
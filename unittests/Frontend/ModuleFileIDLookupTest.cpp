@@ -0,0 +1,250 @@
+//===- unittests/Frontend/ModuleFileIDLookupTest.cpp - Loaded FileIDs -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Checks that getFileID finds the local and loaded SLocEntries of a
+// translation unit importing modules, and measures its throughput over a
+// translation unit importing hundreds of modules built from macro-heavy
+// headers, as indexers see them.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../BenchmarkUtils.h"
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Lex/HeaderSearchOptions.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace clang;
+
+namespace {
+
+typedef std::function<void(SourceManager &)> SourceManagerCallback;
+
+/// \brief Hands the SourceManager of the parsed translation unit to a
+/// callback, while the modules it imports are still loaded.
+class SourceManagerAction : public ASTFrontendAction {
+  class Consumer : public ASTConsumer {
+    SourceManagerCallback &Callback;
+
+  public:
+    explicit Consumer(SourceManagerCallback &Callback) : Callback(Callback) {}
+
+    void HandleTranslationUnit(ASTContext &Context) override {
+      Callback(Context.getSourceManager());
+    }
+  };
+
+  SourceManagerCallback Callback;
+
+public:
+  explicit SourceManagerAction(SourceManagerCallback Callback)
+    : Callback(Callback) {}
+
+  ASTConsumer *CreateASTConsumer(CompilerInstance &CI,
+                                 StringRef InFile) override {
+    return new Consumer(Callback);
+  }
+};
+
+/// \brief Returns the location at the start of \p Entry.
+SourceLocation getStartLoc(const SrcMgr::SLocEntry &Entry) {
+  // The raw encoding of a macro location has its top bit set.
+  return SourceLocation::getFromRawEncoding(
+      Entry.getOffset() | (Entry.isExpansion() ? 1U << 31 : 0));
+}
+
+/// \brief Returns the location at the start of every SLocEntry of \p SM,
+/// loading the entries of the imported modules.
+std::vector<SourceLocation> getEntryStartLocs(SourceManager &SM) {
+  std::vector<SourceLocation> Locs;
+  // The first local entry is a sentinel.
+  for (unsigned I = 1, E = SM.local_sloc_entry_size(); I != E; ++I)
+    Locs.push_back(getStartLoc(SM.getLocalSLocEntry(I)));
+  for (unsigned I = 0, E = SM.loaded_sloc_entry_size(); I != E; ++I) {
+    bool Invalid = false;
+    const SrcMgr::SLocEntry &Entry = SM.getLoadedSLocEntry(I, &Invalid);
+    if (!Invalid)
+      Locs.push_back(getStartLoc(Entry));
+  }
+  return Locs;
+}
+
+class ModuleFileIDLookupTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    ASSERT_FALSE(sys::fs::createUniqueDirectory("module-fileid-lookup", Dir));
+  }
+
+  void TearDown() override {
+    // Remove the module cache and the headers, innermost entries first.
+    std::vector<std::string> Entries;
+    std::error_code EC;
+    for (sys::fs::recursive_directory_iterator I(Dir.str(), EC), E;
+         !EC && I != E; I.increment(EC))
+      Entries.push_back(I->path());
+    for (unsigned I = Entries.size(); I != 0; --I)
+      sys::fs::remove(Entries[I - 1]);
+    sys::fs::remove(Dir.str());
+  }
+
+  std::string getPath(StringRef Name) {
+    SmallString<256> Path(Dir);
+    sys::path::append(Path, Name);
+    return Path.str();
+  }
+
+  void writeFile(StringRef Name, StringRef Contents) {
+    std::string ErrorInfo;
+    raw_fd_ostream Out(getPath(Name).c_str(), ErrorInfo, sys::fs::F_None);
+    ASSERT_TRUE(ErrorInfo.empty());
+    Out << Contents;
+  }
+
+  /// \brief Writes \p NumModules modules of \p NumFunctions functions
+  /// expanding macros, each importing one of the previous ones, and a main
+  /// file including all of them and expanding their macros in turn.
+  void writeModules(unsigned NumModules, unsigned NumFunctions) {
+    std::string ModuleMap, Main;
+    for (unsigned M = 0; M != NumModules; ++M) {
+      std::string Name = "m" + utostr(M);
+      std::string Macro = "M" + utostr(M);
+      ModuleMap += "module " + Name + " { header \"" + Name +
+                   ".h\" export * }\n";
+      Main += "#include \"" + Name + ".h\"\n";
+
+      // Import a module of the previous level, so that the modules form a
+      // shallow tree rather than a deep chain of nested module builds.
+      std::string Header;
+      if (M)
+        Header += "#include \"m" + utostr((M - 1) / 2) + ".h\"\n";
+      Header += "#define " + Macro + "_SCALE(x) ((x) * " + utostr(M + 1) +
+                ")\n"
+                "#define " + Macro + "_FIELD(s, f) ((s)->f)\n"
+                "struct " + Name + " { int a; int b; };\n";
+      for (unsigned F = 0; F != NumFunctions; ++F)
+        Header += "static inline int " + Name + "_f" + utostr(F) +
+                  "(struct " + Name + " *s) { return " + Macro + "_SCALE(" +
+                  Macro + "_FIELD(s, a)) + " + Macro + "_FIELD(s, b); }\n";
+      writeFile(Name + ".h", Header);
+    }
+    for (unsigned M = 0; M != NumModules; ++M)
+      Main += "int use" + utostr(M) + "(struct m" + utostr(M) + " *s) { "
+              "return M" + utostr(M) + "_SCALE(m" + utostr(M) + "_f0(s)); }\n";
+    writeFile("module.modulemap", ModuleMap);
+    writeFile("main.c", Main);
+  }
+
+  /// \brief Parses the main file with modules enabled, building them in a
+  /// module cache under the test directory, and calls \p Inspect on the
+  /// SourceManager of the translation unit.
+  bool parseWithModules(SourceManagerCallback Inspect) {
+    CompilerInvocation *Invocation = new CompilerInvocation;
+    Invocation->getLangOpts()->Modules = 1;
+    HeaderSearchOptions &HSOpts = Invocation->getHeaderSearchOpts();
+    HSOpts.UseBuiltinIncludes = false;
+    HSOpts.UseStandardSystemIncludes = false;
+    HSOpts.AddPath(Dir.str(), frontend::Angled, false, false);
+    HSOpts.ModuleCachePath = getPath("cache");
+    Invocation->getFrontendOpts().Inputs.push_back(
+        FrontendInputFile(getPath("main.c"), IK_C));
+    Invocation->getFrontendOpts().ProgramAction = frontend::ParseSyntaxOnly;
+    Invocation->getTargetOpts().Triple = "i386-unknown-linux-gnu";
+    CompilerInstance Compiler;
+    Compiler.setInvocation(Invocation);
+    Compiler.createDiagnostics();
+
+    SourceManagerAction Action(Inspect);
+    return Compiler.ExecuteAction(Action);
+  }
+
+  SmallString<256> Dir;
+};
+
+TEST_F(ModuleFileIDLookupTest, FindsLocalAndLoadedEntries) {
+  writeModules(7, 4);
+  bool Inspected = false;
+  ASSERT_TRUE(parseWithModules([&](SourceManager &SM) {
+    Inspected = true;
+    EXPECT_LT(0U, SM.loaded_sloc_entry_size());
+
+    std::vector<SourceLocation> Locs = getEntryStartLocs(SM);
+    ASSERT_LT(0U, Locs.size());
+    // In order, in reverse, and at random, so that the lookups go through the
+    // caches, the linear scans and the binary searches of both tables.
+    std::vector<unsigned> Order;
+    for (unsigned I = 0, E = Locs.size(); I != E; ++I)
+      Order.push_back(I);
+    for (unsigned I = Locs.size(); I != 0; --I)
+      Order.push_back(I - 1);
+    benchmark::IndexSequence Random(Locs.size());
+    for (unsigned I = 0; I != 10000; ++I)
+      Order.push_back(Random.next());
+
+    for (unsigned I = 0, E = Order.size(); I != E; ++I) {
+      SourceLocation Loc = Locs[Order[I]];
+      std::pair<FileID, unsigned> Decomposed = SM.getDecomposedLoc(Loc);
+      EXPECT_EQ(0U, Decomposed.second);
+      EXPECT_EQ(Loc, getStartLoc(SM.getSLocEntry(Decomposed.first)));
+    }
+  }));
+  EXPECT_TRUE(Inspected);
+}
+
+TEST_F(ModuleFileIDLookupTest, DISABLED_FileIDLookupThroughput) {
+  writeModules(300, 40);
+  ASSERT_TRUE(parseWithModules([&](SourceManager &SM) {
+    std::vector<SourceLocation> Locs = getEntryStartLocs(SM);
+    outs() << Locs.size() << " SLocEntries (" << SM.loaded_sloc_entry_size()
+           << " loaded from modules)\n";
+    const unsigned NumLookups = 4000000;
+
+    // Lookups all over the tables, and lookups going back and forth between
+    // a few entries, as an indexer does between a declaration and its uses.
+    benchmark::IndexSequence Random(Locs.size());
+    std::vector<SourceLocation> Scattered, Clustered;
+    for (unsigned I = 0; I != NumLookups; ++I)
+      Scattered.push_back(Locs[Random.next()]);
+    for (unsigned I = 0; I != NumLookups / 16; ++I) {
+      unsigned Hot[4];
+      for (unsigned J = 0; J != 4; ++J)
+        Hot[J] = Random.next();
+      for (unsigned J = 0; J != 16; ++J)
+        Clustered.push_back(Locs[Hot[J % 4]]);
+    }
+
+    const std::vector<SourceLocation> *Patterns[] = { &Scattered, &Clustered };
+    const char *const Names[] = { "scattered lookups", "clustered lookups" };
+    for (unsigned P = 0; P != 2; ++P) {
+      const std::vector<SourceLocation> &Pattern = *Patterns[P];
+      unsigned NumFound = 0;
+      double Seconds = benchmark::measureWallTime([&] {
+        for (unsigned I = 0, E = Pattern.size(); I != E; ++I)
+          NumFound += SM.getDecomposedLoc(Pattern[I]).first.isValid();
+      });
+      benchmark::reportLatency(Pattern.size(), Names[P], Seconds);
+      EXPECT_EQ(Pattern.size(), NumFound);
+    }
+    SM.PrintStats();
+  }));
+}
+
+} // anonymous namespace
@@ -0,0 +1,185 @@
+//===- unittests/Lex/HeaderTokenCacheTest.cpp - Header token cache --------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Lex/HeaderTokenCache.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/FileSystemOptions.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include <cstring>
+
+using namespace llvm;
+using namespace clang;
+
+namespace {
+
+const char *const GuardedSource = "#ifndef GUARDED_H\n"
+                                  "#define GUARDED_H\n"
+                                  "int guarded = 42;\n"
+                                  "#endif\n";
+
+class HeaderTokenCacheTest : public ::testing::Test {
+protected:
+  HeaderTokenCacheTest()
+    : FileMgr(FileMgrOpts),
+      Buffer(MemoryBuffer::getMemBuffer(GuardedSource)) {
+    File = FileMgr.getVirtualFile("guarded.h", std::strlen(GuardedSource), 0);
+  }
+
+  void SetUp() override {
+    ASSERT_FALSE(sys::fs::createUniqueDirectory("header-token-cache", Dir));
+  }
+
+  void TearDown() override {
+    std::vector<std::string> Entries;
+    std::error_code EC;
+    for (sys::fs::directory_iterator I(Dir.str(), EC), E; !EC && I != E;
+         I.increment(EC))
+      Entries.push_back(I->path());
+    for (unsigned I = 0, E = Entries.size(); I != E; ++I)
+      sys::fs::remove(Entries[I]);
+    sys::fs::remove(Dir.str());
+  }
+
+  /// \brief Fill the cache with the tokens of the header and return the path
+  /// of the only entry.
+  std::string fillCache(std::vector<PreLexedToken> &Tokens) {
+    HeaderTokenCache Cache(Dir, LangOpts);
+    ArrayRef<PreLexedToken> Lexed = Cache.getTokens(File, Buffer.get());
+    EXPECT_EQ(1u, Cache.getNumMisses());
+    Tokens.assign(Lexed.begin(), Lexed.end());
+
+    std::error_code EC;
+    sys::fs::directory_iterator I(Dir.str(), EC);
+    EXPECT_FALSE(EC);
+    return I->path();
+  }
+
+  /// \brief Replace the first token of the cache entry at \p Path.
+  void corruptFirstToken(StringRef Path, const PreLexedToken &Tok) {
+    std::string Data;
+    {
+      ErrorOr<std::unique_ptr<MemoryBuffer>> Entry =
+          MemoryBuffer::getFile(Path);
+      ASSERT_TRUE(bool(Entry));
+      Data = Entry.get()->getBuffer();
+    }
+
+    // The tokens follow a 16-byte header.
+    ASSERT_LE(16 + sizeof(PreLexedToken), Data.size());
+    std::memcpy(&Data[16], &Tok, sizeof(PreLexedToken));
+
+    std::string ErrorInfo;
+    raw_fd_ostream Out(Path.str().c_str(), ErrorInfo, sys::fs::F_None);
+    ASSERT_TRUE(ErrorInfo.empty());
+    Out << Data;
+  }
+
+  /// \brief Whether a new cache rejects the corrupted entry and lexes the
+  /// header again.
+  void expectRejected(ArrayRef<PreLexedToken> Expected) {
+    HeaderTokenCache Cache(Dir, LangOpts);
+    ArrayRef<PreLexedToken> Tokens = Cache.getTokens(File, Buffer.get());
+    EXPECT_EQ(0u, Cache.getNumHits());
+    EXPECT_EQ(1u, Cache.getNumMisses());
+    ASSERT_EQ(Expected.size(), Tokens.size());
+    EXPECT_EQ(Expected[0].Offset, Tokens[0].Offset);
+    EXPECT_EQ(Expected[0].Kind, Tokens[0].Kind);
+  }
+
+  SmallString<128> Dir;
+  FileSystemOptions FileMgrOpts;
+  FileManager FileMgr;
+  LangOptions LangOpts;
+  std::unique_ptr<MemoryBuffer> Buffer;
+  const FileEntry *File;
+};
+
+TEST_F(HeaderTokenCacheTest, ReusesEntries) {
+  std::vector<PreLexedToken> Tokens;
+  fillCache(Tokens);
+  ASSERT_FALSE(Tokens.empty());
+
+  HeaderTokenCache Cache(Dir, LangOpts);
+  EXPECT_EQ(Tokens.size(), Cache.getTokens(File, Buffer.get()).size());
+  EXPECT_EQ(1u, Cache.getNumHits());
+  EXPECT_EQ(0u, Cache.getNumMisses());
+}
+
+TEST_F(HeaderTokenCacheTest, RejectsTokensPastTheBuffer) {
+  std::vector<PreLexedToken> Tokens;
+  std::string Path = fillCache(Tokens);
+  ASSERT_FALSE(Tokens.empty());
+
+  PreLexedToken Tok = Tokens[0];
+  Tok.Length = std::strlen(GuardedSource) - Tok.Offset + 1;
+  corruptFirstToken(Path, Tok);
+  expectRejected(Tokens);
+}
+
+TEST_F(HeaderTokenCacheTest, RejectsTokensBeforeTheirGap) {
+  std::vector<PreLexedToken> Tokens;
+  std::string Path = fillCache(Tokens);
+  ASSERT_LT(1u, Tokens.size());
+
+  // The first token ends after the second one begins.
+  PreLexedToken Tok = Tokens[0];
+  Tok.Length = Tokens[1].Offset - Tok.Offset + 1;
+  corruptFirstToken(Path, Tok);
+  expectRejected(Tokens);
+
+  Tok = Tokens[0];
+  Tok.GapStart = Tok.Offset + 1;
+  corruptFirstToken(Path, Tok);
+  expectRejected(Tokens);
+}
+
+TEST_F(HeaderTokenCacheTest, RejectsUnknownTokenKinds) {
+  std::vector<PreLexedToken> Tokens;
+  std::string Path = fillCache(Tokens);
+  ASSERT_FALSE(Tokens.empty());
+
+  PreLexedToken Tok = Tokens[0];
+  Tok.Kind = tok::NUM_TOKENS;
+  corruptFirstToken(Path, Tok);
+  expectRejected(Tokens);
+}
+
+TEST_F(HeaderTokenCacheTest, RejectsTokensSpelledUnlikeTheirKind) {
+  std::vector<PreLexedToken> Tokens;
+  std::string Path = fillCache(Tokens);
+  ASSERT_FALSE(Tokens.empty());
+  ASSERT_EQ(tok::raw_identifier, Tokens[0].Kind);
+
+  // The raw lexer never keeps these, whatever their spelling.
+  const tok::TokenKind NeverLexed[] = { tok::eof, tok::eod,
+                                        tok::code_completion, tok::identifier,
+                                        tok::annot_typename };
+  for (unsigned I = 0; I != llvm::array_lengthof(NeverLexed); ++I) {
+    PreLexedToken Tok = Tokens[0];
+    Tok.Kind = NeverLexed[I];
+    corruptFirstToken(Path, Tok);
+    expectRejected(Tokens);
+  }
+
+  // "int" is neither a semicolon nor a number.
+  PreLexedToken Tok = Tokens[0];
+  Tok.Kind = tok::semi;
+  corruptFirstToken(Path, Tok);
+  expectRejected(Tokens);
+
+  Tok.Kind = tok::numeric_constant;
+  corruptFirstToken(Path, Tok);
+  expectRejected(Tokens);
+}
+
+} // anonymous namespace
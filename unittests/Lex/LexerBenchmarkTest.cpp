@@ -0,0 +1,117 @@
+//===- unittests/Lex/LexerBenchmarkTest.cpp - Raw lexing throughput -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Checks that identifiers and numbers of all lengths are lexed correctly by
+// the vectorized paths of the lexer, and measures raw lexing throughput on a
+// large generated header.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../BenchmarkUtils.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/SourceLocation.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace clang;
+
+namespace {
+
+/// Raw-lexes \p Source, returning its tokens.
+std::vector<Token> rawLex(StringRef Source, const LangOptions &LangOpts) {
+  Lexer L(SourceLocation(), LangOpts, Source.begin(), Source.begin(),
+          Source.end());
+  std::vector<Token> Tokens;
+  Token Tok;
+  while (!L.LexFromRawLexer(Tok))
+    Tokens.push_back(Tok);
+  if (Tok.isNot(tok::eof))
+    Tokens.push_back(Tok);
+  return Tokens;
+}
+
+/// Generates a header of roughly \p Size bytes of declarations with
+/// identifiers and numbers of varying lengths.
+std::string makeHeader(unsigned Size) {
+  std::string Header;
+  for (unsigned I = 0; Header.size() < Size; ++I) {
+    std::string Suffix = std::string(I % 23, 'x') + utostr(I);
+    Header += "static inline unsigned long long function_" + Suffix +
+              "(const struct Argument_type *arg, double scale_factor) {\n"
+              "  return arg->member_" + Suffix + " * 0x1234abcdULL + " +
+              utostr(I) + ".5e+10 * scale_factor;\n"
+              "}\n";
+  }
+  return Header;
+}
+
+TEST(LexerBenchmarkTest, LexesIdentifiersAndNumbersOfAllLengths) {
+  LangOptions LangOpts;
+  for (unsigned Length = 1; Length != 70; ++Length) {
+    std::string Identifier = "_" + std::string(Length - 1, 'a');
+    for (unsigned I = 1; I < Length; I += 7)
+      Identifier[I] = "Z9_"[I % 3];
+    std::string Number = "1" + std::string(Length - 1, '0') + ".5e+3f";
+    std::string Source = Identifier + "+" + Number + " " + Identifier;
+
+    std::vector<Token> Tokens = rawLex(Source, LangOpts);
+    ASSERT_EQ(4u, Tokens.size());
+    EXPECT_EQ(tok::raw_identifier, Tokens[0].getKind());
+    EXPECT_EQ(Identifier, Tokens[0].getRawIdentifier().str());
+    EXPECT_EQ(tok::plus, Tokens[1].getKind());
+    EXPECT_EQ(tok::numeric_constant, Tokens[2].getKind());
+    EXPECT_EQ(Number.size(), Tokens[2].getLength());
+    EXPECT_EQ(tok::raw_identifier, Tokens[3].getKind());
+    EXPECT_EQ(Identifier.size(), Tokens[3].getLength());
+  }
+}
+
+TEST(LexerBenchmarkTest, LexesEscapedNewlinesInIdentifiersAndNumbers) {
+  LangOptions LangOpts;
+  std::vector<Token> Tokens =
+      rawLex("abcdefghijklmnopqrstuvwxyz\\\nABC 123456789012345678\\\n90e\\\n+5",
+             LangOpts);
+  ASSERT_EQ(2u, Tokens.size());
+  EXPECT_EQ(tok::raw_identifier, Tokens[0].getKind());
+  EXPECT_TRUE(Tokens[0].needsCleaning());
+  EXPECT_EQ(31u, Tokens[0].getLength());
+  EXPECT_EQ(tok::numeric_constant, Tokens[1].getKind());
+  EXPECT_TRUE(Tokens[1].needsCleaning());
+  EXPECT_EQ(27u, Tokens[1].getLength());
+}
+
+TEST(LexerBenchmarkTest, DISABLED_RawLexThroughput) {
+  LangOptions LangOpts;
+  LangOpts.CPlusPlus = true;
+  std::string Header = makeHeader(16 << 20);
+
+  const unsigned Iterations = 10;
+  uint64_t NumTokens = 0;
+  double Seconds = benchmark::measureWallTime([&] {
+    for (unsigned I = 0; I != Iterations; ++I) {
+      Lexer L(SourceLocation(), LangOpts, Header.data(), Header.data(),
+              Header.data() + Header.size());
+      Token Tok;
+      while (!L.LexFromRawLexer(Tok))
+        ++NumTokens;
+    }
+  });
+
+  benchmark::reportThroughput("Lexed", NumTokens, "tokens", Seconds);
+  benchmark::reportThroughput("Lexed", uint64_t(Header.size()) * Iterations,
+                              "bytes", Seconds);
+  EXPECT_GT(NumTokens, 0u);
+}
+
+} // anonymous namespace
@@ -0,0 +1,191 @@
+//===- unittests/Lex/MacroExpansionBenchmarkTest.cpp - Macro expansion ----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Checks the expansion of function-like macros with many arguments used many
+// times, and measures the expansion throughput on generated X-macro tables
+// and repetition macros in the style of Boost.Preprocessor.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../BenchmarkUtils.h"
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Basic/TargetInfo.h"
+#include "clang/Basic/TargetOptions.h"
+#include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/HeaderSearchOptions.h"
+#include "clang/Lex/ModuleLoader.h"
+#include "clang/Lex/Preprocessor.h"
+#include "clang/Lex/PreprocessorOptions.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "gtest/gtest.h"
+#include <string>
+
+using namespace llvm;
+using namespace clang;
+
+namespace {
+
+class VoidModuleLoader : public ModuleLoader {
+  ModuleLoadResult loadModule(SourceLocation ImportLoc,
+                              ModuleIdPath Path,
+                              Module::NameVisibilityKind Visibility,
+                              bool IsInclusionDirective) override {
+    return ModuleLoadResult();
+  }
+
+  void makeModuleVisible(Module *Mod,
+                         Module::NameVisibilityKind Visibility,
+                         SourceLocation ImportLoc,
+                         bool Complain) override { }
+
+  GlobalModuleIndex *loadGlobalModuleIndex(SourceLocation TriggerLoc) override
+    { return nullptr; }
+  bool lookupMissingImports(StringRef Name, SourceLocation TriggerLoc) override
+    { return 0; };
+};
+
+class MacroExpansionTest : public ::testing::Test {
+protected:
+  MacroExpansionTest()
+    : FileMgr(FileMgrOpts),
+      DiagID(new DiagnosticIDs()),
+      Diags(DiagID, new DiagnosticOptions, new IgnoringDiagConsumer()),
+      SourceMgr(Diags, FileMgr),
+      TargetOpts(new TargetOptions) {
+    TargetOpts->Triple = "x86_64-apple-darwin11.1.0";
+    Target = TargetInfo::CreateTargetInfo(Diags, TargetOpts);
+  }
+
+  /// \brief Preprocesses \p Source, returning the number of tokens and, if
+  /// \p Spelling is given, their spellings separated by spaces.
+  unsigned preprocess(StringRef Source, std::string *Spelling = nullptr) {
+    MemoryBuffer *Buf = MemoryBuffer::getMemBufferCopy(Source);
+    SourceMgr.setMainFileID(SourceMgr.createFileID(Buf));
+
+    VoidModuleLoader ModLoader;
+    HeaderSearch HeaderInfo(new HeaderSearchOptions, SourceMgr, Diags, LangOpts,
+                            Target.get());
+    Preprocessor PP(new PreprocessorOptions(), Diags, LangOpts, SourceMgr,
+                    HeaderInfo, ModLoader, /*IILookup =*/nullptr,
+                    /*OwnsHeaderSearch =*/false);
+    PP.Initialize(*Target);
+    PP.EnterMainSourceFile();
+
+    unsigned NumTokens = 0;
+    Token Tok;
+    for (PP.Lex(Tok); Tok.isNot(tok::eof); PP.Lex(Tok)) {
+      ++NumTokens;
+      if (Spelling) {
+        if (!Spelling->empty())
+          *Spelling += ' ';
+        *Spelling += PP.getSpelling(Tok);
+      }
+    }
+    return NumTokens;
+  }
+
+  std::string expand(StringRef Source) {
+    std::string Spelling;
+    preprocess(Source, &Spelling);
+    return Spelling;
+  }
+
+  FileSystemOptions FileMgrOpts;
+  FileManager FileMgr;
+  IntrusiveRefCntPtr<DiagnosticIDs> DiagID;
+  DiagnosticsEngine Diags;
+  SourceManager SourceMgr;
+  LangOptions LangOpts;
+  std::shared_ptr<TargetOptions> TargetOpts;
+  IntrusiveRefCntPtr<TargetInfo> Target;
+};
+
+TEST_F(MacroExpansionTest, ManyArgumentsUsedManyTimes) {
+  // #define REV(a0, ..., a39) a39 ... a0 a0 ... a39
+  std::string Params, Reversed, Forward, Args, Expected, ExpectedTail;
+  for (unsigned I = 0; I != 40; ++I) {
+    Params += (I ? ", a" : "a") + utostr(I);
+    Reversed = "a" + utostr(I) + (I ? " " : "") + Reversed;
+    Forward += " a" + utostr(I);
+    Args += (I ? ", x" : "x") + utostr(I);
+    Expected = "x" + utostr(I) + (I ? " " : "") + Expected;
+    ExpectedTail += " x" + utostr(I);
+  }
+  EXPECT_EQ(Expected + ExpectedTail,
+            expand("#define REV(" + Params + ") " + Reversed + Forward + "\n"
+                   "REV(" + Args + ")\n"));
+}
+
+TEST_F(MacroExpansionTest, MixesExpandedAndUnexpandedArguments) {
+  EXPECT_EQ("1 y Xy \"X\" y 1",
+            expand("#define X 1\n"
+                   "#define F(a, b) a b a ## b #a b a\n"
+                   "F(X, y)\n"));
+}
+
+TEST_F(MacroExpansionTest, NestedExpansionsReuseArguments) {
+  EXPECT_EQ("( ( ( 1 , 1 ) , ( 1 , 1 ) ) , ( ( 1 , 1 ) , ( 1 , 1 ) ) )",
+            expand("#define ONE 1\n"
+                   "#define P(x) (x, x)\n"
+                   "#define P2(x) P(P(x))\n"
+                   "#define P3(x) P(P2(x))\n"
+                   "P3(ONE)\n"));
+}
+
+/// \brief Generates an X-macro table of \p NumRows rows with four columns,
+/// expanded three times, and a nest of repetition macros.
+std::string makeMacroHeavySource(unsigned NumRows) {
+  std::string Source = "#define TABLE(X) \\\n";
+  for (unsigned I = 0; I != NumRows; ++I)
+    Source += "  X(name_" + utostr(I) + ", " + utostr(I) +
+              ", type_" + utostr(I % 7) + ", \"description " + utostr(I) +
+              "\") \\\n";
+  Source += "\n"
+            "#define ENUM(n, v, t, d) n = v,\n"
+            "#define DECL(n, v, t, d) extern t n##_value;\n"
+            "#define ENTRY(n, v, t, d) { v, #n, d, sizeof(t) },\n"
+            "enum { TABLE(ENUM) };\n"
+            "TABLE(DECL)\n"
+            "struct entry entries[] = { TABLE(ENTRY) };\n"
+            "#define CAT(a, b) CAT_I(a, b)\n"
+            "#define CAT_I(a, b) a ## b\n"
+            "#define REP0(m, d)\n"
+            "#define REP1(m, d) REP0(m, d) m(0, d)\n"
+            "#define REP2(m, d) REP1(m, d) m(1, d)\n"
+            "#define REP3(m, d) REP2(m, d) m(2, d)\n"
+            "#define REP4(m, d) REP3(m, d) m(3, d)\n"
+            "#define REP5(m, d) REP4(m, d) m(4, d)\n"
+            "#define REP6(m, d) REP5(m, d) m(5, d)\n"
+            "#define REP7(m, d) REP6(m, d) m(6, d)\n"
+            "#define REP8(m, d) REP7(m, d) m(7, d)\n"
+            "#define REP(n, m, d) CAT(REP, n)(m, d)\n"
+            "#define PARAMS(d) int CAT(d, 0), int CAT(d, 1), int CAT(d, 2)\n"
+            "#define FN(i, d) void CAT(f, i)(PARAMS(CAT(d, i)));\n";
+  for (unsigned I = 0; I != NumRows / 8; ++I)
+    Source += "REP(8, FN, p" + utostr(I) + "_)\n";
+  return Source;
+}
+
+TEST_F(MacroExpansionTest, DISABLED_MacroExpansionThroughput) {
+  std::string Source = makeMacroHeavySource(20000);
+
+  unsigned NumTokens = 0;
+  double Seconds =
+      benchmark::measureWallTime([&] { NumTokens = preprocess(Source); });
+
+  benchmark::reportThroughput("Expanded", NumTokens, "tokens", Seconds);
+  EXPECT_GT(NumTokens, 0u);
+}
+
+} // anonymous namespace
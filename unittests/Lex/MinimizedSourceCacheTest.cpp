@@ -0,0 +1,186 @@
+//===- unittests/Lex/MinimizedSourceCacheTest.cpp - Minimized sources -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "clang/Lex/MinimizedSourceCache.h"
+#include "llvm/Support/Errc.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "gtest/gtest.h"
+#include <map>
+
+using namespace llvm;
+using namespace clang;
+
+namespace {
+
+std::string minimize(StringRef Source) {
+  std::unique_ptr<MemoryBuffer> Buffer(MemoryBuffer::getMemBuffer(Source));
+  SmallVector<char, 128> Output;
+  LangOptions LangOpts;
+  LangOpts.CPlusPlus = LangOpts.CPlusPlus11 = LangOpts.LineComment = true;
+  minimizeSourceToDirectives(*Buffer, LangOpts, Output);
+  return std::string(Output.begin(), Output.end());
+}
+
+TEST(MinimizeSourceTest, KeepsOnlyDirectives) {
+  EXPECT_EQ("#include \"a.h\"\n"
+            "           \n"
+            "  #  define X 1\n",
+            minimize("#include \"a.h\"\n"
+                     "int x = 42;\n"
+                     "  #  define X 1\n"));
+}
+
+TEST(MinimizeSourceTest, KeepsContinuedDirectives) {
+  EXPECT_EQ("#define F(x) \\\n"
+            "  (x + 1)\n"
+            "          \n"
+            "#if A /* multi\n"
+            "line */ && B\n",
+            minimize("#define F(x) \\\n"
+                     "  (x + 1)\n"
+                     "int y = 0;\n"
+                     "#if A /* multi\n"
+                     "line */ && B\n"));
+}
+
+TEST(MinimizeSourceTest, IgnoresHashesOutsideDirectives) {
+  StringRef Source = "/*\n"
+                     "#include \"x.h\"\n"
+                     "*/\n"
+                     "int z = a # b;\n"
+                     "auto r = R\"(\n#if 0)\";\n"
+                     "#endif\n";
+  std::string Minimized = minimize(Source);
+  EXPECT_EQ(Source.size(), Minimized.size());
+  EXPECT_EQ(Source.count('\n'), StringRef(Minimized).count('\n'));
+  EXPECT_EQ(1u, StringRef(Minimized).count('#'));
+  EXPECT_TRUE(StringRef(Minimized).endswith("\n#endif\n"));
+}
+
+/// \brief A file system serving files from memory.
+class MemoryFileSystem : public vfs::FileSystem {
+  struct MemoryFile : public vfs::File {
+    vfs::Status S;
+    StringRef Contents;
+
+    MemoryFile(const vfs::Status &S, StringRef Contents)
+      : S(S), Contents(Contents) {}
+    ErrorOr<vfs::Status> status() override { return S; }
+    std::error_code getBuffer(const Twine &Name,
+                              std::unique_ptr<MemoryBuffer> &Result,
+                              int64_t FileSize, bool RequiresNullTerminator,
+                              bool IsVolatile) override {
+      Result.reset(MemoryBuffer::getMemBufferCopy(Contents, Name.str()));
+      return std::error_code();
+    }
+    std::error_code close() override { return std::error_code(); }
+    void setName(StringRef Name) override { S.setName(Name); }
+  };
+
+  std::map<std::string, std::pair<vfs::Status, std::string>> Files;
+
+public:
+  void addFile(StringRef Path, StringRef Contents,
+               sys::TimeValue ModTime = sys::TimeValue(0, 0)) {
+    auto Known = Files.find(Path);
+    sys::fs::UniqueID ID = Known != Files.end()
+                               ? Known->second.first.getUniqueID()
+                               : sys::fs::UniqueID(0, Files.size());
+    vfs::Status S(Path, Path, ID, ModTime, 0, 0,
+                  Contents.size(), sys::fs::file_type::regular_file,
+                  sys::fs::all_all);
+    Files[Path] = std::make_pair(S, Contents.str());
+  }
+
+  ErrorOr<vfs::Status> status(const Twine &Path) override {
+    auto Known = Files.find(Path.str());
+    if (Known == Files.end())
+      return make_error_code(llvm::errc::no_such_file_or_directory);
+    return Known->second.first;
+  }
+  std::error_code openFileForRead(const Twine &Path,
+                                  std::unique_ptr<vfs::File> &Result) override {
+    auto Known = Files.find(Path.str());
+    if (Known == Files.end())
+      return make_error_code(llvm::errc::no_such_file_or_directory);
+    Result.reset(new MemoryFile(Known->second.first, Known->second.second));
+    return std::error_code();
+  }
+  vfs::directory_iterator dir_begin(const Twine &Dir,
+                                    std::error_code &EC) override {
+    EC = make_error_code(llvm::errc::operation_not_permitted);
+    return vfs::directory_iterator();
+  }
+};
+
+std::string readFile(vfs::FileSystem &FS, StringRef Path) {
+  std::unique_ptr<MemoryBuffer> Buffer;
+  if (FS.getBufferForFile(Path, Buffer))
+    return "<error>";
+  return Buffer->getBuffer();
+}
+
+TEST(MinimizingFileSystemTest, SharesMinimizedFiles) {
+  IntrusiveRefCntPtr<MemoryFileSystem> Base(new MemoryFileSystem());
+  Base->addFile("/a.h", "#define A\nint a;\n");
+  Base->addFile("/module.modulemap", "module A { header \"a.h\" }\n");
+
+  IntrusiveRefCntPtr<MinimizedSourceCache> Cache(
+      new MinimizedSourceCache(LangOptions()));
+  IntrusiveRefCntPtr<vfs::FileSystem> FS1(
+      new MinimizingFileSystem(Base, Cache));
+  IntrusiveRefCntPtr<vfs::FileSystem> FS2(
+      new MinimizingFileSystem(Base, Cache));
+
+  EXPECT_EQ("#define A\n      \n", readFile(*FS1, "/a.h"));
+  EXPECT_EQ("#define A\n      \n", readFile(*FS2, "/a.h"));
+  EXPECT_EQ(1u, Cache->getNumMinimized());
+  EXPECT_EQ(1u, Cache->getNumReused());
+
+  // Files which are not C family sources are left alone.
+  EXPECT_EQ("module A { header \"a.h\" }\n",
+            readFile(*FS1, "/module.modulemap"));
+  EXPECT_EQ(1u, Cache->getNumMinimized());
+
+  // A modified file is minimized again.
+  Base->addFile("/a.h", "#define B\nint b;\n", sys::TimeValue(1, 0));
+  EXPECT_EQ("#define B\n      \n", readFile(*FS2, "/a.h"));
+  EXPECT_EQ(2u, Cache->getNumMinimized());
+
+  ErrorOr<vfs::Status> Status = FS1->status("/a.h");
+  ASSERT_TRUE(bool(Status));
+  EXPECT_EQ(17u, Status->getSize());
+}
+
+TEST(MinimizingFileSystemTest, ComparesContentsOfRecentlyModifiedFiles) {
+  // The file is modified in the second it is read in, and again without
+  // changing its size or modification time.
+  sys::TimeValue ModTime =
+      sys::TimeValue::now() + sys::TimeValue(/*seconds=*/60, 0);
+  IntrusiveRefCntPtr<MemoryFileSystem> Base(new MemoryFileSystem());
+  Base->addFile("/a.h", "#define A\nint a;\n", ModTime);
+
+  IntrusiveRefCntPtr<MinimizedSourceCache> Cache(
+      new MinimizedSourceCache(LangOptions()));
+  IntrusiveRefCntPtr<vfs::FileSystem> FS(new MinimizingFileSystem(Base, Cache));
+
+  EXPECT_EQ("#define A\n      \n", readFile(*FS, "/a.h"));
+  EXPECT_EQ(1u, Cache->getNumMinimized());
+
+  // Unchanged contents are reused after comparing them.
+  EXPECT_EQ("#define A\n      \n", readFile(*FS, "/a.h"));
+  EXPECT_EQ(1u, Cache->getNumMinimized());
+  EXPECT_EQ(1u, Cache->getNumReused());
+
+  Base->addFile("/a.h", "#define B\nint b;\n", ModTime);
+  EXPECT_EQ("#define B\n      \n", readFile(*FS, "/a.h"));
+  EXPECT_EQ(2u, Cache->getNumMinimized());
+}
+
+} // anonymous namespace
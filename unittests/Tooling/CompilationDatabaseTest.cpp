@@ -11,11 +11,16 @@
 #include "clang/AST/DeclCXX.h"
 #include "clang/AST/DeclGroup.h"
 #include "clang/Frontend/FrontendAction.h"
+#include "clang/Tooling/BinaryCompilationDatabase.h"
 #include "clang/Tooling/FileMatchTrie.h"
 #include "clang/Tooling/JSONCompilationDatabase.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
 #include "gtest/gtest.h"
+#include <algorithm>
 
 namespace clang {
 namespace tooling {
@@ -270,6 +275,32 @@ TEST(findCompileArgsInJsonDatabase, ReadsDirectoryWithSpaces) {
   EXPECT_EQ(Directory, FoundCommand.Directory) << ErrorMessage;
 }
 
+TEST(findCompileArgsInJsonDatabase, UnescapesDirectory) {
+  StringRef FileName("//net/path/to/a-file.cpp");
+  std::string ErrorMessage;
+  CompileCommand FoundCommand = findCompileArgsInJsonDatabase(
+    FileName,
+    "[{\"directory\":\"//net/a\\\"b\\\\c\\/d\\te\","
+      "\"command\":\"a command\","
+      "\"file\":\"//net/path/to/a-file.cpp\"}]",
+    ErrorMessage);
+  EXPECT_EQ("//net/a\"b\\c/d\te", FoundCommand.Directory) << ErrorMessage;
+}
+
+TEST(findCompileArgsInJsonDatabase, UnescapesUnicodeDirectory) {
+  StringRef FileName("//net/path/to/a-file.cpp");
+  std::string ErrorMessage;
+  // U+00E9, U+20AC, U+1F600 as a surrogate pair, and an unpaired surrogate.
+  CompileCommand FoundCommand = findCompileArgsInJsonDatabase(
+    FileName,
+    "[{\"directory\":\"//net/\\u00e9\\u20AC\\ud83d\\ude00\\ud800x\","
+      "\"command\":\"a command\","
+      "\"file\":\"//net/path/to/a-file.cpp\"}]",
+    ErrorMessage);
+  EXPECT_EQ("//net/\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\xef\xbf\xbdx",
+            FoundCommand.Directory) << ErrorMessage;
+}
+
 TEST(findCompileArgsInJsonDatabase, FindsEntry) {
   StringRef Directory("//net/directory");
   StringRef FileName("file");
@@ -397,6 +428,116 @@ TEST(unescapeJsonCommandLine, ParsesSingleQuotedString) {
   EXPECT_EQ("a\\b \"c\"", Args[0]);
 }
 
+TEST(BinaryCompilationDatabase, RoundTripsJSONDatabase) {
+  std::string ErrorMessage;
+  std::unique_ptr<CompilationDatabase> JSONDatabase(
+      JSONCompilationDatabase::loadFromBuffer(
+          "[{\"directory\":\"//net/dir\","
+            "\"command\":\"clang++ -DA 'with space' file1\","
+            "\"file\":\"file1\"},"
+          " {\"directory\":\"//net/dir\","
+            "\"command\":\"clang++ -DB file1\","
+            "\"file\":\"file1\"},"
+          " {\"directory\":\"//net/other\","
+            "\"command\":\"clang++ file2\","
+            "\"file\":\"//net/dir/file2\"}]",
+          ErrorMessage));
+  ASSERT_TRUE(JSONDatabase) << ErrorMessage;
+
+  SmallString<128> BinaryPath;
+  ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("compile_commands", "bin",
+                                                  BinaryPath));
+  ASSERT_TRUE(BinaryCompilationDatabase::writeToFile(*JSONDatabase, BinaryPath,
+                                                     ErrorMessage))
+      << ErrorMessage;
+  std::unique_ptr<CompilationDatabase> Database(
+      BinaryCompilationDatabase::loadFromFile(BinaryPath, ErrorMessage));
+  llvm::sys::fs::remove(BinaryPath.str());
+  ASSERT_TRUE(Database) << ErrorMessage;
+
+  SmallString<16> File1, File2;
+  llvm::sys::path::native("//net/dir/file1", File1);
+  llvm::sys::path::native("//net/dir/file2", File2);
+  std::vector<std::string> Files = Database->getAllFiles();
+  std::sort(Files.begin(), Files.end());
+  ASSERT_EQ(2u, Files.size());
+  EXPECT_EQ(File1.str(), Files[0]);
+  EXPECT_EQ(File2.str(), Files[1]);
+  EXPECT_EQ(3u, Database->getAllCompileCommands().size());
+
+  std::vector<CompileCommand> Commands = Database->getCompileCommands(File1);
+  ASSERT_EQ(2u, Commands.size());
+  EXPECT_EQ("//net/dir", Commands[0].Directory);
+  ASSERT_EQ(4u, Commands[0].CommandLine.size());
+  EXPECT_EQ("with space", Commands[0].CommandLine[2]);
+  EXPECT_EQ("-DB", Commands[1].CommandLine[1]);
+
+  Commands = Database->getCompileCommands(File2);
+  ASSERT_EQ(1u, Commands.size());
+  EXPECT_EQ("//net/other", Commands[0].Directory);
+
+  EXPECT_TRUE(Database->getCompileCommands("//net/dir/file3").empty());
+}
+
+TEST(BinaryCompilationDatabase, RejectsTruncatedDatabase) {
+  SmallString<128> BinaryPath;
+  int FD;
+  ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("compile_commands", "bin",
+                                                  FD, BinaryPath));
+  {
+    // A valid header whose hash table is cut off.
+    llvm::raw_fd_ostream Out(FD, /*shouldClose=*/true);
+    Out.write("CCDB\x01\0\0\0\x0c\0\0\0\x04\0\0\0", 16);
+  }
+  std::string ErrorMessage;
+  std::unique_ptr<CompilationDatabase> Database(
+      BinaryCompilationDatabase::loadFromFile(BinaryPath, ErrorMessage));
+  llvm::sys::fs::remove(BinaryPath.str());
+  EXPECT_FALSE(Database);
+  EXPECT_EQ("Malformed binary compilation database.", ErrorMessage);
+}
+
+TEST(BinaryCompilationDatabase, RejectsLengthsPastTheTable) {
+  std::string ErrorMessage;
+  std::unique_ptr<CompilationDatabase> JSONDatabase(
+      JSONCompilationDatabase::loadFromBuffer(
+          "[{\"directory\":\"//net/dir\","
+            "\"command\":\"clang++ file1\","
+            "\"file\":\"file1\"}]",
+          ErrorMessage));
+  ASSERT_TRUE(JSONDatabase) << ErrorMessage;
+
+  SmallString<128> BinaryPath;
+  ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("compile_commands", "bin",
+                                                  BinaryPath));
+  ASSERT_TRUE(BinaryCompilationDatabase::writeToFile(*JSONDatabase, BinaryPath,
+                                                     ErrorMessage))
+      << ErrorMessage;
+  std::string Contents;
+  {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buffer =
+        llvm::MemoryBuffer::getFile(BinaryPath);
+    ASSERT_TRUE(bool(Buffer));
+    Contents = Buffer.get()->getBuffer();
+  }
+
+  // The only item follows the header and the number of items of its bucket;
+  // its key length comes after its hash.
+  ASSERT_LT(22u, Contents.size());
+  Contents.replace(18, 4, "\xff\xff\xff\x7f");
+  {
+    std::string WriteError;
+    llvm::raw_fd_ostream Out(BinaryPath.c_str(), WriteError,
+                             llvm::sys::fs::F_None);
+    Out << Contents;
+  }
+  std::unique_ptr<CompilationDatabase> Database(
+      BinaryCompilationDatabase::loadFromFile(BinaryPath, ErrorMessage));
+  llvm::sys::fs::remove(BinaryPath.str());
+  EXPECT_FALSE(Database);
+  EXPECT_EQ("Malformed binary compilation database.", ErrorMessage);
+}
+
 TEST(FixedCompilationDatabase, ReturnsFixedCommandLine) {
   std::vector<std::string> CommandLine;
   CommandLine.push_back("one");
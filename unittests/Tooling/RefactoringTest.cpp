@@ -271,6 +271,69 @@ TEST_F(FlushRewrittenFilesTest, StoresChangesOnDisk) {
             getFileContentFromDisk("input.cpp"));
 }
 
+TEST_F(FlushRewrittenFilesTest, AppliesReplacementsToFiles) {
+  createFile("a.cpp", "line1\nline2\nline3\n");
+  createFile("b.cpp", "int x;\n");
+  createFile("conflict.cpp", "unchanged\n");
+  std::string A = TemporaryFiles.lookup("a.cpp");
+  std::string B = TemporaryFiles.lookup("b.cpp");
+  std::string Conflict = TemporaryFiles.lookup("conflict.cpp");
+
+  Replacements Replaces;
+  Replaces.insert(Replacement(A, 6, 5, "replaced"));
+  Replaces.insert(Replacement(A, 6, 5, "replaced"));
+  Replaces.insert(Replacement(A, 0, 0, "// "));
+  Replaces.insert(Replacement(B, 4, 1, "y"));
+  Replaces.insert(Replacement(Conflict, 0, 5, "a"));
+  Replaces.insert(Replacement(Conflict, 2, 5, "b"));
+
+  std::string Errors;
+  llvm::raw_string_ostream ErrorStream(Errors);
+  EXPECT_FALSE(
+      applyAllReplacementsToFiles(Replaces, Context.Files, 2, ErrorStream));
+  ErrorStream.flush();
+  EXPECT_NE(std::string::npos, Errors.find("conflicting replacements"));
+
+  EXPECT_EQ("// line1\nreplaced\nline3\n", getFileContentFromDisk("a.cpp"));
+  EXPECT_EQ("int y;\n", getFileContentFromDisk("b.cpp"));
+  EXPECT_EQ("unchanged\n", getFileContentFromDisk("conflict.cpp"));
+}
+
+TEST_F(FlushRewrittenFilesTest, ResolvesRelativePathsInFileManager) {
+  createFile("relative.cpp", "int x;\n");
+  StringRef Path = TemporaryFiles.lookup("relative.cpp");
+
+  FileSystemOptions FileSystemOpts;
+  FileSystemOpts.WorkingDir = llvm::sys::path::parent_path(Path);
+  FileManager Files(FileSystemOpts);
+  Replacements Replaces;
+  Replaces.insert(Replacement(llvm::sys::path::filename(Path), 4, 1, "y"));
+
+  std::string Errors;
+  llvm::raw_string_ostream ErrorStream(Errors);
+  EXPECT_TRUE(applyAllReplacementsToFiles(Replaces, Files, 1, ErrorStream));
+  EXPECT_EQ("", ErrorStream.str());
+  EXPECT_EQ("int y;\n", getFileContentFromDisk("relative.cpp"));
+}
+
+TEST_F(FlushRewrittenFilesTest, GroupsPathsOfTheSameFile) {
+  createFile("spelled.cpp", "int x;\n");
+  StringRef Path = TemporaryFiles.lookup("spelled.cpp");
+
+  FileSystemOptions FileSystemOpts;
+  FileSystemOpts.WorkingDir = llvm::sys::path::parent_path(Path);
+  FileManager Files(FileSystemOpts);
+  Replacements Replaces;
+  Replaces.insert(Replacement(Path, 4, 1, "y"));
+  Replaces.insert(Replacement(llvm::sys::path::filename(Path), 4, 1, "y"));
+
+  std::string Errors;
+  llvm::raw_string_ostream ErrorStream(Errors);
+  EXPECT_TRUE(applyAllReplacementsToFiles(Replaces, Files, 2, ErrorStream));
+  EXPECT_EQ("", ErrorStream.str());
+  EXPECT_EQ("int y;\n", getFileContentFromDisk("spelled.cpp"));
+}
+
 namespace {
 template <typename T>
 class TestVisitor : public clang::RecursiveASTVisitor<T> {
@@ -14,11 +14,17 @@
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendAction.h"
 #include "clang/Frontend/FrontendActions.h"
+#include "clang/Lex/PreprocessorOptions.h"
+#include "clang/Tooling/ASTUnitPool.h"
 #include "clang/Tooling/CompilationDatabase.h"
 #include "clang/Tooling/Tooling.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
 #include "gtest/gtest.h"
+#include <atomic>
 #include <string>
 
 namespace clang {
@@ -315,6 +321,155 @@ TEST(ClangToolTest, BuildASTs) {
   EXPECT_EQ(2u, ASTs.size());
 }
 
+TEST(ClangToolTest, RunInParallel) {
+  FixedCompilationDatabase Compilations("/", std::vector<std::string>());
+
+  std::vector<std::string> Sources;
+  Sources.push_back("/a.cc");
+  Sources.push_back("/b.cc");
+  Sources.push_back("/c.cc");
+  ClangTool Tool(Compilations, Sources);
+
+  Tool.mapVirtualFile("/a.cc", "void a() {}");
+  Tool.mapVirtualFile("/b.cc", "void b() {}");
+  Tool.mapVirtualFile("/c.cc", "void c() {}");
+
+  std::unique_ptr<FrontendActionFactory> Action(
+      newFrontendActionFactory<SyntaxOnlyAction>());
+  EXPECT_EQ(0, Tool.run(Action.get(), 3));
+
+  Tool.mapVirtualFile("/b.cc", "int x = undeclared;");
+  EXPECT_EQ(1, Tool.run(Action.get(), 3));
+}
+
+namespace {
+/// Counts the variables declared in the main files of the translation units.
+class CountVarDeclsConsumer : public clang::ASTConsumer {
+ public:
+  explicit CountVarDeclsConsumer(std::atomic<unsigned> &NumVarDecls)
+      : NumVarDecls(NumVarDecls) {}
+  virtual bool HandleTopLevelDecl(clang::DeclGroupRef GroupRef) {
+    for (Decl *D : GroupRef)
+      if (isa<VarDecl>(D) && !D->isFromASTFile())
+        ++NumVarDecls;
+    return true;
+  }
+ private:
+  std::atomic<unsigned> &NumVarDecls;
+};
+
+/// Counts the translation units run with a precompiled preamble.
+class PreambleCheckingFactory : public FrontendActionFactory {
+ public:
+  PreambleCheckingFactory() : NumPreamblesUsed(0), NumVarDecls(0) {}
+
+  bool runInvocation(CompilerInvocation *Invocation, FileManager *Files,
+                     DiagnosticConsumer *DiagConsumer) override {
+    if (!Invocation->getPreprocessorOpts().ImplicitPCHInclude.empty())
+      ++NumPreamblesUsed;
+    return FrontendActionFactory::runInvocation(Invocation, Files,
+                                                DiagConsumer);
+  }
+
+  FrontendAction *create() override {
+    return new TestAction(new CountVarDeclsConsumer(NumVarDecls));
+  }
+
+  std::atomic<unsigned> NumPreamblesUsed;
+  std::atomic<unsigned> NumVarDecls;
+};
+
+std::string writeTestFile(StringRef Dir, StringRef Name, StringRef Content) {
+  SmallString<128> Path(Dir);
+  llvm::sys::path::append(Path, Name);
+  std::string ErrorInfo;
+  llvm::raw_fd_ostream Out(Path.c_str(), ErrorInfo, llvm::sys::fs::F_Text);
+  EXPECT_TRUE(ErrorInfo.empty()) << ErrorInfo;
+  Out << Content;
+  return Path.str();
+}
+} // end namespace
+
+TEST(ClangToolTest, ReusePreambles) {
+  SmallString<128> Dir;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("reuse-preambles", Dir));
+  std::vector<std::string> Files;
+  Files.push_back(writeTestFile(Dir, "shared.h", "int shared();\n"));
+  Files.push_back(writeTestFile(Dir, "a.cc",
+                                "#include \"shared.h\"\nint a = shared();\n"));
+  Files.push_back(writeTestFile(Dir, "b.cc",
+                                "#include \"shared.h\"\nint b = shared();\n"));
+  Files.push_back(writeTestFile(Dir, "c.cc",
+                                "#include \"shared.h\"\nint c = shared();\n"
+                                "int d = c;\n"));
+  Files.push_back(writeTestFile(Dir, "error.cc",
+                                "#include \"shared.h\"\n"
+                                "int e = undeclared;\n"));
+
+  FixedCompilationDatabase Compilations(Dir, std::vector<std::string>());
+  std::vector<std::string> Sources(Files.begin() + 1, Files.begin() + 4);
+  ClangTool Tool(Compilations, Sources);
+  Tool.setReusePreambles(true);
+
+  // Every translation unit after the first reuses its preamble, and still
+  // sees the declarations after the preamble.
+  PreambleCheckingFactory Factory;
+  EXPECT_EQ(0, Tool.run(&Factory));
+  EXPECT_EQ(2u, Factory.NumPreamblesUsed.load());
+  EXPECT_EQ(4u, Factory.NumVarDecls.load());
+
+  PreambleCheckingFactory ParallelFactory;
+  EXPECT_EQ(0, Tool.run(&ParallelFactory, 3));
+  EXPECT_EQ(2u, ParallelFactory.NumPreamblesUsed.load());
+  EXPECT_EQ(4u, ParallelFactory.NumVarDecls.load());
+
+  // Errors after a shared preamble are still reported.
+  std::vector<std::string> ErrorSources;
+  ErrorSources.push_back(Files[1]);
+  ErrorSources.push_back(Files[4]);
+  ClangTool ErrorTool(Compilations, ErrorSources);
+  ErrorTool.setReusePreambles(true);
+  PreambleCheckingFactory ErrorFactory;
+  EXPECT_EQ(1, ErrorTool.run(&ErrorFactory));
+  EXPECT_EQ(1u, ErrorFactory.NumPreamblesUsed.load());
+
+  for (const std::string &File : Files)
+    llvm::sys::fs::remove(File);
+  llvm::sys::fs::remove(Dir.str());
+}
+
+TEST(ClangToolTest, ASTUnitPool) {
+  FixedCompilationDatabase Compilations("/", std::vector<std::string>());
+
+  std::vector<std::string> Sources;
+  Sources.push_back("/a.cc");
+  Sources.push_back("/b.cc");
+  Sources.push_back("/c.cc");
+  ClangTool Tool(Compilations, Sources);
+
+  Tool.mapVirtualFile("/a.cc", "void a() {}");
+  Tool.mapVirtualFile("/b.cc", "void b() {}");
+  Tool.mapVirtualFile("/c.cc", "void c() {}");
+
+  ASTUnitPool Pool(Tool, /*MaxResidentASTs=*/1);
+  ASSERT_EQ(3u, Pool.size());
+  EXPECT_EQ("/b.cc", Pool.getFile(1).str());
+
+  ASTUnit *A = Pool.getAST(0);
+  ASSERT_TRUE(A != nullptr);
+  EXPECT_FALSE(A->isMainFileAST());
+  ASSERT_TRUE(Pool.getAST(1) != nullptr);
+  EXPECT_EQ(1u, Pool.getNumResidentASTs());
+
+  // The evicted AST is reloaded from the file it was saved to.
+  A = Pool.getAST(0);
+  ASSERT_TRUE(A != nullptr);
+  EXPECT_TRUE(A->isMainFileAST());
+  EXPECT_EQ(2u, Pool.getNumBuiltASTs());
+  EXPECT_EQ(1u, Pool.getNumReloadedASTs());
+  EXPECT_EQ(A, Pool.getAST(0));
+}
+
 struct TestDiagnosticConsumer : public DiagnosticConsumer {
   TestDiagnosticConsumer() : NumDiagnosticsSeen(0) {}
   virtual void HandleDiagnostic(DiagnosticsEngine::Level DiagLevel,